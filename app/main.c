@@ -1,9 +1,19 @@
 #include <crank-vm/crank-vm.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 static crankvm_context_t *context = NULL;
 static const char *imageFileName = NULL;
+static int dumpInlineCacheStatistics = 0;
+static const char *traceFileName = NULL;
+static int heapCompactionEnabled = 1;
+static int imageLoadThreadCount = 0;
+static int dumpImageLoadStatistics = 0;
+static int lazyImageSwizzlingEnabled = 0;
+static int dumpStackZoneStatistics = 0;
+static int dumpSchedulerStatistics = 0;
+static int calloutThreadCount = 0;
 
 static void printHelp(void)
 {
@@ -32,6 +42,42 @@ int main(int argc, const char* argv[])
                 printVersion();
                 return 0;
             }
+            else if(!strcmp(argv[i], "-inline-cache-stats"))
+            {
+                dumpInlineCacheStatistics = 1;
+            }
+            else if(!strcmp(argv[i], "-trace") && i + 1 < argc)
+            {
+                traceFileName = argv[++i];
+            }
+            else if(!strcmp(argv[i], "-no-compaction"))
+            {
+                heapCompactionEnabled = 0;
+            }
+            else if(!strcmp(argv[i], "-load-threads") && i + 1 < argc)
+            {
+                imageLoadThreadCount = atoi(argv[++i]);
+            }
+            else if(!strcmp(argv[i], "-load-stats"))
+            {
+                dumpImageLoadStatistics = 1;
+            }
+            else if(!strcmp(argv[i], "-lazy-swizzle"))
+            {
+                lazyImageSwizzlingEnabled = 1;
+            }
+            else if(!strcmp(argv[i], "-stack-stats"))
+            {
+                dumpStackZoneStatistics = 1;
+            }
+            else if(!strcmp(argv[i], "-scheduler-stats"))
+            {
+                dumpSchedulerStatistics = 1;
+            }
+            else if(!strcmp(argv[i], "-callout-threads") && i + 1 < argc)
+            {
+                calloutThreadCount = atoi(argv[++i]);
+            }
             else
             {
                 fprintf(stderr, "Unsupported argument %s\n", argv[i]);
@@ -58,6 +104,22 @@ int main(int argc, const char* argv[])
         return 0;
     }
 
+    crankvm_context_setHeapCompactionEnabled(context, heapCompactionEnabled);
+    if(imageLoadThreadCount > 0)
+        crankvm_context_setImageLoadThreadCount(context, imageLoadThreadCount);
+    crankvm_context_setLazyImageSwizzlingEnabled(context, lazyImageSwizzlingEnabled);
+    if(calloutThreadCount > 0)
+        crankvm_context_setCalloutThreadCount(context, calloutThreadCount);
+    if(traceFileName)
+    {
+        error = crankvm_context_setTraceFileName(context, traceFileName);
+        if(error)
+        {
+            fprintf(stderr, "Failed to enable the interpreter trace: %s\n", crankvm_error_getString(error));
+            return 1;
+        }
+    }
+
     error = crankvm_context_loadImageFromFileNamed(context, imageFileName);
     if(error)
     {
@@ -66,7 +128,19 @@ int main(int argc, const char* argv[])
 
     }
 
+    if(dumpImageLoadStatistics)
+        crankvm_context_dumpImageLoadStatistics(context, stdout);
+
     error = crankvm_context_run(context);
+    if(dumpInlineCacheStatistics)
+        crankvm_context_dumpInlineCacheStatistics(context, stdout);
+    if(dumpStackZoneStatistics)
+        crankvm_context_dumpStackZoneStatistics(context, stdout);
+    if(dumpSchedulerStatistics)
+        crankvm_context_dumpSchedulerStatistics(context, stdout);
+
+    // Destroying the context also writes the trace.
+    crankvm_context_destroy(context);
     if(error)
     {
         fprintf(stderr, "Failed to run the image in a crank vm context: %s\n", crankvm_error_getString(error));
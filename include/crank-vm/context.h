@@ -5,6 +5,7 @@
 #include <crank-vm/oop.h>
 #include <crank-vm/error.h>
 #include <stddef.h>
+#include <stdio.h>
 
 #if CRANK_VM_WORD_SIZE == 4
 #   define CRANK_VM_CONTEXT_DEFAULT_MAX_HEAP_CAPACITY (1ull*(1024*1024)) /* 1 GB */
@@ -35,6 +36,44 @@ LIB_CRANK_VM_EXPORT void crankvm_context_setMaxHeapCapacity(crankvm_context_t *c
  */
 LIB_CRANK_VM_EXPORT size_t crankvm_context_getMaxHeapCapacity(crankvm_context_t *context);
 
+/**
+ * Enables or disables the compaction of the old space during the full garbage
+ * collections. When disabled, the free space is only reused through the free lists.
+ */
+LIB_CRANK_VM_EXPORT void crankvm_context_setHeapCompactionEnabled(crankvm_context_t *context, int enabled);
+
+/**
+ * Sets the number of threads that relocate the pointers of a loaded or saved image.
+ * Zero uses one thread per online processor.
+ */
+LIB_CRANK_VM_EXPORT void crankvm_context_setImageLoadThreadCount(crankvm_context_t *context, size_t threadCount);
+
+/**
+ * Enables deferring the pointer swizzling of each page of a memory mapped
+ * image until the page is first touched. This installs a SIGSEGV handler,
+ * and it is only used by one context at a time.
+ */
+LIB_CRANK_VM_EXPORT void crankvm_context_setLazyImageSwizzlingEnabled(crankvm_context_t *context, int enabled);
+
+/**
+ * Sets the number of worker threads that perform the blocking primitives.
+ * Zero uses the default number. It must be set before the first callout.
+ */
+LIB_CRANK_VM_EXPORT void crankvm_context_setCalloutThreadCount(crankvm_context_t *context, size_t threadCount);
+
+/**
+ * Signals the semaphore at a one based index of the external objects table
+ * of the image. The semaphore is signalled by the interpreter at its next
+ * interrupt check. This does not take any lock, so it can be called from any
+ * thread and from a signal handler.
+ */
+LIB_CRANK_VM_EXPORT crankvm_error_t crankvm_context_signalExternalSemaphore(crankvm_context_t *context, size_t index);
+
+/**
+ * Dumps the duration of each phase of the last image load.
+ */
+LIB_CRANK_VM_EXPORT void crankvm_context_dumpImageLoadStatistics(crankvm_context_t *context, FILE *output);
+
 /**
  * Loads a smalltalk image into the context from memory.
  */
@@ -45,11 +84,51 @@ LIB_CRANK_VM_EXPORT crankvm_error_t crankvm_context_loadImageFromMemory(crankvm_
  */
 LIB_CRANK_VM_EXPORT crankvm_error_t crankvm_context_loadImageFromFileNamed(crankvm_context_t *context, const char *fileName);
 
+/**
+ * Collects the garbage, and saves the heap of the context into an image
+ * file. The active process resumes from its suspended context when the
+ * saved image is run.
+ */
+LIB_CRANK_VM_EXPORT crankvm_error_t crankvm_context_saveImageToFileNamed(crankvm_context_t *context, const char *fileName);
+
 /**
  * Loads a smalltalk image into the context from memory.
  */
 LIB_CRANK_VM_EXPORT crankvm_error_t crankvm_context_run(crankvm_context_t *context);
 
+/**
+ * Gets the hit and miss counts of the global method lookup cache.
+ */
+LIB_CRANK_VM_EXPORT void crankvm_context_getMethodCacheStatistics(crankvm_context_t *context, uint64_t *hitCount, uint64_t *missCount);
+
+/**
+ * Dumps the polymorphism statistics of each send site inline cache.
+ */
+LIB_CRANK_VM_EXPORT void crankvm_context_dumpInlineCacheStatistics(crankvm_context_t *context, FILE *output);
+
+/**
+ * Dumps the usage of the stack zone, and how many of its frames were materialized into heap contexts.
+ */
+LIB_CRANK_VM_EXPORT void crankvm_context_dumpStackZoneStatistics(crankvm_context_t *context, FILE *output);
+
+/**
+ * Dumps the number of process switches, the time that they took, and the
+ * number of callouts and of fired timers.
+ */
+LIB_CRANK_VM_EXPORT void crankvm_context_dumpSchedulerStatistics(crankvm_context_t *context, FILE *output);
+
+/**
+ * Enables recording the interpreter trace into a ring buffer, which is written
+ * into the specified file when the context is destroyed. Fails with
+ * CRANK_VM_ERROR_UNSUPPORTED_OPERATION if tracing was not compiled in.
+ */
+LIB_CRANK_VM_EXPORT crankvm_error_t crankvm_context_setTraceFileName(crankvm_context_t *context, const char *fileName);
+
+/**
+ * Writes the current content of the trace ring buffer into the trace file.
+ */
+LIB_CRANK_VM_EXPORT crankvm_error_t crankvm_context_writeTrace(crankvm_context_t *context);
+
 /**
  * Tells if something is nil
  */
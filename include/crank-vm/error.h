@@ -25,6 +25,7 @@ typedef enum crankvm_error_e
     CRANK_VM_ERROR_ILLEGAL_INSTRUCTION = -17,
     CRANK_VM_ERROR_ILLEGAL_STORE = -18,
     CRANK_VM_ERROR_NIL_REMOTE_VECTOR = -19,
+    CRANK_VM_ERROR_FAILED_TO_WRITE_FILE = -20,
 } crankvm_error_t;
 
 LIB_CRANK_VM_EXPORT const char *crankvm_error_getString(crankvm_error_t error);
@@ -72,6 +72,45 @@ typedef struct crankvm_plugin_s
     const crankvm_plugin_primitive_t primitives[];
 } crankvm_plugin_t;
 
+typedef struct crankvm_callout_s crankvm_callout_t;
+
+/**
+ * The blocking part of a callout, which runs in a worker thread. It cannot
+ * access the heap, and it may be cancelled in its blocking calls when the
+ * context is destroyed.
+ */
+typedef void (*crankvm_callout_perform_function_t)(crankvm_callout_t *callout);
+
+/**
+ * Answers the result of the primitive of a callout, in the interpreter thread
+ * and with the receiver and the arguments of the primitive.
+ */
+typedef void (*crankvm_callout_finish_function_t)(crankvm_callout_t *callout, crankvm_primitive_context_t *primitiveContext);
+
+/**
+ * A primitive that blocks, split in the part that runs in a worker thread and
+ * the part that answers its result. The primitives embed it as the first
+ * member of their own callout data, which is allocated with
+ * crankvm_context_malloc and freed by the VM once it is finished.
+ */
+struct crankvm_callout_s
+{
+    crankvm_callout_perform_function_t perform;
+    crankvm_callout_finish_function_t finish;
+
+    // Used by the VM.
+    crankvm_callout_t *next;
+    size_t semaphoreIndex;
+};
+
+/**
+ * Performs the callout of a primitive. The active process waits for it while
+ * the other processes run, and then its primitive answers the result of the
+ * finish function. The callout is performed in the interpreter thread when no
+ * other process can run meanwhile.
+ */
+LIB_CRANK_VM_EXPORT void crankvm_primitive_performCallout(crankvm_primitive_context_t *primitiveContext, crankvm_callout_t *callout);
+
 CRANK_VM_INLINE void
 crankvm_primitive_success(crankvm_primitive_context_t *primitiveContext)
 {
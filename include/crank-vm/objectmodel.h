@@ -78,6 +78,18 @@ crankvm_oop_isPointer(crankvm_oop_t oop)
     return (oop & CRANK_VM_OOP_TAG_POINTER_MASK) == CRANK_VM_OOP_TAG_POINTER_VALUE;
 }
 
+/**
+ * Hashes the address of an object for the lookup tables of the VM. The
+ * objects are aligned, so the low bits of their address are dropped. The
+ * tables mask the hash with their entry count minus one, so their entry
+ * counts must be powers of two.
+ */
+CRANK_VM_INLINE uintptr_t
+crankvm_oop_addressHash(crankvm_oop_t oop)
+{
+    return oop / CRANK_VM_IDENTITY_OBJECT_ALIGNMENT;
+}
+
 CRANK_VM_INLINE int
 crankvm_oop_isSmallInteger(crankvm_oop_t oop)
 {
@@ -164,8 +176,10 @@ crankvm_oop_isFloatInSmallFloatRange(double value)
     uint64_t valueIEEE754 = 0;
     memcpy(&valueIEEE754, &value, 8);
 
+    // The zeros are encoded without offsetting their exponent.
     uint64_t exponent = (valueIEEE754 >> 52) & 2047;
-    return CRANK_VM_SMALL_FLOAT_EXPONENT_MIN <= exponent && exponent <= CRANK_VM_SMALL_FLOAT_EXPONENT_MAX;
+    return (CRANK_VM_SMALL_FLOAT_EXPONENT_MIN <= exponent && exponent <= CRANK_VM_SMALL_FLOAT_EXPONENT_MAX) ||
+        (valueIEEE754 << 1) == 0;
 }
 
 CRANK_VM_INLINE double
@@ -174,18 +188,18 @@ crankvm_oop_decodeSmallFloat(crankvm_oop_t oop)
     crankvm_assertAlways(crankvm_oop_isSmallFloat(oop));
 
     // Shift out the tag.
-    uint64_t decodedOop = oop >> 3;
+    uint64_t decodedOop = oop >> CRANK_VM_OOP_TAG_SMALL_FLOAT_SHIFT;
 
-    // Offset the exponent
-    decodedOop += ((uint64_t)CRANK_VM_SMALL_FLOAT_EXPONENT_OFFSET << 53);
+    // Offset the exponent, except for the zeros.
+    if(decodedOop > 1)
+        decodedOop += ((uint64_t)CRANK_VM_SMALL_FLOAT_EXPONENT_OFFSET << 53);
 
     // Rotate right the sign bit.
-    decodedOop = (decodedOop >> 1) | (decodedOop << 62);
+    decodedOop = (decodedOop >> 1) | (decodedOop << 63);
 
     // Cast back to float.
     double floatValue = 0.0f;
     memcpy(&floatValue, &decodedOop, 8);
-    printf("Decoded float value: %f\n", floatValue);
     return floatValue;
 }
 
@@ -198,17 +212,14 @@ crankvm_oop_encodeSmallFloat(double value)
     memcpy(&valueIEEE754, &value, 8);
 
     // Rotate left the sign.
-    crankvm_oop_t encodedOop = (valueIEEE754 << 1) | (valueIEEE754 >> 62);
+    crankvm_oop_t encodedOop = (valueIEEE754 << 1) | (valueIEEE754 >> 63);
 
-    // Offset the exponent
-    encodedOop -= ((uint64_t)CRANK_VM_SMALL_FLOAT_EXPONENT_OFFSET << 53);
+    // Offset the exponent, except for the zeros.
+    if(encodedOop > 1)
+        encodedOop -= ((uint64_t)CRANK_VM_SMALL_FLOAT_EXPONENT_OFFSET << 53);
 
     // Add the tag.
-    encodedOop = (encodedOop << CRANK_VM_OOP_TAG_SMALL_FLOAT_SHIFT) | CRANK_VM_OOP_TAG_SMALL_FLOAT_VALUE;
-
-    printf("Encoded small float %f -> %f\n", value, crankvm_oop_decodeSmallFloat(encodedOop));
-
-    return encodedOop;
+    return (encodedOop << CRANK_VM_OOP_TAG_SMALL_FLOAT_SHIFT) | CRANK_VM_OOP_TAG_SMALL_FLOAT_VALUE;
 }
 
 #endif
@@ -527,6 +538,17 @@ CRANK_VM_INLINE crankvm_error_t crankvm_object_decodeCompiledCodeHeader(crankvm_
     return CRANK_VM_OK;
 };
 
+/**
+ * Decodes only the number of literals of a compiled code header, which is zero for an invalid header.
+ */
+CRANK_VM_INLINE size_t crankvm_object_decodeCompiledCodeNumberOfLiterals(crankvm_oop_t oop)
+{
+    if(!crankvm_oop_isSmallInteger(oop))
+        return 0;
+
+    return CRANK_VM_AT_GET_BITS(crankvm_oop_decodeSmallInteger(oop), 0, 15);
+}
+
 LIB_CRANK_VM_EXPORT size_t crankvm_object_header_getSmalltalkSize(crankvm_object_header_t *header);
 
 #define crankvm_string_printf_arg(x) ((int)crankvm_object_header_getSmalltalkSize((crankvm_object_header_t*)(x))), (char*)((crankvm_oop_t)(x) + 8)
@@ -553,6 +575,7 @@ LIB_CRANK_VM_EXPORT crankvm_oop_t crankvm_object_forInteger128(crankvm_context_t
 LIB_CRANK_VM_EXPORT crankvm_oop_t crankvm_object_forBoolean(crankvm_context_t *context, int boolean);
 LIB_CRANK_VM_EXPORT crankvm_oop_t crankvm_object_forFloat(crankvm_context_t *context, double value);
 LIB_CRANK_VM_EXPORT int crankvm_object_tryToDecodeFloat(crankvm_context_t *context, crankvm_oop_t object, double *resultValue);
+LIB_CRANK_VM_EXPORT int crankvm_object_tryToDecodeUInteger64(crankvm_context_t *context, crankvm_oop_t object, uint64_t *resultValue);
 LIB_CRANK_VM_EXPORT void crankvm_object_prettyPrintTo(crankvm_context_t *context, crankvm_oop_t object, FILE *output);
 
 #endif //_CRANK_VM_OBJECT_MODEL_H_
@@ -105,6 +105,7 @@ typedef struct crankvm_MethodDictionary_s
     crankvm_Array_t *array;
     crankvm_oop_t keys[];
 } crankvm_MethodDictionary_t;
+#define CRANK_VM_MethodDictionary_InstanceFixedSize 2
 
 /**
  * Behavior layout
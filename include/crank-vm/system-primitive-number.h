@@ -107,6 +107,9 @@ typedef enum crankvm_system_primitive_number_e
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_PERFORM_WITH_ARGUMENTS = 84,
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_SEMAPHORE_SIGNAL = 85,
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_SEMAPHORE_WAIT = 86,
+    CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_PROCESS_RESUME = 87,
+    CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_PROCESS_SUSPEND = 88,
+    CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_FLUSH_CACHE = 89,
 
 /*    "Input/Output Primitives (90-109)"
     (90 primitiveMousePoint)
@@ -151,10 +154,17 @@ typedef enum crankvm_system_primitive_number_e
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_OBJECT_CLASS = 111,
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_QUIT = 113,
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_EXIT_TO_DEBUGGER = 114,
+    CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_FLUSH_CACHE_BY_METHOD = 116,
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_EXTERNAL_PRIMITIVE_CALL = 117,
+    CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_FLUSH_CACHE_BY_SELECTOR = 119,
+
+    CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_FULL_GARBAGE_COLLECT = 130,
+    CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_INCREMENTAL_GARBAGE_COLLECT = 131,
 
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_SHALLOW_COPY = 148,
 
+    CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_PROCESSOR_YIELD = 167,
+
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_OBJECT_IDENTITY_NOT_EQUALS = 169,
 
 /*    "SpurMemoryManager primitives"
@@ -192,8 +202,11 @@ typedef enum crankvm_system_primitive_number_e
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_BLOCK_VALUE_ARGS0_NO_CONTEXT_SWITCH = 221,
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_BLOCK_VALUE_ARGS1_NO_CONTEXT_SWITCH = 222,
 
+    CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_RELINQUISH_PROCESSOR = 230,
+
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_VM_PARAMETER_UTC_MICROSECOND_CLOCK = 240,
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_VM_PARAMETER_LOCAL_MICROSECOND_CLOCK = 241,
+    CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_SIGNAL_AT_UTC_MICROSECONDS = 242,
 
     CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_VM_PARAMETER = 254,
 
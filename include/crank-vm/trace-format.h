@@ -0,0 +1,64 @@
+#ifndef CRANK_VM_TRACE_FORMAT_H
+#define CRANK_VM_TRACE_FORMAT_H
+
+#include <stdint.h>
+
+/**
+ * Binary layout of the interpreter trace files.
+ *
+ * A trace file starts with a crankvm_trace_file_header_t, followed by the
+ * records of the trace ring buffer in chronological order.
+ */
+#define CRANK_VM_TRACE_FILE_MAGIC "CRNKTRC1"
+#define CRANK_VM_TRACE_RECORD_NAME_SIZE 40
+
+/**
+ * The trace events. The three arguments of each event are described in the
+ * second column, and they are used by the decoder for printing.
+ */
+#define CRANK_VM_TRACE_EVENT_KINDS(X) \
+    X(BYTECODE, "pc", "bytecode", "sp") \
+    X(FETCH_METHOD_CONTEXT, "context", "pc", "sp") \
+    X(INVALID_METHOD_CONTEXT, "pc", "sp", "stackLimit") \
+    X(ACTIVATE_CONTEXT, "context", "slotCount", "argumentCount") \
+    X(RETURN_INTO_CONTEXT, "context", NULL, NULL) \
+    X(PRIMITIVE_ACTIVATED_CONTEXT, "context", NULL, NULL) \
+    X(SEND, "receiver", "argumentCount", NULL) \
+    X(SUPER_SEND, "receiver", "argumentCount", NULL) \
+    X(UNEXISTENT_PRIMITIVE, "primitive", NULL, NULL) \
+    X(UNSUPPORTED_INLINE_PRIMITIVE, "primitive", NULL, NULL) \
+    X(ENTRY_POINT, NULL, NULL, NULL) \
+    X(ACTIVE_PROCESS, "process", "suspendedContext", NULL) \
+    X(ENTRY_METHOD_CONTEXT, "context", NULL, NULL) \
+    X(INLINED_PRIMITIVE, "receiver", "primitive", "argumentCount") \
+    X(PROCESS_SWITCH, "process", "context", "priority")
+
+typedef enum crankvm_trace_event_kind_e
+{
+#define CRANK_VM_TRACE_DEFINE_EVENT_KIND(name, argument0, argument1, argument2) CRANK_VM_TRACE_EVENT_ ## name,
+    CRANK_VM_TRACE_EVENT_KINDS(CRANK_VM_TRACE_DEFINE_EVENT_KIND)
+#undef CRANK_VM_TRACE_DEFINE_EVENT_KIND
+    CRANK_VM_TRACE_EVENT_KIND_COUNT
+} crankvm_trace_event_kind_t;
+
+typedef struct crankvm_trace_file_header_s
+{
+    char magic[8];
+    uint32_t recordSize;
+    uint32_t recordCount;
+    uint64_t totalRecordCount;
+} crankvm_trace_file_header_t;
+
+typedef struct crankvm_trace_record_s
+{
+    uint64_t sequence;
+    uint16_t kind;
+    uint16_t nameLength;
+    uint32_t reserved;
+    uint64_t arguments[3];
+
+    // Symbolic information (selector, class, process name) truncated to fit.
+    char name[CRANK_VM_TRACE_RECORD_NAME_SIZE];
+} crankvm_trace_record_t;
+
+#endif //CRANK_VM_TRACE_FORMAT_H
@@ -0,0 +1,175 @@
+#include "vm/compression.h"
+#include "vm/image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void printHelp(void)
+{
+    printf("crankvm-compress-image [-chunk-size <bytes>] <input image> <output image>\n");
+}
+
+static uint8_t *
+readFileNamed(const char *fileName, size_t *fileSize)
+{
+    FILE *input = fopen(fileName, "rb");
+    if(!input)
+        return NULL;
+
+    fseek(input, 0, SEEK_END);
+    *fileSize = ftell(input);
+    fseek(input, 0, SEEK_SET);
+
+    uint8_t *content = malloc(*fileSize);
+    if(content && fread(content, *fileSize, 1, input) != 1)
+    {
+        free(content);
+        content = NULL;
+    }
+
+    fclose(input);
+    return content;
+}
+
+int main(int argc, const char* argv[])
+{
+    const char *inputFileName = NULL;
+    const char *outputFileName = NULL;
+    size_t chunkSize = CRANK_VM_IMAGE_DEFAULT_COMPRESSED_CHUNK_SIZE;
+
+    // Parse the command line arguments.
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "-help"))
+        {
+            printHelp();
+            return 0;
+        }
+        else if(!strcmp(argv[i], "-chunk-size") && i + 1 < argc)
+        {
+            chunkSize = strtoul(argv[++i], NULL, 10);
+        }
+        else if(*argv[i] == '-')
+        {
+            fprintf(stderr, "Unsupported argument %s\n", argv[i]);
+            return 1;
+        }
+        else if(!inputFileName)
+        {
+            inputFileName = argv[i];
+        }
+        else
+        {
+            outputFileName = argv[i];
+        }
+    }
+
+    if(!inputFileName || !outputFileName || !chunkSize)
+    {
+        printHelp();
+        return 1;
+    }
+
+    size_t imageSize;
+    uint8_t *image = readFileNamed(inputFileName, &imageSize);
+    if(!image)
+    {
+        fprintf(stderr, "Failed to read image file %s\n", inputFileName);
+        return 1;
+    }
+
+    // Only the Spur images with the word size of the VM are loaded.
+    uint32_t magic;
+    uint32_t headerSize;
+    uintptr_t imageBytes;
+    uintptr_t imageHeaderFlags;
+    size_t imageHeaderFlagsOffset = 8 + 5 * sizeof(uintptr_t);
+    if(imageSize < imageHeaderFlagsOffset + sizeof(uintptr_t))
+    {
+        fprintf(stderr, "%s is not a valid image file\n", inputFileName);
+        free(image);
+        return 1;
+    }
+
+    memcpy(&magic, image, 4);
+    memcpy(&headerSize, image + 4, 4);
+    memcpy(&imageBytes, image + 8, sizeof(uintptr_t));
+    memcpy(&imageHeaderFlags, image + imageHeaderFlagsOffset, sizeof(uintptr_t));
+    if(magic != (sizeof(uintptr_t) == 8 ? 68021 : 6521) || headerSize < imageHeaderFlagsOffset + sizeof(uintptr_t) ||
+        headerSize > imageSize || imageBytes > imageSize - headerSize)
+    {
+        fprintf(stderr, "%s is not a valid image file\n", inputFileName);
+        free(image);
+        return 1;
+    }
+
+    if(imageHeaderFlags & CRANK_VM_IMAGE_HEADER_FLAG_COMPRESSED)
+    {
+        fprintf(stderr, "%s is already compressed\n", inputFileName);
+        free(image);
+        return 1;
+    }
+
+    // Compress the chunks.
+    const uint8_t *segments = image + headerSize;
+    size_t chunkCount = (imageBytes + chunkSize - 1) / chunkSize;
+    uintptr_t *chunkSizes = calloc(chunkCount + 2, sizeof(uintptr_t));
+    uint8_t *compressed = malloc(chunkCount * crankvm_compression_compressBound(chunkSize));
+    if(!chunkSizes || !compressed)
+    {
+        fprintf(stderr, "Out of memory\n");
+        free(chunkSizes);
+        free(compressed);
+        free(image);
+        return 1;
+    }
+
+    size_t compressedSize = 0;
+    for(size_t i = 0; i < chunkCount; ++i)
+    {
+        size_t uncompressedSize = imageBytes - i * chunkSize < chunkSize ? imageBytes - i * chunkSize : chunkSize;
+        size_t chunkCompressedSize = crankvm_compression_compressBlock(segments + i * chunkSize, uncompressedSize,
+            compressed + compressedSize, uncompressedSize - 1);
+
+        // Store the chunks that do not compress as they are.
+        if(!chunkCompressedSize)
+        {
+            memcpy(compressed + compressedSize, segments + i * chunkSize, uncompressedSize);
+            chunkCompressedSize = uncompressedSize;
+        }
+
+        chunkSizes[2 + i] = chunkCompressedSize;
+        compressedSize += chunkCompressedSize;
+    }
+
+    // Write the flagged header, the chunk table, and the compressed chunks.
+    imageHeaderFlags |= CRANK_VM_IMAGE_HEADER_FLAG_COMPRESSED;
+    memcpy(image + imageHeaderFlagsOffset, &imageHeaderFlags, sizeof(uintptr_t));
+    chunkSizes[0] = chunkSize;
+    chunkSizes[1] = chunkCount;
+
+    int result = 0;
+    FILE *output = fopen(outputFileName, "wb");
+    if(!output ||
+        fwrite(image, headerSize, 1, output) != 1 ||
+        fwrite(chunkSizes, sizeof(uintptr_t), chunkCount + 2, output) != chunkCount + 2 ||
+        (compressedSize && fwrite(compressed, compressedSize, 1, output) != 1))
+    {
+        fprintf(stderr, "Failed to write image file %s\n", outputFileName);
+        result = 1;
+    }
+    else
+    {
+        printf("%s: %zu bytes, segments %zu -> %zu bytes in %zu chunks\n", outputFileName,
+            (size_t)(headerSize + (chunkCount + 2) * sizeof(uintptr_t) + compressedSize),
+            (size_t)imageBytes, compressedSize, chunkCount);
+    }
+
+    if(output && fclose(output))
+        result = 1;
+
+    free(chunkSizes);
+    free(compressed);
+    free(image);
+    return result;
+}
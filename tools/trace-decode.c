@@ -0,0 +1,154 @@
+#include <crank-vm/trace-format.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *bytecodeNameTable[] = {
+#define BYTECODE_WITH_IMPLICIT_PARAM(opcode, name, implicitParam) #name " " #implicitParam,
+#define BYTECODE(opcode, name) #name,
+#define UNDEFINED_BYTECODE(opcode) "UndefinedByteCode",
+
+// SqueakV3Plus closures bytecode set
+#include "vm/SqueakV3PlusClosuresBytecodeSetTable.inc"
+
+// SistaV1 set
+#include "vm/SistaV1BytecodeSetTable.inc"
+
+#undef BYTECODE_WITH_IMPLICIT_PARAM
+#undef BYTECODE
+#undef UNDEFINED_BYTECODE
+};
+
+typedef struct trace_event_description_s
+{
+    const char *name;
+    const char *argumentNames[3];
+} trace_event_description_t;
+
+static const trace_event_description_t eventDescriptions[] = {
+#define CRANK_VM_TRACE_DEFINE_EVENT_DESCRIPTION(name, argument0, argument1, argument2) {#name, {argument0, argument1, argument2}},
+    CRANK_VM_TRACE_EVENT_KINDS(CRANK_VM_TRACE_DEFINE_EVENT_DESCRIPTION)
+#undef CRANK_VM_TRACE_DEFINE_EVENT_DESCRIPTION
+};
+
+static void printHelp(void)
+{
+    printf("crankvm-trace-decode [-kind <event kind>] <trace file>\n");
+}
+
+static void
+printRecord(const crankvm_trace_record_t *record)
+{
+    if(record->kind >= CRANK_VM_TRACE_EVENT_KIND_COUNT)
+    {
+        printf("%10llu UNKNOWN(%d)\n", (unsigned long long)record->sequence, record->kind);
+        return;
+    }
+
+    const trace_event_description_t *description = &eventDescriptions[record->kind];
+    printf("%10llu %s", (unsigned long long)record->sequence, description->name);
+
+    // The bytecode events are decoded specially.
+    if(record->kind == CRANK_VM_TRACE_EVENT_BYTECODE)
+    {
+        uint64_t bytecode = record->arguments[1];
+        const char *bytecodeName = bytecode < sizeof(bytecodeNameTable)/sizeof(bytecodeNameTable[0]) ? bytecodeNameTable[bytecode] : "?";
+        printf(" [%04d: %02X,SP:%02d]%s\n", (int)record->arguments[0], (int)(bytecode & 0xFF), (int)record->arguments[2], bytecodeName);
+        return;
+    }
+
+    for(int i = 0; i < 3; ++i)
+    {
+        if(description->argumentNames[i])
+            printf(" %s: %#llx", description->argumentNames[i], (unsigned long long)record->arguments[i]);
+    }
+
+    size_t nameLength = record->nameLength < CRANK_VM_TRACE_RECORD_NAME_SIZE ? record->nameLength : CRANK_VM_TRACE_RECORD_NAME_SIZE;
+    if(nameLength)
+        printf(" '%.*s'", (int)nameLength, record->name);
+    printf("\n");
+}
+
+int main(int argc, const char* argv[])
+{
+    const char *traceFileName = NULL;
+    int selectedKind = -1;
+
+    // Parse the command line arguments.
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], "-help"))
+        {
+            printHelp();
+            return 0;
+        }
+        else if(!strcmp(argv[i], "-kind") && i + 1 < argc)
+        {
+            const char *kindName = argv[++i];
+            for(int j = 0; j < CRANK_VM_TRACE_EVENT_KIND_COUNT; ++j)
+            {
+                if(!strcmp(kindName, eventDescriptions[j].name))
+                    selectedKind = j;
+            }
+
+            if(selectedKind < 0)
+            {
+                fprintf(stderr, "Unknown event kind %s\n", kindName);
+                return 1;
+            }
+        }
+        else if(*argv[i] == '-')
+        {
+            fprintf(stderr, "Unsupported argument %s\n", argv[i]);
+            return 1;
+        }
+        else
+        {
+            traceFileName = argv[i];
+        }
+    }
+
+    if(!traceFileName)
+    {
+        printHelp();
+        return 1;
+    }
+
+    FILE *input = fopen(traceFileName, "rb");
+    if(!input)
+    {
+        fprintf(stderr, "Failed to open trace file %s\n", traceFileName);
+        return 1;
+    }
+
+    // Read and validate the header.
+    crankvm_trace_file_header_t header;
+    if(fread(&header, sizeof(header), 1, input) != 1 ||
+        memcmp(header.magic, CRANK_VM_TRACE_FILE_MAGIC, sizeof(header.magic)) ||
+        header.recordSize != sizeof(crankvm_trace_record_t))
+    {
+        fprintf(stderr, "%s is not a valid trace file\n", traceFileName);
+        fclose(input);
+        return 1;
+    }
+
+    printf("Trace records: %u of %llu recorded events\n", header.recordCount, (unsigned long long)header.totalRecordCount);
+
+    // Print the records.
+    crankvm_trace_record_t record;
+    for(uint32_t i = 0; i < header.recordCount; ++i)
+    {
+        if(fread(&record, sizeof(record), 1, input) != 1)
+        {
+            fprintf(stderr, "Truncated trace file\n");
+            fclose(input);
+            return 1;
+        }
+
+        if(selectedKind < 0 || record.kind == selectedKind)
+            printRecord(&record);
+    }
+
+    fclose(input);
+    return 0;
+}
@@ -164,23 +164,22 @@ crankvm_primitive_integerBitXor(crankvm_primitive_context_t *primitiveContext)
 void
 crankvm_primitive_integerBitShift(crankvm_primitive_context_t *primitiveContext)
 {
-    // FIXME: Implement this properly.
-    intptr_t left = crankvm_primitive_getSmallIntegerValue(primitiveContext, crankvm_primitive_getReceiver(primitiveContext));
-    intptr_t right = crankvm_primitive_getSmallIntegerValue(primitiveContext, crankvm_primitive_getArgument(primitiveContext, 0));
-    if(!crankvm_primitive_hasFailed(primitiveContext))
-    {
-        printf("Bit shift %ld %ld\n", left, right);
-        if(right < 0)
-        {
-            return crankvm_primitive_returnInteger(primitiveContext, left >> (-right));
-        }
-        else if(right > 0)
-        {
-            return crankvm_primitive_returnInteger(primitiveContext, left << right);
-        }
-    }
-    printf("TODO: crankvm_primitive_integerBitShift\n");
-    abort();
+    intptr_t value = crankvm_primitive_getSmallIntegerValue(primitiveContext, crankvm_primitive_getReceiver(primitiveContext));
+    intptr_t shift = crankvm_primitive_getSmallIntegerValue(primitiveContext, crankvm_primitive_getArgument(primitiveContext, 0));
+    if(crankvm_primitive_hasFailed(primitiveContext))
+        return;
+
+    if(shift < 0)
+        return crankvm_primitive_returnSmallInteger(primitiveContext, shift > -CRANK_VM_OOP_BITS ? value >> -shift : (value < 0 ? -1 : 0));
+
+    // The bits shifted out must not change the value, otherwise the image answers a LargeInteger.
+    if(shift >= CRANK_VM_SMALL_INTEGER_USABLE_BITS)
+        return crankvm_primitive_fail(primitiveContext);
+
+    intptr_t result = (intptr_t)((uintptr_t)value << shift);
+    if((result >> shift) != value)
+        return crankvm_primitive_fail(primitiveContext);
+    return crankvm_primitive_returnSmallInteger(primitiveContext, result);
 }
 
 void
@@ -0,0 +1,88 @@
+#include "at-cache.h"
+#include "context-internal.h"
+#include <crank-vm/system-primitive-number.h>
+#include <string.h>
+
+static uint32_t
+crankvm_at_cache_accessesForPrimitive(crankvm_at_cache_access_t access, int primitiveNumber, crankvm_object_format_t format)
+{
+    // The string primitives only access the byte and word objects.
+    bool isString = CRANK_VM_OBJECT_FORMAT_INDEXABLE_32 <= format;
+    switch(access)
+    {
+    case CRANK_VM_AT_CACHE_ACCESS_AT:
+        if(primitiveNumber == CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_AT)
+            return CRANK_VM_AT_CACHE_ACCESS_AT;
+        if(primitiveNumber == CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_STRING_AT && isString)
+            return CRANK_VM_AT_CACHE_ACCESS_AT | CRANK_VM_AT_CACHE_ACCESS_STRING_AT;
+        return 0;
+    case CRANK_VM_AT_CACHE_ACCESS_AT_PUT:
+        if(primitiveNumber == CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_AT_PUT)
+            return CRANK_VM_AT_CACHE_ACCESS_AT_PUT;
+        if(primitiveNumber == CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_STRING_AT_PUT && isString)
+            return CRANK_VM_AT_CACHE_ACCESS_AT_PUT | CRANK_VM_AT_CACHE_ACCESS_STRING_AT_PUT;
+        return 0;
+    case CRANK_VM_AT_CACHE_ACCESS_SIZE:
+        return primitiveNumber == CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_SIZE ? CRANK_VM_AT_CACHE_ACCESS_SIZE : 0;
+    default:
+        return 0;
+    }
+}
+
+crankvm_at_cache_entry_t *
+crankvm_at_cache_addAccess(crankvm_context_t *context, crankvm_oop_t receiver, crankvm_at_cache_access_t access, int primitiveNumber)
+{
+    crankvm_object_format_t format = crankvm_oop_getFormat(receiver);
+    if(!crankvm_at_cache_isIndexableFormat(format))
+        return NULL;
+
+    uint32_t accesses = crankvm_at_cache_accessesForPrimitive(access, primitiveNumber, format);
+    if(!accesses)
+        return NULL;
+
+    crankvm_at_cache_entry_t *entry = &context->atCache.entries[crankvm_at_cache_index(receiver)];
+    if(entry->receiver != receiver)
+    {
+        // The instance variables are before the indexable slots.
+        size_t fixedSize = 0;
+        if(format == CRANK_VM_OBJECT_FORMAT_VARIABLE_SIZE_IVARS || format == CRANK_VM_OBJECT_FORMAT_WEAK_VARIABLE_SIZE)
+        {
+            crankvm_oop_t behavior = crankvm_object_getClass(context, receiver);
+            if(crankvm_oop_isNil(context, behavior))
+                return NULL;
+            fixedSize = crankvm_Behavior_getInstanceSize((crankvm_Behavior_t*)behavior);
+        }
+
+        size_t size = crankvm_object_header_getSmalltalkSize((crankvm_object_header_t*)receiver);
+        if(fixedSize > size)
+            return NULL;
+
+        entry->receiver = receiver;
+        entry->format = format;
+        entry->accesses = 0;
+        entry->fixedSize = fixedSize;
+        entry->size = size - fixedSize;
+    }
+
+    entry->accesses |= accesses;
+    return entry;
+}
+
+void
+crankvm_at_cache_flush(crankvm_context_t *context)
+{
+    memset(context->atCache.entries, 0, sizeof(context->atCache.entries));
+}
+
+void
+crankvm_at_cache_flushNewSpaceReferences(crankvm_context_t *context)
+{
+    crankvm_at_cache_t *cache = &context->atCache;
+    crankvm_heap_t *heap = &context->heap;
+    for(size_t i = 0; i < CRANK_VM_AT_CACHE_ENTRY_COUNT; ++i)
+    {
+        crankvm_at_cache_entry_t *entry = &cache->entries[i];
+        if(crankvm_heap_isYoung(heap, entry->receiver))
+            memset(entry, 0, sizeof(crankvm_at_cache_entry_t));
+    }
+}
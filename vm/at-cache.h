@@ -0,0 +1,189 @@
+#ifndef CRANK_VM_AT_CACHE_H
+#define CRANK_VM_AT_CACHE_H
+
+#include <crank-vm/objectmodel.h>
+#include <crank-vm/special-objects.h>
+#include <stdbool.h>
+#include "heap.h"
+
+#define CRANK_VM_AT_CACHE_ENTRY_COUNT 64
+#define CRANK_VM_AT_CACHE_ENTRY_MASK (CRANK_VM_AT_CACHE_ENTRY_COUNT - 1)
+
+typedef struct crankvm_context_s crankvm_context_t;
+
+/**
+ * The special selectors whose method was found to be an indexed access
+ * primitive for a receiver.
+ */
+typedef enum crankvm_at_cache_access_e
+{
+    CRANK_VM_AT_CACHE_ACCESS_AT = 1<<0,
+    CRANK_VM_AT_CACHE_ACCESS_AT_PUT = 1<<1,
+    CRANK_VM_AT_CACHE_ACCESS_SIZE = 1<<2,
+
+    // The at: and at:put: of strings answer and take characters.
+    CRANK_VM_AT_CACHE_ACCESS_STRING_AT = 1<<3,
+    CRANK_VM_AT_CACHE_ACCESS_STRING_AT_PUT = 1<<4,
+} crankvm_at_cache_access_t;
+
+/**
+ * The layout of an indexable receiver. An entry is only valid for the
+ * receiver it was computed for, and it is flushed with the method cache, and
+ * when the collector moves the receiver.
+ */
+typedef struct crankvm_at_cache_entry_s
+{
+    crankvm_oop_t receiver;
+    crankvm_object_format_t format;
+    uint32_t accesses;
+
+    // The first indexable slot, and the number of indexable elements.
+    size_t fixedSize;
+    size_t size;
+} crankvm_at_cache_entry_t;
+
+typedef struct crankvm_at_cache_s
+{
+    crankvm_at_cache_entry_t entries[CRANK_VM_AT_CACHE_ENTRY_COUNT];
+} crankvm_at_cache_t;
+
+/**
+ * Only the indexable pointer, byte and word objects are accessed inline.
+ */
+CRANK_VM_INLINE bool
+crankvm_at_cache_isIndexableFormat(crankvm_object_format_t format)
+{
+    return (CRANK_VM_OBJECT_FORMAT_VARIABLE_SIZE_NO_IVARS <= format && format <= CRANK_VM_OBJECT_FORMAT_WEAK_VARIABLE_SIZE) ||
+        (CRANK_VM_OBJECT_FORMAT_INDEXABLE_64 <= format && format < CRANK_VM_OBJECT_FORMAT_COMPILED_METHOD);
+}
+
+/**
+ * Records that the method of a special selector for the receiver is the
+ * primitive with the given number. Returns NULL when the primitive or the
+ * receiver cannot be accessed inline.
+ */
+crankvm_at_cache_entry_t *crankvm_at_cache_addAccess(crankvm_context_t *context, crankvm_oop_t receiver, crankvm_at_cache_access_t access, int primitiveNumber);
+
+void crankvm_at_cache_flush(crankvm_context_t *context);
+void crankvm_at_cache_flushNewSpaceReferences(crankvm_context_t *context);
+
+CRANK_VM_INLINE size_t
+crankvm_at_cache_index(crankvm_oop_t receiver)
+{
+    return crankvm_oop_addressHash(receiver) & CRANK_VM_AT_CACHE_ENTRY_MASK;
+}
+
+CRANK_VM_INLINE crankvm_at_cache_entry_t *
+crankvm_at_cache_lookup(crankvm_at_cache_t *cache, crankvm_oop_t receiver, crankvm_at_cache_access_t access)
+{
+    crankvm_at_cache_entry_t *entry = &cache->entries[crankvm_at_cache_index(receiver)];
+    if(entry->receiver == receiver && (entry->accesses & access))
+        return entry;
+    return NULL;
+}
+
+/**
+ * Reads an element of the receiver of an entry. Fails when the index is out
+ * of bounds, or when the element is not an immediate.
+ */
+CRANK_VM_INLINE bool
+crankvm_at_cache_at(crankvm_at_cache_entry_t *entry, crankvm_oop_t index, crankvm_oop_t *result)
+{
+    if(!crankvm_oop_isSmallInteger(index))
+        return false;
+
+    intptr_t decodedIndex = crankvm_oop_decodeSmallInteger(index) - 1;
+    if(decodedIndex < 0 || (size_t)decodedIndex >= entry->size)
+        return false;
+
+    uint8_t *slots = (uint8_t*)(entry->receiver + sizeof(crankvm_object_header_t));
+    uint64_t element;
+    if(entry->format < CRANK_VM_OBJECT_FORMAT_INDEXABLE_64)
+    {
+        *result = ((crankvm_oop_t*)slots)[entry->fixedSize + decodedIndex];
+        return true;
+    }
+    else if(entry->format == CRANK_VM_OBJECT_FORMAT_INDEXABLE_64)
+        element = ((uint64_t*)slots)[decodedIndex];
+    else if(entry->format <= CRANK_VM_OBJECT_FORMAT_INDEXABLE_32_1)
+        element = ((uint32_t*)slots)[decodedIndex];
+    else if(entry->format <= CRANK_VM_OBJECT_FORMAT_INDEXABLE_16_3)
+        element = ((uint16_t*)slots)[decodedIndex];
+    else
+        element = slots[decodedIndex];
+
+    if(entry->accesses & CRANK_VM_AT_CACHE_ACCESS_STRING_AT)
+    {
+        *result = crankvm_oop_encodeCharacter(element);
+        return true;
+    }
+
+    if(element > CRANK_VM_SMALL_INTEGER_MAX_VALUE)
+        return false;
+    *result = crankvm_oop_encodeSmallInteger(element);
+    return true;
+}
+
+/**
+ * Writes an element of the receiver of an entry. Fails when the index is out
+ * of bounds, when the value does not fit in the element, or when the
+ * receiver is immutable.
+ */
+CRANK_VM_INLINE bool
+crankvm_at_cache_atPut(crankvm_heap_t *heap, crankvm_at_cache_entry_t *entry, crankvm_oop_t index, crankvm_oop_t value)
+{
+    if(!crankvm_oop_isSmallInteger(index) || crankvm_object_header_isImmutable((crankvm_object_header_t*)entry->receiver))
+        return false;
+
+    intptr_t decodedIndex = crankvm_oop_decodeSmallInteger(index) - 1;
+    if(decodedIndex < 0 || (size_t)decodedIndex >= entry->size)
+        return false;
+
+    uint8_t *slots = (uint8_t*)(entry->receiver + sizeof(crankvm_object_header_t));
+    if(entry->format < CRANK_VM_OBJECT_FORMAT_INDEXABLE_64)
+    {
+        ((crankvm_oop_t*)slots)[entry->fixedSize + decodedIndex] = value;
+        crankvm_heap_writeBarrier(heap, entry->receiver, value);
+        return true;
+    }
+
+    uint64_t element;
+    if(entry->accesses & CRANK_VM_AT_CACHE_ACCESS_STRING_AT_PUT)
+    {
+        if(!crankvm_oop_isCharacter(value))
+            return false;
+        element = crankvm_oop_decodeCharacter(value);
+    }
+    else
+    {
+        if(!crankvm_oop_isSmallInteger(value) || crankvm_oop_decodeSmallInteger(value) < 0)
+            return false;
+        element = crankvm_oop_decodeSmallInteger(value);
+    }
+
+    if(entry->format == CRANK_VM_OBJECT_FORMAT_INDEXABLE_64)
+    {
+        ((uint64_t*)slots)[decodedIndex] = element;
+    }
+    else if(entry->format <= CRANK_VM_OBJECT_FORMAT_INDEXABLE_32_1)
+    {
+        if(element > 0xFFFFFFFF)
+            return false;
+        ((uint32_t*)slots)[decodedIndex] = element;
+    }
+    else if(entry->format <= CRANK_VM_OBJECT_FORMAT_INDEXABLE_16_3)
+    {
+        if(element > 0xFFFF)
+            return false;
+        ((uint16_t*)slots)[decodedIndex] = element;
+    }
+    else
+    {
+        if(element > 0xFF)
+            return false;
+        slots[decodedIndex] = element;
+    }
+    return true;
+}
+
+#endif //CRANK_VM_AT_CACHE_H
@@ -0,0 +1,292 @@
+#include "callout.h"
+#include "interpreter-internal.h"
+#include <stdlib.h>
+
+static void *
+crankvm_callout_pool_worker(void *argument)
+{
+    crankvm_context_t *context = argument;
+    crankvm_callout_pool_t *pool = &context->calloutPool;
+
+    // A worker is only cancelled while it performs a callout, never with the mutex held.
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_mutex_lock(&pool->mutex);
+    while(!pool->isShuttingDown)
+    {
+        crankvm_callout_t *callout = pool->firstQueuedCallout;
+        if(!callout)
+        {
+            pthread_cond_wait(&pool->calloutQueued, &pool->mutex);
+            continue;
+        }
+
+        pool->firstQueuedCallout = callout->next;
+        if(!pool->firstQueuedCallout)
+            pool->lastQueuedCallout = NULL;
+        pthread_mutex_unlock(&pool->mutex);
+
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        callout->perform(callout);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        // Signal the index of the callout, for the next interrupt check.
+        crankvm_signal_queue_signal(&pool->performedCallouts, callout->semaphoreIndex);
+        crankvm_scheduler_requestInterrupt(context);
+        pthread_mutex_lock(&pool->mutex);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/**
+ * Starts the worker threads and allocates the external semaphore table, if
+ * it was not done yet. Returns false when the callouts cannot be performed
+ * in a worker.
+ */
+static bool
+crankvm_callout_pool_start(crankvm_context_t *context)
+{
+    crankvm_callout_pool_t *pool = &context->calloutPool;
+    if(pool->startedThreadCount)
+        return true;
+    if(pool->isInitialized)
+        return false;
+
+    pool->isInitialized = true;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->calloutQueued, NULL);
+
+    size_t tableSize = context->scheduler.externalSignals.indexCount;
+    if(!tableSize)
+        tableSize = CRANK_VM_SCHEDULER_DEFAULT_EXTERNAL_SEMAPHORE_TABLE_SIZE;
+    pool->callouts = calloc(tableSize, sizeof(crankvm_callout_t*));
+    crankvm_Array_t *semaphores = crankvm_Array_create(context, tableSize);
+    if(!pool->callouts || crankvm_object_isNil(context, semaphores) ||
+        crankvm_signal_queue_initialize(&pool->performedCallouts, tableSize))
+        return false;
+
+    pool->semaphoreTableSize = tableSize;
+    context->roots.externalSemaphores = semaphores;
+
+    size_t threadCount = pool->threadCount;
+    if(!threadCount)
+        threadCount = CRANK_VM_CALLOUT_DEFAULT_THREAD_COUNT;
+    if(threadCount > CRANK_VM_CALLOUT_MAX_THREAD_COUNT)
+        threadCount = CRANK_VM_CALLOUT_MAX_THREAD_COUNT;
+    for(size_t i = 0; i < threadCount; ++i)
+    {
+        if(pthread_create(&pool->threads[pool->startedThreadCount], NULL, crankvm_callout_pool_worker, context))
+            break;
+        ++pool->startedThreadCount;
+    }
+
+    return pool->startedThreadCount != 0;
+}
+
+void
+crankvm_callout_pool_destroy(crankvm_context_t *context)
+{
+    crankvm_callout_pool_t *pool = &context->calloutPool;
+    if(!pool->isInitialized)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->isShuttingDown = true;
+    pthread_cond_broadcast(&pool->calloutQueued);
+    pthread_mutex_unlock(&pool->mutex);
+
+    // The idle workers see the shutdown, and the blocked ones are cancelled.
+    for(size_t i = 0; i < pool->startedThreadCount; ++i)
+    {
+        pthread_cancel(pool->threads[i]);
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for(size_t i = 0; i < pool->semaphoreTableSize; ++i)
+        crankvm_context_free(context, pool->callouts[i]);
+    free(pool->callouts);
+    crankvm_signal_queue_destroy(&pool->performedCallouts);
+    pthread_cond_destroy(&pool->calloutQueued);
+    pthread_mutex_destroy(&pool->mutex);
+    memset(pool, 0, sizeof(crankvm_callout_pool_t));
+}
+
+/**
+ * Reserves an index of the external semaphore table for a callout. Returns
+ * the semaphore of the index, or NULL when the table is full.
+ */
+static crankvm_Semaphore_t *
+crankvm_callout_pool_reserveSemaphore(crankvm_context_t *context, size_t *index)
+{
+    crankvm_callout_pool_t *pool = &context->calloutPool;
+    size_t freeIndex = 0;
+    while(freeIndex < pool->semaphoreTableSize && pool->callouts[freeIndex])
+        ++freeIndex;
+    if(freeIndex == pool->semaphoreTableSize)
+        return NULL;
+
+    // The semaphores are created on demand, and reused by the later callouts.
+    crankvm_Array_t *semaphores = context->roots.externalSemaphores;
+    crankvm_Semaphore_t *semaphore = (crankvm_Semaphore_t*)semaphores->slots[freeIndex];
+    if(crankvm_object_isNil(context, semaphore))
+    {
+        semaphore = (crankvm_Semaphore_t*)crankvm_Behavior_basicNew(context, context->roots.specialObjectsArray->classSemaphore);
+        if(crankvm_object_isNil(context, semaphore))
+            return NULL;
+
+        semaphores->slots[freeIndex] = (crankvm_oop_t)semaphore;
+        crankvm_heap_writeBarrier(&context->heap, (crankvm_oop_t)semaphores, (crankvm_oop_t)semaphore);
+    }
+
+    // A process that stopped waiting may have left a signal.
+    semaphore->excessSignals = crankvm_oop_encodeSmallInteger(0);
+    *index = freeIndex + 1;
+    return semaphore;
+}
+
+static void
+crankvm_callout_performInInterpreter(crankvm_primitive_context_t *primitiveContext, crankvm_callout_t *callout)
+{
+    ++primitiveContext->context->calloutPool.synchronousCalloutCount;
+    callout->perform(callout);
+    callout->finish(callout, primitiveContext);
+    crankvm_context_free(primitiveContext->context, callout);
+}
+
+LIB_CRANK_VM_EXPORT void
+crankvm_primitive_performCallout(crankvm_primitive_context_t *primitiveContext, crankvm_callout_t *callout)
+{
+    uint64_t startTime = crankvm_scheduler_getNanoseconds();
+    crankvm_context_t *context = primitiveContext->context;
+    crankvm_callout_pool_t *pool = &context->calloutPool;
+    ++pool->calloutCount;
+
+    // Waiting needs another process to run, and a sender that receives the result.
+    crankvm_Process_t *activeProcess = crankvm_context_getActiveProcess(context);
+    crankvm_MethodContext_t *primitiveMethodContext = crankvm_primitive_getPrimitiveMethodContext(primitiveContext);
+    if(!activeProcess || !crankvm_scheduler_highestPriorityProcess(context, 0) ||
+        crankvm_oop_isNil(context, primitiveMethodContext->baseClass.sender) ||
+        !crankvm_callout_pool_start(context))
+        return crankvm_callout_performInInterpreter(primitiveContext, callout);
+
+    size_t index;
+    crankvm_Semaphore_t *semaphore = crankvm_callout_pool_reserveSemaphore(context, &index);
+    if(!semaphore)
+        return crankvm_callout_performInInterpreter(primitiveContext, callout);
+
+    // The active process waits on the semaphore, suspended as if the primitive had failed.
+    crankvm_MethodContext_t *suspendedContext = crankvm_interpreter_materializePrimitiveMethodContext(primitiveContext);
+    crankvm_scheduler_addLastLink(context, &semaphore->baseClass, activeProcess);
+    crankvm_Process_t *newProcess = crankvm_scheduler_wakeHighestPriority(context, 0);
+
+    callout->next = NULL;
+    callout->semaphoreIndex = index;
+    pool->callouts[index - 1] = callout;
+
+    pthread_mutex_lock(&pool->mutex);
+    if(pool->lastQueuedCallout)
+        pool->lastQueuedCallout->next = callout;
+    else
+        pool->firstQueuedCallout = callout;
+    pool->lastQueuedCallout = callout;
+    pthread_cond_signal(&pool->calloutQueued);
+    pthread_mutex_unlock(&pool->mutex);
+
+    crankvm_primitive_finishReplacingMethodContext(primitiveContext, crankvm_scheduler_transferTo(context, newProcess, suspendedContext, startTime));
+}
+
+/**
+ * Answers the result of a finished callout into the context where its
+ * process waits. On success the process resumes in the sender, and on
+ * failure it resumes after the primitive call, with the error object in the
+ * first temporary.
+ */
+static void
+crankvm_callout_answerResult(crankvm_context_t *context, crankvm_interpreter_state_t *interpreter, crankvm_callout_t *callout, crankvm_Process_t *process)
+{
+    crankvm_heap_t *heap = &context->heap;
+    crankvm_MethodContext_t *methodContext = (crankvm_MethodContext_t*)process->suspendedContext;
+    if(!crankvm_oop_isPointer((crankvm_oop_t)methodContext) || crankvm_object_isNil(context, methodContext))
+        return;
+
+    crankvm_compiled_code_cache_entry_t *codeInfo;
+    if(crankvm_compiled_code_cache_lookup(context, (crankvm_CompiledCode_t*)methodContext->method, &codeInfo) ||
+        !codeInfo->header.hasPrimitive)
+        return;
+
+    crankvm_primitive_context_t primitiveContext = {
+        .context = context,
+        .interpreter = interpreter,
+        .error = CRANK_VM_PRIMITIVE_SUCCESS,
+        .argumentCount = codeInfo->header.numberOfArguments,
+        .roots = {
+            .arguments = &methodContext->stackSlots[0],
+            .receiver = methodContext->receiver,
+            .result = crankvm_specialObject_nil(context),
+            .primitiveMethodContext = methodContext,
+        },
+    };
+    callout->finish(callout, &primitiveContext);
+
+    crankvm_oop_t senderOop = methodContext->baseClass.sender;
+    if(!primitiveContext.error && crankvm_oop_isPointer(senderOop) && !crankvm_oop_isNil(context, senderOop))
+    {
+        crankvm_MethodContext_t *sender = (crankvm_MethodContext_t*)senderOop;
+        intptr_t stackPointer = crankvm_oop_decodeSmallInteger(sender->stackp);
+        if(stackPointer + CRANK_VM_MethodContext_InstanceFixedSize < crankvm_object_header_getSlotCount((crankvm_object_header_t *)sender))
+        {
+            // Return from the primitive method into the sender.
+            sender->stackSlots[stackPointer] = primitiveContext.roots.result;
+            crankvm_heap_writeBarrier(heap, senderOop, primitiveContext.roots.result);
+            sender->stackp = crankvm_oop_encodeSmallInteger(stackPointer + 1);
+            methodContext->baseClass.sender = crankvm_specialObject_nil(context);
+            process->suspendedContext = senderOop;
+            crankvm_heap_writeBarrier(heap, (crankvm_oop_t)process, senderOop);
+            return;
+        }
+    }
+
+    // The result cannot be returned.
+    crankvm_primitive_fail(&primitiveContext);
+
+    // Store the error object in the first temporary.
+    if(codeInfo->header.numberOfTemporaries > codeInfo->header.numberOfArguments)
+    {
+        crankvm_oop_t errorObject = crankvm_interpreter_getPrimitiveErrorObject(context, primitiveContext.error);
+        methodContext->stackSlots[codeInfo->header.numberOfArguments] = errorObject;
+        crankvm_heap_writeBarrier(heap, (crankvm_oop_t)methodContext, errorObject);
+    }
+}
+
+void
+crankvm_callout_pool_finishSignalledCallouts(crankvm_context_t *context, crankvm_interpreter_state_t *interpreter)
+{
+    crankvm_callout_pool_t *pool = &context->calloutPool;
+    if(!pool->startedThreadCount)
+        return;
+
+    crankvm_Array_t *semaphores = context->roots.externalSemaphores;
+    size_t index;
+    while(crankvm_signal_queue_next(&pool->performedCallouts, &index))
+    {
+        crankvm_callout_t *callout = pool->callouts[index - 1];
+        pool->callouts[index - 1] = NULL;
+
+        // The result is dropped when its process was terminated meanwhile.
+        crankvm_Semaphore_t *semaphore = (crankvm_Semaphore_t*)semaphores->slots[index - 1];
+        if(!crankvm_oop_isNil(context, semaphore->baseClass.firstLink))
+            crankvm_callout_answerResult(context, interpreter, callout, (crankvm_Process_t*)semaphore->baseClass.firstLink);
+        crankvm_scheduler_signalSemaphore(context, semaphore);
+        crankvm_context_free(context, callout);
+    }
+}
+
+LIB_CRANK_VM_EXPORT void
+crankvm_context_setCalloutThreadCount(crankvm_context_t *context, size_t threadCount)
+{
+    if(!context)
+        return;
+
+    context->calloutPool.threadCount = threadCount;
+}
@@ -0,0 +1,64 @@
+#ifndef CRANK_VM_CALLOUT_H
+#define CRANK_VM_CALLOUT_H
+
+#include <crank-vm/interpreter.h>
+#include "signal-queue.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+#define CRANK_VM_CALLOUT_DEFAULT_THREAD_COUNT 4
+#define CRANK_VM_CALLOUT_MAX_THREAD_COUNT 64
+
+/**
+ * The worker threads that perform the blocking callouts of the primitives.
+ *
+ * A process that performs a callout waits on a semaphore of the external
+ * semaphore table of the VM, whose index identifies the callout in flight.
+ * The table has the size of the external objects table, and its semaphores
+ * are kept in an Array that is a root of the collector. When a callout is
+ * performed, the worker signals its index into a lock-free queue, and the
+ * interpreter finishes the callout and signals its semaphore at the next
+ * interrupt check.
+ *
+ * The threads are started by the first callout.
+ */
+typedef struct crankvm_callout_pool_s
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t calloutQueued;
+    bool isInitialized;
+    bool isShuttingDown;
+
+    size_t threadCount;
+    size_t startedThreadCount;
+    pthread_t threads[CRANK_VM_CALLOUT_MAX_THREAD_COUNT];
+
+    // The callouts that wait for a worker.
+    crankvm_callout_t *firstQueuedCallout;
+    crankvm_callout_t *lastQueuedCallout;
+
+    // The callouts in flight, indexed by their external semaphore index minus one.
+    size_t semaphoreTableSize;
+    crankvm_callout_t **callouts;
+
+    // The external semaphore indices of the callouts that were performed.
+    crankvm_signal_queue_t performedCallouts;
+
+    uint64_t calloutCount;
+    uint64_t synchronousCalloutCount;
+} crankvm_callout_pool_t;
+
+/**
+ * Stops the worker threads, cancelling the callouts that are blocked, and
+ * frees the callouts in flight.
+ */
+void crankvm_callout_pool_destroy(crankvm_context_t *context);
+
+/**
+ * Finishes the callouts whose index was signalled, answering their results to
+ * the waiting processes, which become runnable. It is called at the interrupt
+ * checks of the interpreter.
+ */
+void crankvm_callout_pool_finishSignalledCallouts(crankvm_context_t *context, crankvm_interpreter_state_t *interpreter);
+
+#endif //CRANK_VM_CALLOUT_H
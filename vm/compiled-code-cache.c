@@ -0,0 +1,75 @@
+#include "compiled-code-cache.h"
+#include "context-internal.h"
+#include <string.h>
+
+CRANK_VM_INLINE size_t
+crankvm_compiled_code_cache_index(crankvm_oop_t method)
+{
+    return crankvm_oop_addressHash(method) & CRANK_VM_COMPILED_CODE_CACHE_ENTRY_MASK;
+}
+
+crankvm_error_t
+crankvm_compiled_code_cache_lookup(crankvm_context_t *context, crankvm_CompiledCode_t *compiledCode, crankvm_compiled_code_cache_entry_t **result)
+{
+    crankvm_compiled_code_cache_entry_t *entry = &context->compiledCodeCache.entries[crankvm_compiled_code_cache_index((crankvm_oop_t)compiledCode)];
+    if(entry->method == (crankvm_oop_t)compiledCode && entry->codeHeader == compiledCode->codeHeader)
+    {
+        *result = entry;
+        return CRANK_VM_OK;
+    }
+
+    // Decode the header.
+    crankvm_compiled_code_header_t header;
+    crankvm_error_t error = crankvm_specialObject_getCompiledCodeHeader(&header, compiledCode);
+    if(error)
+        return error;
+
+    // Compute the initial pc
+    uintptr_t initialPC = (header.numberOfLiterals + 1) *sizeof(crankvm_oop_t) + 1;
+    size_t compiledMethodSize = crankvm_object_header_getSmalltalkSize(&compiledCode->baseClass.objectHeader);
+    if(initialPC >= compiledMethodSize)
+        return CRANK_VM_ERROR_INVALID_PARAMETER;
+
+    // The primitive number is in the call primitive bytecode at the initial pc.
+    int primitiveNumber = -1;
+    if(header.hasPrimitive)
+    {
+        uint8_t *methodInstructions = (uint8_t*)(((crankvm_oop_t)compiledCode) + sizeof(crankvm_object_header_t));
+        primitiveNumber = methodInstructions[initialPC] | (methodInstructions[initialPC + 1] << 8);
+    }
+
+    entry->method = (crankvm_oop_t)compiledCode;
+    entry->codeHeader = compiledCode->codeHeader;
+    entry->header = header;
+    entry->primitiveNumber = primitiveNumber;
+    entry->initialPC = initialPC;
+    *result = entry;
+    return CRANK_VM_OK;
+}
+
+void
+crankvm_compiled_code_cache_flush(crankvm_context_t *context)
+{
+    memset(context->compiledCodeCache.entries, 0, sizeof(context->compiledCodeCache.entries));
+}
+
+void
+crankvm_compiled_code_cache_flushMethod(crankvm_context_t *context, crankvm_oop_t method)
+{
+    crankvm_compiled_code_cache_entry_t *entry = &context->compiledCodeCache.entries[crankvm_compiled_code_cache_index(method)];
+    if(entry->method == method)
+        memset(entry, 0, sizeof(crankvm_compiled_code_cache_entry_t));
+}
+
+void
+crankvm_compiled_code_cache_flushNewSpaceReferences(crankvm_context_t *context)
+{
+    crankvm_compiled_code_cache_t *cache = &context->compiledCodeCache;
+    crankvm_heap_t *heap = &context->heap;
+    for(size_t i = 0; i < CRANK_VM_COMPILED_CODE_CACHE_ENTRY_COUNT; ++i)
+    {
+        crankvm_compiled_code_cache_entry_t *entry = &cache->entries[i];
+        if(crankvm_heap_isYoung(heap, entry->method))
+            memset(entry, 0, sizeof(crankvm_compiled_code_cache_entry_t));
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef CRANK_VM_COMPILED_CODE_CACHE_H
+#define CRANK_VM_COMPILED_CODE_CACHE_H
+
+#include <crank-vm/objectmodel.h>
+#include <crank-vm/special-objects.h>
+
+#define CRANK_VM_COMPILED_CODE_CACHE_ENTRY_COUNT 1024
+#define CRANK_VM_COMPILED_CODE_CACHE_ENTRY_MASK (CRANK_VM_COMPILED_CODE_CACHE_ENTRY_COUNT - 1)
+
+typedef struct crankvm_context_s crankvm_context_t;
+
+/**
+ * The decoded header of a compiled code, with its primitive number and its
+ * initial pc. An entry is only valid for the header word it was decoded from.
+ */
+typedef struct crankvm_compiled_code_cache_entry_s
+{
+    crankvm_oop_t method;
+    crankvm_oop_t codeHeader;
+    crankvm_compiled_code_header_t header;
+    int primitiveNumber;
+    uintptr_t initialPC;
+} crankvm_compiled_code_cache_entry_t;
+
+typedef struct crankvm_compiled_code_cache_s
+{
+    crankvm_compiled_code_cache_entry_t entries[CRANK_VM_COMPILED_CODE_CACHE_ENTRY_COUNT];
+} crankvm_compiled_code_cache_t;
+
+/**
+ * Gets the decoded information of a compiled code. Fails when its header is
+ * not valid, or when its initial pc is out of bounds.
+ */
+crankvm_error_t crankvm_compiled_code_cache_lookup(crankvm_context_t *context, crankvm_CompiledCode_t *compiledCode, crankvm_compiled_code_cache_entry_t **result);
+
+void crankvm_compiled_code_cache_flush(crankvm_context_t *context);
+void crankvm_compiled_code_cache_flushMethod(crankvm_context_t *context, crankvm_oop_t method);
+void crankvm_compiled_code_cache_flushNewSpaceReferences(crankvm_context_t *context);
+
+#endif //CRANK_VM_COMPILED_CODE_CACHE_H
@@ -0,0 +1,196 @@
+#include "compression.h"
+#include <crank-vm/common.h>
+#include <string.h>
+
+#define CRANK_VM_COMPRESSION_HASH_BITS 14
+#define CRANK_VM_COMPRESSION_HASH_SIZE (1<<CRANK_VM_COMPRESSION_HASH_BITS)
+
+// The copies of the decompressor may write past the end of the copied bytes by up to this amount.
+#define CRANK_VM_COMPRESSION_WILD_COPY_SIZE 16
+
+CRANK_VM_INLINE uint32_t
+crankvm_compression_read32(const uint8_t *pointer)
+{
+    uint32_t result;
+    memcpy(&result, pointer, 4);
+    return result;
+}
+
+CRANK_VM_INLINE uint32_t
+crankvm_compression_hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - CRANK_VM_COMPRESSION_HASH_BITS);
+}
+
+CRANK_VM_INLINE uint8_t *
+crankvm_compression_writeLength(uint8_t *output, size_t length)
+{
+    for(; length >= 255; length -= 255)
+        *output++ = 255;
+    *output++ = (uint8_t)length;
+    return output;
+}
+
+size_t
+crankvm_compression_compressBound(size_t sourceSize)
+{
+    return sourceSize + sourceSize / 255 + 16;
+}
+
+static uint8_t *
+crankvm_compression_writeToken(uint8_t *output, uint8_t *outputEnd, const uint8_t *literals, size_t literalCount, size_t offset, size_t matchLength)
+{
+    // Token, extended lengths, literals and offset.
+    size_t requiredSize = 1 + literalCount / 255 + 1 + literalCount + 2 + matchLength / 255 + 1;
+    if((size_t)(outputEnd - output) < requiredSize)
+        return NULL;
+
+    uint8_t *token = output++;
+    *token = (literalCount >= 15 ? 15 : literalCount) << 4;
+    if(literalCount >= 15)
+        output = crankvm_compression_writeLength(output, literalCount - 15);
+
+    memcpy(output, literals, literalCount);
+    output += literalCount;
+
+    // The last token has only literals.
+    if(!matchLength)
+        return output;
+
+    *output++ = offset & 0xFF;
+    *output++ = offset >> 8;
+
+    size_t encodedMatchLength = matchLength - CRANK_VM_COMPRESSION_MIN_MATCH;
+    *token |= encodedMatchLength >= 15 ? 15 : encodedMatchLength;
+    if(encodedMatchLength >= 15)
+        output = crankvm_compression_writeLength(output, encodedMatchLength - 15);
+    return output;
+}
+
+size_t
+crankvm_compression_compressBlock(const uint8_t *source, size_t sourceSize, uint8_t *destination, size_t destinationCapacity)
+{
+    uint32_t positions[CRANK_VM_COMPRESSION_HASH_SIZE];
+    memset(positions, 0, sizeof(positions));
+
+    const uint8_t *sourceEnd = source + sourceSize;
+    const uint8_t *input = source;
+    const uint8_t *anchor = source;
+    uint8_t *output = destination;
+    uint8_t *outputEnd = destination + destinationCapacity;
+    size_t missCount = 0;
+
+    while(sourceSize >= CRANK_VM_COMPRESSION_MIN_MATCH && input <= sourceEnd - CRANK_VM_COMPRESSION_MIN_MATCH)
+    {
+        uint32_t sequence = crankvm_compression_read32(input);
+        uint32_t hash = crankvm_compression_hash(sequence);
+        const uint8_t *candidate = source + positions[hash];
+        positions[hash] = input - source;
+
+        if(candidate >= input || input - candidate > CRANK_VM_COMPRESSION_MAX_OFFSET ||
+            crankvm_compression_read32(candidate) != sequence)
+        {
+            // Skip faster over the data that does not compress.
+            input += 1 + (missCount++ >> 6);
+            continue;
+        }
+
+        size_t matchLength = CRANK_VM_COMPRESSION_MIN_MATCH;
+        while(input + matchLength < sourceEnd && candidate[matchLength] == input[matchLength])
+            ++matchLength;
+
+        output = crankvm_compression_writeToken(output, outputEnd, anchor, input - anchor, input - candidate, matchLength);
+        if(!output)
+            return 0;
+
+        input += matchLength;
+        anchor = input;
+        missCount = 0;
+    }
+
+    output = crankvm_compression_writeToken(output, outputEnd, anchor, sourceEnd - anchor, 0, 0);
+    return output ? (size_t)(output - destination) : 0;
+}
+
+CRANK_VM_INLINE bool
+crankvm_compression_readLength(const uint8_t **input, const uint8_t *inputEnd, size_t *length)
+{
+    uint8_t byte;
+    do
+    {
+        if(*input >= inputEnd)
+            return false;
+
+        byte = *(*input)++;
+        *length += byte;
+    } while(byte == 255);
+    return true;
+}
+
+bool
+crankvm_compression_decompressBlock(const uint8_t *source, size_t sourceSize, uint8_t *destination, size_t destinationSize)
+{
+    const uint8_t *input = source;
+    const uint8_t *inputEnd = source + sourceSize;
+    uint8_t *output = destination;
+    uint8_t *outputEnd = destination + destinationSize;
+
+    while(input < inputEnd)
+    {
+        uint8_t token = *input++;
+
+        // Literals.
+        size_t literalCount = token >> 4;
+        if(literalCount == 15 && !crankvm_compression_readLength(&input, inputEnd, &literalCount))
+            return false;
+        if(literalCount > (size_t)(inputEnd - input) || literalCount > (size_t)(outputEnd - output))
+            return false;
+
+        if((size_t)(inputEnd - input) >= literalCount + CRANK_VM_COMPRESSION_WILD_COPY_SIZE &&
+            (size_t)(outputEnd - output) >= literalCount + CRANK_VM_COMPRESSION_WILD_COPY_SIZE)
+        {
+            for(size_t i = 0; i < literalCount; i += CRANK_VM_COMPRESSION_WILD_COPY_SIZE)
+                memcpy(output + i, input + i, CRANK_VM_COMPRESSION_WILD_COPY_SIZE);
+        }
+        else
+        {
+            memcpy(output, input, literalCount);
+        }
+        input += literalCount;
+        output += literalCount;
+
+        // The last token has only literals.
+        if(input == inputEnd)
+            break;
+
+        // Match.
+        if(inputEnd - input < 2)
+            return false;
+        size_t offset = input[0] | (input[1] << 8);
+        input += 2;
+
+        size_t matchLength = token & 15;
+        if(matchLength == 15 && !crankvm_compression_readLength(&input, inputEnd, &matchLength))
+            return false;
+        matchLength += CRANK_VM_COMPRESSION_MIN_MATCH;
+
+        if(offset == 0 || offset > (size_t)(output - destination) || matchLength > (size_t)(outputEnd - output))
+            return false;
+
+        // The match may overlap with the bytes that it produces.
+        const uint8_t *match = output - offset;
+        if(offset >= 8 && (size_t)(outputEnd - output) >= matchLength + CRANK_VM_COMPRESSION_WILD_COPY_SIZE)
+        {
+            for(size_t i = 0; i < matchLength; i += 8)
+                memcpy(output + i, match + i, 8);
+        }
+        else
+        {
+            for(size_t i = 0; i < matchLength; ++i)
+                output[i] = match[i];
+        }
+        output += matchLength;
+    }
+
+    return output == outputEnd;
+}
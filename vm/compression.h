@@ -0,0 +1,37 @@
+#ifndef CRANK_VM_COMPRESSION_H
+#define CRANK_VM_COMPRESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A byte oriented LZ77 block codec, used for the compressed images.
+ *
+ * A block is a sequence of tokens. A token starts with a byte that holds the
+ * literal count in the high nibble, and the match length minus the minimum
+ * match in the low nibble. A nibble of 15 is extended with the following
+ * bytes, up to a byte that is not 255. The literals follow, and then the
+ * match offset as a little endian 16 bits integer. The last token of a block
+ * only has literals.
+ */
+#define CRANK_VM_COMPRESSION_MIN_MATCH 4
+#define CRANK_VM_COMPRESSION_MAX_OFFSET 0xFFFF
+
+/**
+ * The maximum size of a compressed block.
+ */
+size_t crankvm_compression_compressBound(size_t sourceSize);
+
+/**
+ * Compresses a block. Returns the compressed size, or zero when the block
+ * does not fit in the destination.
+ */
+size_t crankvm_compression_compressBlock(const uint8_t *source, size_t sourceSize, uint8_t *destination, size_t destinationCapacity);
+
+/**
+ * Decompresses a block that must fill exactly the destination.
+ */
+bool crankvm_compression_decompressBlock(const uint8_t *source, size_t sourceSize, uint8_t *destination, size_t destinationSize);
+
+#endif //CRANK_VM_COMPRESSION_H
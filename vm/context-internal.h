@@ -5,6 +5,17 @@
 #include <crank-vm/special-objects.h>
 #include <stdbool.h>
 #include "heap.h"
+#include "image.h"
+#include "method-cache.h"
+#include "selector-index.h"
+#include "compiled-code-cache.h"
+#include "at-cache.h"
+#include "inline-cache.h"
+#include "stack-zone.h"
+#include "scheduler.h"
+#include "callout.h"
+#include "jit.h"
+#include "trace.h"
 
 struct crankvm_context_s
 {
@@ -18,6 +29,43 @@ struct crankvm_context_s
     // Identity hash
     uint32_t lastIdentityHash;
 
+    // The loaded image file. The snapshots keep the settings of its header.
+    char *imageFileName;
+    crankvm_image_header_t imageHeader;
+
+    // Global method lookup cache.
+    crankvm_method_cache_t methodCache;
+
+    // The slots of the selectors of the large method dictionaries.
+    crankvm_selector_index_t selectorIndex;
+
+    // Decoded compiled code headers.
+    crankvm_compiled_code_cache_t compiledCodeCache;
+
+    // Per send site inline caches.
+    crankvm_inline_cache_t inlineCache;
+
+    // The layout of the receivers of the indexed access special selectors.
+    crankvm_at_cache_t atCache;
+
+    // The activations that are not reified yet.
+    crankvm_stack_zone_t stackZone;
+
+    // The preemption requests, the external signals and the process switch statistics.
+    crankvm_scheduler_t scheduler;
+
+    // The timers that are fired at the interrupt checks.
+    crankvm_timer_wheel_t timerWheel;
+
+    // The worker threads of the blocking primitives.
+    crankvm_callout_pool_t calloutPool;
+
+    // The native code of the hot methods.
+    crankvm_jit_t jit;
+
+    // Interpreter trace ring buffer.
+    crankvm_trace_buffer_t trace;
+
     struct {
         crankvm_special_object_array_t *specialObjectsArray;
 
@@ -30,7 +78,13 @@ struct crankvm_context_s
         crankvm_oop_t freeListObject;
         crankvm_HiddenRoots_t *hiddenRootsObject;
         crankvm_ClassTablePage_t *firstClassTablePage;
+
+        // The semaphores that the processes wait on during their callouts.
+        crankvm_Array_t *externalSemaphores;
     } roots;
 };
 
+crankvm_ProcessorScheduler_t *crankvm_context_getProcessorScheduler(crankvm_context_t *context);
+crankvm_Process_t *crankvm_context_getActiveProcess(crankvm_context_t *context);
+
 #endif //CRANK_VM_CONTEXT_INTERNAL_H
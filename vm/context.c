@@ -35,6 +35,7 @@ crankvm_context_create(crankvm_context_t **returnContext)
 
     // Initialize the context
     context->heap.maxCapacity = CRANK_VM_CONTEXT_DEFAULT_MAX_HEAP_CAPACITY;
+    context->heap.compactionEnabled = true;
 
     *returnContext = context;
     return CRANK_VM_OK;
@@ -46,7 +47,15 @@ crankvm_context_destroy(crankvm_context_t *context)
     if(!context)
         return;
 
+    crankvm_callout_pool_destroy(context);
+    crankvm_timer_wheel_destroy(context);
+    crankvm_scheduler_destroy(&context->scheduler);
+    crankvm_trace_destroy(context);
+    crankvm_stack_zone_destroy(&context->stackZone);
+    crankvm_jit_destroy(&context->jit);
+    crankvm_selector_index_destroy(&context->selectorIndex);
     crankvm_heap_destroy(&context->heap);
+    free(context->imageFileName);
     free(context);
 }
 
@@ -68,6 +77,33 @@ crankvm_context_getMaxHeapCapacity(crankvm_context_t *context)
     return context->heap.maxCapacity;
 }
 
+LIB_CRANK_VM_EXPORT void
+crankvm_context_setHeapCompactionEnabled(crankvm_context_t *context, int enabled)
+{
+    if(!context)
+        return;
+
+    context->heap.compactionEnabled = enabled != 0;
+}
+
+LIB_CRANK_VM_EXPORT void
+crankvm_context_setImageLoadThreadCount(crankvm_context_t *context, size_t threadCount)
+{
+    if(!context)
+        return;
+
+    context->heap.loadThreadCount = threadCount;
+}
+
+LIB_CRANK_VM_EXPORT void
+crankvm_context_setLazyImageSwizzlingEnabled(crankvm_context_t *context, int enabled)
+{
+    if(!context)
+        return;
+
+    context->heap.lazySwizzlingEnabled = enabled != 0;
+}
+
 LIB_CRANK_VM_EXPORT crankvm_special_object_array_t *
 crankvm_context_getSpecialObjectsArray(crankvm_context_t *context)
 {
@@ -76,8 +112,8 @@ crankvm_context_getSpecialObjectsArray(crankvm_context_t *context)
     return context->roots.specialObjectsArray;
 }
 
-static crankvm_ProcessorScheduler_t *
-crankvm_context_getScheduler(crankvm_context_t *context)
+crankvm_ProcessorScheduler_t *
+crankvm_context_getProcessorScheduler(crankvm_context_t *context)
 {
     if(!context->roots.specialObjectsArray ||
         crankvm_object_isNil(context, context->roots.specialObjectsArray->schedulerAssociation) ||
@@ -87,10 +123,10 @@ crankvm_context_getScheduler(crankvm_context_t *context)
     return (crankvm_ProcessorScheduler_t*)context->roots.specialObjectsArray->schedulerAssociation->value;
 }
 
-static crankvm_Process_t *
+crankvm_Process_t *
 crankvm_context_getActiveProcess(crankvm_context_t *context)
 {
-    crankvm_ProcessorScheduler_t *scheduler = crankvm_context_getScheduler(context);
+    crankvm_ProcessorScheduler_t *scheduler = crankvm_context_getProcessorScheduler(context);
     if(!scheduler || crankvm_oop_isNil(context, scheduler->activeProcess))
         return NULL;
 
@@ -106,7 +142,7 @@ crankvm_context_getEntryMethodContext(crankvm_context_t *context)
         crankvm_oop_isNil(context, context->roots.specialObjectsArray->crankVMEntryContext->value))
         return NULL;
 
-    printf("Entry point key: '%.*s'\n", crankvm_string_printf_arg(context->roots.specialObjectsArray->crankVMEntryContext->key));
+    crankvm_traceWithStringOop(context, ENTRY_POINT, 0, 0, 0, context->roots.specialObjectsArray->crankVMEntryContext->key);
 
     crankvm_MethodContext_t *methodContext;
     crankvm_error_t error = crankvm_MethodContext_createObjectMessageSendActivationContext(context, &methodContext,
@@ -128,12 +164,11 @@ crankvm_context_run(crankvm_context_t *context)
         if(!process || crankvm_oop_isNil(context, process->suspendedContext))
             return CRANK_VM_ERROR_UNSUPPORTED_OPERATION;
 
-        printf("Processor name: '%.*s'\n", crankvm_string_printf_arg(context->roots.specialObjectsArray->schedulerAssociation->key));
-        printf("Active process %p name '%.*s' suspended context %p\n", process, crankvm_string_printf_arg(process->name), (void*)process->suspendedContext);
+        crankvm_traceWithStringOop(context, ACTIVE_PROCESS, process, process->suspendedContext, 0, process->name);
         methodContext = (crankvm_MethodContext_t *)process->suspendedContext;
     }
 
-    printf("Entry method context: %p\n", methodContext);
+    crankvm_trace(context, ENTRY_METHOD_CONTEXT, methodContext, 0, 0);
     crankvm_oop_t returnValue;
     crankvm_error_t error = crankvm_interpret(context, methodContext, &returnValue);
     if(error)
@@ -24,6 +24,7 @@ LIB_CRANK_VM_EXPORT const char *crankvm_error_getString(crankvm_error_t error)
     case CRANK_VM_ERROR_ILLEGAL_INSTRUCTION: return "Illegal instruction.";
     case CRANK_VM_ERROR_ILLEGAL_STORE: return "Illegal store instruction.";
     case CRANK_VM_ERROR_NIL_REMOTE_VECTOR: return "Accessing to nil remote vector.";
+    case CRANK_VM_ERROR_FAILED_TO_WRITE_FILE: return "Failed to write file.";
     default: return "Unknown error code.";
     }
 }
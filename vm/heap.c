@@ -1,11 +1,21 @@
 #include "heap.h"
+#include "compression.h"
 #include "image.h"
 #include "read-memory-stream.h"
 #include "context-internal.h"
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <time.h>
 
+#include <signal.h>
 #include <sys/mman.h>
+#include <unistd.h>
+
+// The signal handlers are global, so only one heap at a time can swizzle lazily.
+static crankvm_heap_lazy_swizzle_t *crankvm_heap_activeLazySwizzle;
+static struct sigaction crankvm_heap_previousFaultAction;
 
 CRANK_VM_INLINE size_t
 crankvm_heap_roundUpHeapSize(size_t size)
@@ -24,10 +34,49 @@ crankvm_heap_segment_initializeWithCapacity(crankvm_heap_segment_t *segment, siz
     if(segment->address == MAP_FAILED)
         return CRANK_VM_ERROR_OUT_OF_MEMORY;
 
+    segment->reservationAddress = segment->address;
     segment->addressSpaceCapacity = capacity;
     return CRANK_VM_OK;
 }
 
+static void
+crankvm_heap_segment_destroy(crankvm_heap_segment_t *segment)
+{
+    if(segment->reservationAddress)
+        munmap(segment->reservationAddress, segment->address + segment->addressSpaceCapacity - segment->reservationAddress);
+    memset(segment, 0, sizeof(crankvm_heap_segment_t));
+}
+
+/**
+ * Maps a range of the image file at the start of an empty segment, with
+ * private copy-on-write pages. The start of the segment is moved within its
+ * first page, so that it has the same page offset as the range in the file.
+ * Returns false when the segment is not suitable for mapping.
+ */
+static bool
+crankvm_heap_segment_mapFile(crankvm_heap_segment_t *segment, int fileDescriptor, size_t fileOffset, size_t size)
+{
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t pageOffset = fileOffset % pageSize;
+    if(segment->size != 0 || segment->address != segment->reservationAddress ||
+        pageOffset + size > segment->addressSpaceCapacity)
+        return false;
+
+    size_t mappingSize = (pageOffset + size + pageSize - 1) / pageSize * pageSize;
+    void *mapping = mmap(segment->reservationAddress, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fileDescriptor, fileOffset - pageOffset);
+    if(mapping == MAP_FAILED)
+    {
+        // A failed fixed mapping may have discarded the reservation.
+        mmap(segment->reservationAddress, mappingSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        return false;
+    }
+
+    segment->address += pageOffset;
+    segment->addressSpaceCapacity -= pageOffset;
+    segment->allocatedCapacity = mappingSize - pageOffset;
+    return true;
+}
+
 static void*
 crankvm_heap_segment_allocate(crankvm_heap_segment_t *segment, size_t size)
 {
@@ -38,27 +87,294 @@ crankvm_heap_segment_allocate(crankvm_heap_segment_t *segment, size_t size)
     size_t newSegmentSize = segment->size + size;
     if(newSegmentSize > segment->allocatedCapacity)
     {
-        size_t newAllocatedCapacity = crankvm_heap_roundUpHeapSize(newSegmentSize);
-        int res = mprotect(segment->address + segment->allocatedCapacity, newAllocatedCapacity - segment->allocatedCapacity, PROT_READ | PROT_WRITE);
+        // Commit whole pages, the segment address may be in the middle of a page.
+        uint8_t *allocatedLimit = segment->address + segment->allocatedCapacity;
+        uint8_t *newAllocatedLimit = (uint8_t*)crankvm_heap_roundUpHeapSize((uintptr_t)(segment->address + newSegmentSize));
+        int res = mprotect(allocatedLimit, newAllocatedLimit - allocatedLimit, PROT_READ | PROT_WRITE);
         if(res)
             return NULL;
 
-        segment->allocatedCapacity = newAllocatedCapacity;
+        segment->allocatedCapacity = newAllocatedLimit - segment->address;
     }
 
     segment->size = newSegmentSize;
     return result;
 }
 
-static crankvm_object_header_t *
-crankvm_heap_allocate(crankvm_heap_t *heap, size_t size)
+static void*
+crankvm_heap_segment_allocateObject(crankvm_heap_segment_t *segment, size_t size)
+{
+    // Always leave room for the bridge to the next segment.
+    if(segment->size + size + CRANK_VM_HEAP_BRIDGE_SIZE > segment->addressSpaceCapacity)
+        return NULL;
+
+    return crankvm_heap_segment_allocate(segment, size);
+}
+
+static void
+crankvm_heap_initializeBridge(crankvm_object_header_t *bridge, uint8_t *nextSegmentAddress)
+{
+    memset(bridge, 0, sizeof(crankvm_object_header_t));
+    crankvm_object_header_setRawSlotCount(bridge, 1);
+    crankvm_object_header_setObjectFormat(bridge, CRANK_VM_OBJECT_FORMAT_INDEXABLE_64);
+    crankvm_object_header_setClassIndex(bridge, CRANKVM_CLASS_INDEX_PUN_SEGMENT_BRIDGE);
+    ((crankvm_oop_t*)&bridge[1])[0] = (crankvm_oop_t)nextSegmentAddress;
+}
+
+static crankvm_heap_segment_t *
+crankvm_heap_addSegment(crankvm_heap_t *heap, size_t capacity)
+{
+    if(heap->segmentCount >= CRANK_VM_HEAP_MAX_SEGMENT_COUNT)
+        return NULL;
+
+    crankvm_heap_segment_t *segment = &heap->segments[heap->segmentCount];
+    if(crankvm_heap_segment_initializeWithCapacity(segment, capacity))
+        return NULL;
+
+    // Link the previous last segment with a bridge.
+    if(heap->segmentCount > 0)
+    {
+        crankvm_object_header_t *bridge = crankvm_heap_segment_allocate(&heap->segments[heap->segmentCount - 1], CRANK_VM_HEAP_BRIDGE_SIZE);
+        if(!bridge)
+        {
+            crankvm_heap_segment_destroy(segment);
+            return NULL;
+        }
+
+        crankvm_heap_initializeBridge(bridge, segment->address);
+    }
+    ++heap->segmentCount;
+
+    uintptr_t segmentStart = (uintptr_t)segment->address;
+    uintptr_t segmentEnd = segmentStart + segment->addressSpaceCapacity;
+    if(!heap->oldSpaceLowestAddress || segmentStart < heap->oldSpaceLowestAddress)
+        heap->oldSpaceLowestAddress = segmentStart;
+    if(segmentEnd > heap->oldSpaceHighestAddress)
+        heap->oldSpaceHighestAddress = segmentEnd;
+
+    return segment;
+}
+
+/**
+ * Releases an empty segment, and relinks the bridge of the previous segment.
+ */
+static void
+crankvm_heap_releaseSegment(crankvm_heap_t *heap, size_t segmentIndex)
+{
+    assert(segmentIndex > 0 && segmentIndex < heap->segmentCount);
+    crankvm_heap_segment_t *segment = &heap->segments[segmentIndex];
+    crankvm_heap_segment_destroy(segment);
+    memmove(segment, segment + 1, (heap->segmentCount - segmentIndex - 1)*sizeof(crankvm_heap_segment_t));
+    --heap->segmentCount;
+
+    crankvm_heap_segment_t *previousSegment = &heap->segments[segmentIndex - 1];
+    crankvm_object_header_t *bridge = (crankvm_object_header_t*)(previousSegment->address + previousSegment->size - CRANK_VM_HEAP_BRIDGE_SIZE);
+    assert(crankvm_object_header_getClassIndex(bridge) == CRANKVM_CLASS_INDEX_PUN_SEGMENT_BRIDGE);
+    if(segmentIndex < heap->segmentCount)
+        crankvm_heap_initializeBridge(bridge, heap->segments[segmentIndex].address);
+    else
+        previousSegment->size -= CRANK_VM_HEAP_BRIDGE_SIZE; // The previous segment is now the last one.
+
+    ++heap->releasedSegmentCount;
+}
+
+static size_t
+crankvm_heap_getOldSpaceSize(crankvm_heap_t *heap)
+{
+    size_t size = 0;
+    for(size_t i = 0; i < heap->segmentCount; ++i)
+        size += heap->segments[i].size;
+    return size;
+}
+
+CRANK_VM_INLINE size_t
+crankvm_heap_objectHeaderSize(crankvm_object_header_t *object)
+{
+    if(crankvm_object_header_getRawSlotCount(object) == 255)
+        return sizeof(crankvm_object_header_t)*2;
+    return sizeof(crankvm_object_header_t);
+}
+
+CRANK_VM_INLINE uint8_t *
+crankvm_heap_objectEnd(crankvm_object_header_t *object)
+{
+    // There is at least one slot, for the forwarding pointer.
+    size_t slotCount = crankvm_object_header_getSlotCount(object);
+    if(slotCount == 0)
+        slotCount = 1;
+
+    return (uint8_t*)&object[1] + slotCount * sizeof(crankvm_oop_t);
+}
+
+CRANK_VM_INLINE uint8_t *
+crankvm_heap_objectStart(crankvm_object_header_t *object)
+{
+    return (uint8_t*)&object[1] - crankvm_heap_objectHeaderSize(object);
+}
+
+CRANK_VM_INLINE bool
+crankvm_heap_isOld(crankvm_heap_t *heap, crankvm_oop_t oop)
+{
+    return !crankvm_heap_isYoung(heap, oop) &&
+        oop - heap->oldSpaceLowestAddress < heap->oldSpaceHighestAddress - heap->oldSpaceLowestAddress;
+}
+
+CRANK_VM_INLINE crankvm_object_header_t **
+crankvm_heap_freeChunkNextLink(crankvm_object_header_t *chunk)
+{
+    // The free chunks are linked through their first slot.
+    return (crankvm_object_header_t**)&chunk[1];
+}
+
+/**
+ * Turns a range of the old space into a free chunk, and adds it into its free list.
+ */
+static void
+crankvm_heap_addFreeChunk(crankvm_heap_t *heap, uint8_t *start, size_t size)
+{
+    size_t unitCount = size / CRANK_VM_HEAP_ALLOCATION_UNIT;
+    assert(unitCount >= 2);
+
+    // A free chunk is an object with the free object class index pun.
+    crankvm_object_header_t *chunk = (crankvm_object_header_t*)start;
+    memset(chunk, 0, sizeof(crankvm_object_header_t));
+    if(unitCount - 1 >= 255)
+    {
+        ++chunk;
+        memset(chunk, 0, sizeof(crankvm_object_header_t));
+        crankvm_object_header_setRawSlotCount(chunk, 255);
+        crankvm_object_header_setRawSlotOverflowCount(chunk, unitCount - 2);
+    }
+    else
+    {
+        crankvm_object_header_setRawSlotCount(chunk, unitCount - 1);
+    }
+
+    size_t listIndex = unitCount < CRANK_VM_HEAP_FREE_LIST_COUNT ? unitCount : 0;
+    crankvm_heap_free_lists_t *freeLists = &heap->freeLists;
+    *crankvm_heap_freeChunkNextLink(chunk) = freeLists->lists[listIndex];
+    freeLists->lists[listIndex] = chunk;
+    freeLists->freeBytes += size;
+}
+
+static uint8_t *
+crankvm_heap_takeFreeChunk(crankvm_heap_t *heap, crankvm_object_header_t **link, size_t size)
+{
+    crankvm_object_header_t *chunk = *link;
+    uint8_t *chunkStart = crankvm_heap_objectStart(chunk);
+    size_t chunkSize = crankvm_heap_objectEnd(chunk) - chunkStart;
+
+    *link = *crankvm_heap_freeChunkNextLink(chunk);
+    heap->freeLists.freeBytes -= chunkSize;
+
+    // Return the remainder into the free lists.
+    if(chunkSize > size)
+        crankvm_heap_addFreeChunk(heap, chunkStart + size, chunkSize - size);
+    return chunkStart;
+}
+
+static uint8_t *
+crankvm_heap_allocateFromFreeLists(crankvm_heap_t *heap, size_t size)
+{
+    crankvm_heap_free_lists_t *freeLists = &heap->freeLists;
+    size_t unitCount = size / CRANK_VM_HEAP_ALLOCATION_UNIT;
+    if(!freeLists->freeBytes)
+        return NULL;
+
+    if(unitCount < CRANK_VM_HEAP_FREE_LIST_COUNT)
+    {
+        // Exact fit.
+        if(freeLists->lists[unitCount])
+            return crankvm_heap_takeFreeChunk(heap, &freeLists->lists[unitCount], size);
+
+        // Split a larger small chunk, leaving room for a free chunk.
+        for(size_t i = unitCount + 2; i < CRANK_VM_HEAP_FREE_LIST_COUNT; ++i)
+        {
+            if(freeLists->lists[i])
+                return crankvm_heap_takeFreeChunk(heap, &freeLists->lists[i], size);
+        }
+    }
+
+    // First fit in the large chunk list.
+    for(crankvm_object_header_t **link = &freeLists->lists[0]; *link; link = crankvm_heap_freeChunkNextLink(*link))
+    {
+        size_t chunkSize = crankvm_heap_objectEnd(*link) - crankvm_heap_objectStart(*link);
+        if(chunkSize == size || chunkSize >= size + 2*CRANK_VM_HEAP_ALLOCATION_UNIT)
+            return crankvm_heap_takeFreeChunk(heap, link, size);
+    }
+
+    return NULL;
+}
+
+static uint8_t *
+crankvm_heap_allocateFromLastSegment(crankvm_heap_t *heap, size_t size)
 {
-    crankvm_object_header_t *allocatedObject = crankvm_heap_segment_allocate(&heap->firstSegment, size);
+    uint8_t *allocatedObject = crankvm_heap_segment_allocateObject(&heap->segments[heap->segmentCount - 1], size);
     if(allocatedObject)
         return allocatedObject;
 
-    printf("TODO: Create an additional heap segment\n");
-    abort();
+    // Grow the old space with a new segment.
+    size_t capacity = crankvm_heap_roundUpHeapSize(size + CRANK_VM_HEAP_BRIDGE_SIZE);
+    if(capacity < CRANK_VM_HEAP_SEGMENT_GROWTH_SIZE)
+        capacity = CRANK_VM_HEAP_SEGMENT_GROWTH_SIZE;
+
+    crankvm_heap_segment_t *segment = crankvm_heap_addSegment(heap, capacity);
+    if(!segment)
+        return NULL;
+
+    return crankvm_heap_segment_allocateObject(segment, size);
+}
+
+static crankvm_object_header_t *
+crankvm_heap_allocateOld(crankvm_heap_t *heap, size_t size)
+{
+    crankvm_object_header_t *allocatedObject = (crankvm_object_header_t*)crankvm_heap_allocateFromFreeLists(heap, size);
+    if(!allocatedObject)
+        allocatedObject = (crankvm_object_header_t*)crankvm_heap_allocateFromLastSegment(heap, size);
+    if(!allocatedObject)
+    {
+        fprintf(stderr, "Out of memory for growing the old space.\n");
+        abort();
+    }
+
+    // Collect the old space when it has grown enough since the last full collection.
+    heap->oldSpaceUsage += size;
+    if(heap->fullGCThreshold && heap->oldSpaceUsage > heap->fullGCThreshold)
+        crankvm_heap_requestGarbageCollection(heap, true);
+
+    return allocatedObject;
+}
+
+static crankvm_object_header_t *
+crankvm_heap_allocate(crankvm_heap_t *heap, size_t size)
+{
+    crankvm_heap_new_space_t *newSpace = &heap->newSpace;
+
+    // Objects that do not fit in a survivor space are directly allocated in the old space.
+    if(size <= newSpace->survivorSpaceSize)
+    {
+        if(size <= (size_t)(newSpace->edenLimit - newSpace->edenFreeStart))
+        {
+            crankvm_object_header_t *allocatedObject = (crankvm_object_header_t*)newSpace->edenFreeStart;
+            newSpace->edenFreeStart += size;
+            if(newSpace->edenFreeStart >= newSpace->scavengeThreshold)
+                newSpace->scavengeRequested = true;
+            return allocatedObject;
+        }
+
+        // Eden is full. Allocate in the old space until the next scavenge.
+        newSpace->scavengeRequested = true;
+    }
+
+    return crankvm_heap_allocateOld(heap, size);
+}
+
+CRANK_VM_INLINE void
+crankvm_heap_rememberIfOld(crankvm_heap_t *heap, crankvm_object_header_t *object)
+{
+    // New objects that could not be allocated in eden are initialized without write barrier.
+    if(!crankvm_heap_isYoung(heap, (crankvm_oop_t)object))
+        crankvm_heap_remember(heap, object);
 }
 
 static crankvm_object_header_t *
@@ -128,6 +444,7 @@ crankvm_heap_newObjectWithLogicalSize(crankvm_context_t *context, crankvm_object
 
     crankvm_object_header_setSlotCount(allocatedObject, slotCount);
     crankvm_object_header_setObjectFormat(allocatedObject, instanceFormat);
+    crankvm_heap_rememberIfOld(&context->heap, allocatedObject);
 
     // Clear the slots with nil for pointers objects.
     if(format < CRANK_VM_OBJECT_FORMAT_INDEXABLE_64)
@@ -159,13 +476,18 @@ crankvm_heap_shallowCopy(crankvm_context_t *context, crankvm_object_header_t *so
         headerSize += sizeof(crankvm_object_header_t);
 
     size_t objectSize = headerSize + bodySize;
-    crankvm_object_header_t *allocatedObject = (crankvm_object_header_t*)crankvm_heap_allocate(&context->heap, objectSize);
-    memcpy(allocatedObject, sourceObject, objectSize);
+    uint8_t *sourceStart = (uint8_t*)sourceObject + sizeof(crankvm_object_header_t) - headerSize;
+    uint8_t *allocatedStart = (uint8_t*)crankvm_heap_allocate(&context->heap, objectSize);
+    memcpy(allocatedStart, sourceStart, objectSize);
+
+    // The copy has a fresh header, without identity hash.
+    crankvm_object_header_t *allocatedObject = (crankvm_object_header_t*)(allocatedStart + headerSize) - 1;
     memset(allocatedObject, 0, sizeof(crankvm_object_header_t));
 
     crankvm_object_header_setSlotCount(allocatedObject, slotCount);
     crankvm_object_header_setObjectFormat(allocatedObject, format);
     crankvm_object_header_setClassIndex(allocatedObject, classIndex);
+    crankvm_heap_rememberIfOld(&context->heap, allocatedObject);
 
     return allocatedObject;
 }
@@ -176,151 +498,1412 @@ crankvm_heap_newObject(crankvm_context_t *context, crankvm_object_format_t forma
     return crankvm_heap_newObjectWithLogicalSize(context, format, fixedSize + variableSize);
 }
 
-static crankvm_error_t
-crankvm_heap_initializeFor(crankvm_heap_t *heap, size_t initialHeapSize)
+static void
+crankvm_heap_object_stack_push(crankvm_heap_object_stack_t *stack, crankvm_object_header_t *object)
 {
-    return crankvm_heap_segment_initializeWithCapacity(&heap->firstSegment, heap->maxCapacity);
+    if(stack->size >= stack->capacity)
+    {
+        size_t newCapacity = stack->capacity * 2;
+        if(newCapacity == 0)
+            newCapacity = 1024;
+
+        crankvm_object_header_t **newElements = realloc(stack->elements, newCapacity*sizeof(crankvm_object_header_t*));
+        if(!newElements)
+        {
+            fprintf(stderr, "Out of memory for the garbage collector object stacks.\n");
+            abort();
+        }
+
+        stack->elements = newElements;
+        stack->capacity = newCapacity;
+    }
+
+    stack->elements[stack->size++] = object;
 }
 
-crankvm_error_t
-crankvm_heap_destroy(crankvm_heap_t *heap)
+static void
+crankvm_heap_object_stack_destroy(crankvm_heap_object_stack_t *stack)
 {
-    return CRANK_VM_OK;
+    free(stack->elements);
+    memset(stack, 0, sizeof(crankvm_heap_object_stack_t));
 }
 
-crankvm_spur_segment_info_t *
-crankvm_heap_allocateSegmentInfo(crankvm_heap_t *heap)
+void
+crankvm_heap_remember(crankvm_heap_t *heap, crankvm_object_header_t *object)
 {
-    if(heap->segmentInfoSize >= heap->segmentInfoCapacity)
-    {
-        heap->segmentInfoCapacity *= 2;
-        if(heap->segmentInfoCapacity == 0)
-            heap->segmentInfoCapacity = 16;
+    if(!heap->newSpace.address)
+        return;
 
-        crankvm_spur_segment_info_t * newInfos = realloc(heap->segmentInfos, heap->segmentInfoCapacity*sizeof(crankvm_spur_segment_info_t));
-        if(!newInfos)
-            return NULL;
-        heap->segmentInfos = newInfos;
-    }
+    crankvm_object_header_setIsRemembered(object, 1);
+    crankvm_heap_object_stack_push(&heap->newSpace.rememberedSet, object);
+}
 
-    crankvm_spur_segment_info_t *result = &heap->segmentInfos[heap->segmentInfoSize++];
-    memset(result, 0, sizeof(crankvm_spur_segment_info_t));
-    return result;
+static crankvm_error_t
+crankvm_heap_initializeNewSpace(crankvm_heap_t *heap, size_t desiredEdenBytes)
+{
+    crankvm_heap_new_space_t *newSpace = &heap->newSpace;
+    size_t edenSize = crankvm_heap_roundUpHeapSize(desiredEdenBytes ? desiredEdenBytes : CRANK_VM_HEAP_DEFAULT_EDEN_SIZE);
+    size_t survivorSpaceSize = crankvm_heap_roundUpHeapSize(edenSize / CRANK_VM_HEAP_SURVIVOR_SPACE_EDEN_FRACTION);
+    size_t newSpaceSize = survivorSpaceSize*2 + edenSize;
+
+    // TODO: Use VirtualAlloc on Windows
+    uint8_t *address = (uint8_t*)mmap(NULL, newSpaceSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(address == MAP_FAILED)
+        return CRANK_VM_ERROR_OUT_OF_MEMORY;
+
+    newSpace->address = address;
+    newSpace->size = newSpaceSize;
+    newSpace->survivorSpaceSize = survivorSpaceSize;
+
+    newSpace->pastSpaceStart = newSpace->pastSpaceFreeStart = address;
+    newSpace->futureSpaceStart = newSpace->futureSpaceFreeStart = address + survivorSpaceSize;
+
+    newSpace->edenStart = newSpace->edenFreeStart = address + survivorSpaceSize*2;
+    newSpace->edenLimit = newSpace->edenStart + edenSize;
+
+    // Leave some headroom for the allocations performed before reaching a safe point.
+    newSpace->scavengeThreshold = newSpace->edenLimit - edenSize / 8;
+    return CRANK_VM_OK;
 }
 
+static crankvm_error_t
+crankvm_heap_initializeFor(crankvm_heap_t *heap, size_t initialHeapSize, size_t desiredEdenBytes)
+{
+    if(!crankvm_heap_addSegment(heap, heap->maxCapacity))
+        return CRANK_VM_ERROR_OUT_OF_MEMORY;
 
-crankvm_heap_iterator_t
-crankvm_heap_iterator_create(crankvm_heap_t *heap)
+    return crankvm_heap_initializeNewSpace(heap, desiredEdenBytes);
+}
+
+static void
+crankvm_heap_releaseLazySwizzling(crankvm_heap_t *heap)
 {
-    crankvm_heap_iterator_t iterator;
-    memset(&iterator, 0, sizeof(iterator));
+    crankvm_heap_lazy_swizzle_t *lazySwizzle = &heap->lazySwizzle;
+    if(crankvm_heap_activeLazySwizzle != lazySwizzle)
+        return;
 
-    iterator.heap = heap;
-    iterator.segment = &heap->firstSegment;
+    sigaction(SIGSEGV, &crankvm_heap_previousFaultAction, NULL);
+    crankvm_heap_activeLazySwizzle = NULL;
 
-    crankvm_heap_iterator_advance(&iterator);
+    munmap(lazySwizzle->sourceView, lazySwizzle->pageCount*lazySwizzle->pageSize);
+    free(lazySwizzle->pageFirstObjects);
+    free(lazySwizzle->swizzledPages);
+    memset(lazySwizzle, 0, sizeof(crankvm_heap_lazy_swizzle_t));
 
-    return iterator;
+    free(heap->segmentInfos);
+    heap->segmentInfos = NULL;
+    heap->segmentInfoCapacity = 0;
+    heap->segmentInfoSize = 0;
 }
 
-void
-crankvm_heap_iterator_advance(crankvm_heap_iterator_t *iterator)
+crankvm_error_t
+crankvm_heap_destroy(crankvm_heap_t *heap)
 {
-    if(iterator->atEnd)
-        return;
+    crankvm_heap_releaseLazySwizzling(heap);
 
-    if(iterator->currentObjectEnd + sizeof(crankvm_object_header_t) >= iterator->segment->size)
-    {
-        // TODO: Advance the segment
-        iterator->atEnd = 1;
-        return;
-    }
+    crankvm_heap_new_space_t *newSpace = &heap->newSpace;
+    if(newSpace->address)
+        munmap(newSpace->address, newSpace->size);
 
-    iterator->currentObjectStart = iterator->currentObjectEnd;
+    crankvm_heap_object_stack_destroy(&newSpace->rememberedSet);
+    crankvm_heap_object_stack_destroy(&newSpace->promotedStack);
+    memset(newSpace, 0, sizeof(crankvm_heap_new_space_t));
 
-    crankvm_object_header_t *header = (crankvm_object_header_t *)(iterator->segment->address + iterator->currentObjectEnd);
-    iterator->currentObjectEnd += sizeof(crankvm_object_header_t);
-    if(crankvm_object_header_getRawSlotCount(header) == 255)
+    crankvm_heap_object_stack_destroy(&heap->markStack);
+    memset(&heap->freeLists, 0, sizeof(crankvm_heap_free_lists_t));
+
+    for(size_t i = 0; i < heap->segmentCount; ++i)
+        crankvm_heap_segment_destroy(&heap->segments[i]);
+    heap->segmentCount = 0;
+    heap->oldSpaceLowestAddress = 0;
+    heap->oldSpaceHighestAddress = 0;
+    return CRANK_VM_OK;
+}
+
+static uint64_t
+crankvm_heap_getMicroseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec*1000000 + now.tv_nsec / 1000;
+}
+
+static crankvm_oop_t
+crankvm_heap_copyAndForward(crankvm_heap_t *heap, crankvm_object_header_t *object)
+{
+    crankvm_heap_new_space_t *newSpace = &heap->newSpace;
+    size_t headerSize = crankvm_heap_objectHeaderSize(object);
+    uint8_t *objectStart = (uint8_t*)&object[1] - headerSize;
+    size_t objectSize = crankvm_heap_objectEnd(object) - objectStart;
+
+    // Old survivors, and the survivors that do not fit in the future space are tenured.
+    uint8_t *futureSpaceLimit = newSpace->futureSpaceStart + newSpace->survivorSpaceSize;
+    bool tenure = newSpace->tenureAll ||
+        ((uint8_t*)object >= newSpace->pastSpaceStart && (uint8_t*)object < newSpace->tenuringThreshold) ||
+        objectSize > (size_t)(futureSpaceLimit - newSpace->futureSpaceFreeStart);
+
+    uint8_t *newObjectStart;
+    if(tenure)
     {
-        // This is an extension header
-        assert(iterator->currentObjectEnd + sizeof(crankvm_object_header_t) <= iterator->segment->size);
-        iterator->currentObjectEnd += sizeof(crankvm_object_header_t);
-        ++header;
+        newObjectStart = (uint8_t*)crankvm_heap_allocateOld(heap, objectSize);
+    }
+    else
+    {
+        newObjectStart = newSpace->futureSpaceFreeStart;
+        newSpace->futureSpaceFreeStart += objectSize;
     }
 
-    // We found the header.
-    iterator->currentHeader = header;
+    memcpy(newObjectStart, objectStart, objectSize);
+    crankvm_object_header_t *newObject = (crankvm_object_header_t*)(newObjectStart + headerSize) - 1;
+    if(tenure)
+    {
+        crankvm_heap_object_stack_push(&newSpace->promotedStack, newObject);
+        ++newSpace->tenuredObjectCount;
+    }
 
-    size_t slotCount = crankvm_object_header_getSlotCount(header);
-    iterator->currentObjectSlots = (crankvm_oop_t*)&header[1];
-    iterator->currentObjectSlotCount = slotCount;
-    iterator->currentObjectEnd += slotCount * sizeof(crankvm_oop_t);
-    if(slotCount == 0) // For forwarding pointer
-        iterator->currentObjectEnd += sizeof(crankvm_oop_t);
+    // Leave the forwarding pointer in the first slot.
+    crankvm_object_header_setClassIndex(object, CRANKVM_CLASS_INDEX_PUN_FORWARDED);
+    ((crankvm_oop_t*)&object[1])[0] = (crankvm_oop_t)newObject;
+    return (crankvm_oop_t)newObject;
 }
 
-crankvm_object_header_t *
-crankvm_heap_objectPointerAfter(crankvm_heap_t *heap, crankvm_object_header_t *object)
+/**
+ * Scavenges a single reference. Returns true if the reference is still into the new space.
+ */
+static bool
+crankvm_heap_scavengeReference(crankvm_heap_t *heap, crankvm_oop_t *reference)
 {
-    size_t objectSize = sizeof(crankvm_object_header_t);
-    size_t slotCount = crankvm_object_header_getSlotCount(object);
-    if(slotCount == 0)
-        slotCount = 1;
-    objectSize += slotCount * sizeof(crankvm_oop_t);
-
-    crankvm_object_header_t *nextObject = (crankvm_object_header_t *) (((uint8_t*)object) + objectSize);
-    if(crankvm_object_header_getRawSlotCount(nextObject) == 255)
-        ++nextObject;
-    return nextObject;
+    crankvm_heap_new_space_t *newSpace = &heap->newSpace;
+    crankvm_oop_t oop = *reference;
+    if(!crankvm_oop_isPointer(oop) || !crankvm_heap_isYoung(heap, oop))
+        return false;
+
+    // Is this already a survivor of this scavenge?
+    if(oop - (crankvm_oop_t)newSpace->futureSpaceStart < newSpace->survivorSpaceSize)
+        return true;
+
+    crankvm_object_header_t *object = (crankvm_object_header_t*)oop;
+    if(crankvm_object_header_getClassIndex(object) == CRANKVM_CLASS_INDEX_PUN_FORWARDED)
+        oop = ((crankvm_oop_t*)&object[1])[0];
+    else
+        oop = crankvm_heap_copyAndForward(heap, object);
+
+    *reference = oop;
+    return crankvm_heap_isYoung(heap, oop);
 }
 
-static crankvm_error_t
-crankvm_heap_loadClassTable(crankvm_context_t *context)
+/**
+ * Gets the slots of an object that hold object references.
+ */
+static crankvm_oop_t *
+crankvm_heap_getReferenceSlots(crankvm_context_t *context, crankvm_object_header_t *object, size_t *referenceCount)
 {
-    crankvm_HiddenRoots_t *hiddenRoots = context->roots.hiddenRootsObject;
-    context->numberOfClassTablePages = CRANK_VM_CLASS_TABLE_ROOT_COUNT;
-    context->roots.firstClassTablePage = hiddenRoots->classTablePages[0];
-    if(crankvm_object_isNil(context, context->roots.firstClassTablePage))
-        return CRANK_VM_ERROR_INVALID_PARAMETER;
+    crankvm_object_format_t format = crankvm_object_header_getObjectFormat(object);
+    size_t slotCount = crankvm_object_header_getSlotCount(object);
+    crankvm_oop_t *slots = (crankvm_oop_t*)&object[1];
 
-    // Check the class table.
-    for(size_t i = 1; i < context->numberOfClassTablePages; ++i)
+    if(format < CRANK_VM_OBJECT_FORMAT_INDEXABLE_64)
     {
-        if(crankvm_object_isNil(context, hiddenRoots->classTablePages[i]))
-        {
-            context->numberOfClassTablePages = i;
-            context->nextClassTableIndex = i;
-        }
+        *referenceCount = slotCount;
+        return slots;
     }
+    else if(format >= CRANK_VM_OBJECT_FORMAT_COMPILED_METHOD)
+    {
+        // Skip the method header, and scan the literals.
+        size_t numberOfLiterals = crankvm_CompiledCode_getNumberOfLiterals(context, (crankvm_CompiledCode_t*)object);
+        if(numberOfLiterals >= slotCount)
+            numberOfLiterals = slotCount ? slotCount - 1 : 0;
 
-    // There are not unused pages, so start wit the second one.
-    context->nextClassTableIndex = 1;
-    return CRANK_VM_OK;
+        *referenceCount = numberOfLiterals;
+        return slots + 1;
+    }
+
+    *referenceCount = 0;
+    return slots;
 }
 
-crankvm_error_t
-crankvm_heap_loadImageContent(crankvm_context_t *context, crankvm_read_memory_stream_t *stream, crankvm_image_header_t *header)
+/**
+ * Scavenges the references of an object. Returns true if the object still refers into the new space.
+ */
+static bool
+crankvm_heap_scavengeObjectSlots(crankvm_context_t *context, crankvm_object_header_t *object)
 {
     crankvm_heap_t *heap = &context->heap;
+    size_t referenceCount;
+    crankvm_oop_t *references = crankvm_heap_getReferenceSlots(context, object, &referenceCount);
+    bool hasYoungReferences = false;
 
-    // Make sure the heap has the required capacity for the image.
-    size_t initialHeapSize = crankvm_heap_roundUpHeapSize(header->imageBytes + header->extraVMMemory);
-    if(initialHeapSize > heap->maxCapacity)
-        return CRANK_VM_ERROR_OUT_OF_MEMORY;
+    for(size_t i = 0; i < referenceCount; ++i)
+        hasYoungReferences |= crankvm_heap_scavengeReference(heap, &references[i]);
 
-    // Initialize the heap.
-    crankvm_error_t error = crankvm_heap_initializeFor(heap, initialHeapSize);
-    if(error)
-        return error;
+    return hasYoungReferences;
+}
 
-    // Load the image segments.
-    crankvm_heap_segment_t *targetSegment = &heap->firstSegment;
-    size_t nextSegmentSize = header->firstSegmentSize;
-    uintptr_t oldBaseAddress = header->startOfMemory;
+#define CRANK_VM_HEAP_CONTEXT_ROOT_COUNT 9
 
-    do
+static void
+crankvm_heap_getContextRoots(crankvm_context_t *context, crankvm_oop_t **roots)
+{
+    roots[0] = (crankvm_oop_t*)&context->roots.specialObjectsArray;
+    roots[1] = &context->roots.nilOop;
+    roots[2] = &context->roots.falseOop;
+    roots[3] = &context->roots.trueOop;
+    roots[4] = &context->roots.byteSymbolClassOop;
+    roots[5] = &context->roots.freeListObject;
+    roots[6] = (crankvm_oop_t*)&context->roots.hiddenRootsObject;
+    roots[7] = (crankvm_oop_t*)&context->roots.firstClassTablePage;
+    roots[8] = (crankvm_oop_t*)&context->roots.externalSemaphores;
+}
+
+static void
+crankvm_heap_scavengeContextRoots(crankvm_context_t *context)
+{
+    crankvm_oop_t *contextRoots[CRANK_VM_HEAP_CONTEXT_ROOT_COUNT];
+    crankvm_heap_getContextRoots(context, contextRoots);
+    for(size_t i = 0; i < CRANK_VM_HEAP_CONTEXT_ROOT_COUNT; ++i)
+        crankvm_heap_scavengeReference(&context->heap, contextRoots[i]);
+}
+
+/**
+ * The frames of the stack zone are not heap objects, but all their slots are roots.
+ */
+static void
+crankvm_heap_scavengeStackZone(crankvm_context_t *context)
+{
+    crankvm_stack_zone_t *zone = &context->stackZone;
+    for(crankvm_object_header_t *frame = (crankvm_object_header_t*)zone->start; (uint8_t*)frame < zone->top; frame = crankvm_stack_zone_frameEnd(frame))
+        crankvm_heap_scavengeObjectSlots(context, frame);
+}
+
+void
+crankvm_heap_scavenge(crankvm_context_t *context, size_t rootCount, crankvm_oop_t **roots)
+{
+    crankvm_heap_t *heap = &context->heap;
+    crankvm_heap_new_space_t *newSpace = &heap->newSpace;
+    if(!newSpace->address)
+        return;
+
+    uint64_t startTime = crankvm_heap_getMicroseconds();
+
+    // The lookup caches are not scanned, so drop their references into the new space.
+    // The recycled contexts are not referenced by anything else, so they are dropped as garbage.
+    crankvm_method_cache_flushNewSpaceReferences(context);
+    crankvm_stack_zone_flushContextPool(context);
+
+    // When the past space is almost full, tenure the older half of its objects.
+    size_t pastSpaceUsage = newSpace->pastSpaceFreeStart - newSpace->pastSpaceStart;
+    newSpace->tenuringThreshold = newSpace->pastSpaceStart;
+    if(pastSpaceUsage > newSpace->survivorSpaceSize / 10 * 9)
+        newSpace->tenuringThreshold += pastSpaceUsage / 2;
+
+    newSpace->futureSpaceFreeStart = newSpace->futureSpaceStart;
+
+    // Scavenge the roots.
+    for(size_t i = 0; i < rootCount; ++i)
+        crankvm_heap_scavengeReference(heap, roots[i]);
+    crankvm_heap_scavengeContextRoots(context);
+    crankvm_heap_scavengeStackZone(context);
+
+    // Scavenge the remembered set, keeping only the objects that still refer into the new space.
+    crankvm_heap_object_stack_t *rememberedSet = &newSpace->rememberedSet;
+    size_t rememberedCount = 0;
+    for(size_t i = 0; i < rememberedSet->size; ++i)
+    {
+        crankvm_object_header_t *object = rememberedSet->elements[i];
+        if(crankvm_heap_scavengeObjectSlots(context, object))
+            rememberedSet->elements[rememberedCount++] = object;
+        else
+            crankvm_object_header_setIsRemembered(object, 0);
+    }
+    rememberedSet->size = rememberedCount;
+
+    // Scan the copied objects, until there are not more objects to copy.
+    uint8_t *scanPointer = newSpace->futureSpaceStart;
+    crankvm_heap_object_stack_t *promotedStack = &newSpace->promotedStack;
+    while(scanPointer < newSpace->futureSpaceFreeStart || promotedStack->size > 0)
+    {
+        while(scanPointer < newSpace->futureSpaceFreeStart)
+        {
+            crankvm_object_header_t *object = (crankvm_object_header_t*)scanPointer;
+            if(crankvm_object_header_getRawSlotCount(object) == 255)
+                ++object;
+
+            crankvm_heap_scavengeObjectSlots(context, object);
+            scanPointer = crankvm_heap_objectEnd(object);
+        }
+
+        while(promotedStack->size > 0)
+        {
+            crankvm_object_header_t *object = promotedStack->elements[--promotedStack->size];
+            if(crankvm_heap_scavengeObjectSlots(context, object))
+                crankvm_heap_remember(heap, object);
+        }
+    }
+
+    // Swap the survivor spaces, and empty eden.
+    uint8_t *newPastSpaceStart = newSpace->futureSpaceStart;
+    newSpace->futureSpaceStart = newSpace->pastSpaceStart;
+    newSpace->futureSpaceFreeStart = newSpace->futureSpaceStart;
+    newSpace->pastSpaceStart = newPastSpaceStart;
+    newSpace->pastSpaceFreeStart = scanPointer;
+    newSpace->tenuringThreshold = newSpace->pastSpaceStart;
+
+    newSpace->edenFreeStart = newSpace->edenStart;
+
+    // The tenured objects may have requested a full collection.
+    newSpace->scavengeRequested = heap->fullGCRequested;
+
+    ++newSpace->scavengeCount;
+    newSpace->scavengeMicroseconds += crankvm_heap_getMicroseconds() - startTime;
+}
+
+void
+crankvm_heap_requestGarbageCollection(crankvm_heap_t *heap, bool fullGC)
+{
+    if(fullGC)
+        heap->fullGCRequested = true;
+
+    // The interpreter only checks this flag at its safe points.
+    heap->newSpace.scavengeRequested = true;
+}
+
+size_t
+crankvm_heap_getFreeBytes(crankvm_heap_t *heap)
+{
+    if(!heap->segmentCount)
+        return 0;
+
+    crankvm_heap_segment_t *segment = &heap->segments[heap->segmentCount - 1];
+    return heap->freeLists.freeBytes + (segment->addressSpaceCapacity - segment->size);
+}
+
+static void
+crankvm_heap_setOldSpaceUsage(crankvm_heap_t *heap, size_t usage)
+{
+    size_t growth = usage / CRANK_VM_HEAP_FULL_GC_GROWTH_FRACTION;
+    if(growth < CRANK_VM_HEAP_FULL_GC_MINIMUM_GROWTH)
+        growth = CRANK_VM_HEAP_FULL_GC_MINIMUM_GROWTH;
+
+    heap->oldSpaceUsage = usage;
+    heap->fullGCThreshold = usage + growth;
+}
+
+CRANK_VM_INLINE bool
+crankvm_heap_isSegmentBridge(crankvm_object_header_t *object)
+{
+    return crankvm_object_header_getClassIndex(object) == CRANKVM_CLASS_INDEX_PUN_SEGMENT_BRIDGE;
+}
+
+CRANK_VM_INLINE void
+crankvm_heap_markReference(crankvm_heap_t *heap, crankvm_oop_t oop)
+{
+    if(!crankvm_oop_isPointer(oop) || !crankvm_heap_isOld(heap, oop))
+        return;
+
+    crankvm_object_header_t *object = (crankvm_object_header_t*)oop;
+    if(crankvm_object_header_getIsMarked(object))
+        return;
+
+    crankvm_object_header_setIsMarked(object, 1);
+    crankvm_heap_object_stack_push(&heap->markStack, object);
+}
+
+/**
+ * Marks the old space objects that are reachable from the roots. Returns the size in bytes of the marked objects.
+ */
+static size_t
+crankvm_heap_markReachableObjects(crankvm_context_t *context, size_t rootCount, crankvm_oop_t **roots)
+{
+    crankvm_heap_t *heap = &context->heap;
+    crankvm_oop_t *contextRoots[CRANK_VM_HEAP_CONTEXT_ROOT_COUNT];
+    crankvm_heap_getContextRoots(context, contextRoots);
+
+    for(size_t i = 0; i < rootCount; ++i)
+        crankvm_heap_markReference(heap, *roots[i]);
+    for(size_t i = 0; i < CRANK_VM_HEAP_CONTEXT_ROOT_COUNT; ++i)
+        crankvm_heap_markReference(heap, *contextRoots[i]);
+
+    crankvm_stack_zone_t *zone = &context->stackZone;
+    for(crankvm_object_header_t *frame = (crankvm_object_header_t*)zone->start; (uint8_t*)frame < zone->top; frame = crankvm_stack_zone_frameEnd(frame))
+    {
+        crankvm_oop_t *slots = (crankvm_oop_t*)&frame[1];
+        for(size_t i = 0; i < crankvm_object_header_getSlotCount(frame); ++i)
+            crankvm_heap_markReference(heap, slots[i]);
+    }
+
+    // Use an explicit stack, the object graph can be very deep.
+    crankvm_heap_object_stack_t *markStack = &heap->markStack;
+    size_t markedBytes = 0;
+    while(markStack->size > 0)
+    {
+        crankvm_object_header_t *object = markStack->elements[--markStack->size];
+        markedBytes += crankvm_heap_objectEnd(object) - crankvm_heap_objectStart(object);
+
+        size_t referenceCount;
+        crankvm_oop_t *references = crankvm_heap_getReferenceSlots(context, object, &referenceCount);
+        for(size_t i = 0; i < referenceCount; ++i)
+            crankvm_heap_markReference(heap, references[i]);
+    }
+
+    return markedBytes;
+}
+
+/**
+ * Rebuilds the free lists from the unmarked objects, and clears the mark bits.
+ */
+static void
+crankvm_heap_sweep(crankvm_heap_t *heap, bool *isSegmentEmpty)
+{
+    memset(&heap->freeLists, 0, sizeof(crankvm_heap_free_lists_t));
+
+    // Coalesce each run of unmarked objects into a single free chunk. The
+    // runs do not cross segments, because the segments end with a bridge.
+    uint8_t *freeRunStart = NULL;
+    crankvm_heap_iterator_t iterator = crankvm_heap_iterator_create(heap);
+    for(; !iterator.atEnd; crankvm_heap_iterator_advance(&iterator))
+    {
+        crankvm_object_header_t *object = iterator.currentHeader;
+        uint8_t *objectStart = iterator.segment->address + iterator.currentObjectStart;
+        if(crankvm_object_header_getIsMarked(object) || crankvm_heap_isSegmentBridge(object))
+        {
+            if(crankvm_object_header_getIsMarked(object))
+                isSegmentEmpty[iterator.segmentIndex] = false;
+
+            crankvm_object_header_setIsMarked(object, 0);
+            if(freeRunStart)
+                crankvm_heap_addFreeChunk(heap, freeRunStart, objectStart - freeRunStart);
+            freeRunStart = NULL;
+        }
+        else if(!freeRunStart)
+        {
+            freeRunStart = objectStart;
+        }
+    }
+
+    // A trailing free run of the last segment is given back to the bump allocator.
+    if(freeRunStart)
+    {
+        crankvm_heap_segment_t *lastSegment = &heap->segments[heap->segmentCount - 1];
+        lastSegment->size = freeRunStart - lastSegment->address;
+    }
+}
+
+static void
+crankvm_heap_rebuildFreeLists(crankvm_heap_t *heap)
+{
+    memset(&heap->freeLists, 0, sizeof(crankvm_heap_free_lists_t));
+
+    crankvm_heap_iterator_t iterator = crankvm_heap_iterator_create(heap);
+    for(; !iterator.atEnd; crankvm_heap_iterator_advance(&iterator))
+    {
+        if(crankvm_object_header_getClassIndex(iterator.currentHeader) == CRANKVM_CLASS_INDEX_PUN_FREE_OBJECT)
+            crankvm_heap_addFreeChunk(heap, iterator.segment->address + iterator.currentObjectStart, iterator.currentObjectEnd - iterator.currentObjectStart);
+    }
+}
+
+static void
+crankvm_heap_releaseEmptySegments(crankvm_heap_t *heap, bool *isSegmentEmpty)
+{
+    // The first segment contains the image, so it is never released.
+    bool hasReleasedSegments = false;
+    for(size_t i = heap->segmentCount - 1; i > 0; --i)
+    {
+        if(isSegmentEmpty[i])
+        {
+            crankvm_heap_releaseSegment(heap, i);
+            hasReleasedSegments = true;
+        }
+    }
+
+    // Forget the free chunks of the released segments.
+    if(hasReleasedSegments)
+        crankvm_heap_rebuildFreeLists(heap);
+}
+
+static void
+crankvm_heap_forwarding_table_add(crankvm_heap_forwarding_table_t *table, crankvm_object_header_t *oldObject, crankvm_object_header_t *newObject)
+{
+    if(table->size >= table->capacity)
+    {
+        size_t newCapacity = table->capacity * 2;
+        if(newCapacity == 0)
+            newCapacity = 1024;
+
+        crankvm_heap_forwarding_entry_t *newEntries = realloc(table->entries, newCapacity*sizeof(crankvm_heap_forwarding_entry_t));
+        if(!newEntries)
+        {
+            fprintf(stderr, "Out of memory for the compactor forwarding table.\n");
+            abort();
+        }
+
+        table->entries = newEntries;
+        table->capacity = newCapacity;
+    }
+
+    crankvm_heap_forwarding_entry_t *entry = &table->entries[table->size++];
+    entry->oldObject = oldObject;
+    entry->newObject = newObject;
+}
+
+static void
+crankvm_heap_forwarding_table_destroy(crankvm_heap_forwarding_table_t *table)
+{
+    free(table->entries);
+    memset(table, 0, sizeof(crankvm_heap_forwarding_table_t));
+}
+
+static crankvm_oop_t
+crankvm_heap_forwarding_table_lookup(crankvm_heap_forwarding_table_t *table, crankvm_oop_t oop)
+{
+    size_t lower = 0;
+    size_t upper = table->size;
+    while(lower < upper)
+    {
+        size_t middle = lower + (upper - lower) / 2;
+        crankvm_oop_t oldObject = (crankvm_oop_t)table->entries[middle].oldObject;
+        if(oldObject == oop)
+            return (crankvm_oop_t)table->entries[middle].newObject;
+        else if(oldObject < oop)
+            lower = middle + 1;
+        else
+            upper = middle;
+    }
+
+    // This object is not moved.
+    return oop;
+}
+
+static int
+crankvm_heap_forwarding_entry_compare(const void *first, const void *second)
+{
+    uintptr_t firstAddress = (uintptr_t)((const crankvm_heap_forwarding_entry_t*)first)->oldObject;
+    uintptr_t secondAddress = (uintptr_t)((const crankvm_heap_forwarding_entry_t*)second)->oldObject;
+    return firstAddress < secondAddress ? -1 : (firstAddress > secondAddress ? 1 : 0);
+}
+
+CRANK_VM_INLINE void
+crankvm_heap_updateMovedReference(crankvm_heap_t *heap, crankvm_heap_forwarding_table_t *table, crankvm_oop_t *reference)
+{
+    if(crankvm_oop_isPointer(*reference) && crankvm_heap_isOld(heap, *reference))
+        *reference = crankvm_heap_forwarding_table_lookup(table, *reference);
+}
+
+/**
+ * Slides the marked objects towards the start of their segment. Pinned
+ * objects and segment bridges are not moved, and the gaps before them
+ * become free chunks.
+ */
+static void
+crankvm_heap_compact(crankvm_context_t *context, size_t rootCount, crankvm_oop_t **roots, bool *isSegmentEmpty)
+{
+    crankvm_heap_t *heap = &context->heap;
+
+    // The gaps are recorded with the same layout, as start and end addresses.
+    crankvm_heap_forwarding_table_t forwardingTable;
+    crankvm_heap_forwarding_table_t gaps;
+    memset(&forwardingTable, 0, sizeof(forwardingTable));
+    memset(&gaps, 0, sizeof(gaps));
+
+    // Compute the new address of the objects.
+    uint8_t *freePointers[CRANK_VM_HEAP_MAX_SEGMENT_COUNT];
+    for(size_t i = 0; i < heap->segmentCount; ++i)
+        freePointers[i] = heap->segments[i].address;
+
+    crankvm_heap_iterator_t iterator = crankvm_heap_iterator_create(heap);
+    for(; !iterator.atEnd; crankvm_heap_iterator_advance(&iterator))
+    {
+        crankvm_object_header_t *object = iterator.currentHeader;
+        uint8_t *objectStart = iterator.segment->address + iterator.currentObjectStart;
+        uint8_t *objectEnd = iterator.segment->address + iterator.currentObjectEnd;
+        uint8_t **freePointer = &freePointers[iterator.segmentIndex];
+        bool isMarked = crankvm_object_header_getIsMarked(object);
+        if(isMarked)
+            isSegmentEmpty[iterator.segmentIndex] = false;
+
+        if(crankvm_heap_isSegmentBridge(object) || (isMarked && crankvm_object_header_getIsPinned(object)))
+        {
+            if(*freePointer != objectStart)
+                crankvm_heap_forwarding_table_add(&gaps, (crankvm_object_header_t*)*freePointer, (crankvm_object_header_t*)objectStart);
+            *freePointer = objectEnd;
+        }
+        else if(isMarked)
+        {
+            if(*freePointer != objectStart)
+                crankvm_heap_forwarding_table_add(&forwardingTable, object, (crankvm_object_header_t*)(*freePointer + ((uint8_t*)object - objectStart)));
+            *freePointer += objectEnd - objectStart;
+        }
+    }
+
+    // The segments are not sorted by address, but the binary search requires sorted entries.
+    qsort(forwardingTable.entries, forwardingTable.size, sizeof(crankvm_heap_forwarding_entry_t), crankvm_heap_forwarding_entry_compare);
+
+    // Update the references to the moved objects.
+    crankvm_oop_t *contextRoots[CRANK_VM_HEAP_CONTEXT_ROOT_COUNT];
+    crankvm_heap_getContextRoots(context, contextRoots);
+    for(size_t i = 0; i < rootCount; ++i)
+        crankvm_heap_updateMovedReference(heap, &forwardingTable, roots[i]);
+    for(size_t i = 0; i < CRANK_VM_HEAP_CONTEXT_ROOT_COUNT; ++i)
+        crankvm_heap_updateMovedReference(heap, &forwardingTable, contextRoots[i]);
+
+    crankvm_stack_zone_t *zone = &context->stackZone;
+    for(crankvm_object_header_t *frame = (crankvm_object_header_t*)zone->start; (uint8_t*)frame < zone->top; frame = crankvm_stack_zone_frameEnd(frame))
+    {
+        crankvm_oop_t *slots = (crankvm_oop_t*)&frame[1];
+        for(size_t i = 0; i < crankvm_object_header_getSlotCount(frame); ++i)
+            crankvm_heap_updateMovedReference(heap, &forwardingTable, &slots[i]);
+    }
+
+    iterator = crankvm_heap_iterator_create(heap);
+    for(; !iterator.atEnd; crankvm_heap_iterator_advance(&iterator))
+    {
+        crankvm_object_header_t *object = iterator.currentHeader;
+        if(!crankvm_object_header_getIsMarked(object))
+            continue;
+
+        crankvm_object_header_setIsMarked(object, 0);
+        size_t referenceCount;
+        crankvm_oop_t *references = crankvm_heap_getReferenceSlots(context, object, &referenceCount);
+        for(size_t i = 0; i < referenceCount; ++i)
+            crankvm_heap_updateMovedReference(heap, &forwardingTable, &references[i]);
+    }
+
+    // Move the objects. They are only moved downwards within their segment, so this is done in address order.
+    for(size_t i = 0; i < forwardingTable.size; ++i)
+    {
+        crankvm_heap_forwarding_entry_t *entry = &forwardingTable.entries[i];
+        size_t headerSize = crankvm_heap_objectHeaderSize(entry->oldObject);
+        uint8_t *oldObjectStart = (uint8_t*)&entry->oldObject[1] - headerSize;
+        size_t objectSize = crankvm_heap_objectEnd(entry->oldObject) - oldObjectStart;
+        memmove((uint8_t*)&entry->newObject[1] - headerSize, oldObjectStart, objectSize);
+    }
+
+    // Rebuild the free lists from the gaps.
+    memset(&heap->freeLists, 0, sizeof(crankvm_heap_free_lists_t));
+    for(size_t i = 0; i < gaps.size; ++i)
+    {
+        crankvm_heap_forwarding_entry_t *gap = &gaps.entries[i];
+        crankvm_heap_addFreeChunk(heap, (uint8_t*)gap->oldObject, (uint8_t*)gap->newObject - (uint8_t*)gap->oldObject);
+    }
+
+    for(size_t i = 0; i < heap->segmentCount; ++i)
+        heap->segments[i].size = freePointers[i] - heap->segments[i].address;
+
+    crankvm_heap_forwarding_table_destroy(&forwardingTable);
+    crankvm_heap_forwarding_table_destroy(&gaps);
+    ++heap->compactionCount;
+}
+
+void
+crankvm_heap_fullGarbageCollect(crankvm_context_t *context, size_t rootCount, crankvm_oop_t **roots)
+{
+    crankvm_heap_t *heap = &context->heap;
+    uint64_t startTime = crankvm_heap_getMicroseconds();
+
+    // The sweep and the compaction touch every page of the old space, so the
+    // pages that are still protected are swizzled up front.
+    crankvm_heap_endLazySwizzling(heap);
+
+    // Tenure all of the new space, so that only the old space has to be traced.
+    heap->newSpace.tenureAll = true;
+    crankvm_heap_scavenge(context, rootCount, roots);
+    heap->newSpace.tenureAll = false;
+    assert(heap->newSpace.rememberedSet.size == 0);
+
+    size_t liveBytes = crankvm_heap_markReachableObjects(context, rootCount, roots);
+
+    bool isSegmentEmpty[CRANK_VM_HEAP_MAX_SEGMENT_COUNT];
+    for(size_t i = 0; i < heap->segmentCount; ++i)
+        isSegmentEmpty[i] = true;
+
+    // Compact a fragmented old space, otherwise just rebuild the free lists.
+    size_t oldSpaceSize = crankvm_heap_getOldSpaceSize(heap);
+    size_t freeBytes = oldSpaceSize - liveBytes;
+    if(heap->compactionEnabled && freeBytes > oldSpaceSize / CRANK_VM_HEAP_COMPACTION_FREE_SPACE_FRACTION)
+        crankvm_heap_compact(context, rootCount, roots, isSegmentEmpty);
+    else
+        crankvm_heap_sweep(heap, isSegmentEmpty);
+    crankvm_heap_releaseEmptySegments(heap, isSegmentEmpty);
+
+    // The lookup caches are not roots, and they may refer to freed or moved objects.
+    crankvm_method_cache_flush(context);
+
+    crankvm_heap_setOldSpaceUsage(heap, liveBytes);
+    heap->fullGCRequested = false;
+    heap->newSpace.scavengeRequested = false;
+
+    ++heap->fullGCCount;
+    heap->fullGCMicroseconds += crankvm_heap_getMicroseconds() - startTime;
+}
+
+crankvm_spur_segment_info_t *
+crankvm_heap_allocateSegmentInfo(crankvm_heap_t *heap)
+{
+    if(heap->segmentInfoSize >= heap->segmentInfoCapacity)
+    {
+        heap->segmentInfoCapacity *= 2;
+        if(heap->segmentInfoCapacity == 0)
+            heap->segmentInfoCapacity = 16;
+
+        crankvm_spur_segment_info_t * newInfos = realloc(heap->segmentInfos, heap->segmentInfoCapacity*sizeof(crankvm_spur_segment_info_t));
+        if(!newInfos)
+            return NULL;
+        heap->segmentInfos = newInfos;
+    }
+
+    crankvm_spur_segment_info_t *result = &heap->segmentInfos[heap->segmentInfoSize++];
+    memset(result, 0, sizeof(crankvm_spur_segment_info_t));
+    return result;
+}
+
+/**
+ * Relocates a pointer of the saved image. The swizzle depends on the segment of the referenced object.
+ */
+static crankvm_oop_t
+crankvm_heap_swizzleOop(crankvm_heap_t *heap, crankvm_oop_t oop)
+{
+    for(size_t i = heap->segmentInfoSize; i > 0; --i)
+    {
+        crankvm_spur_segment_info_t *segmentInfo = &heap->segmentInfos[i - 1];
+        if(oop >= (uintptr_t)segmentInfo->startAddress - segmentInfo->swizzle)
+            return oop + segmentInfo->swizzle;
+    }
+
+    return oop;
+}
+
+crankvm_heap_iterator_t
+crankvm_heap_iterator_create(crankvm_heap_t *heap)
+{
+    crankvm_heap_iterator_t iterator;
+    memset(&iterator, 0, sizeof(iterator));
+
+    iterator.heap = heap;
+    iterator.segment = &heap->segments[0];
+    iterator.segmentIndex = 0;
+    if(heap->segmentCount == 0)
+    {
+        iterator.atEnd = 1;
+        return iterator;
+    }
+
+    crankvm_heap_iterator_advance(&iterator);
+
+    return iterator;
+}
+
+void
+crankvm_heap_iterator_advance(crankvm_heap_iterator_t *iterator)
+{
+    if(iterator->atEnd)
+        return;
+
+    // Cross into the next segment that has objects.
+    while(iterator->currentObjectEnd + sizeof(crankvm_object_header_t) >= iterator->segment->size)
+    {
+        if(iterator->segmentIndex + 1 >= iterator->heap->segmentCount)
+        {
+            iterator->atEnd = 1;
+            return;
+        }
+
+        iterator->segment = &iterator->heap->segments[++iterator->segmentIndex];
+        iterator->currentObjectEnd = 0;
+    }
+
+    iterator->currentObjectStart = iterator->currentObjectEnd;
+
+    crankvm_object_header_t *header = (crankvm_object_header_t *)(iterator->segment->address + iterator->currentObjectEnd);
+    iterator->currentObjectEnd += sizeof(crankvm_object_header_t);
+    if(crankvm_object_header_getRawSlotCount(header) == 255)
+    {
+        // This is an extension header
+        assert(iterator->currentObjectEnd + sizeof(crankvm_object_header_t) <= iterator->segment->size);
+        iterator->currentObjectEnd += sizeof(crankvm_object_header_t);
+        ++header;
+    }
+
+    // We found the header.
+    iterator->currentHeader = header;
+
+    size_t slotCount = crankvm_object_header_getSlotCount(header);
+    iterator->currentObjectSlots = (crankvm_oop_t*)&header[1];
+    iterator->currentObjectSlotCount = slotCount;
+    iterator->currentObjectEnd += slotCount * sizeof(crankvm_oop_t);
+    if(slotCount == 0) // For forwarding pointer
+        iterator->currentObjectEnd += sizeof(crankvm_oop_t);
+}
+
+crankvm_object_header_t *
+crankvm_heap_objectPointerAfter(crankvm_heap_t *heap, crankvm_object_header_t *object)
+{
+    size_t objectSize = sizeof(crankvm_object_header_t);
+    size_t slotCount = crankvm_object_header_getSlotCount(object);
+    if(slotCount == 0)
+        slotCount = 1;
+    objectSize += slotCount * sizeof(crankvm_oop_t);
+
+    crankvm_object_header_t *nextObject = (crankvm_object_header_t *) (((uint8_t*)object) + objectSize);
+    if(crankvm_object_header_getRawSlotCount(nextObject) == 255)
+        ++nextObject;
+    return nextObject;
+}
+
+/**
+ * The work shared by the swizzling threads. The chunk boundaries are object
+ * starts in the first segment, where the image segments are loaded.
+ */
+typedef struct crankvm_heap_swizzle_work_s
+{
+    crankvm_context_t *context;
+    uint8_t **chunkBoundaries;
+    size_t chunkCount;
+    atomic_size_t nextChunk;
+} crankvm_heap_swizzle_work_t;
+
+static void
+crankvm_heap_swizzleObject(crankvm_context_t *context, crankvm_object_header_t *object)
+{
+    size_t referenceCount;
+    crankvm_oop_t *references = crankvm_heap_getReferenceSlots(context, object, &referenceCount);
+    for(size_t i = 0; i < referenceCount; ++i)
+    {
+        if(crankvm_oop_isPointer(references[i]))
+            references[i] = crankvm_heap_swizzleOop(&context->heap, references[i]);
+    }
+}
+
+static void *
+crankvm_heap_swizzleChunks(void *argument)
+{
+    crankvm_heap_swizzle_work_t *work = argument;
+    size_t chunkIndex;
+    while((chunkIndex = atomic_fetch_add_explicit(&work->nextChunk, 1, memory_order_relaxed)) < work->chunkCount)
+    {
+        uint8_t *position = work->chunkBoundaries[chunkIndex];
+        uint8_t *chunkEnd = work->chunkBoundaries[chunkIndex + 1];
+        while(position < chunkEnd)
+        {
+            crankvm_object_header_t *object = (crankvm_object_header_t *)position;
+            if(crankvm_object_header_getRawSlotCount(object) == 255)
+                ++object;
+
+            crankvm_heap_swizzleObject(work->context, object);
+            position = crankvm_heap_objectEnd(object);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Finds the object boundaries that split a range of objects into chunks of
+ * similar size. Only the object headers are read. The boundaries array
+ * needs room for maxChunkCount + 1 entries, and it ends with the range end.
+ */
+static size_t
+crankvm_heap_findChunkBoundaries(uint8_t *start, uint8_t *end, uint8_t **boundaries, size_t maxChunkCount)
+{
+    uint8_t *position = start;
+    uint8_t *nextBoundary = position;
+    size_t chunkCount = 0;
+    while(position < end)
+    {
+        if(position >= nextBoundary && chunkCount < maxChunkCount)
+        {
+            boundaries[chunkCount++] = position;
+            nextBoundary = position + CRANK_VM_HEAP_SWIZZLE_CHUNK_SIZE;
+        }
+
+        crankvm_object_header_t *object = (crankvm_object_header_t *)position;
+        if(crankvm_object_header_getRawSlotCount(object) == 255)
+            ++object;
+        position = crankvm_heap_objectEnd(object);
+    }
+    assert(position == end);
+
+    boundaries[chunkCount] = end;
+    return chunkCount;
+}
+
+static crankvm_error_t
+crankvm_heap_prescanSwizzleChunks(crankvm_heap_t *heap, crankvm_heap_swizzle_work_t *work)
+{
+    crankvm_heap_segment_t *segment = &heap->segments[0];
+    size_t maxChunkCount = segment->size / CRANK_VM_HEAP_SWIZZLE_CHUNK_SIZE + 1;
+    work->chunkBoundaries = malloc((maxChunkCount + 1) * sizeof(uint8_t*));
+    if(!work->chunkBoundaries)
+        return CRANK_VM_ERROR_OUT_OF_MEMORY;
+
+    work->chunkCount = crankvm_heap_findChunkBoundaries(segment->address, segment->address + segment->size, work->chunkBoundaries, maxChunkCount);
+    return CRANK_VM_OK;
+}
+
+static size_t
+crankvm_heap_getSwizzleThreadCount(crankvm_heap_t *heap, size_t chunkCount)
+{
+    size_t threadCount = heap->loadThreadCount;
+    if(!threadCount)
+    {
+        long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = processorCount > 0 ? processorCount : 1;
+    }
+
+    if(threadCount > CRANK_VM_HEAP_MAX_SWIZZLE_THREAD_COUNT)
+        threadCount = CRANK_VM_HEAP_MAX_SWIZZLE_THREAD_COUNT;
+    if(threadCount > chunkCount)
+        threadCount = chunkCount;
+    return threadCount ? threadCount : 1;
+}
+
+/**
+ * Runs a chunk worker in a pool of threads, with the calling thread taking
+ * part. The workers take the chunks from a shared counter. Returns the
+ * number of threads that were used.
+ */
+static size_t
+crankvm_heap_runChunkWorkers(crankvm_heap_t *heap, size_t chunkCount, void *(*worker)(void *), void *work)
+{
+    pthread_t threads[CRANK_VM_HEAP_MAX_SWIZZLE_THREAD_COUNT];
+    size_t threadCount = crankvm_heap_getSwizzleThreadCount(heap, chunkCount);
+    size_t startedThreadCount = 0;
+    for(size_t i = 1; i < threadCount; ++i)
+    {
+        // The remaining chunks are taken by the started threads.
+        if(pthread_create(&threads[startedThreadCount], NULL, worker, work))
+            break;
+        ++startedThreadCount;
+    }
+
+    worker(work);
+    for(size_t i = 0; i < startedThreadCount; ++i)
+        pthread_join(threads[i], NULL);
+
+    return startedThreadCount + 1;
+}
+
+/**
+ * Applies the swizzle to the pointers of every loaded object. The calling
+ * thread also swizzles, so a single thread is used for small images.
+ */
+static crankvm_error_t
+crankvm_heap_swizzleLoadedObjects(crankvm_context_t *context)
+{
+    crankvm_heap_t *heap = &context->heap;
+    crankvm_heap_load_statistics_t *statistics = &heap->loadStatistics;
+
+    uint64_t startTime = crankvm_heap_getMicroseconds();
+    crankvm_heap_swizzle_work_t work;
+    memset(&work, 0, sizeof(work));
+    work.context = context;
+    atomic_init(&work.nextChunk, 0);
+    crankvm_error_t error = crankvm_heap_prescanSwizzleChunks(heap, &work);
+    if(error)
+        return error;
+
+    uint64_t swizzleStartTime = crankvm_heap_getMicroseconds();
+    statistics->prescanMicroseconds = swizzleStartTime - startTime;
+
+    size_t threadCount = crankvm_heap_runChunkWorkers(heap, work.chunkCount, crankvm_heap_swizzleChunks, &work);
+
+    free(work.chunkBoundaries);
+    statistics->swizzleMicroseconds = crankvm_heap_getMicroseconds() - swizzleStartTime;
+    statistics->swizzleChunkCount = work.chunkCount;
+    statistics->swizzleThreadCount = threadCount;
+    return CRANK_VM_OK;
+}
+
+static bool
+crankvm_heap_isImageBridgeAt(crankvm_heap_t *heap, uint8_t *position)
+{
+    for(size_t i = 0; i < heap->segmentInfoSize; ++i)
+    {
+        crankvm_spur_segment_info_t *segmentInfo = &heap->segmentInfos[i];
+        if(position == segmentInfo->startAddress + segmentInfo->size - CRANK_VM_HEAP_BRIDGE_SIZE)
+            return true;
+    }
+
+    return false;
+}
+
+CRANK_VM_INLINE uint8_t *
+crankvm_heap_lazySwizzle_sourceOf(crankvm_heap_lazy_swizzle_t *lazySwizzle, void *pointer)
+{
+    return lazySwizzle->sourceView + ((uint8_t*)pointer - lazySwizzle->pagesStart);
+}
+
+CRANK_VM_INLINE uint8_t *
+crankvm_heap_lazySwizzle_heapOf(crankvm_heap_lazy_swizzle_t *lazySwizzle, void *sourcePointer)
+{
+    return lazySwizzle->pagesStart + ((uint8_t*)sourcePointer - lazySwizzle->sourceView);
+}
+
+/**
+ * Gets the header of the image object that starts at a position, as read from the source view.
+ * Returns NULL for the bridges, which were rewritten by the loader.
+ */
+static crankvm_object_header_t *
+crankvm_heap_lazySwizzle_sourceObjectAt(crankvm_heap_lazy_swizzle_t *lazySwizzle, uint8_t *position, uint8_t **objectEnd)
+{
+    crankvm_heap_t *heap = &lazySwizzle->context->heap;
+    if(crankvm_heap_isImageBridgeAt(heap, position))
+    {
+        *objectEnd = position + CRANK_VM_HEAP_BRIDGE_SIZE;
+        return NULL;
+    }
+
+    crankvm_object_header_t *header = (crankvm_object_header_t *)crankvm_heap_lazySwizzle_sourceOf(lazySwizzle, position);
+    if(crankvm_object_header_getRawSlotCount(header) == 255)
+        ++header;
+
+    *objectEnd = crankvm_heap_lazySwizzle_heapOf(lazySwizzle, crankvm_heap_objectEnd(header));
+    return header;
+}
+
+/**
+ * Walks the object headers until the first object of a page is known.
+ */
+static void
+crankvm_heap_lazySwizzle_scanUpToPage(crankvm_heap_lazy_swizzle_t *lazySwizzle, size_t pageIndex)
+{
+    while(lazySwizzle->scannedPageCount <= pageIndex && lazySwizzle->scanPosition < lazySwizzle->objectsEnd)
+    {
+        uint8_t *objectStart = lazySwizzle->scanPosition;
+        uint8_t *objectEnd;
+        crankvm_heap_lazySwizzle_sourceObjectAt(lazySwizzle, objectStart, &objectEnd);
+
+        size_t lastPageIndex = (objectEnd - 1 - lazySwizzle->pagesStart) / lazySwizzle->pageSize;
+        for(; lazySwizzle->scannedPageCount <= lastPageIndex; ++lazySwizzle->scannedPageCount)
+            lazySwizzle->pageFirstObjects[lazySwizzle->scannedPageCount] = objectStart;
+        lazySwizzle->scanPosition = objectEnd;
+    }
+}
+
+/**
+ * Swizzles the references that are in an unprotected page.
+ */
+static void
+crankvm_heap_lazySwizzle_swizzlePage(crankvm_heap_lazy_swizzle_t *lazySwizzle, size_t pageIndex)
+{
+    crankvm_context_t *context = lazySwizzle->context;
+    crankvm_oop_t *pageStart = (crankvm_oop_t *)(lazySwizzle->pagesStart + pageIndex*lazySwizzle->pageSize);
+    crankvm_oop_t *pageEnd = (crankvm_oop_t *)((uint8_t*)pageStart + lazySwizzle->pageSize);
+
+    crankvm_heap_lazySwizzle_scanUpToPage(lazySwizzle, pageIndex);
+    uint8_t *position = pageIndex < lazySwizzle->scannedPageCount ? lazySwizzle->pageFirstObjects[pageIndex] : lazySwizzle->objectsEnd;
+    while(position < (uint8_t*)pageEnd && position < lazySwizzle->objectsEnd)
+    {
+        uint8_t *objectEnd;
+        crankvm_object_header_t *sourceHeader = crankvm_heap_lazySwizzle_sourceObjectAt(lazySwizzle, position, &objectEnd);
+        if(sourceHeader)
+        {
+            // Only the references in this page are swizzled.
+            size_t referenceCount;
+            crankvm_oop_t *sourceReferences = crankvm_heap_getReferenceSlots(context, sourceHeader, &referenceCount);
+            crankvm_oop_t *references = (crankvm_oop_t *)crankvm_heap_lazySwizzle_heapOf(lazySwizzle, sourceReferences);
+            crankvm_oop_t *firstReference = references > pageStart ? references : pageStart;
+            crankvm_oop_t *referencesEnd = references + referenceCount < pageEnd ? references + referenceCount : pageEnd;
+            for(crankvm_oop_t *reference = firstReference; reference < referencesEnd; ++reference)
+            {
+                if(crankvm_oop_isPointer(*reference))
+                    *reference = crankvm_heap_swizzleOop(&context->heap, *reference);
+            }
+        }
+
+        position = objectEnd;
+    }
+}
+
+static bool
+crankvm_heap_lazySwizzle_unprotectPage(crankvm_heap_lazy_swizzle_t *lazySwizzle, size_t pageIndex)
+{
+    if(lazySwizzle->swizzledPages[pageIndex])
+        return true;
+
+    if(mprotect(lazySwizzle->pagesStart + pageIndex*lazySwizzle->pageSize, lazySwizzle->pageSize, PROT_READ | PROT_WRITE))
+        return false;
+
+    crankvm_heap_lazySwizzle_swizzlePage(lazySwizzle, pageIndex);
+    lazySwizzle->swizzledPages[pageIndex] = 1;
+    ++lazySwizzle->swizzledPageCount;
+    return true;
+}
+
+static void
+crankvm_heap_lazySwizzle_handleFault(int signalNumber, siginfo_t *signalInfo, void *userContext)
+{
+    crankvm_heap_lazy_swizzle_t *lazySwizzle = crankvm_heap_activeLazySwizzle;
+    uint8_t *address = signalInfo->si_addr;
+    if(lazySwizzle && address >= lazySwizzle->pagesStart &&
+        address < lazySwizzle->pagesStart + lazySwizzle->pageCount*lazySwizzle->pageSize)
+    {
+        // A page that is already swizzled was unprotected by another thread,
+        // so the faulting access is retried.
+        while(atomic_flag_test_and_set_explicit(&lazySwizzle->lock, memory_order_acquire))
+            ;
+        bool handled = crankvm_heap_lazySwizzle_unprotectPage(lazySwizzle, (address - lazySwizzle->pagesStart) / lazySwizzle->pageSize);
+        atomic_flag_clear_explicit(&lazySwizzle->lock, memory_order_release);
+        if(handled)
+            return;
+    }
+
+    // This is not a fault of the lazy swizzling.
+    struct sigaction *previousAction = &crankvm_heap_previousFaultAction;
+    if((previousAction->sa_flags & SA_SIGINFO) && previousAction->sa_sigaction)
+        previousAction->sa_sigaction(signalNumber, signalInfo, userContext);
+    else if(previousAction->sa_handler != SIG_DFL && previousAction->sa_handler != SIG_IGN)
+        previousAction->sa_handler(signalNumber);
+    else
+        signal(SIGSEGV, SIG_DFL); // The faulting access is retried, and it terminates the process.
+}
+
+/**
+ * Protects the pages of an image that was mapped into the first segment, so
+ * they are swizzled when they are first touched. Returns false when lazy
+ * swizzling cannot be used, and the image has to be swizzled eagerly.
+ */
+static bool
+crankvm_heap_beginLazySwizzling(crankvm_context_t *context, int imageFileDescriptor, size_t fileOffset, size_t imageBytes)
+{
+    crankvm_heap_t *heap = &context->heap;
+    crankvm_heap_lazy_swizzle_t *lazySwizzle = &heap->lazySwizzle;
+    crankvm_heap_segment_t *segment = &heap->segments[0];
+    if(crankvm_heap_activeLazySwizzle)
+        return false;
+
+    // The mapping of the image file starts at the reservation of the first segment.
+    memset(lazySwizzle, 0, sizeof(crankvm_heap_lazy_swizzle_t));
+    lazySwizzle->context = context;
+    lazySwizzle->pagesStart = segment->reservationAddress;
+    lazySwizzle->pageSize = sysconf(_SC_PAGESIZE);
+    lazySwizzle->objectsStart = segment->address;
+    lazySwizzle->objectsEnd = segment->address + imageBytes;
+    lazySwizzle->scanPosition = lazySwizzle->objectsStart;
+    lazySwizzle->pageCount = (lazySwizzle->objectsEnd - lazySwizzle->pagesStart + lazySwizzle->pageSize - 1) / lazySwizzle->pageSize;
+    atomic_flag_clear(&lazySwizzle->lock);
+
+    size_t pageOffset = segment->address - segment->reservationAddress;
+    lazySwizzle->sourceView = mmap(NULL, lazySwizzle->pageCount*lazySwizzle->pageSize, PROT_READ, MAP_PRIVATE, imageFileDescriptor, fileOffset - pageOffset);
+    lazySwizzle->pageFirstObjects = malloc(lazySwizzle->pageCount*sizeof(uint8_t*));
+    lazySwizzle->swizzledPages = calloc(lazySwizzle->pageCount, 1);
+    if(lazySwizzle->sourceView == MAP_FAILED || !lazySwizzle->pageFirstObjects || !lazySwizzle->swizzledPages)
+    {
+        if(lazySwizzle->sourceView != MAP_FAILED)
+            munmap(lazySwizzle->sourceView, lazySwizzle->pageCount*lazySwizzle->pageSize);
+        free(lazySwizzle->pageFirstObjects);
+        free(lazySwizzle->swizzledPages);
+        memset(lazySwizzle, 0, sizeof(crankvm_heap_lazy_swizzle_t));
+        return false;
+    }
+
+    struct sigaction faultAction;
+    memset(&faultAction, 0, sizeof(faultAction));
+    faultAction.sa_sigaction = crankvm_heap_lazySwizzle_handleFault;
+    faultAction.sa_flags = SA_SIGINFO;
+    sigemptyset(&faultAction.sa_mask);
+    crankvm_heap_activeLazySwizzle = lazySwizzle;
+    if(sigaction(SIGSEGV, &faultAction, &crankvm_heap_previousFaultAction) ||
+        mprotect(lazySwizzle->pagesStart, lazySwizzle->pageCount*lazySwizzle->pageSize, PROT_NONE))
+    {
+        crankvm_heap_releaseLazySwizzling(heap);
+        return false;
+    }
+
+    return true;
+}
+
+void
+crankvm_heap_endLazySwizzling(crankvm_heap_t *heap)
+{
+    crankvm_heap_lazy_swizzle_t *lazySwizzle = &heap->lazySwizzle;
+    if(crankvm_heap_activeLazySwizzle != lazySwizzle)
+        return;
+
+    // Other threads may still fault on the pages that are being swizzled.
+    while(atomic_flag_test_and_set_explicit(&lazySwizzle->lock, memory_order_acquire))
+        ;
+    for(size_t i = 0; i < lazySwizzle->pageCount; ++i)
+    {
+        if(!crankvm_heap_lazySwizzle_unprotectPage(lazySwizzle, i))
+            abort();
+    }
+    atomic_flag_clear_explicit(&lazySwizzle->lock, memory_order_release);
+
+    crankvm_heap_releaseLazySwizzling(heap);
+}
+
+static crankvm_error_t
+crankvm_heap_loadClassTable(crankvm_context_t *context)
+{
+    crankvm_HiddenRoots_t *hiddenRoots = context->roots.hiddenRootsObject;
+    context->numberOfClassTablePages = CRANK_VM_CLASS_TABLE_ROOT_COUNT;
+    context->roots.firstClassTablePage = hiddenRoots->classTablePages[0];
+    if(crankvm_object_isNil(context, context->roots.firstClassTablePage))
+        return CRANK_VM_ERROR_INVALID_PARAMETER;
+
+    // Check the class table.
+    for(size_t i = 1; i < context->numberOfClassTablePages; ++i)
+    {
+        if(crankvm_object_isNil(context, hiddenRoots->classTablePages[i]))
+        {
+            context->numberOfClassTablePages = i;
+            context->nextClassTableIndex = i;
+        }
+    }
+
+    // There are not unused pages, so start wit the second one.
+    context->nextClassTableIndex = 1;
+    return CRANK_VM_OK;
+}
+
+/**
+ * The compressed chunks of an image, and where they are decompressed.
+ */
+typedef struct crankvm_heap_decompress_work_s
+{
+    const uint8_t *source;
+    size_t *sourceOffsets;
+    uint8_t *destination;
+    size_t destinationSize;
+    size_t chunkSize;
+    size_t chunkCount;
+    atomic_size_t nextChunk;
+    atomic_bool failed;
+} crankvm_heap_decompress_work_t;
+
+static void *
+crankvm_heap_decompressChunks(void *argument)
+{
+    crankvm_heap_decompress_work_t *work = argument;
+    for(size_t chunkIndex = atomic_fetch_add(&work->nextChunk, 1); chunkIndex < work->chunkCount; chunkIndex = atomic_fetch_add(&work->nextChunk, 1))
+    {
+        const uint8_t *source = work->source + work->sourceOffsets[chunkIndex];
+        size_t sourceSize = work->sourceOffsets[chunkIndex + 1] - work->sourceOffsets[chunkIndex];
+        uint8_t *destination = work->destination + chunkIndex * work->chunkSize;
+        size_t destinationSize = work->destinationSize - chunkIndex * work->chunkSize;
+        if(destinationSize > work->chunkSize)
+            destinationSize = work->chunkSize;
+
+        // The chunks that do not compress are stored as is.
+        if(sourceSize == destinationSize)
+            memcpy(destination, source, destinationSize);
+        else if(!crankvm_compression_decompressBlock(source, sourceSize, destination, destinationSize))
+            atomic_store(&work->failed, true);
+    }
+
+    return NULL;
+}
+
+/**
+ * Decompresses the segments of a compressed image into the memory where they
+ * are loaded. The chunks are decompressed in parallel.
+ */
+static crankvm_error_t
+crankvm_heap_decompressImageContent(crankvm_heap_t *heap, crankvm_read_memory_stream_t *stream, size_t imageBytes, uint8_t *destination)
+{
+    crankvm_heap_load_statistics_t *statistics = &heap->loadStatistics;
+    uint64_t startTime = crankvm_heap_getMicroseconds();
+
+    crankvm_heap_decompress_work_t work;
+    memset(&work, 0, sizeof(work));
+    work.destination = destination;
+    work.destinationSize = imageBytes;
+    atomic_init(&work.nextChunk, 0);
+    atomic_init(&work.failed, false);
+
+    // Read the chunk table.
+    if(!crankvm_read_memory_stream_nextWord(stream, &work.chunkSize) ||
+        !crankvm_read_memory_stream_nextWord(stream, &work.chunkCount))
+        return CRANK_VM_ERROR_BAD_IMAGE;
+    if(!work.chunkSize || work.chunkCount != (imageBytes + work.chunkSize - 1) / work.chunkSize ||
+        !crankvm_read_memory_stream_hasNextSize(stream, work.chunkCount * sizeof(uintptr_t)))
+        return CRANK_VM_ERROR_BAD_IMAGE;
+
+    work.sourceOffsets = malloc((work.chunkCount + 1) * sizeof(size_t));
+    if(!work.sourceOffsets)
+        return CRANK_VM_ERROR_OUT_OF_MEMORY;
+
+    work.sourceOffsets[0] = 0;
+    for(size_t i = 0; i < work.chunkCount; ++i)
+    {
+        uintptr_t compressedSize = 0;
+        crankvm_read_memory_stream_nextWord(stream, &compressedSize);
+        work.sourceOffsets[i + 1] = work.sourceOffsets[i] + compressedSize;
+        if(compressedSize > crankvm_compression_compressBound(work.chunkSize) || work.sourceOffsets[i + 1] < work.sourceOffsets[i])
+        {
+            free(work.sourceOffsets);
+            return CRANK_VM_ERROR_BAD_IMAGE;
+        }
+    }
+
+    size_t compressedSize = work.sourceOffsets[work.chunkCount];
+    if(!crankvm_read_memory_stream_hasNextSize(stream, compressedSize))
+    {
+        free(work.sourceOffsets);
+        return CRANK_VM_ERROR_BAD_IMAGE;
+    }
+
+    work.source = stream->data + stream->position;
+    stream->position += compressedSize;
+
+    statistics->decompressChunkCount = work.chunkCount;
+    statistics->decompressThreadCount = crankvm_heap_runChunkWorkers(heap, work.chunkCount, crankvm_heap_decompressChunks, &work);
+    statistics->decompressMicroseconds = crankvm_heap_getMicroseconds() - startTime;
+
+    free(work.sourceOffsets);
+    return atomic_load(&work.failed) ? CRANK_VM_ERROR_BAD_IMAGE : CRANK_VM_OK;
+}
+
+crankvm_error_t
+crankvm_heap_loadImageContent(crankvm_context_t *context, crankvm_read_memory_stream_t *stream, crankvm_image_header_t *header, int imageFileDescriptor)
+{
+    crankvm_heap_t *heap = &context->heap;
+    crankvm_heap_load_statistics_t *statistics = &heap->loadStatistics;
+    memset(statistics, 0, sizeof(crankvm_heap_load_statistics_t));
+    uint64_t startTime = crankvm_heap_getMicroseconds();
+
+    // Make sure the heap has the required capacity for the image.
+    size_t initialHeapSize = crankvm_heap_roundUpHeapSize(header->imageBytes + header->extraVMMemory);
+    if(initialHeapSize > heap->maxCapacity)
+        return CRANK_VM_ERROR_OUT_OF_MEMORY;
+
+    // Initialize the heap.
+    crankvm_error_t error = crankvm_heap_initializeFor(heap, initialHeapSize, header->desiredEdenBytes);
+    if(error)
+        return error;
+
+    // Load the image segments.
+    crankvm_heap_segment_t *targetSegment = &heap->segments[0];
+    size_t nextSegmentSize = header->firstSegmentSize;
+    uintptr_t oldBaseAddress = header->startOfMemory;
+
+    // Map the image segments from the file instead of copying them, when possible.
+    uint8_t *preloadedLimit = NULL;
+    size_t imageFileOffset = stream->position;
+    statistics->compressed = (header->imageHeaderFlags & CRANK_VM_IMAGE_HEADER_FLAG_COMPRESSED) != 0;
+    if(!statistics->compressed && imageFileDescriptor >= 0 && crankvm_read_memory_stream_hasNextSize(stream, header->imageBytes) &&
+        crankvm_heap_segment_mapFile(targetSegment, imageFileDescriptor, imageFileOffset, header->imageBytes))
+        preloadedLimit = targetSegment->address + header->imageBytes;
+    statistics->mapped = preloadedLimit != NULL;
+
+    // Decompress the whole image in place, and then read the segments from it.
+    crankvm_read_memory_stream_t decompressedStream;
+    if(statistics->compressed)
+    {
+        if(!crankvm_heap_segment_allocate(targetSegment, header->imageBytes))
+            return CRANK_VM_ERROR_OUT_OF_MEMORY;
+        targetSegment->size = 0;
+
+        error = crankvm_heap_decompressImageContent(heap, stream, header->imageBytes, targetSegment->address);
+        if(error)
+            return error;
+
+        decompressedStream = crankvm_read_memory_stream_create(targetSegment->address, 0, header->imageBytes);
+        stream = &decompressedStream;
+        preloadedLimit = targetSegment->address + header->imageBytes;
+    }
+
+    do
     {
-        printf("Load segment %zu\n", nextSegmentSize);
         crankvm_spur_segment_info_t *segmentInfo = crankvm_heap_allocateSegmentInfo(heap);
         if(!segmentInfo)
             return CRANK_VM_ERROR_OUT_OF_MEMORY;
@@ -333,72 +1916,49 @@ crankvm_heap_loadImageContent(crankvm_context_t *context, crankvm_read_memory_st
         segmentInfo->size = nextSegmentSize;
         segmentInfo->swizzle = ((uintptr_t)segmentInfo->startAddress) - oldBaseAddress;
 
-        //printf("Read segment of size %zu into %p\n", nextSegmentSize, targetPointer);
-        if(!crankvm_read_memory_stream_nextBytesInto(stream, nextSegmentSize, targetPointer))
+        if(targetPointer + nextSegmentSize <= preloadedLimit)
+        {
+            if(!crankvm_read_memory_stream_skip(stream, nextSegmentSize))
+                return CRANK_VM_ERROR_BAD_IMAGE;
+        }
+        else if(!crankvm_read_memory_stream_nextBytesInto(stream, nextSegmentSize, targetPointer))
+        {
             return CRANK_VM_ERROR_BAD_IMAGE;
+        }
 
+        // The bridge holds the size of the next image segment, and the
+        // distance to it in the memory of the saved image.
         uint64_t *bridge = (uint64_t*)(targetPointer + nextSegmentSize - 8);
         size_t bridgeSpan = 0;
         size_t bridgeSize = *bridge;
-        printf("bridgeSize %zu\n", bridgeSize);
         crankvm_object_header_t *bridgeObject = (crankvm_object_header_t *)bridge;
-        if(crankvm_object_header_getRawSlotCount((crankvm_object_header_t*)(bridge - 1)) == 0)
-        {
-            // Ignore the last element
-            bridgeSpan = 0;
-            //targetSegment->size -= 8;
-            //printf("Last bridguintptr_te %p\n", bridgeObject);
-        }
+        if(crankvm_object_header_getRawSlotCount((crankvm_object_header_t*)(bridge - 1)) != 0)
+            bridgeSpan = crankvm_object_header_getRawSlotOverflowCount(bridgeObject) * sizeof(crankvm_oop_t);
+
+        // The image segments are loaded contiguously. Keep the inner bridges
+        // as single slot objects, and allocate the new objects over the last one.
+        if(bridgeSize)
+            crankvm_heap_initializeBridge(bridgeObject - 1, targetPointer + nextSegmentSize);
         else
-        {
-            bridgeSpan = crankvm_object_header_getRawSlotOverflowCount(bridgeObject);
-            memset(bridgeObject, 0, sizeof(*bridgeObject));
-            crankvm_object_header_setRawSlotOverflowCount(bridgeObject, 0);
-            crankvm_object_header_setRawSlotCount(bridgeObject, 255);
-        }
+            targetSegment->size -= CRANK_VM_HEAP_BRIDGE_SIZE;
 
-        oldBaseAddress += bridgeSpan;
+        oldBaseAddress += nextSegmentSize + bridgeSpan;
         nextSegmentSize = bridgeSize;
-        //printf("Bridge span %zu next %zu\n", bridgeSpan, bridgeSize);
     } while(nextSegmentSize != 0);
 
     // Time to fixup the image segments.
-    crankvm_heap_iterator_t iterator = crankvm_heap_iterator_create(heap);
-    crankvm_spur_segment_info_t *currentSegmentInfo = NULL;
-    crankvm_spur_segment_info_t *nextSegmentInfo = &heap->segmentInfos[0];
-    for(; !iterator.atEnd; crankvm_heap_iterator_advance(&iterator))
+    // A mapped image can be swizzled lazily, when its pages are touched.
+    statistics->readMicroseconds = crankvm_heap_getMicroseconds() - startTime;
+    statistics->lazySwizzling = statistics->mapped && heap->lazySwizzlingEnabled &&
+        crankvm_heap_beginLazySwizzling(context, imageFileDescriptor, imageFileOffset, header->imageBytes);
+    if(!statistics->lazySwizzling)
     {
-        if(iterator.segment->address + iterator.currentObjectStart == nextSegmentInfo->startAddress)
-        {
-            currentSegmentInfo = nextSegmentInfo;
-            ++nextSegmentInfo;
-        }
-
-        // Apply the swizzle to the slots
-        crankvm_object_format_t format = crankvm_oop_getFormat((crankvm_oop_t)iterator.currentHeader);
-        if(format < CRANK_VM_OBJECT_FORMAT_INDEXABLE_64)
-        {
-            for(size_t i = 0; i < iterator.currentObjectSlotCount; ++i)
-            {
-                if(crankvm_oop_isPointer(iterator.currentObjectSlots[i]))
-                    iterator.currentObjectSlots[i] += currentSegmentInfo->swizzle;
-            }
-        }
-        else if(format >= CRANK_VM_OBJECT_FORMAT_COMPILED_METHOD)
-        {
-            crankvm_CompiledCode_t *compiledCode = (crankvm_CompiledCode_t *)iterator.currentHeader;
-            size_t numberOfLiterals = crankvm_CompiledCode_getNumberOfLiterals(context, compiledCode);
-            //printf("Swizzle compiled %p literal count %zu\n", compiledCode, numberOfLiterals);
-            for(size_t i = 0; i < numberOfLiterals; ++i)
-            {
-                if(crankvm_oop_isPointer(compiledCode->literals[i]))
-                    compiledCode->literals[i] += currentSegmentInfo->swizzle;
-            }
-        }
+        error = crankvm_heap_swizzleLoadedObjects(context);
+        if(error)
+            return error;
     }
-    assert(iterator.currentObjectEnd == targetSegment->size);
 
-    context->roots.specialObjectsArray = (crankvm_special_object_array_t*)(header->specialObjectsOop - header->startOfMemory + (uintptr_t)heap->firstSegment.address);
+    context->roots.specialObjectsArray = (crankvm_special_object_array_t*)crankvm_heap_swizzleOop(heap, header->specialObjectsOop);
     // TODO: Validate the special objects array
 
     // Make sure nil, false, and true are in sequencial order.
@@ -408,8 +1968,9 @@ crankvm_heap_loadImageContent(crankvm_context_t *context, crankvm_read_memory_st
 
     // Initialize with nil some other non-mandatory objects.
     context->roots.byteSymbolClassOop = context->roots.nilOop;
+    context->roots.externalSemaphores = (crankvm_Array_t*)context->roots.nilOop;
 
-    if(context->roots.nilOop != (crankvm_oop_t)heap->firstSegment.address)
+    if(context->roots.nilOop != (crankvm_oop_t)heap->segments[0].address)
         return CRANK_VM_ERROR_INVALID_PARAMETER;
     if(context->roots.falseOop != (crankvm_oop_t)crankvm_heap_objectPointerAfter(heap, (crankvm_object_header_t*)context->roots.nilOop))
         return CRANK_VM_ERROR_INVALID_PARAMETER;
@@ -426,13 +1987,256 @@ crankvm_heap_loadImageContent(crankvm_context_t *context, crankvm_read_memory_st
 
     // TODO: Swizzle the object stacks SpurMemoryManager>> #swizzleObjStackAt:
 
-    free(heap->segmentInfos);
-    heap->segmentInfoCapacity = 0;
-    heap->segmentInfoSize = 0;
+    // The lazy swizzling still needs the segment infos.
+    if(!statistics->lazySwizzling)
+    {
+        free(heap->segmentInfos);
+        heap->segmentInfos = NULL;
+        heap->segmentInfoCapacity = 0;
+        heap->segmentInfoSize = 0;
+    }
 
     // Infer some additional classes that are used for debugging purposes.
     context->roots.byteSymbolClassOop = crankvm_object_getClass(context, context->roots.specialObjectsArray->selectorDoesNotUnderstand);
 
+    // The cached lookups of a previous image are no longer valid.
+    crankvm_method_cache_flush(context);
+
+    // The loaded objects are the initial live data of the old space.
+    crankvm_heap_setOldSpaceUsage(heap, crankvm_heap_getOldSpaceSize(heap));
+
+    statistics->totalMicroseconds = crankvm_heap_getMicroseconds() - startTime;
+    return CRANK_VM_OK;
+}
+
+/**
+ * A chunk of the objects of a segment, and its location in the image file.
+ */
+typedef struct crankvm_heap_snapshot_chunk_s
+{
+    uint8_t *start;
+    uint8_t *end;
+    size_t fileOffset;
+
+    // The bridge at the end of the chunk, which is rewritten with the size of the next segment.
+    uint8_t *bridge;
+    size_t nextSegmentSize;
+} crankvm_heap_snapshot_chunk_t;
+
+/**
+ * The work shared by the threads that write the image segments. The
+ * segments are written contiguously, starting at the address of the first one.
+ */
+typedef struct crankvm_heap_snapshot_work_s
+{
+    crankvm_context_t *context;
+    int fileDescriptor;
+    uintptr_t imageAddresses[CRANK_VM_HEAP_MAX_SEGMENT_COUNT];
+    crankvm_heap_snapshot_chunk_t *chunks;
+    size_t chunkCount;
+    atomic_size_t nextChunk;
+    atomic_bool failed;
+} crankvm_heap_snapshot_work_t;
+
+/**
+ * Converts a pointer into its address in the written image.
+ */
+static crankvm_oop_t
+crankvm_heap_unswizzleOop(crankvm_heap_snapshot_work_t *work, crankvm_oop_t oop)
+{
+    crankvm_heap_t *heap = &work->context->heap;
+    for(size_t i = 0; i < heap->segmentCount; ++i)
+    {
+        crankvm_heap_segment_t *segment = &heap->segments[i];
+        if(oop - (crankvm_oop_t)segment->address < segment->size)
+            return oop - (crankvm_oop_t)segment->address + work->imageAddresses[i];
+    }
+
+    return oop;
+}
+
+static bool
+crankvm_heap_writeFully(int fileDescriptor, const uint8_t *data, size_t size, size_t fileOffset)
+{
+    while(size > 0)
+    {
+        ssize_t writtenSize = pwrite(fileDescriptor, data, size, fileOffset);
+        if(writtenSize <= 0)
+            return false;
+
+        data += writtenSize;
+        size -= writtenSize;
+        fileOffset += writtenSize;
+    }
+
+    return true;
+}
+
+/**
+ * Copies each chunk into a page aligned buffer, unswizzles the pointers in
+ * the copy, and writes it at its offset in the image file.
+ */
+static void *
+crankvm_heap_writeSnapshotChunks(void *argument)
+{
+    crankvm_heap_snapshot_work_t *work = argument;
+    crankvm_context_t *context = work->context;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    uint8_t *buffer = NULL;
+    size_t bufferCapacity = 0;
+    size_t chunkIndex;
+    while(!atomic_load_explicit(&work->failed, memory_order_relaxed) &&
+        (chunkIndex = atomic_fetch_add_explicit(&work->nextChunk, 1, memory_order_relaxed)) < work->chunkCount)
+    {
+        crankvm_heap_snapshot_chunk_t *chunk = &work->chunks[chunkIndex];
+        size_t chunkSize = chunk->end - chunk->start;
+        if(chunkSize > bufferCapacity)
+        {
+            free(buffer);
+            bufferCapacity = (chunkSize + pageSize - 1) / pageSize * pageSize;
+            if(posix_memalign((void**)&buffer, pageSize, bufferCapacity))
+            {
+                buffer = NULL;
+                atomic_store(&work->failed, true);
+                break;
+            }
+        }
+
+        memcpy(buffer, chunk->start, chunkSize);
+        for(uint8_t *position = buffer; position < buffer + chunkSize; )
+        {
+            crankvm_object_header_t *object = (crankvm_object_header_t *)position;
+            if(crankvm_object_header_getRawSlotCount(object) == 255)
+                ++object;
+
+            // The remembered set is not saved.
+            crankvm_object_header_setIsRemembered(object, false);
+
+            size_t referenceCount;
+            crankvm_oop_t *references = crankvm_heap_getReferenceSlots(context, object, &referenceCount);
+            for(size_t i = 0; i < referenceCount; ++i)
+            {
+                if(crankvm_oop_isPointer(references[i]))
+                    references[i] = crankvm_heap_unswizzleOop(work, references[i]);
+            }
+
+            position = crankvm_heap_objectEnd(object);
+        }
+
+        // The saved bridges hold the size of the next segment, without a gap between them.
+        if(chunk->bridge)
+        {
+            uint64_t *bridge = (uint64_t*)(buffer + (chunk->bridge - chunk->start));
+            bridge[0] = 0xFFull << 56;
+            bridge[1] = chunk->nextSegmentSize;
+        }
+
+        if(!crankvm_heap_writeFully(work->fileDescriptor, buffer, chunkSize, chunk->fileOffset))
+            atomic_store(&work->failed, true);
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+crankvm_error_t
+crankvm_heap_writeImageContent(crankvm_context_t *context, int fileDescriptor, size_t fileOffset, crankvm_image_header_t *header)
+{
+    crankvm_heap_t *heap = &context->heap;
+    crankvm_heap_new_space_t *newSpace = &heap->newSpace;
+    if(heap->segmentCount == 0)
+        return CRANK_VM_ERROR_INVALID_PARAMETER;
+
+    // Only the old space is saved.
+    if(newSpace->edenFreeStart != newSpace->edenStart || newSpace->pastSpaceFreeStart != newSpace->pastSpaceStart)
+        return CRANK_VM_ERROR_INVALID_PARAMETER;
+
+    crankvm_heap_snapshot_work_t work;
+    memset(&work, 0, sizeof(work));
+    work.context = context;
+    work.fileDescriptor = fileDescriptor;
+    atomic_init(&work.nextChunk, 0);
+    atomic_init(&work.failed, false);
+
+    // The last segment does not have a bridge in memory, one is appended to it.
+    size_t segmentFileOffsets[CRANK_VM_HEAP_MAX_SEGMENT_COUNT];
+    size_t maxChunkCount = 0;
+    size_t imageBytes = 0;
+    for(size_t i = 0; i < heap->segmentCount; ++i)
+    {
+        work.imageAddresses[i] = (uintptr_t)heap->segments[0].address + imageBytes;
+        segmentFileOffsets[i] = fileOffset + imageBytes;
+        imageBytes += heap->segments[i].size;
+        maxChunkCount += heap->segments[i].size / CRANK_VM_HEAP_SWIZZLE_CHUNK_SIZE + 1;
+    }
+    imageBytes += CRANK_VM_HEAP_BRIDGE_SIZE;
+
+    // Split the segments into object aligned chunks.
+    work.chunks = malloc(maxChunkCount * sizeof(crankvm_heap_snapshot_chunk_t));
+    uint8_t **boundaries = malloc((maxChunkCount + 1) * sizeof(uint8_t*));
+    if(!work.chunks || !boundaries)
+    {
+        free(work.chunks);
+        free(boundaries);
+        return CRANK_VM_ERROR_OUT_OF_MEMORY;
+    }
 
+    for(size_t i = 0; i < heap->segmentCount; ++i)
+    {
+        crankvm_heap_segment_t *segment = &heap->segments[i];
+        uint8_t *segmentEnd = segment->address + segment->size;
+        size_t chunkCount = crankvm_heap_findChunkBoundaries(segment->address, segmentEnd, boundaries, maxChunkCount - work.chunkCount);
+        for(size_t j = 0; j < chunkCount; ++j)
+        {
+            crankvm_heap_snapshot_chunk_t *chunk = &work.chunks[work.chunkCount++];
+            memset(chunk, 0, sizeof(crankvm_heap_snapshot_chunk_t));
+            chunk->start = boundaries[j];
+            chunk->end = boundaries[j + 1];
+            chunk->fileOffset = segmentFileOffsets[i] + (chunk->start - segment->address);
+            if(chunk->end == segmentEnd && i + 1 < heap->segmentCount)
+            {
+                chunk->bridge = segmentEnd - CRANK_VM_HEAP_BRIDGE_SIZE;
+                chunk->nextSegmentSize = heap->segments[i + 1].size + (i + 2 == heap->segmentCount ? CRANK_VM_HEAP_BRIDGE_SIZE : 0);
+            }
+        }
+    }
+    free(boundaries);
+
+    crankvm_heap_runChunkWorkers(heap, work.chunkCount, crankvm_heap_writeSnapshotChunks, &work);
+    free(work.chunks);
+
+    // The final bridge.
+    static const uint8_t finalBridge[CRANK_VM_HEAP_BRIDGE_SIZE];
+    if(atomic_load(&work.failed) ||
+        !crankvm_heap_writeFully(fileDescriptor, finalBridge, sizeof(finalBridge), fileOffset + imageBytes - sizeof(finalBridge)))
+        return CRANK_VM_ERROR_FAILED_TO_WRITE_FILE;
+
+    header->imageBytes = imageBytes;
+    header->startOfMemory = work.imageAddresses[0];
+    header->firstSegmentSize = heap->segments[0].size + (heap->segmentCount == 1 ? CRANK_VM_HEAP_BRIDGE_SIZE : 0);
+    header->specialObjectsOop = crankvm_heap_unswizzleOop(&work, (crankvm_oop_t)context->roots.specialObjectsArray);
+    header->freeOldSpaceInImage = heap->freeLists.freeBytes;
     return CRANK_VM_OK;
 }
+
+LIB_CRANK_VM_EXPORT void
+crankvm_context_dumpImageLoadStatistics(crankvm_context_t *context, FILE *output)
+{
+    if(!context || !output)
+        return;
+
+    crankvm_heap_load_statistics_t *statistics = &context->heap.loadStatistics;
+    fprintf(output, "Image load (%s): %.3f ms\n", statistics->mapped ? "mapped" : statistics->compressed ? "compressed" : "copied", statistics->totalMicroseconds / 1000.0);
+    fprintf(output, "\tread segments: %.3f ms\n", statistics->readMicroseconds / 1000.0);
+    if(statistics->compressed)
+        fprintf(output, "\tdecompress: %.3f ms chunks: %zu threads: %zu\n", statistics->decompressMicroseconds / 1000.0, statistics->decompressChunkCount, statistics->decompressThreadCount);
+    if(statistics->lazySwizzling)
+    {
+        crankvm_heap_lazy_swizzle_t *lazySwizzle = &context->heap.lazySwizzle;
+        fprintf(output, "\tswizzle: lazy, swizzled pages: %zu of %zu\n", lazySwizzle->swizzledPageCount, lazySwizzle->pageCount);
+        return;
+    }
+
+    fprintf(output, "\tprescan: %.3f ms chunks: %zu\n", statistics->prescanMicroseconds / 1000.0, statistics->swizzleChunkCount);
+    fprintf(output, "\tswizzle: %.3f ms threads: %zu\n", statistics->swizzleMicroseconds / 1000.0, statistics->swizzleThreadCount);
+}
@@ -3,6 +3,36 @@
 
 #include <crank-vm/objectmodel.h>
 #include <crank-vm/error.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Used when the image header does not specify the desired eden size.
+#define CRANK_VM_HEAP_DEFAULT_EDEN_SIZE (4*1024*1024)
+
+// Each survivor space has a fifth of the eden size, as in Spur.
+#define CRANK_VM_HEAP_SURVIVOR_SPACE_EDEN_FRACTION 5
+
+// Free chunks smaller than this number of allocation units have an exact size free list.
+#define CRANK_VM_HEAP_ALLOCATION_UNIT 8
+#define CRANK_VM_HEAP_FREE_LIST_COUNT 64
+
+// The old space can grow by this fraction of the live data before the next full collection.
+#define CRANK_VM_HEAP_FULL_GC_GROWTH_FRACTION 3
+#define CRANK_VM_HEAP_FULL_GC_MINIMUM_GROWTH (16*1024*1024)
+
+// Compact the old space when more than this fraction of it is free after marking.
+#define CRANK_VM_HEAP_COMPACTION_FREE_SPACE_FRACTION 4
+
+// The old space grows by adding segments, with at least this reserved address space.
+#define CRANK_VM_HEAP_MAX_SEGMENT_COUNT 256
+#define CRANK_VM_HEAP_SEGMENT_GROWTH_SIZE (64*1024*1024)
+
+// A bridge is a header with a single slot, which holds the address of the next segment.
+#define CRANK_VM_HEAP_BRIDGE_SIZE (sizeof(crankvm_object_header_t) + sizeof(crankvm_oop_t))
+
+// The pointers of the loaded image are swizzled in parallel, in chunks of at least this size.
+#define CRANK_VM_HEAP_MAX_SWIZZLE_THREAD_COUNT 64
+#define CRANK_VM_HEAP_SWIZZLE_CHUNK_SIZE (4*1024*1024)
 
 typedef struct crankvm_spur_segment_info_s {
 	uint8_t *startAddress;
@@ -10,17 +40,175 @@ typedef struct crankvm_spur_segment_info_s {
 	intptr_t swizzle;
 } crankvm_spur_segment_info_t;
 
+/**
+ * An old space segment. Every segment except the last one ends with a bridge
+ * object, and the objects are bump allocated in the last segment.
+ */
 typedef struct crankvm_heap_segment_s
 {
     size_t addressSpaceCapacity;
     size_t allocatedCapacity;
     size_t size;
     uint8_t *address;
+
+    // The first segment starts in the middle of its first page when the image file is mapped into it.
+    uint8_t *reservationAddress;
 } crankvm_heap_segment_t;
 
+typedef struct crankvm_heap_object_stack_s
+{
+    crankvm_object_header_t **elements;
+    size_t size;
+    size_t capacity;
+} crankvm_heap_object_stack_t;
+
+/**
+ * The new space is a separate memory region, with the layout:
+ * | past/future survivor space | future/past survivor space | eden |
+ */
+typedef struct crankvm_heap_new_space_s
+{
+    uint8_t *address;
+    size_t size;
+
+    // Eden, where the new objects are allocated.
+    uint8_t *edenStart;
+    uint8_t *edenFreeStart;
+    uint8_t *edenLimit;
+    uint8_t *scavengeThreshold;
+
+    // The survivors of the previous scavenge live in the past space.
+    size_t survivorSpaceSize;
+    uint8_t *pastSpaceStart;
+    uint8_t *pastSpaceFreeStart;
+    uint8_t *futureSpaceStart;
+    uint8_t *futureSpaceFreeStart;
+
+    // Survivors below this address are tenured by the current scavenge.
+    uint8_t *tenuringThreshold;
+
+    // Tenure every survivor. This is used for emptying the new space before a full collection.
+    bool tenureAll;
+
+    // Set when eden is exhausted. The scavenge is performed at the next safe point.
+    bool scavengeRequested;
+
+    // Old objects that may refer into the new space. They have the isRemembered bit set.
+    crankvm_heap_object_stack_t rememberedSet;
+
+    // Objects that are tenured during a scavenge, and whose slots have not been scanned yet.
+    crankvm_heap_object_stack_t promotedStack;
+
+    // Statistics
+    uint64_t scavengeCount;
+    uint64_t scavengeMicroseconds;
+    uint64_t tenuredObjectCount;
+} crankvm_heap_new_space_t;
+
+/**
+ * The new location of an object that is moved by the compactor. The entries
+ * are sorted by their old address.
+ */
+typedef struct crankvm_heap_forwarding_entry_s
+{
+    crankvm_object_header_t *oldObject;
+    crankvm_object_header_t *newObject;
+} crankvm_heap_forwarding_entry_t;
+
+typedef struct crankvm_heap_forwarding_table_s
+{
+    crankvm_heap_forwarding_entry_t *entries;
+    size_t size;
+    size_t capacity;
+} crankvm_heap_forwarding_table_t;
+
+/**
+ * Segregated free lists of the old space. The free chunks are linked through their first slot.
+ * The list at index 0 contains the chunks that are too large for an exact size list.
+ */
+typedef struct crankvm_heap_free_lists_s
+{
+    crankvm_object_header_t *lists[CRANK_VM_HEAP_FREE_LIST_COUNT];
+    size_t freeBytes;
+} crankvm_heap_free_lists_t;
+
+/**
+ * The duration of each phase of the image loading.
+ */
+typedef struct crankvm_heap_load_statistics_s
+{
+    uint64_t readMicroseconds;
+    uint64_t decompressMicroseconds;
+    uint64_t prescanMicroseconds;
+    uint64_t swizzleMicroseconds;
+    uint64_t totalMicroseconds;
+    size_t decompressChunkCount;
+    size_t decompressThreadCount;
+    size_t swizzleChunkCount;
+    size_t swizzleThreadCount;
+    bool mapped;
+    bool compressed;
+    bool lazySwizzling;
+} crankvm_heap_load_statistics_t;
+
+/**
+ * The pages of a mapped image can be swizzled when they are first touched.
+ * They are protected after loading, and the fault handler swizzles a page
+ * before unprotecting it. The object headers are read from a read only view
+ * of the image file, because the page that holds the header of an object
+ * may be still protected.
+ */
+typedef struct crankvm_heap_lazy_swizzle_s
+{
+    struct crankvm_context_s *context;
+    uint8_t *pagesStart;
+    size_t pageSize;
+    size_t pageCount;
+    uint8_t *sourceView;
+
+    // The objects of the image, including the bridges.
+    uint8_t *objectsStart;
+    uint8_t *objectsEnd;
+
+    // The object that contains the first byte of each page, which are found on demand.
+    uint8_t **pageFirstObjects;
+    size_t scannedPageCount;
+    uint8_t *scanPosition;
+
+    uint8_t *swizzledPages;
+    size_t swizzledPageCount;
+    atomic_flag lock;
+} crankvm_heap_lazy_swizzle_t;
+
 typedef struct crankvm_heap_s {
     size_t maxCapacity;
-    crankvm_heap_segment_t firstSegment;
+
+    // The old space segments, sorted by creation. The image is loaded into the first one.
+    crankvm_heap_segment_t segments[CRANK_VM_HEAP_MAX_SEGMENT_COUNT];
+    size_t segmentCount;
+    uintptr_t oldSpaceLowestAddress;
+    uintptr_t oldSpaceHighestAddress;
+    crankvm_heap_new_space_t newSpace;
+
+    // Old space allocation and full collection policy.
+    crankvm_heap_free_lists_t freeLists;
+    size_t oldSpaceUsage;
+    size_t fullGCThreshold;
+    bool fullGCRequested;
+    bool compactionEnabled;
+    crankvm_heap_object_stack_t markStack;
+
+    // Full collection statistics
+    uint64_t fullGCCount;
+    uint64_t fullGCMicroseconds;
+    uint64_t compactionCount;
+    uint64_t releasedSegmentCount;
+
+    // Image loading. Zero threads means one per online processor.
+    size_t loadThreadCount;
+    bool lazySwizzlingEnabled;
+    crankvm_heap_load_statistics_t loadStatistics;
+    crankvm_heap_lazy_swizzle_t lazySwizzle;
 
     crankvm_spur_segment_info_t *segmentInfos;
     size_t segmentInfoCapacity;
@@ -30,6 +218,7 @@ typedef struct crankvm_heap_s {
 typedef struct crankvm_heap_iterator_s {
     crankvm_heap_t *heap;
     crankvm_heap_segment_t *segment;
+    size_t segmentIndex;
 
     crankvm_object_header_t *currentHeader;
     crankvm_oop_t *currentObjectSlots;
@@ -46,7 +235,27 @@ typedef struct crankvm_read_memory_stream_s crankvm_read_memory_stream_t;
 typedef struct crankvm_context_s crankvm_context_t;
 
 crankvm_error_t crankvm_heap_destroy(crankvm_heap_t *heap);
-crankvm_error_t crankvm_heap_loadImageContent(crankvm_context_t *context, crankvm_read_memory_stream_t *stream, crankvm_image_header_t *header);
+/**
+ * Loads the image segments that follow the header in the stream. When the
+ * image comes from a file, imageFileDescriptor is used for mapping the
+ * segments into the heap, otherwise it is -1.
+ */
+crankvm_error_t crankvm_heap_loadImageContent(crankvm_context_t *context, crankvm_read_memory_stream_t *stream, crankvm_image_header_t *header, int imageFileDescriptor);
+
+/**
+ * Writes the old space segments into an image file, starting at the file
+ * offset, and fills the heap related fields of the image header. The new
+ * space must be empty. The pointers are unswizzled into the written copy, so
+ * the heap is not modified.
+ */
+crankvm_error_t crankvm_heap_writeImageContent(crankvm_context_t *context, int fileDescriptor, size_t fileOffset, crankvm_image_header_t *header);
+
+/**
+ * Stops the lazy swizzling of the loaded image, if it is active. The pages
+ * that were not touched yet are swizzled first. It is called at the start of
+ * the first full garbage collection, which also precedes the snapshots.
+ */
+void crankvm_heap_endLazySwizzling(crankvm_heap_t *heap);
 
 crankvm_heap_iterator_t crankvm_heap_iterator_create(crankvm_heap_t *heap);
 void crankvm_heap_iterator_advance(crankvm_heap_iterator_t *iterator);
@@ -56,4 +265,50 @@ crankvm_object_header_t *crankvm_heap_objectPointerAfter(crankvm_heap_t *heap, c
 crankvm_object_header_t *crankvm_heap_newObject(crankvm_context_t *context, crankvm_object_format_t format, size_t fixedSize, size_t variableSize);
 crankvm_object_header_t *crankvm_heap_shallowCopy(crankvm_context_t *context, crankvm_object_header_t *sourceObject);
 
+void crankvm_heap_remember(crankvm_heap_t *heap, crankvm_object_header_t *object);
+
+/**
+ * Copies the live objects of the new space into the survivor and old spaces.
+ * The roots array contains pointers to the oops held outside of the heap by
+ * the caller, which are updated to the new location of the objects.
+ */
+void crankvm_heap_scavenge(crankvm_context_t *context, size_t rootCount, crankvm_oop_t **roots);
+
+/**
+ * Empties the new space, and collects the old space with a mark-sweep, or a
+ * mark-compact when the old space is fragmented. The roots are updated as in
+ * crankvm_heap_scavenge.
+ */
+void crankvm_heap_fullGarbageCollect(crankvm_context_t *context, size_t rootCount, crankvm_oop_t **roots);
+
+/**
+ * Requests a collection at the next safe point of the interpreter.
+ */
+void crankvm_heap_requestGarbageCollection(crankvm_heap_t *heap, bool fullGC);
+
+/**
+ * The number of bytes that can still be allocated in the old space, either from
+ * the free lists or from its reserved address space.
+ */
+size_t crankvm_heap_getFreeBytes(crankvm_heap_t *heap);
+
+CRANK_VM_INLINE bool
+crankvm_heap_isYoung(crankvm_heap_t *heap, crankvm_oop_t oop)
+{
+    return oop - (crankvm_oop_t)heap->newSpace.address < heap->newSpace.size;
+}
+
+/**
+ * Write barrier. This must be called after storing a pointer into an object
+ * that may be in the old space.
+ */
+CRANK_VM_INLINE void
+crankvm_heap_writeBarrier(crankvm_heap_t *heap, crankvm_oop_t object, crankvm_oop_t value)
+{
+    if(crankvm_oop_isPointer(value) && crankvm_heap_isYoung(heap, value) &&
+        !crankvm_heap_isYoung(heap, object) &&
+        !crankvm_object_header_getIsRemembered((crankvm_object_header_t*)object))
+        crankvm_heap_remember(heap, (crankvm_object_header_t*)object);
+}
+
 #endif //CRANK_VM_HEAP_H
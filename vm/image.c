@@ -1,10 +1,16 @@
 #include "context-internal.h"
 #include "image.h"
 #include "read-memory-stream.h"
+#include "write-memory-stream.h"
 #include "heap.h"
 #include <string.h>
 #include <stdlib.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 static crankvm_error_t
 crankvm_image_readFormatFromIntegerAndLittleEndianness(crankvm_image_format_t *format, uint32_t integer, bool littleEndian)
 {
@@ -176,8 +182,8 @@ crankvm_image_readHeader(crankvm_read_memory_stream_t *stream, crankvm_image_hea
     return CRANK_VM_OK;
 }
 
-LIB_CRANK_VM_EXPORT crankvm_error_t
-crankvm_context_loadImageFromMemory(crankvm_context_t *context, size_t imageSize, const void *imageData)
+static crankvm_error_t
+crankvm_image_loadFromMemory(crankvm_context_t *context, size_t imageSize, const void *imageData, int imageFileDescriptor)
 {
     if(!context || !imageData)
         return CRANK_VM_ERROR_NULL_POINTER;
@@ -194,17 +200,67 @@ crankvm_context_loadImageFromMemory(crankvm_context_t *context, size_t imageSize
         return error;
 
     context->lastIdentityHash = header.lastHash;
+    context->imageHeader = header;
+
+    error = crankvm_heap_loadImageContent(context, &stream, &header, imageFileDescriptor);
+    if(error)
+        return error;
+
+    error = crankvm_stack_zone_initialize(&context->stackZone, header.desiredNumStackPages);
+    if(error)
+        return error;
 
-    return crankvm_heap_loadImageContent(context, &stream, &header);
+    error = crankvm_scheduler_initialize(&context->scheduler, header.maxExtSemTabSizeSet);
+    if(error)
+        return error;
+
+    crankvm_jit_initialize(&context->jit, header.unknownShortOrCodeSizeInKs);
+    return CRANK_VM_OK;
 }
 
 LIB_CRANK_VM_EXPORT crankvm_error_t
-crankvm_context_loadImageFromFileNamed(crankvm_context_t *context, const char *fileName)
+crankvm_context_loadImageFromMemory(crankvm_context_t *context, size_t imageSize, const void *imageData)
 {
-    if(!context)
-        return CRANK_VM_ERROR_NULL_POINTER;
+    return crankvm_image_loadFromMemory(context, imageSize, imageData, -1);
+}
 
-    // TODO: Use memory mapping, if possible
+/**
+ * Loads an image file through a read only mapping of the whole file. The
+ * heap maps the image segments from the file descriptor, so they are not
+ * copied. Fails with CRANK_VM_ERROR_UNSUPPORTED_OPERATION when the file
+ * cannot be mapped.
+ */
+static crankvm_error_t
+crankvm_image_loadMappedFileNamed(crankvm_context_t *context, const char *fileName)
+{
+    int fd = open(fileName, O_RDONLY);
+    if(fd < 0)
+        return CRANK_VM_ERROR_FAILED_TO_OPEN_FILE;
+
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) || !S_ISREG(fileStat.st_mode) || fileStat.st_size == 0)
+    {
+        close(fd);
+        return CRANK_VM_ERROR_UNSUPPORTED_OPERATION;
+    }
+
+    size_t imageSize = fileStat.st_size;
+    void *imageData = mmap(NULL, imageSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(imageData == MAP_FAILED)
+    {
+        close(fd);
+        return CRANK_VM_ERROR_UNSUPPORTED_OPERATION;
+    }
+
+    crankvm_error_t error = crankvm_image_loadFromMemory(context, imageSize, imageData, fd);
+    munmap(imageData, imageSize);
+    close(fd);
+    return error;
+}
+
+static crankvm_error_t
+crankvm_image_loadReadFileNamed(crankvm_context_t *context, const char *fileName)
+{
     FILE *file = fopen(fileName, "rb");
     if(!file)
         return CRANK_VM_ERROR_FAILED_TO_OPEN_FILE;
@@ -236,3 +292,106 @@ crankvm_context_loadImageFromFileNamed(crankvm_context_t *context, const char *f
     free(buffer);
     return error;
 }
+
+LIB_CRANK_VM_EXPORT crankvm_error_t
+crankvm_context_loadImageFromFileNamed(crankvm_context_t *context, const char *fileName)
+{
+    if(!context || !fileName)
+        return CRANK_VM_ERROR_NULL_POINTER;
+
+    // Prefer memory mapping. Fallback to reading the file when it cannot be mapped.
+    crankvm_error_t error = crankvm_image_loadMappedFileNamed(context, fileName);
+    if(error == CRANK_VM_ERROR_UNSUPPORTED_OPERATION)
+        error = crankvm_image_loadReadFileNamed(context, fileName);
+    if(error)
+        return error;
+
+    // The snapshots are saved into the same file.
+    free(context->imageFileName);
+    context->imageFileName = strdup(fileName);
+    return context->imageFileName ? CRANK_VM_OK : CRANK_VM_ERROR_OUT_OF_MEMORY;
+}
+
+static crankvm_error_t
+crankvm_image_writeHeader(int fd, crankvm_image_header_t *header)
+{
+    uint8_t buffer[CRANK_VM_IMAGE_SAVED_HEADER_SIZE];
+    memset(buffer, 0, sizeof(buffer));
+
+    // Spur with closures, and native float word order.
+    crankvm_write_memory_stream_t stream = crankvm_write_memory_stream_create(buffer, 0, sizeof(buffer));
+    crankvm_write_memory_stream_nextPutU32(&stream, sizeof(crankvm_oop_t) == 8 ? 68021 : 6521);
+
+    // Standard headers
+    crankvm_write_memory_stream_nextPutU32(&stream, header->headerSize);
+    crankvm_write_memory_stream_nextPutWord(&stream, header->imageBytes);
+    crankvm_write_memory_stream_nextPutWord(&stream, header->startOfMemory);
+    crankvm_write_memory_stream_nextPutWord(&stream, header->specialObjectsOop);
+    crankvm_write_memory_stream_nextPutWord(&stream, header->lastHash);
+    crankvm_write_memory_stream_nextPutWord(&stream, header->screenSizeWord);
+    crankvm_write_memory_stream_nextPutWord(&stream, header->imageHeaderFlags);
+    crankvm_write_memory_stream_nextPutU32(&stream, header->extraVMMemory);
+
+    // Cog headers
+    crankvm_write_memory_stream_nextPutU16(&stream, header->desiredNumStackPages);
+    crankvm_write_memory_stream_nextPutU16(&stream, header->unknownShortOrCodeSizeInKs);
+    crankvm_write_memory_stream_nextPutU32(&stream, header->desiredEdenBytes);
+    crankvm_write_memory_stream_nextPutU16(&stream, header->maxExtSemTabSizeSet);
+    crankvm_write_memory_stream_nextPutU16(&stream, header->secondUnknownShort);
+    crankvm_write_memory_stream_nextPutWord(&stream, header->firstSegmentSize);
+    crankvm_write_memory_stream_nextPutWord(&stream, header->freeOldSpaceInImage);
+
+    ssize_t writtenSize = pwrite(fd, buffer, header->headerSize, 0);
+    return writtenSize == (ssize_t)header->headerSize ? CRANK_VM_OK : CRANK_VM_ERROR_FAILED_TO_WRITE_FILE;
+}
+
+crankvm_error_t
+crankvm_image_writeFileNamed(crankvm_context_t *context, const char *fileName)
+{
+    size_t fileNameLength = strlen(fileName);
+    char *temporaryFileName = malloc(fileNameLength + sizeof(".tmp"));
+    if(!temporaryFileName)
+        return CRANK_VM_ERROR_OUT_OF_MEMORY;
+    memcpy(temporaryFileName, fileName, fileNameLength);
+    memcpy(temporaryFileName + fileNameLength, ".tmp", sizeof(".tmp"));
+
+    int fd = open(temporaryFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        free(temporaryFileName);
+        return CRANK_VM_ERROR_FAILED_TO_OPEN_FILE;
+    }
+
+    // Keep the settings of the loaded image.
+    crankvm_image_header_t header = context->imageHeader;
+    header.headerSize = CRANK_VM_IMAGE_SAVED_HEADER_SIZE;
+    header.lastHash = context->lastIdentityHash;
+    header.imageHeaderFlags &= ~CRANK_VM_IMAGE_HEADER_FLAG_COMPRESSED;
+
+    crankvm_error_t error = crankvm_heap_writeImageContent(context, fd, header.headerSize, &header);
+    if(!error)
+        error = crankvm_image_writeHeader(fd, &header);
+    if(close(fd) && !error)
+        error = CRANK_VM_ERROR_FAILED_TO_WRITE_FILE;
+
+    if(!error && rename(temporaryFileName, fileName))
+        error = CRANK_VM_ERROR_FAILED_TO_WRITE_FILE;
+    if(error)
+        unlink(temporaryFileName);
+
+    free(temporaryFileName);
+    return error;
+}
+
+LIB_CRANK_VM_EXPORT crankvm_error_t
+crankvm_context_saveImageToFileNamed(crankvm_context_t *context, const char *fileName)
+{
+    if(!context || !fileName)
+        return CRANK_VM_ERROR_NULL_POINTER;
+    if(!context->roots.specialObjectsArray)
+        return CRANK_VM_ERROR_INVALID_PARAMETER;
+
+    // Move every object into the old space, and drop the garbage.
+    crankvm_heap_fullGarbageCollect(context, 0, NULL);
+    return crankvm_image_writeFileNamed(context, fileName);
+}
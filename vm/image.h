@@ -1,6 +1,7 @@
 #ifndef CRANK_VM_IMAGE_H
 #define CRANK_VM_IMAGE_H
 
+#include <crank-vm/error.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -15,6 +16,19 @@
 #define CRANK_VM_IMAGE_FORMAT_BASE_VERSION_NUMBERS 6502 6504 68000 68002
 #define CRANK_VM_IMAGE_FORMAT_KNOWN_VERSION_NUMBERS 6502 6504 6505 6521 68000 68002 68003 68019 68021
 
+/**
+ * The segments of a compressed image are split in chunks of a fixed
+ * uncompressed size, which are compressed independently. The header is
+ * followed by the chunk size, the chunk count, and the compressed size of
+ * each chunk as words, and then by the compressed chunks. A chunk that does
+ * not compress is stored as is, with its uncompressed size.
+ */
+#define CRANK_VM_IMAGE_HEADER_FLAG_COMPRESSED ((uintptr_t)1 << 30)
+#define CRANK_VM_IMAGE_DEFAULT_COMPRESSED_CHUNK_SIZE (1<<20)
+
+// The saved images have the header padded to a page, so the segments can be mapped from the file.
+#define CRANK_VM_IMAGE_SAVED_HEADER_SIZE 4096
+
 typedef struct crankvm_image_format_s
 {
     bool isLittleEndian;
@@ -51,4 +65,13 @@ typedef struct crankvm_image_header_s
 
 } crankvm_image_header_t;
 
+typedef struct crankvm_context_s crankvm_context_t;
+
+/**
+ * Writes the old space into an image file. The file is written under a
+ * temporary name, and then it replaces the image file, which may be still
+ * mapped into the heap.
+ */
+crankvm_error_t crankvm_image_writeFileNamed(crankvm_context_t *context, const char *fileName);
+
 #endif //CRANK_VM_IMAGE_H
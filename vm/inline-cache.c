@@ -0,0 +1,152 @@
+#include "inline-cache.h"
+#include "context-internal.h"
+#include <string.h>
+
+CRANK_VM_INLINE size_t
+crankvm_inline_cache_siteIndex(crankvm_oop_t method, intptr_t pc)
+{
+    uintptr_t hash = crankvm_oop_addressHash(method) ^ ((uintptr_t)pc * 0x9E3779B1u);
+    return (hash ^ (hash >> 12)) & CRANK_VM_INLINE_CACHE_SITE_MASK;
+}
+
+crankvm_inline_cache_site_t *
+crankvm_inline_cache_getSite(crankvm_context_t *context, crankvm_oop_t method, intptr_t pc, crankvm_oop_t selector)
+{
+    crankvm_inline_cache_t *cache = &context->inlineCache;
+    crankvm_inline_cache_site_t *site = &cache->sites[crankvm_inline_cache_siteIndex(method, pc)];
+    if(site->method == method && site->pc == pc && site->selector == selector)
+        return site;
+
+    // Claim the site for this send.
+    if(site->method)
+        ++cache->siteEvictionCount;
+
+    memset(site, 0, sizeof(crankvm_inline_cache_site_t));
+    site->method = method;
+    site->pc = pc;
+    site->selector = selector;
+    return site;
+}
+
+void
+crankvm_inline_cache_addEntry(crankvm_inline_cache_site_t *site, uint32_t classTag, crankvm_oop_t targetMethod)
+{
+    if(!classTag || site->state == CRANK_VM_INLINE_CACHE_STATE_MEGAMORPHIC)
+        return;
+
+    if(site->entryCount == CRANK_VM_INLINE_CACHE_POLYMORPHIC_ENTRY_COUNT)
+    {
+        // Too many classes, keep the entries but stop extending this site.
+        site->state = CRANK_VM_INLINE_CACHE_STATE_MEGAMORPHIC;
+        return;
+    }
+
+    site->classTags[site->entryCount] = classTag;
+    site->targetMethods[site->entryCount] = targetMethod;
+    ++site->entryCount;
+    site->state = site->entryCount == 1 ? CRANK_VM_INLINE_CACHE_STATE_MONOMORPHIC : CRANK_VM_INLINE_CACHE_STATE_POLYMORPHIC;
+}
+
+void
+crankvm_inline_cache_flush(crankvm_context_t *context)
+{
+    memset(context->inlineCache.sites, 0, sizeof(context->inlineCache.sites));
+}
+
+void
+crankvm_inline_cache_flushSelector(crankvm_context_t *context, crankvm_oop_t selector)
+{
+    crankvm_inline_cache_t *cache = &context->inlineCache;
+    for(size_t i = 0; i < CRANK_VM_INLINE_CACHE_SITE_COUNT; ++i)
+    {
+        crankvm_inline_cache_site_t *site = &cache->sites[i];
+        if(site->selector == selector)
+            memset(site, 0, sizeof(crankvm_inline_cache_site_t));
+    }
+}
+
+void
+crankvm_inline_cache_flushMethod(crankvm_context_t *context, crankvm_oop_t method)
+{
+    crankvm_inline_cache_t *cache = &context->inlineCache;
+    for(size_t i = 0; i < CRANK_VM_INLINE_CACHE_SITE_COUNT; ++i)
+    {
+        crankvm_inline_cache_site_t *site = &cache->sites[i];
+        bool flushSite = site->method == method;
+        for(uint32_t j = 0; j < site->entryCount && !flushSite; ++j)
+            flushSite = site->targetMethods[j] == method;
+
+        if(flushSite)
+            memset(site, 0, sizeof(crankvm_inline_cache_site_t));
+    }
+}
+
+void
+crankvm_inline_cache_flushNewSpaceReferences(crankvm_context_t *context)
+{
+    crankvm_inline_cache_t *cache = &context->inlineCache;
+    crankvm_heap_t *heap = &context->heap;
+    for(size_t i = 0; i < CRANK_VM_INLINE_CACHE_SITE_COUNT; ++i)
+    {
+        crankvm_inline_cache_site_t *site = &cache->sites[i];
+        bool flushSite = crankvm_heap_isYoung(heap, site->method) || crankvm_heap_isYoung(heap, site->selector);
+        for(uint32_t j = 0; j < site->entryCount && !flushSite; ++j)
+            flushSite = crankvm_heap_isYoung(heap, site->targetMethods[j]);
+
+        if(flushSite)
+            memset(site, 0, sizeof(crankvm_inline_cache_site_t));
+    }
+}
+
+static const char *
+crankvm_inline_cache_stateName(crankvm_inline_cache_state_t state)
+{
+    switch(state)
+    {
+    case CRANK_VM_INLINE_CACHE_STATE_EMPTY: return "empty";
+    case CRANK_VM_INLINE_CACHE_STATE_MONOMORPHIC: return "monomorphic";
+    case CRANK_VM_INLINE_CACHE_STATE_POLYMORPHIC: return "polymorphic";
+    case CRANK_VM_INLINE_CACHE_STATE_MEGAMORPHIC: return "megamorphic";
+    default: return "unknown";
+    }
+}
+
+LIB_CRANK_VM_EXPORT void
+crankvm_context_dumpInlineCacheStatistics(crankvm_context_t *context, FILE *output)
+{
+    if(!context || !output)
+        return;
+
+    crankvm_inline_cache_t *cache = &context->inlineCache;
+    size_t stateCounts[CRANK_VM_INLINE_CACHE_STATE_MEGAMORPHIC + 1] = {0};
+    uint64_t totalHits = 0;
+    uint64_t totalMisses = 0;
+
+    // Per-site statistics.
+    fprintf(output, "Inline cache sites:\n");
+    for(size_t i = 0; i < CRANK_VM_INLINE_CACHE_SITE_COUNT; ++i)
+    {
+        crankvm_inline_cache_site_t *site = &cache->sites[i];
+        if(!site->method)
+            continue;
+
+        ++stateCounts[site->state];
+        totalHits += site->hitCount;
+        totalMisses += site->missCount;
+
+        fprintf(output, "\tmethod %p pc %4d #", (void*)site->method, (int)site->pc);
+        if(crankvm_oop_isPointer(site->selector))
+            fprintf(output, "%.*s", crankvm_string_printf_arg(site->selector));
+        fprintf(output, " %s classes: %u hits: %llu misses: %llu\n", crankvm_inline_cache_stateName(site->state),
+            site->entryCount, (unsigned long long)site->hitCount, (unsigned long long)site->missCount);
+    }
+
+    // Summary.
+    fprintf(output, "Inline cache summary: monomorphic %zu polymorphic %zu megamorphic %zu unresolved %zu\n",
+        stateCounts[CRANK_VM_INLINE_CACHE_STATE_MONOMORPHIC],
+        stateCounts[CRANK_VM_INLINE_CACHE_STATE_POLYMORPHIC],
+        stateCounts[CRANK_VM_INLINE_CACHE_STATE_MEGAMORPHIC],
+        stateCounts[CRANK_VM_INLINE_CACHE_STATE_EMPTY]);
+    fprintf(output, "Inline cache hits: %llu misses: %llu site evictions: %llu\n",
+        (unsigned long long)totalHits, (unsigned long long)totalMisses, (unsigned long long)cache->siteEvictionCount);
+}
@@ -0,0 +1,92 @@
+#ifndef CRANK_VM_INLINE_CACHE_H
+#define CRANK_VM_INLINE_CACHE_H
+
+#include <crank-vm/objectmodel.h>
+#include <crank-vm/special-objects.h>
+#include <stdio.h>
+
+#define CRANK_VM_INLINE_CACHE_SITE_COUNT 4096
+#define CRANK_VM_INLINE_CACHE_SITE_MASK (CRANK_VM_INLINE_CACHE_SITE_COUNT - 1)
+#define CRANK_VM_INLINE_CACHE_POLYMORPHIC_ENTRY_COUNT 6
+
+typedef struct crankvm_context_s crankvm_context_t;
+
+typedef enum crankvm_inline_cache_state_e
+{
+    CRANK_VM_INLINE_CACHE_STATE_EMPTY = 0,
+    CRANK_VM_INLINE_CACHE_STATE_MONOMORPHIC,
+    CRANK_VM_INLINE_CACHE_STATE_POLYMORPHIC,
+    CRANK_VM_INLINE_CACHE_STATE_MEGAMORPHIC,
+} crankvm_inline_cache_state_t;
+
+/**
+ * The cache of a single send site. A send site is identified by its method
+ * and the pc that follows the send bytecode. The cache is keyed by class
+ * tag: the tag bits for immediates, and the class index for pointers, so a
+ * hit does not need to go through the class table.
+ */
+typedef struct crankvm_inline_cache_site_s
+{
+    crankvm_oop_t method;
+    intptr_t pc;
+    crankvm_oop_t selector;
+
+    crankvm_inline_cache_state_t state;
+    uint32_t entryCount;
+    uint32_t classTags[CRANK_VM_INLINE_CACHE_POLYMORPHIC_ENTRY_COUNT];
+    crankvm_oop_t targetMethods[CRANK_VM_INLINE_CACHE_POLYMORPHIC_ENTRY_COUNT];
+
+    uint64_t hitCount;
+    uint64_t missCount;
+} crankvm_inline_cache_site_t;
+
+typedef struct crankvm_inline_cache_s
+{
+    // Side table with the send sites. The image bytes are never modified.
+    crankvm_inline_cache_site_t sites[CRANK_VM_INLINE_CACHE_SITE_COUNT];
+
+    uint64_t siteEvictionCount;
+} crankvm_inline_cache_t;
+
+CRANK_VM_INLINE uint32_t
+crankvm_inline_cache_classTagOf(crankvm_oop_t receiver)
+{
+    crankvm_oop_t tag = receiver & CRANK_VM_OOP_TAG_MASK;
+    if(tag)
+        return (uint32_t)tag;
+
+    // Class index zero means that the class cannot be cached by index.
+    uint32_t classIndex = crankvm_object_header_getClassIndex((crankvm_object_header_t*)receiver);
+    if(classIndex == CRANKVM_CLASS_INDEX_PUN_IS_ITSELF_CLASS || classIndex == CRANKVM_CLASS_INDEX_PUN_FORWARDED)
+        return 0;
+    return classIndex;
+}
+
+crankvm_inline_cache_site_t *crankvm_inline_cache_getSite(crankvm_context_t *context, crankvm_oop_t method, intptr_t pc, crankvm_oop_t selector);
+void crankvm_inline_cache_addEntry(crankvm_inline_cache_site_t *site, uint32_t classTag, crankvm_oop_t targetMethod);
+
+CRANK_VM_INLINE crankvm_oop_t
+crankvm_inline_cache_lookup(crankvm_inline_cache_site_t *site, uint32_t classTag)
+{
+    if(classTag)
+    {
+        for(uint32_t i = 0; i < site->entryCount; ++i)
+        {
+            if(site->classTags[i] == classTag)
+            {
+                ++site->hitCount;
+                return site->targetMethods[i];
+            }
+        }
+    }
+
+    ++site->missCount;
+    return 0;
+}
+
+void crankvm_inline_cache_flush(crankvm_context_t *context);
+void crankvm_inline_cache_flushSelector(crankvm_context_t *context, crankvm_oop_t selector);
+void crankvm_inline_cache_flushMethod(crankvm_context_t *context, crankvm_oop_t method);
+void crankvm_inline_cache_flushNewSpaceReferences(crankvm_context_t *context);
+
+#endif //CRANK_VM_INLINE_CACHE_H
@@ -1,4 +1,5 @@
 #include "crank-vm/interpreter.h"
+#include <errno.h>
 #include <unistd.h>
 #include <stdint.h>
 
@@ -26,6 +27,111 @@ crankvm_primitive_getFileHandleAt(crankvm_primitive_context_t *primitiveContext,
     return handleBytes;
 }
 
+/**
+ * A read or a write, performed in a worker thread into a buffer of its own,
+ * because the heap objects may move meanwhile.
+ */
+typedef struct crankvm_FilePlugin_transfer_s
+{
+    crankvm_callout_t baseClass;
+    int fileDescriptor;
+    size_t count;
+    ssize_t transferredCount;
+    uint8_t buffer[];
+} crankvm_FilePlugin_transfer_t;
+
+/**
+ * Gets the bytes of a byte object in the range of a transfer.
+ */
+static uint8_t *
+crankvm_FilePlugin_getTransferBytes(crankvm_primitive_context_t *primitiveContext, crankvm_oop_t bytesOop, size_t startIndex, size_t count)
+{
+    if(crankvm_primitive_hasFailed(primitiveContext))
+        return NULL;
+
+    crankvm_object_header_t *bytesHeader = (crankvm_object_header_t*)bytesOop;
+    if(!crankvm_oop_isPointer(bytesOop) ||
+        crankvm_object_header_getObjectFormat(bytesHeader) < CRANK_VM_OBJECT_FORMAT_INDEXABLE_8 ||
+        crankvm_object_header_getObjectFormat(bytesHeader) >= CRANK_VM_OBJECT_FORMAT_COMPILED_METHOD)
+    {
+        crankvm_primitive_failWithCode(primitiveContext, CRANK_VM_PRIMITIVE_ERROR_BAD_ARGUMENT);
+        return NULL;
+    }
+
+    if(startIndex < 1 || startIndex - 1 + count > crankvm_object_header_getSmalltalkSize(bytesHeader))
+    {
+        crankvm_primitive_failWithCode(primitiveContext, CRANK_VM_PRIMITIVE_ERROR_BAD_INDEX);
+        return NULL;
+    }
+
+    return (uint8_t*)(bytesHeader + 1) + startIndex - 1;
+}
+
+static crankvm_FilePlugin_transfer_t *
+crankvm_FilePlugin_createTransfer(crankvm_primitive_context_t *primitiveContext, crankvm_file_handle_t *fileHandle, size_t count,
+    crankvm_callout_perform_function_t perform, crankvm_callout_finish_function_t finish)
+{
+    crankvm_FilePlugin_transfer_t *transfer = crankvm_context_malloc(primitiveContext->context, sizeof(crankvm_FilePlugin_transfer_t) + count);
+    if(!transfer)
+    {
+        crankvm_primitive_failWithCode(primitiveContext, CRANK_VM_PRIMITIVE_ERROR_INSUFFICIENT_C_MEMORY);
+        return NULL;
+    }
+
+    memset(transfer, 0, sizeof(crankvm_FilePlugin_transfer_t));
+    transfer->baseClass.perform = perform;
+    transfer->baseClass.finish = finish;
+    transfer->fileDescriptor = (int)fileHandle->nativeHandle;
+    transfer->count = count;
+    return transfer;
+}
+
+static void
+crankvm_FilePlugin_performRead(crankvm_callout_t *callout)
+{
+    crankvm_FilePlugin_transfer_t *transfer = (crankvm_FilePlugin_transfer_t*)callout;
+    do
+    {
+        transfer->transferredCount = read(transfer->fileDescriptor, transfer->buffer, transfer->count);
+    } while(transfer->transferredCount < 0 && errno == EINTR);
+}
+
+static void
+crankvm_FilePlugin_finishRead(crankvm_callout_t *callout, crankvm_primitive_context_t *primitiveContext)
+{
+    crankvm_FilePlugin_transfer_t *transfer = (crankvm_FilePlugin_transfer_t*)callout;
+    if(transfer->transferredCount < 0)
+        return crankvm_primitive_fail(primitiveContext);
+
+    // The bytes are copied into the array where it is now.
+    size_t startIndex = crankvm_primitive_getSizeValue(primitiveContext, crankvm_primitive_getStackAt(primitiveContext, 1));
+    uint8_t *bytes = crankvm_FilePlugin_getTransferBytes(primitiveContext, crankvm_primitive_getStackAt(primitiveContext, 2), startIndex, transfer->transferredCount);
+    if(crankvm_primitive_hasFailed(primitiveContext)) return;
+
+    memcpy(bytes, transfer->buffer, transfer->transferredCount);
+    return crankvm_primitive_returnInteger(primitiveContext, transfer->transferredCount);
+}
+
+static void
+crankvm_FilePlugin_performWrite(crankvm_callout_t *callout)
+{
+    crankvm_FilePlugin_transfer_t *transfer = (crankvm_FilePlugin_transfer_t*)callout;
+    do
+    {
+        transfer->transferredCount = write(transfer->fileDescriptor, transfer->buffer, transfer->count);
+    } while(transfer->transferredCount < 0 && errno == EINTR);
+}
+
+static void
+crankvm_FilePlugin_finishWrite(crankvm_callout_t *callout, crankvm_primitive_context_t *primitiveContext)
+{
+    crankvm_FilePlugin_transfer_t *transfer = (crankvm_FilePlugin_transfer_t*)callout;
+    if(transfer->transferredCount < 0)
+        return crankvm_primitive_fail(primitiveContext);
+
+    return crankvm_primitive_returnInteger(primitiveContext, transfer->transferredCount);
+}
+
 static crankvm_oop_t
 crankvm_primitive_encodeFileHandle(crankvm_primitive_context_t *primitiveContext, crankvm_file_handle_t fileHandle)
 {
@@ -155,7 +261,18 @@ crankvm_FilePlugin_primitiveFileOpenNew(crankvm_primitive_context_t *primitiveCo
 static void
 crankvm_FilePlugin_primitiveFileRead(crankvm_primitive_context_t *primitiveContext)
 {
-    CRANK_UNIMPLEMENTED();
+    size_t count = crankvm_primitive_getSizeValue(primitiveContext, crankvm_primitive_getStackAt(primitiveContext, 0));
+    size_t startIndex = crankvm_primitive_getSizeValue(primitiveContext, crankvm_primitive_getStackAt(primitiveContext, 1));
+    crankvm_FilePlugin_getTransferBytes(primitiveContext, crankvm_primitive_getStackAt(primitiveContext, 2), startIndex, count);
+    crankvm_file_handle_t *fileHandle = crankvm_primitive_getFileHandleAt(primitiveContext, 3);
+    if(crankvm_primitive_hasFailed(primitiveContext)) return;
+
+    // The read may block, so it is performed by a worker.
+    crankvm_FilePlugin_transfer_t *transfer = crankvm_FilePlugin_createTransfer(primitiveContext, fileHandle, count,
+        crankvm_FilePlugin_performRead, crankvm_FilePlugin_finishRead);
+    if(!transfer) return;
+
+    return crankvm_primitive_performCallout(primitiveContext, &transfer->baseClass);
 }
 
 static void
@@ -210,19 +327,17 @@ crankvm_FilePlugin_primitiveFileWrite(crankvm_primitive_context_t *primitiveCont
 {
     size_t count = crankvm_primitive_getSizeValue(primitiveContext, crankvm_primitive_getStackAt(primitiveContext, 0));
     size_t startIndex = crankvm_primitive_getSizeValue(primitiveContext, crankvm_primitive_getStackAt(primitiveContext, 1));
-    uint8_t *bytes = crankvm_primitive_getBytesPointer(primitiveContext, crankvm_primitive_getStackAt(primitiveContext, 2));
+    uint8_t *bytes = crankvm_FilePlugin_getTransferBytes(primitiveContext, crankvm_primitive_getStackAt(primitiveContext, 2), startIndex, count);
     crankvm_file_handle_t *fileHandle = crankvm_primitive_getFileHandleAt(primitiveContext, 3);
-    printf("fd: %p\n", (void*)fileHandle->nativeHandle);
     if(crankvm_primitive_hasFailed(primitiveContext)) return;
 
-    printf("write bytes %zu into %d\n", count, (int)fileHandle->nativeHandle);
-    ssize_t written = write((int)fileHandle->nativeHandle, bytes + startIndex - 1, count);
-    fflush(stdout);
-    abort();
-    if(written < 0)
-        return crankvm_primitive_fail(primitiveContext);
+    // The write may block, so it is performed by a worker with a copy of the bytes.
+    crankvm_FilePlugin_transfer_t *transfer = crankvm_FilePlugin_createTransfer(primitiveContext, fileHandle, count,
+        crankvm_FilePlugin_performWrite, crankvm_FilePlugin_finishWrite);
+    if(!transfer) return;
 
-    return crankvm_primitive_returnInteger(primitiveContext, written);
+    memcpy(transfer->buffer, bytes, count);
+    return crankvm_primitive_performCallout(primitiveContext, &transfer->baseClass);
 }
 
 static void
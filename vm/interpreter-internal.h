@@ -34,8 +34,49 @@ struct crankvm_interpreter_state_s
         crankvm_oop_t receiver;
     } objects;
 
+#ifdef CRANK_VM_USE_JIT
+    // The JIT entry of the active method, when it is hot or compiled.
+    crankvm_jit_method_t *jitMethod;
+#endif
+
 };
 
+/**
+ * Collects all the garbage during a primitive. The roots of the primitive
+ * context are updated with the moved objects.
+ */
+void crankvm_interpreter_fullGarbageCollectFromPrimitive(crankvm_primitive_context_t *primitiveContext);
+
+/**
+ * Collects the garbage of the new space during a primitive. The roots of the
+ * primitive context are updated with the moved objects.
+ */
+void crankvm_interpreter_scavengeFromPrimitive(crankvm_primitive_context_t *primitiveContext);
+
+/**
+ * Materializes the frames of the stack zone during a primitive that has not
+ * replaced its method context, so its contexts can be stored in the heap.
+ */
+void crankvm_interpreter_materializeStackFramesFromPrimitive(crankvm_primitive_context_t *primitiveContext);
+
+/**
+ * Stores the pc and the stack pointer of the method context of a primitive,
+ * and materializes the stack frames, so the active process can be suspended
+ * in it. The process resumes after the primitive call, as if it had failed.
+ */
+crankvm_MethodContext_t *crankvm_interpreter_materializePrimitiveMethodContext(crankvm_primitive_context_t *primitiveContext);
+
+/**
+ * Gets the object that a failed primitive stores in the first temporary of its method.
+ */
+CRANK_VM_INLINE crankvm_oop_t
+crankvm_interpreter_getPrimitiveErrorObject(crankvm_context_t *context, crankvm_primitive_error_code_t code)
+{
+    if(code < CRANK_VM_PRIMITIVE_ERROR_KNOWN_COUNT)
+        return context->roots.specialObjectsArray->primitiveErrorTable->errorNameArray[code - 1];
+    return crankvm_oop_encodeSmallInteger(code);
+}
+
 #define CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(name, number) /* Nothing generated */
 
 #endif //CRANK_VM_INTERPRETER_H
@@ -1,21 +1,7 @@
 #include "interpreter-internal.h"
 #include "numbered-primitives.h"
+#include "trace.h"
 
-static const char *bytecodeNameTable[] = {
-#define BYTECODE_WITH_IMPLICIT_PARAM(opcode, name, implicitParam) #name " " #implicitParam,
-#define BYTECODE(opcode, name) #name,
-#define UNDEFINED_BYTECODE(opcode) "UndefinedByteCode",
-
-// SqueakV3Plus closures bytecode set
-#include "SqueakV3PlusClosuresBytecodeSetTable.inc"
-
-// SistaV1 set
-#include "SistaV1BytecodeSetTable.inc"
-
-#undef BYTECODE_WITH_IMPLICIT_PARAM
-#undef BYTECODE
-#undef UNDEFINED_BYTECODE
-};
 
 // <editor-fold> Interpreter public interface
 LIB_CRANK_VM_EXPORT inline crankvm_context_t*
@@ -106,6 +92,7 @@ crankvm_interpreter_setReceiverSlot(crankvm_interpreter_state_t *self, size_t in
 {
     assert(crankvm_interpreter_checkReceiverSlotIndex(self, index) == CRANK_VM_OK);
     crankvm_interpreter_getReceiverSlots(self)[index] = value;
+    crankvm_heap_writeBarrier(&self->context->heap, self->objects.receiver, value);
     return CRANK_VM_OK;
 }
 
@@ -239,23 +226,60 @@ crankvm_interpreter_fetchByte(crankvm_interpreter_state_t *self)
     return self->instructions[self->pc++];
 }
 
+CRANK_VM_INLINE void
+crankvm_interpreter_rememberOldMethodContext(crankvm_interpreter_state_t *self)
+{
+    // The stack of the active context is written without write barrier. The frames of the stack zone are scanned as roots.
+    crankvm_heap_t *heap = &self->context->heap;
+    crankvm_object_header_t *methodContextHeader = (crankvm_object_header_t*)self->objects.methodContext;
+    if(!crankvm_heap_isYoung(heap, (crankvm_oop_t)methodContextHeader) &&
+        !crankvm_stack_zone_isFrame(&self->context->stackZone, (crankvm_oop_t)methodContextHeader) &&
+        !crankvm_object_header_getIsRemembered(methodContextHeader))
+        crankvm_heap_remember(heap, methodContextHeader);
+}
+
+static void
+crankvm_interpreter_materializeStackFrames(crankvm_interpreter_state_t *self, bool escaping)
+{
+    self->objects.methodContext = crankvm_stack_zone_materialize(self->context, self->objects.methodContext, escaping);
+}
+
+CRANK_VM_INLINE void
+crankvm_interpreter_reserveStackFrame(crankvm_interpreter_state_t *self)
+{
+    // Empty a full zone before activating, so a context in the heap never has a frame as its sender.
+    crankvm_stack_zone_t *zone = &self->context->stackZone;
+    if(zone->start && !crankvm_stack_zone_hasRoomForFrame(zone))
+        crankvm_interpreter_materializeStackFrames(self, false);
+}
+
 CRANK_VM_INLINE crankvm_error_t
 crankvm_interpreter_fetchMethodContext(crankvm_interpreter_state_t *self)
 {
-    // Validate the context
-    printf("crankvm_interpreter_fetchMethodContext %p\n", self->objects.methodContext);
-    crankvm_error_t error = crankvm_MethodContext_validate(self->context, self->objects.methodContext);
-    if(error)
-        return error;
+    // Validate the context. The frames of the stack zone are always built by the VM.
+    crankvm_error_t error;
+    if(!crankvm_stack_zone_isFrame(&self->context->stackZone, (crankvm_oop_t)self->objects.methodContext))
+    {
+        error = crankvm_MethodContext_validate(self->context, self->objects.methodContext);
+        if(error)
+            return error;
+    }
+
+    crankvm_interpreter_rememberOldMethodContext(self);
 
     // Read some elements for easier access.
     self->objects.receiver = self->objects.methodContext->receiver;
     self->objects.method = (crankvm_CompiledCode_t*)self->objects.methodContext->method;
 
-    // Decode the method/fullblock header.
-    error = crankvm_specialObject_getCompiledCodeHeader(&self->codeHeader, self->objects.method);
+    // Get the decoded method/fullblock header.
+    crankvm_compiled_code_cache_entry_t *codeInfo;
+    error = crankvm_compiled_code_cache_lookup(self->context, self->objects.method, &codeInfo);
     if(error)
         return error;
+    self->codeHeader = codeInfo->header;
+#ifdef CRANK_VM_USE_JIT
+    self->jitMethod = crankvm_jit_noteActivation(self->context, self->objects.method);
+#endif
 
     crankvm_MethodContext_t *methodContext = self->objects.methodContext;
     self->pc = crankvm_oop_decodeSmallInteger(methodContext->baseClass.pc);
@@ -263,25 +287,15 @@ crankvm_interpreter_fetchMethodContext(crankvm_interpreter_state_t *self)
     self->stackLimit = crankvm_object_header_getSlotCount((crankvm_object_header_t *)methodContext);
     if(self->pc <= 0 || self->stackPointer + CRANK_VM_MethodContext_InstanceFixedSize > self->stackLimit)
     {
-        printf("Fetched method context invalid parameters: pc %d sp %d stackLimit %d\n", (int)self->pc, (int)self->stackPointer, (int)self->stackLimit);
+        crankvm_trace(self->context, INVALID_METHOD_CONTEXT, self->pc, self->stackPointer, self->stackLimit);
         return CRANK_VM_ERROR_INVALID_PARAMETER;
     }
 
     self->stackLimit -= CRANK_VM_MethodContext_InstanceFixedSize;
 
+    crankvm_traceWithMethod(self->context, FETCH_METHOD_CONTEXT, self->objects.methodContext, self->pc, self->stackPointer, self->objects.method);
+
     // Get the pointer into the instructions.
-    crankvm_oop_t methodSelector = crankvm_CompiledCode_getSelector(_theContext, self->objects.method);
-
-    crankvm_oop_t methodClass = crankvm_CompiledCode_getClass(_theContext, self->objects.method);
-    crankvm_oop_t methodClassName = crankvm_class_getNameOop(_theContext, methodClass);
-    const char *classType = crankvm_object_isMetaclassInstance(_theContext, methodClass) ? " class" : "";
-
-    printf("\tmethod: %p [%.*s%s >> #%.*s]pc: %d stackp: %d\n",
-        (void*)self->objects.method,
-        crankvm_string_printf_arg(methodClassName),
-        classType,
-        crankvm_string_printf_arg(methodSelector),
-        (int)self->pc, (int)self->stackPointer);
     --self->pc; // Zero based PC.
     self->instructions = (uint8_t*)(self->objects.methodContext->method + sizeof(crankvm_object_header_t));
     self->currentBytecodeSetOffset = self->codeHeader.isAlternateBytecode ? 256 : 0;
@@ -306,12 +320,63 @@ crankvm_interpreter_storeMethodContextState(crankvm_interpreter_state_t *self)
     return CRANK_VM_OK;
 }
 
+/**
+ * Fires the expired timers, makes runnable the processes of the finished
+ * callouts and of the signalled external semaphores, and switches to the
+ * runnable process with the highest priority, when it is higher than the
+ * priority of the active process. The active process resumes at the next
+ * bytecode.
+ */
+static crankvm_error_t
+crankvm_interpreter_preemptActiveProcess(crankvm_interpreter_state_t *self)
+{
+    uint64_t startTime = crankvm_scheduler_getNanoseconds();
+    _theContext->scheduler.interruptRequested = false;
+    crankvm_timer_wheel_advance(_theContext);
+    crankvm_callout_pool_finishSignalledCallouts(_theContext, self);
+    crankvm_scheduler_signalExternalSemaphores(_theContext);
+
+    crankvm_Process_t *activeProcess = crankvm_context_getActiveProcess(_theContext);
+    if(!activeProcess)
+        return CRANK_VM_OK;
+
+    crankvm_LinkedLink_t *runList = crankvm_scheduler_getRunList(_theContext, activeProcess->priority);
+    if(!runList)
+        return CRANK_VM_OK;
+
+    crankvm_Process_t *newProcess = crankvm_scheduler_wakeHighestPriority(_theContext, crankvm_scheduler_getPriority(activeProcess));
+    if(!newProcess)
+        return CRANK_VM_OK;
+
+    // The suspended context of the preempted process is stored in the heap.
+    crankvm_interpreter_storeMethodContextState(self);
+    crankvm_interpreter_materializeStackFrames(self, true);
+    crankvm_scheduler_addLastLink(_theContext, runList, activeProcess);
+
+    ++_theContext->scheduler.preemptionCount;
+    self->objects.methodContext = crankvm_scheduler_transferTo(_theContext, newProcess, self->objects.methodContext, startTime);
+    return crankvm_interpreter_fetchMethodContext(self);
+}
+
+/**
+ * Checks for a requested process switch. The backward jumps and the sends
+ * are the points where the active process can be preempted.
+ */
+CRANK_VM_INLINE crankvm_error_t
+crankvm_interpreter_checkForInterrupts(crankvm_interpreter_state_t *self)
+{
+    if(!_theContext->scheduler.interruptRequested)
+        return CRANK_VM_OK;
+    return crankvm_interpreter_preemptActiveProcess(self);
+}
+
 static crankvm_error_t
 crankvm_interpreter_returnOopActivatingContext(crankvm_interpreter_state_t *self, crankvm_oop_t returnValue, crankvm_MethodContext_t *returnContext)
 {
 
-    // Clear the sender of the context.
+    // Clear the sender of the context, and pop its frame.
     self->objects.methodContext->baseClass.sender = crankvm_specialObject_nil(self->context);
+    crankvm_stack_zone_popFramesAbove(&self->context->stackZone, returnContext);
 
     // If the return context is nil, then it is time to finish the interpreter.
     if(crankvm_object_isNil(self->context, returnContext))
@@ -323,7 +388,7 @@ crankvm_interpreter_returnOopActivatingContext(crankvm_interpreter_state_t *self
     }
 
     // Activate the return context.
-    printf("Returning into context: %p\n", returnContext);
+    crankvm_trace(self->context, RETURN_INTO_CONTEXT, returnContext, 0, 0);
     self->objects.methodContext = returnContext;
     crankvm_interpreter_fetchMethodContext(self);
 
@@ -338,8 +403,12 @@ crankvm_interpreter_localMethodReturnOop(crankvm_interpreter_state_t *self, cran
     // Store back some of the pointers.
     crankvm_interpreter_storeMethodContextState(self);
 
-    crankvm_MethodContext_t *returnContext = (crankvm_MethodContext_t*)self->objects.methodContext->baseClass.sender;
-    return crankvm_interpreter_returnOopActivatingContext(self, returnValue, returnContext);
+    // A context that was never reified is recycled once it has returned.
+    crankvm_MethodContext_t *returningContext = self->objects.methodContext;
+    crankvm_MethodContext_t *returnContext = (crankvm_MethodContext_t*)returningContext->baseClass.sender;
+    crankvm_error_t error = crankvm_interpreter_returnOopActivatingContext(self, returnValue, returnContext);
+    crankvm_stack_zone_recycleContext(&self->context->stackZone, returningContext);
+    return error;
 }
 
 
@@ -371,7 +440,7 @@ crankvm_interpreter_returnOopFromMethod(crankvm_interpreter_state_t *self, crank
     if(unwindContext != nilValue)
     {
         // Unwind
-        printf("TODO: implement block unwind\n");
+        fprintf(stderr, "TODO: implement block unwind\n");
         abort();
     }
 
@@ -379,7 +448,7 @@ crankvm_interpreter_returnOopFromMethod(crankvm_interpreter_state_t *self, crank
     if(currentContext != targetContext)
     {
         // Cannot return.
-        printf("TODO: implement block cannot return\n");
+        fprintf(stderr, "TODO: implement block cannot return\n");
         abort();
     }
 
@@ -393,11 +462,86 @@ crankvm_interpreter_returnOopFromBlock(crankvm_interpreter_state_t *self, crankv
     return crankvm_interpreter_localMethodReturnOop(self, oop);
 }
 
+/**
+ * Replaces the receiver and the arguments of a send that was not activated
+ * with its result, and continues with the instruction after the send.
+ */
+CRANK_VM_INLINE void
+crankvm_interpreter_replaceReceiverAndArguments(crankvm_interpreter_state_t *self, int argumentCount, crankvm_oop_t result)
+{
+    self->stackPointer -= argumentCount;
+    crankvm_oop_t *stackSlots = self->objects.methodContext->stackSlots;
+    for(int i = 0; i < argumentCount; ++i)
+        stackSlots[self->stackPointer + i] = _theContext->roots.nilOop;
+    stackSlots[self->stackPointer - 1] = result;
+    fetchNextInstruction();
+}
+
 static crankvm_error_t
 crankvm_interpreter_inlineQuickMethod(crankvm_interpreter_state_t *self, int expectedArgumentCount, int quickMethodPrimitiveNumber)
 {
-    //UNIMPLEMENTED();
-    return CRANK_VM_ERROR_UNIMPLEMENTED;
+    crankvm_oop_t receiver = crankvm_interpreter_stackOopAt(self, expectedArgumentCount);
+    crankvm_oop_t result;
+    switch(quickMethodPrimitiveNumber)
+    {
+    case CRANK_VM_QUICK_METHOD_RETURN_RECEIVER:
+        result = receiver;
+        break;
+    case CRANK_VM_QUICK_METHOD_RETURN_TRUE:
+        result = _theContext->roots.trueOop;
+        break;
+    case CRANK_VM_QUICK_METHOD_RETURN_FALSE:
+        result = _theContext->roots.falseOop;
+        break;
+    case CRANK_VM_QUICK_METHOD_RETURN_NIL:
+        result = _theContext->roots.nilOop;
+        break;
+    case CRANK_VM_QUICK_METHOD_RETURN_MINUS_ONE ... CRANK_VM_QUICK_METHOD_RETURN_TWO:
+        result = crankvm_oop_encodeSmallInteger(quickMethodPrimitiveNumber - CRANK_VM_QUICK_METHOD_RETURN_MINUS_ONE - 1);
+        break;
+    default:
+        {
+            // Fetch the instance variable. A receiver without it activates the method.
+            size_t slotIndex = quickMethodPrimitiveNumber - CRANK_VM_QUICK_METHOD_RETURN_INSTANCE_VARIABLE;
+            if(crankvm_oop_getFormat(receiver) > CRANK_VM_OBJECT_FORMAT_WEAK_FIXED_SIZE ||
+                slotIndex >= crankvm_object_header_getSlotCount((crankvm_object_header_t*)receiver))
+                return CRANK_VM_ERROR_OUT_OF_BOUNDS;
+            result = ((crankvm_oop_t*)&((crankvm_object_header_t*)receiver)[1])[slotIndex];
+        }
+        break;
+    }
+
+    crankvm_interpreter_replaceReceiverAndArguments(self, expectedArgumentCount, result);
+    return CRANK_VM_OK;
+}
+
+/// I am used for a primitive whose invocation context is inlined. (i.e. I do not create a new activation context for the primitive)
+static crankvm_error_t
+crankvm_interpreter_invokeNormalInlinedPrimitive(crankvm_interpreter_state_t *self, int expectedArgumentCount, int primitiveNumber)
+{
+    // The arguments are read from the stack of the sender.
+    crankvm_primitive_context_t primitiveContext = {
+        .context = _theContext,
+        .interpreter = self,
+        .error = CRANK_VM_PRIMITIVE_SUCCESS,
+        .argumentCount = expectedArgumentCount,
+        .roots = {
+            .arguments = &self->objects.methodContext->stackSlots[self->stackPointer - expectedArgumentCount],
+            .receiver = crankvm_interpreter_stackOopAt(self, expectedArgumentCount),
+            .result = _theContext->roots.nilOop,
+            .primitiveMethodContext = self->objects.methodContext,
+        },
+    };
+
+    crankvm_numberedPrimitiveTable[primitiveNumber](&primitiveContext);
+
+    // The failures are handled by the activated method.
+    if(primitiveContext.error)
+        return CRANK_VM_ERROR_UNSUPPORTED_OPERATION;
+
+    crankvm_trace(self->context, INLINED_PRIMITIVE, primitiveContext.roots.receiver, primitiveNumber, expectedArgumentCount);
+    crankvm_interpreter_replaceReceiverAndArguments(self, expectedArgumentCount, primitiveContext.roots.result);
+    return CRANK_VM_OK;
 }
 
 static crankvm_error_t
@@ -423,16 +567,23 @@ crankvm_interpreter_activateMethodWithArguments(crankvm_interpreter_state_t *sel
             if(!error)
                 return CRANK_VM_OK;
         }
+        else if(crankvm_primitive_isInlinable(parsedPrimitiveNumber))
+        {
+            // The trivial primitives do not need their activation unless they fail.
+            error = crankvm_interpreter_invokeNormalInlinedPrimitive(self, expectedArgumentCount, parsedPrimitiveNumber);
+            if(!error)
+                return CRANK_VM_OK;
+        }
     }
 
     // Should we create a compiled method activation context?
+    crankvm_interpreter_reserveStackFrame(self);
     crankvm_MethodContext_t *newContext = NULL;
     error = crankvm_MethodContext_createCompiledMethodActivationContext(_theContext, &newContext, (crankvm_CompiledCode_t*)methodOop, crankvm_specialObject_nil(self->context), expectedArgumentCount, NULL, &calledHeader, initialPC);
     if(error)
         return error;
 
     // Set the sender context.
-    printf("expectedArgumentCount %d, New context %p slotCount %d\n", expectedArgumentCount, newContext, (int)crankvm_object_header_getSlotCount((crankvm_object_header_t *)newContext));
     newContext->baseClass.sender = (crankvm_oop_t)self->objects.methodContext;
 
     // Pop the arguments into the new context.
@@ -447,32 +598,27 @@ crankvm_interpreter_activateMethodWithArguments(crankvm_interpreter_state_t *sel
 
     // Change into the new context.
     self->objects.methodContext = newContext;
-    printf("Activating new context %p\n", newContext);
-    printf("New context %p slotCount %d\n", newContext, (int)crankvm_object_header_getSlotCount((crankvm_object_header_t *)newContext));
-    return crankvm_interpreter_fetchMethodContext(self);
+    crankvm_trace(self->context, ACTIVATE_CONTEXT, newContext, crankvm_object_header_getSlotCount((crankvm_object_header_t *)newContext), expectedArgumentCount);
+    error = crankvm_interpreter_fetchMethodContext(self);
+    if(error)
+        return error;
+
+    return crankvm_interpreter_checkForInterrupts(self);
 }
 
 static crankvm_error_t
-crankvm_interpreter_sendToWithLookupFrom(crankvm_interpreter_state_t *self, int expectedArgumentCount, crankvm_oop_t selector, crankvm_oop_t receiverClass)
+crankvm_interpreter_sendMethodWithArguments(crankvm_interpreter_state_t *self, int expectedArgumentCount, crankvm_oop_t methodOop)
 {
-    checkSizeToPop(expectedArgumentCount + 1);
-
-    // Check the receiver class.
-    if(crankvm_oop_isNil(_theContext, receiverClass))
-        return CRANK_VM_ERROR_RECEIVER_CLASS_NIL;
-
-    // Lookup the selector
-    crankvm_oop_t methodOop = crankvm_Behavior_lookupSelector(_theContext, (crankvm_Behavior_t*)receiverClass, selector);
     if(crankvm_oop_isNil(_theContext, methodOop))
     {
-        printf("TODO: Send doesNotUnderstand:\n");
+        fprintf(stderr, "TODO: Send doesNotUnderstand:\n");
         UNIMPLEMENTED();
     }
 
     // TODO: Support calling something that is not a compiled code.
     if(!crankvm_oop_isCompiledCode(methodOop))
     {
-        printf("TODO: Send to non-compiled method\n");
+        fprintf(stderr, "TODO: Send to non-compiled method\n");
         UNIMPLEMENTED();
     }
 
@@ -480,6 +626,20 @@ crankvm_interpreter_sendToWithLookupFrom(crankvm_interpreter_state_t *self, int
     return crankvm_interpreter_activateMethodWithArguments(self, expectedArgumentCount, methodOop);
 }
 
+static crankvm_error_t
+crankvm_interpreter_sendToWithLookupFrom(crankvm_interpreter_state_t *self, int expectedArgumentCount, crankvm_oop_t selector, crankvm_oop_t receiverClass)
+{
+    checkSizeToPop(expectedArgumentCount + 1);
+
+    // Check the receiver class.
+    if(crankvm_oop_isNil(_theContext, receiverClass))
+        return CRANK_VM_ERROR_RECEIVER_CLASS_NIL;
+
+    // Lookup the selector
+    crankvm_oop_t methodOop = crankvm_method_cache_lookupSelector(_theContext, (crankvm_Behavior_t*)receiverClass, selector);
+    return crankvm_interpreter_sendMethodWithArguments(self, expectedArgumentCount, methodOop);
+}
+
 static crankvm_MethodContext_t*
 crankvm_interpreter_createMethodContextWithArguments(crankvm_interpreter_state_t *self, crankvm_oop_t methodOop, crankvm_oop_t receiver, size_t expectedArgumentCount, crankvm_oop_t *expectedArguments)
 {
@@ -509,17 +669,17 @@ crankvm_interpreter_createMethodContextForMessageSendWithLookupClass(crankvm_int
         return (crankvm_MethodContext_t*)crankvm_specialObject_nil(_theContext);
 
     // Lookup the selector
-    crankvm_oop_t methodOop = crankvm_Behavior_lookupSelector(_theContext, (crankvm_Behavior_t*)lookupClass, selector);
+    crankvm_oop_t methodOop = crankvm_method_cache_lookupSelector(_theContext, (crankvm_Behavior_t*)lookupClass, selector);
     if(crankvm_oop_isNil(_theContext, methodOop))
     {
-        printf("TODO: create method context for doesNotUnderstand:\n");
+        fprintf(stderr, "TODO: create method context for doesNotUnderstand:\n");
         UNIMPLEMENTED();
     }
 
     // TODO: Support calling something that is not a compiled code.
     if(!crankvm_oop_isCompiledCode(methodOop))
     {
-        printf("TODO: create method context for non-compiled method\n");
+        fprintf(stderr, "TODO: create method context for non-compiled method\n");
         UNIMPLEMENTED();
     }
 
@@ -538,11 +698,26 @@ crankvm_interpreter_sendTo(crankvm_interpreter_state_t *self, int expectedArgume
     checkSizeToPop(expectedArgumentCount + 1);
 
     crankvm_oop_t receiver = crankvm_interpreter_stackOopAt(self, expectedArgumentCount);
-    printf("Send #%.*s to %p\n", crankvm_string_printf_arg(selector), (void*)receiver);
+    crankvm_traceWithStringOop(self->context, SEND, receiver, expectedArgumentCount, 0, selector);
+
+    // Try the inline cache of this send site.
+    uint32_t classTag = crankvm_inline_cache_classTagOf(receiver);
+    crankvm_inline_cache_site_t *site = crankvm_inline_cache_getSite(_theContext, (crankvm_oop_t)self->objects.method, self->pc, selector);
+    crankvm_oop_t methodOop = crankvm_inline_cache_lookup(site, classTag);
+    if(methodOop)
+        return crankvm_interpreter_activateMethodWithArguments(self, expectedArgumentCount, methodOop);
 
     // Get the receiver class.
     crankvm_oop_t receiverClass = crankvm_object_getClass(_theContext, receiver);
-    return crankvm_interpreter_sendToWithLookupFrom(self, expectedArgumentCount, selector, receiverClass);
+    if(crankvm_oop_isNil(_theContext, receiverClass))
+        return CRANK_VM_ERROR_RECEIVER_CLASS_NIL;
+
+    // Lookup the selector, and extend the inline cache.
+    methodOop = crankvm_method_cache_lookupSelector(_theContext, (crankvm_Behavior_t*)receiverClass, selector);
+    if(crankvm_oop_isCompiledCode(methodOop))
+        crankvm_inline_cache_addEntry(site, classTag, methodOop);
+
+    return crankvm_interpreter_sendMethodWithArguments(self, expectedArgumentCount, methodOop);
 }
 
 static crankvm_error_t
@@ -550,8 +725,7 @@ crankvm_interpreter_superSendTo(crankvm_interpreter_state_t *self, int expectedA
 {
     checkSizeToPop(expectedArgumentCount + 1);
 
-    crankvm_oop_t receiver = crankvm_interpreter_stackOopAt(self, expectedArgumentCount);
-    printf("Super Send #%.*s to %p\n", crankvm_string_printf_arg(selector), (void*)receiver);
+    crankvm_traceWithStringOop(self->context, SUPER_SEND, crankvm_interpreter_stackOopAt(self, expectedArgumentCount), expectedArgumentCount, 0, selector);
 
     // Get the super class.
     crankvm_oop_t superClass = crankvm_interpreter_getSuperClass(self);
@@ -564,16 +738,12 @@ crankvm_interpreter_sendToSpecialSelector(crankvm_interpreter_state_t *self, cra
     return crankvm_interpreter_sendTo(self, crankvm_oop_decodeSmallInteger(specialSelector.argumentCountOop), specialSelector.selector);
 }
 
-/// I am used for a primitive whose invocation context is inlined. (i.e. I do not create a new activation context for the primitive)
-/*static crankvm_error_t
-crankvm_interpreter_invokeNormalInlinedPrimitive(crankvm_interpreter_state_t *self, crankvm_primitive_function_t primitiveFunction)
-{
-    UNIMPLEMENTED();
-}*/
-
 static crankvm_error_t
 crankvm_interpreter_invokeNormalPrimitive(crankvm_interpreter_state_t *self, crankvm_primitive_function_t primitiveFunction)
 {
+    // The primitives that replace the method context activate a single frame.
+    crankvm_interpreter_reserveStackFrame(self);
+
     // Create the primitive context
     crankvm_primitive_context_t primitiveContext = {
         .context = _theContext,
@@ -594,9 +764,7 @@ crankvm_interpreter_invokeNormalPrimitive(crankvm_interpreter_state_t *self, cra
     // Did we fail?
     if(primitiveContext.error)
     {
-        crankvm_oop_t errorObject = crankvm_oop_encodeSmallInteger(primitiveContext.error);
-        if(primitiveContext.error < CRANK_VM_PRIMITIVE_ERROR_KNOWN_COUNT)
-            errorObject = _theSpecialObjectsArray->primitiveErrorTable->errorNameArray[primitiveContext.error - 1];
+        crankvm_oop_t errorObject = crankvm_interpreter_getPrimitiveErrorObject(_theContext, primitiveContext.error);
 
         // Store the error object in the first temporary.
         if(self->codeHeader.numberOfTemporaries > self->codeHeader.numberOfArguments)
@@ -607,7 +775,7 @@ crankvm_interpreter_invokeNormalPrimitive(crankvm_interpreter_state_t *self, cra
     // Are we activating a new method?
     if(primitiveContext.roots.primitiveMethodContext != self->objects.methodContext)
     {
-        printf("Activating new context created by primitive: %p\n", primitiveContext.roots.primitiveMethodContext);
+        crankvm_trace(self->context, PRIMITIVE_ACTIVATED_CONTEXT, primitiveContext.roots.primitiveMethodContext, 0, 0);
         self->objects.methodContext = primitiveContext.roots.primitiveMethodContext;
         return crankvm_interpreter_fetchMethodContext(self);
     }
@@ -621,7 +789,7 @@ crankvm_interpreter_getNumberedPrimitive(crankvm_interpreter_state_t *self, unsi
 {
     if(primitiveNumber >= crankvm_numberedPrimitiveTableSize)
     {
-        printf("Using unexistent primitive %d\n", primitiveNumber);
+        crankvm_trace(self->context, UNEXISTENT_PRIMITIVE, primitiveNumber, 0, 0);
         return crankvm_primitive_primitiveFailUnexistent;
     }
 
@@ -629,7 +797,7 @@ crankvm_interpreter_getNumberedPrimitive(crankvm_interpreter_state_t *self, unsi
     if(result)
         return result;
 
-    printf("Using unexistent primitive %d\n", primitiveNumber);
+    crankvm_trace(self->context, UNEXISTENT_PRIMITIVE, primitiveNumber, 0, 0);
     return crankvm_primitive_primitiveFailUnexistent;
 }
 
@@ -713,6 +881,8 @@ crankvm_interpreter_jump(crankvm_interpreter_state_t *self, int delta)
 {
     self->pc += delta;
     fetchNextInstruction();
+    if(delta < 0)
+        return crankvm_interpreter_checkForInterrupts(self);
     return CRANK_VM_OK;
 }
 
@@ -962,6 +1132,7 @@ crankvm_interpreter_bytecodeExtendedStoreMaybePop(crankvm_interpreter_state_t *s
             checkLiteralVariableIndex(variableIndex);
             crankvm_Association_t *literalVariable = (crankvm_Association_t *)crankvm_interpreter_getLiteral(self, variableIndex);
             literalVariable->value = value;
+            crankvm_heap_writeBarrier(&self->context->heap, (crankvm_oop_t)literalVariable, value);
         }
         break;
     default: abort();
@@ -1043,6 +1214,7 @@ crankvm_interpreter_bytecodeDoubleExtendedDoAnything(crankvm_interpreter_state_t
             checkLiteralVariableIndex(literalVariableIndex);
             crankvm_Association_t *literalVariable = (crankvm_Association_t *)crankvm_interpreter_getLiteral(self, literalVariableIndex);
             literalVariable->value = crankvm_interpreter_stackOopAt(self, 0);
+            crankvm_heap_writeBarrier(&self->context->heap, (crankvm_oop_t)literalVariable, literalVariable->value);
             return CRANK_VM_OK;
         }
     default:
@@ -1104,6 +1276,9 @@ static crankvm_error_t
 crankvm_interpreter_bytecodePushThisContext(crankvm_interpreter_state_t *self)
 {
     fetchNextInstruction();
+
+    // The reified context must be a heap object.
+    crankvm_interpreter_materializeStackFrames(self, true);
     pushOop((crankvm_oop_t)self->objects.methodContext);
     return CRANK_VM_OK;
 }
@@ -1145,7 +1320,7 @@ crankvm_interpreter_bytecodeCallPrimitive(crankvm_interpreter_state_t *self)
     // Is this an inline primitive?
     if(primitiveNumber & 0x8000)
     {
-        printf("TODO: Invoke inline primitive: %d\n", primitiveNumber);
+        crankvm_trace(self->context, UNSUPPORTED_INLINE_PRIMITIVE, primitiveNumber, 0, 0);
         return CRANK_VM_ERROR_ILLEGAL_INSTRUCTION;
     }
 
@@ -1184,6 +1359,7 @@ crankvm_interpreter_storeRemoteTemporaryElementInVectorMaybePop(crankvm_interpre
     crankvm_oop_t value = popElement ? popOop() : crankvm_interpreter_stackOopAt(self, 0);
     crankvm_Array_t *remoteVector = (crankvm_Array_t *)remoteVectorOop;
     remoteVector->slots[remoteTemporaryIndex] = value;
+    crankvm_heap_writeBarrier(&self->context->heap, remoteVectorOop, value);
     return CRANK_VM_OK;
 }
 
@@ -1239,6 +1415,8 @@ crankvm_interpreter_bytecodePushClosureCopyCopiedValues(crankvm_interpreter_stat
     if(crankvm_object_isNil(self->context, blockClosure))
         return CRANK_VM_ERROR_OUT_OF_MEMORY;
 
+    // The outer context outlives its frame.
+    crankvm_interpreter_materializeStackFrames(self, true);
     blockClosure->startpc = crankvm_oop_encodeSmallInteger(blockStartPC + 1); // One based PC.
     blockClosure->outerContext = self->objects.methodContext;
 
@@ -1307,69 +1485,341 @@ crankvm_interpreter_bytecodeJumpIfFalse(crankvm_interpreter_state_t *self)
     UNIMPLEMENTED();
 }
 
+/**
+ * Fetches the receiver and the argument of an arithmetic special selector when both are SmallIntegers.
+ */
+CRANK_VM_INLINE bool
+crankvm_interpreter_getSmallIntegerOperands(crankvm_interpreter_state_t *self, intptr_t *left, intptr_t *right)
+{
+    if(self->stackPointer < 2)
+        return false;
+
+    crankvm_oop_t receiver = crankvm_interpreter_stackOopAt(self, 1);
+    crankvm_oop_t argument = crankvm_interpreter_stackOopAt(self, 0);
+    if(!crankvm_oop_isSmallInteger(receiver) || !crankvm_oop_isSmallInteger(argument))
+        return false;
+
+    *left = crankvm_oop_decodeSmallInteger(receiver);
+    *right = crankvm_oop_decodeSmallInteger(argument);
+    return true;
+}
+
+/**
+ * Fetches the receiver and the argument of an arithmetic special selector
+ * when one is a SmallFloat, and the other is a SmallFloat or a SmallInteger.
+ * The comparisons require the SmallInteger to be exact as a double, which
+ * is the case when its magnitude fits in 53 bits. The others are compared
+ * exactly by the image.
+ */
+CRANK_VM_INLINE bool
+crankvm_interpreter_getSmallFloatOperands(crankvm_interpreter_state_t *self, double *left, double *right, bool exactIntegers)
+{
+    if(self->stackPointer < 2)
+        return false;
+
+    crankvm_oop_t receiver = crankvm_interpreter_stackOopAt(self, 1);
+    crankvm_oop_t argument = crankvm_interpreter_stackOopAt(self, 0);
+    crankvm_oop_t integerOperand = 0;
+    if(crankvm_oop_isSmallFloat(receiver))
+        *left = crankvm_oop_decodeSmallFloat(receiver);
+    else if(crankvm_oop_isSmallInteger(receiver) && crankvm_oop_isSmallFloat(argument))
+    {
+        integerOperand = receiver;
+        *left = (double)crankvm_oop_decodeSmallInteger(receiver);
+    }
+    else
+        return false;
+
+    if(crankvm_oop_isSmallFloat(argument))
+        *right = crankvm_oop_decodeSmallFloat(argument);
+    else if(crankvm_oop_isSmallInteger(argument))
+    {
+        integerOperand = argument;
+        *right = (double)crankvm_oop_decodeSmallInteger(argument);
+    }
+    else
+        return false;
+
+    if(exactIntegers && integerOperand)
+    {
+        intptr_t value = crankvm_oop_decodeSmallInteger(integerOperand);
+        if(value < -((intptr_t)1 << 53) || value > ((intptr_t)1 << 53))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Replaces the operands with an integer result. Fails when the result overflows a SmallInteger.
+ */
+CRANK_VM_INLINE bool
+crankvm_interpreter_returnSmallIntegerResult(crankvm_interpreter_state_t *self, intptr_t result)
+{
+    if(!crankvm_oop_isIntegerInSmallIntegerRange(result))
+        return false;
+
+    crankvm_interpreter_replaceReceiverAndArguments(self, 1, crankvm_oop_encodeSmallInteger(result));
+    return true;
+}
+
+/**
+ * Replaces the operands with a float result. Fails when the result cannot be a SmallFloat.
+ */
+CRANK_VM_INLINE bool
+crankvm_interpreter_returnSmallFloatResult(crankvm_interpreter_state_t *self, double result)
+{
+    if(!crankvm_oop_isFloatInSmallFloatRange(result))
+        return false;
+
+    crankvm_interpreter_replaceReceiverAndArguments(self, 1, crankvm_oop_encodeSmallFloat(result));
+    return true;
+}
+
+/**
+ * Decodes the conditional jump that follows the current instruction. Gets
+ * its length, its delta, and the boolean on which it jumps.
+ */
+CRANK_VM_INLINE bool
+crankvm_interpreter_decodeNextConditionalJump(crankvm_interpreter_state_t *self, unsigned int *length, intptr_t *delta, bool *jumpValue)
+{
+    uint8_t nextBytecode = self->instructions[self->pc];
+    if(self->currentBytecodeSetOffset == 0)
+    {
+        // SqueakV3PlusClosures: short jump if false, long jump if true, and long jump if false.
+        if(152 <= nextBytecode && nextBytecode <= 159)
+        {
+            *length = 1;
+            *delta = nextBytecode - 151;
+            *jumpValue = false;
+            return true;
+        }
+        else if(168 <= nextBytecode && nextBytecode <= 175)
+        {
+            *length = 2;
+            *delta = ((nextBytecode & 3) << 8) | self->instructions[self->pc + 1];
+            *jumpValue = nextBytecode < 172;
+            return true;
+        }
+    }
+    else
+    {
+        // SistaV1: short jump if true, and short jump if false.
+        if(184 <= nextBytecode && nextBytecode <= 199)
+        {
+            *length = 1;
+            *delta = (nextBytecode & 7) + 1;
+            *jumpValue = nextBytecode < 192;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Replaces the operands with the result of a comparison. When a conditional
+ * jump follows, the comparison and the jump are executed together, without
+ * pushing the boolean.
+ */
+CRANK_VM_INLINE void
+crankvm_interpreter_returnBooleanResult(crankvm_interpreter_state_t *self, bool result)
+{
+    unsigned int jumpLength;
+    intptr_t jumpDelta;
+    bool jumpValue;
+    if(!crankvm_interpreter_decodeNextConditionalJump(self, &jumpLength, &jumpDelta, &jumpValue))
+    {
+        crankvm_interpreter_replaceReceiverAndArguments(self, 1, result ? _theContext->roots.trueOop : _theContext->roots.falseOop);
+        return;
+    }
+
+    // Pop the operands, and skip or take the jump.
+    crankvm_oop_t *stackSlots = self->objects.methodContext->stackSlots;
+    self->stackPointer -= 2;
+    stackSlots[self->stackPointer] = _theContext->roots.nilOop;
+    stackSlots[self->stackPointer + 1] = _theContext->roots.nilOop;
+
+    self->pc += jumpLength;
+    if(result == jumpValue)
+        self->pc += jumpDelta;
+    fetchNextInstruction();
+}
+
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageAdd(crankvm_interpreter_state_t *self)
 {
+    intptr_t left, right;
+    double leftFloat, rightFloat;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &left, &right))
+    {
+        if(crankvm_interpreter_returnSmallIntegerResult(self, left + right))
+            return CRANK_VM_OK;
+    }
+    else if(crankvm_interpreter_getSmallFloatOperands(self, &leftFloat, &rightFloat, false))
+    {
+        if(crankvm_interpreter_returnSmallFloatResult(self, leftFloat + rightFloat))
+            return CRANK_VM_OK;
+    }
+
     return crankvm_interpreter_sendToSpecialSelector(self,  _theSpecialSelectors->add);
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageMinus(crankvm_interpreter_state_t *self)
 {
+    intptr_t left, right;
+    double leftFloat, rightFloat;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &left, &right))
+    {
+        if(crankvm_interpreter_returnSmallIntegerResult(self, left - right))
+            return CRANK_VM_OK;
+    }
+    else if(crankvm_interpreter_getSmallFloatOperands(self, &leftFloat, &rightFloat, false))
+    {
+        if(crankvm_interpreter_returnSmallFloatResult(self, leftFloat - rightFloat))
+            return CRANK_VM_OK;
+    }
+
     return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->subtract);
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageLessThan(crankvm_interpreter_state_t *self)
 {
-    return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->lessThan);
+    intptr_t left, right;
+    double leftFloat, rightFloat;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &left, &right))
+        crankvm_interpreter_returnBooleanResult(self, left < right);
+    else if(crankvm_interpreter_getSmallFloatOperands(self, &leftFloat, &rightFloat, true))
+        crankvm_interpreter_returnBooleanResult(self, leftFloat < rightFloat);
+    else
+        return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->lessThan);
+    return CRANK_VM_OK;
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageGreaterThan(crankvm_interpreter_state_t *self)
 {
-    return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->greaterThan);
+    intptr_t left, right;
+    double leftFloat, rightFloat;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &left, &right))
+        crankvm_interpreter_returnBooleanResult(self, left > right);
+    else if(crankvm_interpreter_getSmallFloatOperands(self, &leftFloat, &rightFloat, true))
+        crankvm_interpreter_returnBooleanResult(self, leftFloat > rightFloat);
+    else
+        return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->greaterThan);
+    return CRANK_VM_OK;
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageLessEqual(crankvm_interpreter_state_t *self)
 {
-    return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->lessOrEqual);
+    intptr_t left, right;
+    double leftFloat, rightFloat;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &left, &right))
+        crankvm_interpreter_returnBooleanResult(self, left <= right);
+    else if(crankvm_interpreter_getSmallFloatOperands(self, &leftFloat, &rightFloat, true))
+        crankvm_interpreter_returnBooleanResult(self, leftFloat <= rightFloat);
+    else
+        return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->lessOrEqual);
+    return CRANK_VM_OK;
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageGreaterEqual(crankvm_interpreter_state_t *self)
 {
-    return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->greaterOrEqual);
+    intptr_t left, right;
+    double leftFloat, rightFloat;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &left, &right))
+        crankvm_interpreter_returnBooleanResult(self, left >= right);
+    else if(crankvm_interpreter_getSmallFloatOperands(self, &leftFloat, &rightFloat, true))
+        crankvm_interpreter_returnBooleanResult(self, leftFloat >= rightFloat);
+    else
+        return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->greaterOrEqual);
+    return CRANK_VM_OK;
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageEqual(crankvm_interpreter_state_t *self)
 {
-    return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->equal);
+    intptr_t left, right;
+    double leftFloat, rightFloat;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &left, &right))
+        crankvm_interpreter_returnBooleanResult(self, left == right);
+    else if(crankvm_interpreter_getSmallFloatOperands(self, &leftFloat, &rightFloat, true))
+        crankvm_interpreter_returnBooleanResult(self, leftFloat == rightFloat);
+    else
+        return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->equal);
+    return CRANK_VM_OK;
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageNotEqual(crankvm_interpreter_state_t *self)
 {
-    return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->notEqual);
+    intptr_t left, right;
+    double leftFloat, rightFloat;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &left, &right))
+        crankvm_interpreter_returnBooleanResult(self, left != right);
+    else if(crankvm_interpreter_getSmallFloatOperands(self, &leftFloat, &rightFloat, true))
+        crankvm_interpreter_returnBooleanResult(self, leftFloat != rightFloat);
+    else
+        return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->notEqual);
+    return CRANK_VM_OK;
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageMultiply(crankvm_interpreter_state_t *self)
 {
+    intptr_t left, right, result;
+    double leftFloat, rightFloat;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &left, &right))
+    {
+        if(!__builtin_mul_overflow(left, right, &result) && crankvm_interpreter_returnSmallIntegerResult(self, result))
+            return CRANK_VM_OK;
+    }
+    else if(crankvm_interpreter_getSmallFloatOperands(self, &leftFloat, &rightFloat, false))
+    {
+        if(crankvm_interpreter_returnSmallFloatResult(self, leftFloat * rightFloat))
+            return CRANK_VM_OK;
+    }
+
     return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->multiply);
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageDivide(crankvm_interpreter_state_t *self)
 {
+    // Only the exact integer divisions answer an integer. The others answer a Fraction.
+    intptr_t left, right;
+    double leftFloat, rightFloat;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &left, &right))
+    {
+        if(right != 0 && left % right == 0 && crankvm_interpreter_returnSmallIntegerResult(self, left / right))
+            return CRANK_VM_OK;
+    }
+    else if(crankvm_interpreter_getSmallFloatOperands(self, &leftFloat, &rightFloat, false))
+    {
+        if(rightFloat != 0.0 && crankvm_interpreter_returnSmallFloatResult(self, leftFloat / rightFloat))
+            return CRANK_VM_OK;
+    }
+
     return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->divide);
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageRemainder(crankvm_interpreter_state_t *self)
 {
+    intptr_t dividend, divisor;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &dividend, &divisor) && divisor != 0)
+    {
+        // Floored modulo, as in the primitive.
+        intptr_t rem = dividend % divisor;
+        if(rem != 0 && (rem < 0) != (divisor < 0))
+            rem += divisor;
+        if(crankvm_interpreter_returnSmallIntegerResult(self, rem))
+            return CRANK_VM_OK;
+    }
+
     return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->remainder);
 }
 
@@ -1382,42 +1832,148 @@ crankvm_interpreter_bytecodeArithmeticMessageMakePoint(crankvm_interpreter_state
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageBitShift(crankvm_interpreter_state_t *self)
 {
+    intptr_t value, shift;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &value, &shift))
+    {
+        if(shift >= 0)
+        {
+            // The bits shifted out must not change the value. The shift is unsigned, because shifting a negative value left is undefined.
+            if(shift < CRANK_VM_SMALL_INTEGER_USABLE_BITS)
+            {
+                intptr_t result = (intptr_t)((uintptr_t)value << shift);
+                if((result >> shift) == value && crankvm_interpreter_returnSmallIntegerResult(self, result))
+                    return CRANK_VM_OK;
+            }
+        }
+        else
+        {
+            if(crankvm_interpreter_returnSmallIntegerResult(self, shift > -CRANK_VM_OOP_BITS ? value >> -shift : (value < 0 ? -1 : 0)))
+                return CRANK_VM_OK;
+        }
+    }
+
     return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->bitShift);
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageIntegerDivision(crankvm_interpreter_state_t *self)
 {
+    intptr_t dividend, divisor;
+    if(crankvm_interpreter_getSmallIntegerOperands(self, &dividend, &divisor) && divisor != 0)
+    {
+        // Floored division, as in the primitive.
+        intptr_t quotient = dividend / divisor;
+        intptr_t rem = dividend % divisor;
+        if(rem != 0 && (rem < 0) != (divisor < 0))
+            --quotient;
+        if(crankvm_interpreter_returnSmallIntegerResult(self, quotient))
+            return CRANK_VM_OK;
+    }
+
     return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->integerDivide);
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageBitAnd(crankvm_interpreter_state_t *self)
 {
-    return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->bitAnd);
+    intptr_t left, right;
+    if(!crankvm_interpreter_getSmallIntegerOperands(self, &left, &right))
+        return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->bitAnd);
+
+    // The result is always a SmallInteger.
+    crankvm_interpreter_replaceReceiverAndArguments(self, 1, crankvm_oop_encodeSmallInteger(left & right));
+    return CRANK_VM_OK;
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeArithmeticMessageBitOr(crankvm_interpreter_state_t *self)
 {
-    return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->bitOr);
+    intptr_t left, right;
+    if(!crankvm_interpreter_getSmallIntegerOperands(self, &left, &right))
+        return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->bitOr);
+
+    // The result is always a SmallInteger.
+    crankvm_interpreter_replaceReceiverAndArguments(self, 1, crankvm_oop_encodeSmallInteger(left | right));
+    return CRANK_VM_OK;
+}
+
+/**
+ * Gets the at-cache entry of the receiver of an indexed access special
+ * selector. On a miss, the method of the selector is looked up, and the entry
+ * is added when the method is an indexed access primitive.
+ */
+static crankvm_at_cache_entry_t *
+crankvm_interpreter_lookupAtCache(crankvm_interpreter_state_t *self, crankvm_special_selector_with_arg_count_t specialSelector, crankvm_at_cache_access_t access)
+{
+    intptr_t argumentCount = crankvm_oop_decodeSmallInteger(specialSelector.argumentCountOop);
+    if(self->stackPointer <= argumentCount)
+        return NULL;
+
+    crankvm_oop_t receiver = crankvm_interpreter_stackOopAt(self, argumentCount);
+    if(!crankvm_oop_isPointer(receiver))
+        return NULL;
+
+    crankvm_at_cache_entry_t *entry = crankvm_at_cache_lookup(&_theContext->atCache, receiver, access);
+    if(entry)
+        return entry;
+
+    // The other receivers are never added, so their methods are not looked up twice.
+    if(!crankvm_at_cache_isIndexableFormat(crankvm_oop_getFormat(receiver)))
+        return NULL;
+
+    crankvm_oop_t receiverClass = crankvm_object_getClass(_theContext, receiver);
+    if(crankvm_oop_isNil(_theContext, receiverClass))
+        return NULL;
+
+    crankvm_oop_t methodOop = crankvm_method_cache_lookupSelector(_theContext, (crankvm_Behavior_t*)receiverClass, specialSelector.selector);
+    crankvm_compiled_code_cache_entry_t *codeEntry;
+    if(!crankvm_oop_isCompiledCode(methodOop) || crankvm_compiled_code_cache_lookup(_theContext, (crankvm_CompiledCode_t*)methodOop, &codeEntry))
+        return NULL;
+
+    return crankvm_at_cache_addAccess(_theContext, receiver, access, codeEntry->primitiveNumber);
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeSpecialMessageAt(crankvm_interpreter_state_t *self)
 {
+    crankvm_at_cache_entry_t *entry = crankvm_interpreter_lookupAtCache(self, _theSpecialSelectors->at, CRANK_VM_AT_CACHE_ACCESS_AT);
+    crankvm_oop_t element;
+    if(entry && crankvm_at_cache_at(entry, crankvm_interpreter_stackOopAt(self, 0), &element))
+    {
+        crankvm_interpreter_replaceReceiverAndArguments(self, 1, element);
+        return CRANK_VM_OK;
+    }
+
     return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->at);
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeSpecialMessageAtPut(crankvm_interpreter_state_t *self)
 {
+    crankvm_at_cache_entry_t *entry = crankvm_interpreter_lookupAtCache(self, _theSpecialSelectors->atPut, CRANK_VM_AT_CACHE_ACCESS_AT_PUT);
+    if(entry)
+    {
+        crankvm_oop_t value = crankvm_interpreter_stackOopAt(self, 0);
+        if(crankvm_at_cache_atPut(&_theContext->heap, entry, crankvm_interpreter_stackOopAt(self, 1), value))
+        {
+            crankvm_interpreter_replaceReceiverAndArguments(self, 2, value);
+            return CRANK_VM_OK;
+        }
+    }
+
     return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->atPut);
 }
 
 static crankvm_error_t
 crankvm_interpreter_bytecodeSpecialMessageSize(crankvm_interpreter_state_t *self)
 {
+    crankvm_at_cache_entry_t *entry = crankvm_interpreter_lookupAtCache(self, _theSpecialSelectors->size, CRANK_VM_AT_CACHE_ACCESS_SIZE);
+    if(entry)
+    {
+        crankvm_interpreter_replaceReceiverAndArguments(self, 0, crankvm_oop_encodeSmallInteger(entry->size));
+        return CRANK_VM_OK;
+    }
+
     return crankvm_interpreter_sendToSpecialSelector(self, _theSpecialSelectors->size);
 }
 
@@ -1664,26 +2220,246 @@ crankvm_interpreter_bytecodePopStoreTemporalInVector(crankvm_interpreter_state_t
 
 // </editor-fold> End of implementation of the bytecodes.
 
-crankvm_error_t
-crankvm_interpreter_run(crankvm_interpreter_state_t *self)
+static void
+crankvm_interpreter_collectGarbage(crankvm_interpreter_state_t *self)
 {
-    if(self->callerReturnValuePointer)
-        *self->callerReturnValuePointer = crankvm_specialObject_nil(self->context);
+    crankvm_oop_t *roots[] = {
+        (crankvm_oop_t*)&self->objects.methodContext,
+        (crankvm_oop_t*)&self->objects.method,
+        &self->objects.receiver,
+    };
+    if(self->context->heap.fullGCRequested)
+        crankvm_heap_fullGarbageCollect(self->context, sizeof(roots) / sizeof(roots[0]), roots);
+    else
+        crankvm_heap_scavenge(self->context, sizeof(roots) / sizeof(roots[0]), roots);
+
+    // Refresh the pointers into the objects that may have been moved.
+    self->instructions = (uint8_t*)((crankvm_oop_t)self->objects.method + sizeof(crankvm_object_header_t));
+    crankvm_interpreter_rememberOldMethodContext(self);
+}
+
+void
+crankvm_interpreter_fullGarbageCollectFromPrimitive(crankvm_primitive_context_t *primitiveContext)
+{
+    crankvm_interpreter_state_t *self = primitiveContext->interpreter;
+    crankvm_oop_t *roots[] = {
+        (crankvm_oop_t*)&self->objects.methodContext,
+        (crankvm_oop_t*)&self->objects.method,
+        &self->objects.receiver,
+        &primitiveContext->roots.receiver,
+        &primitiveContext->roots.result,
+        (crankvm_oop_t*)&primitiveContext->roots.primitiveMethodContext,
+    };
+    crankvm_heap_fullGarbageCollect(self->context, sizeof(roots) / sizeof(roots[0]), roots);
 
-    // Validate and fetch the method context
-    crankvm_error_t error = crankvm_interpreter_fetchMethodContext(self);
-    if(error)
-        return error;
+    // Refresh the pointers into the objects that may have been moved.
+    self->instructions = (uint8_t*)((crankvm_oop_t)self->objects.method + sizeof(crankvm_object_header_t));
+    crankvm_interpreter_rememberOldMethodContext(self);
+    primitiveContext->roots.arguments = &self->objects.methodContext->stackSlots[0];
+}
 
-    // Fetch the first instruction.
-    self->returnFromInterpreter = false;
-    while(!self->returnFromInterpreter)
+void
+crankvm_interpreter_scavengeFromPrimitive(crankvm_primitive_context_t *primitiveContext)
+{
+    crankvm_interpreter_state_t *self = primitiveContext->interpreter;
+    crankvm_oop_t *roots[] = {
+        (crankvm_oop_t*)&self->objects.methodContext,
+        (crankvm_oop_t*)&self->objects.method,
+        &self->objects.receiver,
+        &primitiveContext->roots.receiver,
+        &primitiveContext->roots.result,
+        (crankvm_oop_t*)&primitiveContext->roots.primitiveMethodContext,
+    };
+    crankvm_heap_scavenge(self->context, sizeof(roots) / sizeof(roots[0]), roots);
+
+    // Refresh the pointers into the objects that may have been moved.
+    self->instructions = (uint8_t*)((crankvm_oop_t)self->objects.method + sizeof(crankvm_object_header_t));
+    crankvm_interpreter_rememberOldMethodContext(self);
+    primitiveContext->roots.arguments = &self->objects.methodContext->stackSlots[0];
+}
+
+void
+crankvm_interpreter_materializeStackFramesFromPrimitive(crankvm_primitive_context_t *primitiveContext)
+{
+    crankvm_interpreter_state_t *self = primitiveContext->interpreter;
+    crankvm_interpreter_materializeStackFrames(self, true);
+    primitiveContext->roots.primitiveMethodContext = self->objects.methodContext;
+    primitiveContext->roots.arguments = &self->objects.methodContext->stackSlots[0];
+}
+
+crankvm_MethodContext_t *
+crankvm_interpreter_materializePrimitiveMethodContext(crankvm_primitive_context_t *primitiveContext)
+{
+    crankvm_interpreter_storeMethodContextState(primitiveContext->interpreter);
+    crankvm_interpreter_materializeStackFramesFromPrimitive(primitiveContext);
+    return primitiveContext->roots.primitiveMethodContext;
+}
+
+CRANK_VM_INLINE void
+crankvm_interpreter_beginBytecode(crankvm_interpreter_state_t *self)
+{
+    // Between bytecodes all the interpreter references are known, so this is a safe point for collecting garbage.
+    if(self->context->heap.newSpace.scavengeRequested)
+        crankvm_interpreter_collectGarbage(self);
+
+    self->currentBytecode = self->nextBytecode;
+    self->pc = self->nextPC;
+    crankvm_trace(self->context, BYTECODE, self->pc, self->currentBytecode + self->currentBytecodeSetOffset, self->stackPointer);
+}
+
+#ifdef CRANK_VM_USE_JIT
+
+// The implementations called by the native code, one per opcode of both bytecode sets.
+static const crankvm_jit_bytecode_template_t crankvm_interpreter_jitTemplates[512] = {
+#define BYTECODE_WITH_IMPLICIT_PARAM(opcode, name, implicitParam) [opcode + BYTECODE_TABLE_OFFSET] = {(crankvm_jit_bytecode_function_t)crankvm_interpreter_bytecode ## name, implicitParam},
+#define BYTECODE(opcode, name) [opcode + BYTECODE_TABLE_OFFSET] = {(crankvm_jit_bytecode_function_t)crankvm_interpreter_bytecode ## name, 0},
+#define UNDEFINED_BYTECODE(opcode) // Left to the interpreter.
+
+// SqueakV3Plus closures bytecode set
+#define BYTECODE_TABLE_OFFSET 0
+#include "SqueakV3PlusClosuresBytecodeSetTable.inc"
+#undef BYTECODE_TABLE_OFFSET
+
+// SistaV1 set
+#define BYTECODE_TABLE_OFFSET 256
+#include "SistaV1BytecodeSetTable.inc"
+#undef BYTECODE_TABLE_OFFSET
+
+#undef BYTECODE_WITH_IMPLICIT_PARAM
+#undef BYTECODE
+#undef UNDEFINED_BYTECODE
+};
+
+/**
+ * Runs the native code from the next bytecode, for as long as the fetched
+ * method contexts have native code for their next bytecode. The active
+ * method is compiled first when it is hot.
+ */
+static crankvm_error_t
+crankvm_interpreter_runNativeCode(crankvm_interpreter_state_t *self)
+{
+    crankvm_jit_method_t *jitMethod;
+    while((jitMethod = self->jitMethod) && jitMethod->method == (crankvm_oop_t)self->objects.method)
     {
-        self->currentBytecode = self->nextBytecode;
-        self->pc = self->nextPC;
+        // No native code is running here, so the code zone can be emptied.
+        if(!jitMethod->code &&
+            !crankvm_jit_compile(self->context, jitMethod, self->objects.method, &self->codeHeader, self->currentBytecodeSetOffset, crankvm_interpreter_jitTemplates))
+        {
+            self->jitMethod = NULL;
+            return CRANK_VM_OK;
+        }
+
+        void *entry = crankvm_jit_entryAt(jitMethod->code, self->nextPC);
+        if(!entry)
+            return CRANK_VM_OK;
+
+        crankvm_error_t error = jitMethod->code->function(self, entry);
+        if(error || self->returnFromInterpreter)
+            return error;
+
+        // The interpreter collects the garbage before the next bytecode.
+        if(self->context->heap.newSpace.scavengeRequested)
+            return CRANK_VM_OK;
+    }
+
+    return CRANK_VM_OK;
+}
+
+#define runNativeCode() do { \
+    if(self->jitMethod) { \
+        error = crankvm_interpreter_runNativeCode(self); \
+        if(error) return error; \
+        if(self->returnFromInterpreter) return CRANK_VM_OK; \
+    } \
+} while(0)
+
+#else /* !CRANK_VM_USE_JIT */
+
+#define runNativeCode() do {} while(0)
+
+#endif /* CRANK_VM_USE_JIT */
+
+#ifdef CRANK_VM_USE_THREADED_DISPATCH
+
+#define CRANK_VM_BYTECODE_LABEL_NAME_(offset, opcode) bytecode_ ## offset ## _ ## opcode
+#define CRANK_VM_BYTECODE_LABEL_NAME(offset, opcode) CRANK_VM_BYTECODE_LABEL_NAME_(offset, opcode)
+
+static crankvm_error_t
+crankvm_interpreter_dispatchBytecodes(crankvm_interpreter_state_t *self)
+{
+    // The dispatch table, one label per opcode of both bytecode sets.
+    static const void * const dispatchTable[512] = {
+#define BYTECODE_WITH_IMPLICIT_PARAM(opcode, name, implicitParam) [opcode + BYTECODE_TABLE_OFFSET] = &&CRANK_VM_BYTECODE_LABEL_NAME(BYTECODE_TABLE_OFFSET, opcode),
+#define BYTECODE(opcode, name) [opcode + BYTECODE_TABLE_OFFSET] = &&CRANK_VM_BYTECODE_LABEL_NAME(BYTECODE_TABLE_OFFSET, opcode),
+#define UNDEFINED_BYTECODE(opcode) [opcode + BYTECODE_TABLE_OFFSET] = &&undefinedBytecode,
+
+// SqueakV3Plus closures bytecode set
+#define BYTECODE_TABLE_OFFSET 0
+#include "SqueakV3PlusClosuresBytecodeSetTable.inc"
+#undef BYTECODE_TABLE_OFFSET
+
+// SistaV1 set
+#define BYTECODE_TABLE_OFFSET 256
+#include "SistaV1BytecodeSetTable.inc"
+#undef BYTECODE_TABLE_OFFSET
+
+#undef BYTECODE_WITH_IMPLICIT_PARAM
+#undef BYTECODE
+#undef UNDEFINED_BYTECODE
+    };
+
+    // Each bytecode implementation jumps directly into the next one.
+#define dispatchNextBytecode() do { \
+    if(error) return error; \
+    if(self->returnFromInterpreter) return CRANK_VM_OK; \
+    runNativeCode(); \
+    crankvm_interpreter_beginBytecode(self); \
+    goto *dispatchTable[self->currentBytecode + self->currentBytecodeSetOffset]; \
+} while(0)
+
+    crankvm_error_t error = CRANK_VM_OK;
+    dispatchNextBytecode();
+
+#define BYTECODE_WITH_IMPLICIT_PARAM(opcode, name, implicitParam) \
+    CRANK_VM_BYTECODE_LABEL_NAME(BYTECODE_TABLE_OFFSET, opcode): \
+        error = crankvm_interpreter_bytecode ## name (self, implicitParam);\
+        dispatchNextBytecode();
+#define BYTECODE(opcode, name) \
+    CRANK_VM_BYTECODE_LABEL_NAME(BYTECODE_TABLE_OFFSET, opcode): \
+        error = crankvm_interpreter_bytecode ## name (self);\
+        dispatchNextBytecode();
+#define UNDEFINED_BYTECODE(opcode) // Shared undefined bytecode label.
+
+// SqueakV3Plus closures bytecode set
+#define BYTECODE_TABLE_OFFSET 0
+#include "SqueakV3PlusClosuresBytecodeSetTable.inc"
+#undef BYTECODE_TABLE_OFFSET
 
-        int bytecodePC = self->pc;
-        printf("Bytecode: [%04d: %02X,SP:%02d]%s\n", (int)bytecodePC, self->currentBytecode, (int)self->stackPointer, bytecodeNameTable[self->currentBytecode + self->currentBytecodeSetOffset]);
+// SistaV1 set
+#define BYTECODE_TABLE_OFFSET 256
+#include "SistaV1BytecodeSetTable.inc"
+#undef BYTECODE_TABLE_OFFSET
+
+#undef BYTECODE_WITH_IMPLICIT_PARAM
+#undef BYTECODE
+#undef UNDEFINED_BYTECODE
+
+undefinedBytecode:
+    return CRANK_VM_OK;
+
+#undef dispatchNextBytecode
+}
+
+#else /* !CRANK_VM_USE_THREADED_DISPATCH */
+
+static crankvm_error_t
+crankvm_interpreter_dispatchBytecodes(crankvm_interpreter_state_t *self)
+{
+    crankvm_error_t error = CRANK_VM_OK;
+    while(!self->returnFromInterpreter)
+    {
+        runNativeCode();
+        crankvm_interpreter_beginBytecode(self);
 
         switch(self->currentBytecode + self->currentBytecodeSetOffset)
         {
@@ -1723,6 +2499,26 @@ crankvm_interpreter_run(crankvm_interpreter_state_t *self)
     return CRANK_VM_OK;
 }
 
+#endif /* CRANK_VM_USE_THREADED_DISPATCH */
+
+#undef runNativeCode
+
+crankvm_error_t
+crankvm_interpreter_run(crankvm_interpreter_state_t *self)
+{
+    if(self->callerReturnValuePointer)
+        *self->callerReturnValuePointer = crankvm_specialObject_nil(self->context);
+
+    // Validate and fetch the method context
+    crankvm_error_t error = crankvm_interpreter_fetchMethodContext(self);
+    if(error)
+        return error;
+
+    // Fetch the first instruction.
+    self->returnFromInterpreter = false;
+    return crankvm_interpreter_dispatchBytecodes(self);
+}
+
 crankvm_error_t
 crankvm_interpret(crankvm_context_t *context, crankvm_MethodContext_t *methodContext, crankvm_oop_t *callerReturnValuePointer)
 {
@@ -0,0 +1,636 @@
+#include "jit.h"
+#include "interpreter-internal.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CRANK_VM_USE_JIT
+
+#include <sys/mman.h>
+
+/**
+ * Emits x86-64 machine code into the code zone. The emission stops silently
+ * when the zone is exhausted, and the overflow is checked at the end.
+ */
+typedef struct crankvm_jit_assembler_s
+{
+    uint8_t *position;
+    uint8_t *end;
+    bool overflow;
+} crankvm_jit_assembler_t;
+
+// The condition codes of the jumps.
+#define CRANK_VM_JIT_CONDITION_AE 0x3
+#define CRANK_VM_JIT_CONDITION_E 0x4
+#define CRANK_VM_JIT_CONDITION_NE 0x5
+#define CRANK_VM_JIT_CONDITION_GE 0xD
+#define CRANK_VM_JIT_CONDITION_LE 0xE
+
+/**
+ * How a bytecode is translated. The stack bytecodes are emitted inline, and
+ * the others call their implementation. The straight line bytecodes cannot
+ * send, return, jump or allocate, so they always continue with the bytecode
+ * that follows them.
+ */
+typedef enum crankvm_jit_bytecode_kind_e
+{
+    CRANK_VM_JIT_BYTECODE_CALL = 0,
+    CRANK_VM_JIT_BYTECODE_STRAIGHT_LINE,
+    CRANK_VM_JIT_BYTECODE_PUSH_TEMPORARY,
+    CRANK_VM_JIT_BYTECODE_PUSH_RECEIVER,
+    CRANK_VM_JIT_BYTECODE_PUSH_TRUE,
+    CRANK_VM_JIT_BYTECODE_PUSH_FALSE,
+    CRANK_VM_JIT_BYTECODE_PUSH_NIL,
+    CRANK_VM_JIT_BYTECODE_PUSH_SMALL_INTEGER,
+    CRANK_VM_JIT_BYTECODE_DUPLICATE,
+    CRANK_VM_JIT_BYTECODE_POP,
+    CRANK_VM_JIT_BYTECODE_POP_STORE_TEMPORARY,
+} crankvm_jit_bytecode_kind_t;
+
+// The interpreter state and the method context of the run are in callee saved registers.
+#define CRANK_VM_JIT_STATE_OFFSET(field) ((int32_t)offsetof(crankvm_interpreter_state_t, field))
+
+static void
+crankvm_jit_emitByte(crankvm_jit_assembler_t *assembler, uint8_t byte)
+{
+    if(assembler->position >= assembler->end)
+    {
+        assembler->overflow = true;
+        return;
+    }
+
+    *assembler->position++ = byte;
+}
+
+static void
+crankvm_jit_emitInt32(crankvm_jit_assembler_t *assembler, int32_t value)
+{
+    for(int i = 0; i < 4; ++i)
+        crankvm_jit_emitByte(assembler, (uint32_t)value >> (i*8));
+}
+
+static void
+crankvm_jit_emitInt64(crankvm_jit_assembler_t *assembler, uint64_t value)
+{
+    for(int i = 0; i < 8; ++i)
+        crankvm_jit_emitByte(assembler, value >> (i*8));
+}
+
+static void
+crankvm_jit_emitRelativeTarget(crankvm_jit_assembler_t *assembler, uint8_t *target)
+{
+    crankvm_jit_emitInt32(assembler, (int32_t)(target - (assembler->position + 4)));
+}
+
+/// jmp target
+static void
+crankvm_jit_emitJump(crankvm_jit_assembler_t *assembler, uint8_t *target)
+{
+    crankvm_jit_emitByte(assembler, 0xE9);
+    crankvm_jit_emitRelativeTarget(assembler, target);
+}
+
+/// jcc target
+static void
+crankvm_jit_emitJumpIf(crankvm_jit_assembler_t *assembler, int condition, uint8_t *target)
+{
+    crankvm_jit_emitByte(assembler, 0x0F);
+    crankvm_jit_emitByte(assembler, 0x80 | condition);
+    crankvm_jit_emitRelativeTarget(assembler, target);
+}
+
+/// mov rax, [rbx + offset]
+static void
+crankvm_jit_emitLoadStateField(crankvm_jit_assembler_t *assembler, int32_t offset)
+{
+    crankvm_jit_emitByte(assembler, 0x48);
+    crankvm_jit_emitByte(assembler, 0x8B);
+    crankvm_jit_emitByte(assembler, 0x83);
+    crankvm_jit_emitInt32(assembler, offset);
+}
+
+/// cmp byte [rbx + offset], 0
+static void
+crankvm_jit_emitTestStateFlag(crankvm_jit_assembler_t *assembler, int32_t offset)
+{
+    crankvm_jit_emitByte(assembler, 0x80);
+    crankvm_jit_emitByte(assembler, 0xBB);
+    crankvm_jit_emitInt32(assembler, offset);
+    crankvm_jit_emitByte(assembler, 0);
+}
+
+/// cmp rax, value
+static void
+crankvm_jit_emitCompareRAX(crankvm_jit_assembler_t *assembler, int32_t value)
+{
+    crankvm_jit_emitByte(assembler, 0x48);
+    crankvm_jit_emitByte(assembler, 0x3D);
+    crankvm_jit_emitInt32(assembler, value);
+}
+
+/// mov rax, imm64; mov rax, [rax]
+static void
+crankvm_jit_emitLoadGlobal(crankvm_jit_assembler_t *assembler, void *address)
+{
+    crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0xB8);
+    crankvm_jit_emitInt64(assembler, (uint64_t)(uintptr_t)address);
+    crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x8B); crankvm_jit_emitByte(assembler, 0x00);
+}
+
+/// mov rdx, [rbx + stackPointer]
+static void
+crankvm_jit_emitLoadStackPointer(crankvm_jit_assembler_t *assembler)
+{
+    crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x8B); crankvm_jit_emitByte(assembler, 0x93);
+    crankvm_jit_emitInt32(assembler, CRANK_VM_JIT_STATE_OFFSET(stackPointer));
+}
+
+/// mov [rbx + stackPointer], rdx
+static void
+crankvm_jit_emitStoreStackPointer(crankvm_jit_assembler_t *assembler)
+{
+    crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x89); crankvm_jit_emitByte(assembler, 0x93);
+    crankvm_jit_emitInt32(assembler, CRANK_VM_JIT_STATE_OFFSET(stackPointer));
+}
+
+/// mov [r12 + rdx*8 + stackSlots + offset], rax or rcx
+static void
+crankvm_jit_emitStoreStackSlot(crankvm_jit_assembler_t *assembler, bool fromRCX, int32_t offset)
+{
+    crankvm_jit_emitByte(assembler, 0x49); crankvm_jit_emitByte(assembler, 0x89); crankvm_jit_emitByte(assembler, fromRCX ? 0x8C : 0x84);
+    crankvm_jit_emitByte(assembler, 0xD4);
+    crankvm_jit_emitInt32(assembler, (int32_t)offsetof(crankvm_MethodContext_t, stackSlots) + offset);
+}
+
+/// The scavenge is requested by an allocation, and the interpreter performs it before the next bytecode.
+static void
+crankvm_jit_emitScavengeCheck(crankvm_jit_assembler_t *assembler, crankvm_context_t *context, uint8_t *exit)
+{
+    // mov rax, &scavengeRequested; cmp byte [rax], 0
+    crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0xB8);
+    crankvm_jit_emitInt64(assembler, (uint64_t)(uintptr_t)&context->heap.newSpace.scavengeRequested);
+    crankvm_jit_emitByte(assembler, 0x80); crankvm_jit_emitByte(assembler, 0x38); crankvm_jit_emitByte(assembler, 0x00);
+    crankvm_jit_emitJumpIf(assembler, CRANK_VM_JIT_CONDITION_NE, exit);
+}
+
+/**
+ * Emits the shared code of a method: the entry, which jumps to the entry of a
+ * bytecode, the exits, and the dispatch on the next pc in rax. Returns the
+ * addresses of the exits and of the dispatch.
+ */
+static void
+crankvm_jit_emitPrologue(crankvm_jit_assembler_t *assembler, crankvm_context_t *context, crankvm_jit_code_t *code, uint8_t **exit, uint8_t **exitWithError, uint8_t **dispatch)
+{
+    // xor eax, eax
+    *exit = assembler->position;
+    crankvm_jit_emitByte(assembler, 0x31); crankvm_jit_emitByte(assembler, 0xC0);
+
+    // pop r13; pop r12; pop rbx; ret
+    *exitWithError = assembler->position;
+    crankvm_jit_emitByte(assembler, 0x41); crankvm_jit_emitByte(assembler, 0x5D);
+    crankvm_jit_emitByte(assembler, 0x41); crankvm_jit_emitByte(assembler, 0x5C);
+    crankvm_jit_emitByte(assembler, 0x5B);
+    crankvm_jit_emitByte(assembler, 0xC3);
+
+    // The entry of the function: push rbx; push r12; push r13. This also aligns the stack for the calls.
+    code->function = (crankvm_jit_native_function_t)assembler->position;
+    crankvm_jit_emitByte(assembler, 0x53);
+    crankvm_jit_emitByte(assembler, 0x41); crankvm_jit_emitByte(assembler, 0x54);
+    crankvm_jit_emitByte(assembler, 0x41); crankvm_jit_emitByte(assembler, 0x55);
+
+    // mov rbx, rdi
+    crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x89); crankvm_jit_emitByte(assembler, 0xFB);
+
+    // mov r12, [rbx + methodContext]
+    crankvm_jit_emitByte(assembler, 0x4C); crankvm_jit_emitByte(assembler, 0x8B); crankvm_jit_emitByte(assembler, 0xA3);
+    crankvm_jit_emitInt32(assembler, CRANK_VM_JIT_STATE_OFFSET(objects.methodContext));
+
+    // mov r13, entries
+    crankvm_jit_emitByte(assembler, 0x49); crankvm_jit_emitByte(assembler, 0xBD);
+    crankvm_jit_emitInt64(assembler, (uint64_t)(uintptr_t)code->entries);
+
+    crankvm_jit_emitScavengeCheck(assembler, context, *exit);
+
+    // jmp rsi
+    crankvm_jit_emitByte(assembler, 0xFF); crankvm_jit_emitByte(assembler, 0xE6);
+
+    // Jump to the entry of the next pc, or exit when it has none.
+    *dispatch = assembler->position;
+    crankvm_jit_emitScavengeCheck(assembler, context, *exit);
+    crankvm_jit_emitLoadStateField(assembler, CRANK_VM_JIT_STATE_OFFSET(nextPC));
+    crankvm_jit_emitCompareRAX(assembler, (int32_t)code->entryCount);
+    crankvm_jit_emitJumpIf(assembler, CRANK_VM_JIT_CONDITION_AE, *exit);
+
+    // mov rax, [r13 + rax*8]; test rax, rax
+    crankvm_jit_emitByte(assembler, 0x49); crankvm_jit_emitByte(assembler, 0x8B); crankvm_jit_emitByte(assembler, 0x44);
+    crankvm_jit_emitByte(assembler, 0xC5); crankvm_jit_emitByte(assembler, 0x00);
+    crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x85); crankvm_jit_emitByte(assembler, 0xC0);
+    crankvm_jit_emitJumpIf(assembler, CRANK_VM_JIT_CONDITION_E, *exit);
+
+    // jmp rax
+    crankvm_jit_emitByte(assembler, 0xFF); crankvm_jit_emitByte(assembler, 0xE0);
+}
+
+/**
+ * Emits a template that manipulates the stack directly. The interpreter runs
+ * the bytecode instead when it would fail, so the template exits with the
+ * bytecode as the next one. It leaves the next pc and the next bytecode as
+ * the interpreter would.
+ */
+static void
+crankvm_jit_emitStackBytecode(crankvm_jit_assembler_t *assembler, crankvm_context_t *context, crankvm_jit_bytecode_kind_t kind, int operand,
+    intptr_t nextPC, int nextBytecode, uint8_t *exit)
+{
+    int32_t temporaryOffset = (int32_t)offsetof(crankvm_MethodContext_t, stackSlots) + operand * (int32_t)sizeof(crankvm_oop_t);
+    crankvm_jit_emitLoadStackPointer(assembler);
+    switch(kind)
+    {
+    case CRANK_VM_JIT_BYTECODE_PUSH_TEMPORARY:
+        // cmp rdx, index; jle exit; mov rax, [r12 + temporary]
+        crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x81); crankvm_jit_emitByte(assembler, 0xFA);
+        crankvm_jit_emitInt32(assembler, operand);
+        crankvm_jit_emitJumpIf(assembler, CRANK_VM_JIT_CONDITION_LE, exit);
+        crankvm_jit_emitByte(assembler, 0x49); crankvm_jit_emitByte(assembler, 0x8B); crankvm_jit_emitByte(assembler, 0x84);
+        crankvm_jit_emitByte(assembler, 0x24);
+        crankvm_jit_emitInt32(assembler, temporaryOffset);
+        break;
+    case CRANK_VM_JIT_BYTECODE_PUSH_RECEIVER:
+        crankvm_jit_emitLoadStateField(assembler, CRANK_VM_JIT_STATE_OFFSET(objects.receiver));
+        break;
+    case CRANK_VM_JIT_BYTECODE_PUSH_TRUE:
+        crankvm_jit_emitLoadGlobal(assembler, &context->roots.trueOop);
+        break;
+    case CRANK_VM_JIT_BYTECODE_PUSH_FALSE:
+        crankvm_jit_emitLoadGlobal(assembler, &context->roots.falseOop);
+        break;
+    case CRANK_VM_JIT_BYTECODE_PUSH_NIL:
+        crankvm_jit_emitLoadGlobal(assembler, &context->roots.nilOop);
+        break;
+    case CRANK_VM_JIT_BYTECODE_PUSH_SMALL_INTEGER:
+        // mov rax, value
+        crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0xC7); crankvm_jit_emitByte(assembler, 0xC0);
+        crankvm_jit_emitInt32(assembler, (int32_t)crankvm_oop_encodeSmallInteger(operand));
+        break;
+    case CRANK_VM_JIT_BYTECODE_DUPLICATE:
+        // test rdx, rdx; jle exit; mov rax, [r12 + rdx*8 + stackSlots - 8]
+        crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x85); crankvm_jit_emitByte(assembler, 0xD2);
+        crankvm_jit_emitJumpIf(assembler, CRANK_VM_JIT_CONDITION_LE, exit);
+        crankvm_jit_emitByte(assembler, 0x49); crankvm_jit_emitByte(assembler, 0x8B); crankvm_jit_emitByte(assembler, 0x84);
+        crankvm_jit_emitByte(assembler, 0xD4);
+        crankvm_jit_emitInt32(assembler, (int32_t)offsetof(crankvm_MethodContext_t, stackSlots) - (int32_t)sizeof(crankvm_oop_t));
+        break;
+    case CRANK_VM_JIT_BYTECODE_POP:
+        // test rdx, rdx; jle exit; sub rdx, 1; store nil
+        crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x85); crankvm_jit_emitByte(assembler, 0xD2);
+        crankvm_jit_emitJumpIf(assembler, CRANK_VM_JIT_CONDITION_LE, exit);
+        crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x83); crankvm_jit_emitByte(assembler, 0xEA); crankvm_jit_emitByte(assembler, 0x01);
+        crankvm_jit_emitLoadGlobal(assembler, &context->roots.nilOop);
+        crankvm_jit_emitStoreStackSlot(assembler, false, 0);
+        break;
+    case CRANK_VM_JIT_BYTECODE_POP_STORE_TEMPORARY:
+        // cmp rdx, index; jle exit; sub rdx, 1; mov rcx, [r12 + rdx*8 + stackSlots]
+        crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x81); crankvm_jit_emitByte(assembler, 0xFA);
+        crankvm_jit_emitInt32(assembler, operand);
+        crankvm_jit_emitJumpIf(assembler, CRANK_VM_JIT_CONDITION_LE, exit);
+        crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x83); crankvm_jit_emitByte(assembler, 0xEA); crankvm_jit_emitByte(assembler, 0x01);
+        crankvm_jit_emitByte(assembler, 0x49); crankvm_jit_emitByte(assembler, 0x8B); crankvm_jit_emitByte(assembler, 0x8C);
+        crankvm_jit_emitByte(assembler, 0xD4);
+        crankvm_jit_emitInt32(assembler, (int32_t)offsetof(crankvm_MethodContext_t, stackSlots));
+
+        // The popped slot is cleared before the store, because it may be the temporary.
+        crankvm_jit_emitLoadGlobal(assembler, &context->roots.nilOop);
+        crankvm_jit_emitStoreStackSlot(assembler, false, 0);
+
+        // mov [r12 + temporary], rcx
+        crankvm_jit_emitByte(assembler, 0x49); crankvm_jit_emitByte(assembler, 0x89); crankvm_jit_emitByte(assembler, 0x8C);
+        crankvm_jit_emitByte(assembler, 0x24);
+        crankvm_jit_emitInt32(assembler, temporaryOffset);
+        break;
+    default:
+        abort();
+    }
+
+    // The pushes check for overflow, store the value, and increment the stack pointer.
+    if(kind != CRANK_VM_JIT_BYTECODE_POP && kind != CRANK_VM_JIT_BYTECODE_POP_STORE_TEMPORARY)
+    {
+        // cmp rdx, [rbx + stackLimit]; jge exit
+        crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x3B); crankvm_jit_emitByte(assembler, 0x93);
+        crankvm_jit_emitInt32(assembler, CRANK_VM_JIT_STATE_OFFSET(stackLimit));
+        crankvm_jit_emitJumpIf(assembler, CRANK_VM_JIT_CONDITION_GE, exit);
+        crankvm_jit_emitStoreStackSlot(assembler, false, 0);
+        crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x83); crankvm_jit_emitByte(assembler, 0xC2); crankvm_jit_emitByte(assembler, 0x01);
+    }
+    crankvm_jit_emitStoreStackPointer(assembler);
+
+    // mov qword [rbx + nextPC], nextPC; mov dword [rbx + nextBytecode], nextBytecode
+    crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0xC7); crankvm_jit_emitByte(assembler, 0x83);
+    crankvm_jit_emitInt32(assembler, CRANK_VM_JIT_STATE_OFFSET(nextPC));
+    crankvm_jit_emitInt32(assembler, (int32_t)nextPC);
+    crankvm_jit_emitByte(assembler, 0xC7); crankvm_jit_emitByte(assembler, 0x83);
+    crankvm_jit_emitInt32(assembler, CRANK_VM_JIT_STATE_OFFSET(nextBytecode));
+    crankvm_jit_emitInt32(assembler, nextBytecode);
+}
+
+/**
+ * Emits a template that calls the implementation of a bytecode, after doing
+ * the work of beginning the bytecode in the interpreter. Only the bytecodes
+ * that may send, return, jump or allocate are followed by the checks for
+ * leaving the native code.
+ */
+static void
+crankvm_jit_emitCallBytecode(crankvm_jit_assembler_t *assembler, crankvm_context_t *context, const crankvm_jit_bytecode_template_t *template, bool isStraightLine,
+    intptr_t pc, intptr_t nextPC, uint8_t *exit, uint8_t *exitWithError, uint8_t *dispatch)
+{
+    // mov qword [rbx + pc], pc
+    crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0xC7); crankvm_jit_emitByte(assembler, 0x83);
+    crankvm_jit_emitInt32(assembler, CRANK_VM_JIT_STATE_OFFSET(pc));
+    crankvm_jit_emitInt32(assembler, (int32_t)pc);
+
+    // mov rdi, rbx; mov esi, implicitParam; mov rax, function; call rax
+    crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0x89); crankvm_jit_emitByte(assembler, 0xDF);
+    crankvm_jit_emitByte(assembler, 0xBE);
+    crankvm_jit_emitInt32(assembler, template->implicitParam);
+    crankvm_jit_emitByte(assembler, 0x48); crankvm_jit_emitByte(assembler, 0xB8);
+    crankvm_jit_emitInt64(assembler, (uint64_t)(uintptr_t)template->function);
+    crankvm_jit_emitByte(assembler, 0xFF); crankvm_jit_emitByte(assembler, 0xD0);
+
+    // test eax, eax
+    crankvm_jit_emitByte(assembler, 0x85); crankvm_jit_emitByte(assembler, 0xC0);
+    crankvm_jit_emitJumpIf(assembler, CRANK_VM_JIT_CONDITION_NE, exitWithError);
+    if(isStraightLine)
+        return;
+
+    crankvm_jit_emitTestStateFlag(assembler, CRANK_VM_JIT_STATE_OFFSET(returnFromInterpreter));
+    crankvm_jit_emitJumpIf(assembler, CRANK_VM_JIT_CONDITION_NE, exit);
+
+    // A send or a return has fetched another method context: cmp r12, [rbx + methodContext]
+    crankvm_jit_emitByte(assembler, 0x4C); crankvm_jit_emitByte(assembler, 0x3B); crankvm_jit_emitByte(assembler, 0xA3);
+    crankvm_jit_emitInt32(assembler, CRANK_VM_JIT_STATE_OFFSET(objects.methodContext));
+    crankvm_jit_emitJumpIf(assembler, CRANK_VM_JIT_CONDITION_NE, exit);
+
+    // Fall through into the next bytecode, or dispatch on the target of a jump.
+    crankvm_jit_emitLoadStateField(assembler, CRANK_VM_JIT_STATE_OFFSET(nextPC));
+    crankvm_jit_emitCompareRAX(assembler, (int32_t)nextPC);
+    crankvm_jit_emitJumpIf(assembler, CRANK_VM_JIT_CONDITION_NE, dispatch);
+    crankvm_jit_emitScavengeCheck(assembler, context, exit);
+}
+
+static size_t
+crankvm_jit_bytecodeLength(int bytecode)
+{
+    // SqueakV3PlusClosures
+    if(bytecode < 256)
+    {
+        switch(bytecode)
+        {
+        case 128 ... 131:
+        case 133 ... 134:
+        case 138:
+        case 160 ... 175:
+            return 2;
+        case 132:
+        case 139 ... 142:
+            return 3;
+        case 143:
+            return 4;
+        default:
+            return 1;
+        }
+    }
+
+    // SistaV1
+    bytecode -= 256;
+    if(bytecode < 224)
+        return 1;
+    else if(bytecode < 248)
+        return 2;
+    return 3;
+}
+
+static crankvm_jit_bytecode_kind_t
+crankvm_jit_bytecodeKind(int bytecode, int *operand)
+{
+    switch(bytecode)
+    {
+    // SqueakV3PlusClosures
+    case 16 ... 31: *operand = bytecode - 16; return CRANK_VM_JIT_BYTECODE_PUSH_TEMPORARY;
+    case 104 ... 111: *operand = bytecode - 104; return CRANK_VM_JIT_BYTECODE_POP_STORE_TEMPORARY;
+    case 112: return CRANK_VM_JIT_BYTECODE_PUSH_RECEIVER;
+    case 113: return CRANK_VM_JIT_BYTECODE_PUSH_TRUE;
+    case 114: return CRANK_VM_JIT_BYTECODE_PUSH_FALSE;
+    case 115: return CRANK_VM_JIT_BYTECODE_PUSH_NIL;
+    case 116 ... 119: *operand = bytecode - 117; return CRANK_VM_JIT_BYTECODE_PUSH_SMALL_INTEGER;
+    case 135: return CRANK_VM_JIT_BYTECODE_POP;
+    case 136: return CRANK_VM_JIT_BYTECODE_DUPLICATE;
+    case 0 ... 15:
+    case 32 ... 103:
+    case 128 ... 130:
+    case 140 ... 142:
+        return CRANK_VM_JIT_BYTECODE_STRAIGHT_LINE;
+
+    // SistaV1
+    case 256 + 64 ... 256 + 75: *operand = bytecode - 256 - 64; return CRANK_VM_JIT_BYTECODE_PUSH_TEMPORARY;
+    case 256 + 208 ... 256 + 215: *operand = bytecode - 256 - 208; return CRANK_VM_JIT_BYTECODE_POP_STORE_TEMPORARY;
+    case 256 + 76: return CRANK_VM_JIT_BYTECODE_PUSH_RECEIVER;
+    case 256 + 77: return CRANK_VM_JIT_BYTECODE_PUSH_TRUE;
+    case 256 + 78: return CRANK_VM_JIT_BYTECODE_PUSH_FALSE;
+    case 256 + 79: return CRANK_VM_JIT_BYTECODE_PUSH_NIL;
+    case 256 + 80 ... 256 + 81: *operand = bytecode - 256 - 80; return CRANK_VM_JIT_BYTECODE_PUSH_SMALL_INTEGER;
+    case 256 + 83: return CRANK_VM_JIT_BYTECODE_DUPLICATE;
+    case 256 + 216: return CRANK_VM_JIT_BYTECODE_POP;
+    case 256 + 0 ... 256 + 63:
+    case 256 + 200 ... 256 + 207:
+    case 256 + 226 ... 256 + 229:
+    case 256 + 232:
+    case 256 + 240 ... 256 + 245:
+    case 256 + 251 ... 256 + 253:
+        return CRANK_VM_JIT_BYTECODE_STRAIGHT_LINE;
+
+    default:
+        return CRANK_VM_JIT_BYTECODE_CALL;
+    }
+}
+
+void
+crankvm_jit_initialize(crankvm_jit_t *jit, size_t codeSizeInKs)
+{
+    crankvm_jit_destroy(jit);
+    if(!codeSizeInKs)
+        codeSizeInKs = CRANK_VM_JIT_DEFAULT_CODE_SIZE_IN_KS;
+
+    size_t size = codeSizeInKs * 1024;
+    void *start = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(start == MAP_FAILED)
+        return;
+
+    jit->start = start;
+    jit->end = jit->start + size;
+    jit->top = jit->start;
+}
+
+void
+crankvm_jit_destroy(crankvm_jit_t *jit)
+{
+    if(jit->start)
+        munmap(jit->start, jit->end - jit->start);
+    jit->start = NULL;
+    jit->end = NULL;
+    jit->top = NULL;
+}
+
+CRANK_VM_INLINE size_t
+crankvm_jit_methodIndex(crankvm_oop_t method)
+{
+    return crankvm_oop_addressHash(method) & CRANK_VM_JIT_METHOD_MASK;
+}
+
+crankvm_jit_method_t *
+crankvm_jit_noteActivation(crankvm_context_t *context, crankvm_CompiledCode_t *method)
+{
+    crankvm_jit_t *jit = &context->jit;
+    if(!jit->start)
+        return NULL;
+
+    crankvm_jit_method_t *jitMethod = &jit->methods[crankvm_jit_methodIndex((crankvm_oop_t)method)];
+    if(jitMethod->method != (crankvm_oop_t)method)
+    {
+        memset(jitMethod, 0, sizeof(crankvm_jit_method_t));
+        jitMethod->method = (crankvm_oop_t)method;
+    }
+
+    if(jitMethod->code)
+        return jitMethod;
+    if(jitMethod->isNotCompilable || ++jitMethod->activationCount < CRANK_VM_JIT_COMPILE_THRESHOLD)
+        return NULL;
+    return jitMethod;
+}
+
+static crankvm_jit_code_t *
+crankvm_jit_emitMethod(crankvm_context_t *context, uint8_t *instructions, size_t initialPC, size_t size,
+    int bytecodeSetOffset, const crankvm_jit_bytecode_template_t *templates)
+{
+    // The entry table is before the machine code.
+    crankvm_jit_t *jit = &context->jit;
+    uintptr_t codeAddress = ((uintptr_t)jit->top + 15) & ~(uintptr_t)15;
+    size_t entryCount = size + 1;
+    uintptr_t machineCodeAddress = (codeAddress + sizeof(crankvm_jit_code_t) + entryCount * sizeof(void*) + 15) & ~(uintptr_t)15;
+    if(machineCodeAddress >= (uintptr_t)jit->end)
+        return NULL;
+
+    crankvm_jit_code_t *code = (crankvm_jit_code_t*)codeAddress;
+    code->entryCount = entryCount;
+    memset(code->entries, 0, entryCount * sizeof(void*));
+
+    crankvm_jit_assembler_t assembler = {(uint8_t*)machineCodeAddress, jit->end, false};
+    uint8_t *exit, *exitWithError, *dispatch;
+    crankvm_jit_emitPrologue(&assembler, context, code, &exit, &exitWithError, &dispatch);
+
+    // The bytecodes are translated linearly. An entry is only used when its pc is
+    // reached by the interpreter, so the data after the last bytecode is harmless.
+    for(size_t pc = initialPC; pc < size; )
+    {
+        int bytecode = instructions[pc] + bytecodeSetOffset;
+        size_t nextPC = pc + crankvm_jit_bytecodeLength(bytecode);
+        const crankvm_jit_bytecode_template_t *template = &templates[bytecode];
+        if(template->function)
+        {
+            int operand = 0;
+            crankvm_jit_bytecode_kind_t kind = crankvm_jit_bytecodeKind(bytecode, &operand);
+            code->entries[pc + 1] = assembler.position;
+            if(kind == CRANK_VM_JIT_BYTECODE_CALL || kind == CRANK_VM_JIT_BYTECODE_STRAIGHT_LINE)
+                crankvm_jit_emitCallBytecode(&assembler, context, template, kind == CRANK_VM_JIT_BYTECODE_STRAIGHT_LINE, pc + 1, nextPC + 1, exit, exitWithError, dispatch);
+            else
+                crankvm_jit_emitStackBytecode(&assembler, context, kind, operand, nextPC + 1, nextPC < size ? instructions[nextPC] : 0, exit);
+        }
+        else
+        {
+            // The undefined bytecodes are left to the interpreter.
+            crankvm_jit_emitJump(&assembler, exit);
+        }
+
+        pc = nextPC;
+    }
+    crankvm_jit_emitJump(&assembler, exit);
+
+    if(assembler.overflow)
+        return NULL;
+
+    jit->top = assembler.position;
+    return code;
+}
+
+static void
+crankvm_jit_resetZone(crankvm_jit_t *jit)
+{
+    memset(jit->methods, 0, sizeof(jit->methods));
+    jit->top = jit->start;
+    ++jit->zoneResetCount;
+}
+
+bool
+crankvm_jit_compile(crankvm_context_t *context, crankvm_jit_method_t *jitMethod, crankvm_CompiledCode_t *method,
+    crankvm_compiled_code_header_t *header, int bytecodeSetOffset, const crankvm_jit_bytecode_template_t *templates)
+{
+    crankvm_jit_t *jit = &context->jit;
+    size_t size = crankvm_object_header_getSmalltalkSize((crankvm_object_header_t*)method);
+    size_t initialPC = (header->numberOfLiterals + 1) * sizeof(crankvm_oop_t);
+    if(size > CRANK_VM_JIT_MAX_METHOD_SIZE || initialPC >= size)
+    {
+        jitMethod->isNotCompilable = true;
+        return false;
+    }
+
+    if(mprotect(jit->start, jit->end - jit->start, PROT_READ | PROT_WRITE))
+        return false;
+
+    uint8_t *instructions = (uint8_t*)((crankvm_oop_t)method + sizeof(crankvm_object_header_t));
+    crankvm_jit_code_t *code = crankvm_jit_emitMethod(context, instructions, initialPC, size, bytecodeSetOffset, templates);
+    if(!code)
+    {
+        // Empty the full zone, keeping the entry of the method.
+        crankvm_jit_resetZone(jit);
+        jitMethod->method = (crankvm_oop_t)method;
+        code = crankvm_jit_emitMethod(context, instructions, initialPC, size, bytecodeSetOffset, templates);
+    }
+
+    mprotect(jit->start, jit->end - jit->start, PROT_READ | PROT_EXEC);
+    if(!code)
+    {
+        jitMethod->isNotCompilable = true;
+        return false;
+    }
+
+    jitMethod->code = code;
+    ++jit->compiledMethodCount;
+    return true;
+}
+
+void
+crankvm_jit_flush(crankvm_context_t *context)
+{
+    crankvm_jit_t *jit = &context->jit;
+    memset(jit->methods, 0, sizeof(jit->methods));
+}
+
+void
+crankvm_jit_flushMethod(crankvm_context_t *context, crankvm_oop_t method)
+{
+    crankvm_jit_method_t *jitMethod = &context->jit.methods[crankvm_jit_methodIndex(method)];
+    if(jitMethod->method == method)
+        memset(jitMethod, 0, sizeof(crankvm_jit_method_t));
+}
+
+void
+crankvm_jit_flushNewSpaceReferences(crankvm_context_t *context)
+{
+    crankvm_jit_t *jit = &context->jit;
+    crankvm_heap_t *heap = &context->heap;
+    for(size_t i = 0; i < CRANK_VM_JIT_METHOD_COUNT; ++i)
+    {
+        crankvm_jit_method_t *jitMethod = &jit->methods[i];
+        if(crankvm_heap_isYoung(heap, jitMethod->method))
+            memset(jitMethod, 0, sizeof(crankvm_jit_method_t));
+    }
+}
+
+#endif /* CRANK_VM_USE_JIT */
@@ -0,0 +1,133 @@
+#ifndef CRANK_VM_JIT_H
+#define CRANK_VM_JIT_H
+
+#include <crank-vm/error.h>
+#include <crank-vm/objectmodel.h>
+#include <crank-vm/special-objects.h>
+#include <stdbool.h>
+
+#define CRANK_VM_JIT_METHOD_COUNT 1024
+#define CRANK_VM_JIT_METHOD_MASK (CRANK_VM_JIT_METHOD_COUNT - 1)
+
+#define CRANK_VM_JIT_DEFAULT_CODE_SIZE_IN_KS 2048
+
+// The number of activations of a method before it is compiled.
+#define CRANK_VM_JIT_COMPILE_THRESHOLD 4
+
+// The methods with more bytes are always interpreted.
+#define CRANK_VM_JIT_MAX_METHOD_SIZE 4096
+
+typedef struct crankvm_context_s crankvm_context_t;
+typedef struct crankvm_interpreter_state_s crankvm_interpreter_state_t;
+
+/**
+ * The implementation of a bytecode, with the implicit parameter of its
+ * opcode. The bytecodes without implicit parameter ignore it.
+ */
+typedef crankvm_error_t (*crankvm_jit_bytecode_function_t)(crankvm_interpreter_state_t *self, int implicitParam);
+
+typedef struct crankvm_jit_bytecode_template_s
+{
+    crankvm_jit_bytecode_function_t function;
+    int implicitParam;
+} crankvm_jit_bytecode_template_t;
+
+/**
+ * Runs the native code of a method from the entry of a bytecode, until the
+ * method context changes, a bytecode fails, or a bytecode without entry is
+ * reached.
+ */
+typedef crankvm_error_t (*crankvm_jit_native_function_t)(crankvm_interpreter_state_t *self, void *entry);
+
+/**
+ * The native code of a method. It keeps the entry of each compiled bytecode,
+ * indexed by the pc that follows its opcode, so it does not refer to the
+ * method object, which the collector may move.
+ */
+typedef struct crankvm_jit_code_s
+{
+    crankvm_jit_native_function_t function;
+    size_t entryCount;
+    void *entries[];
+} crankvm_jit_code_t;
+
+/**
+ * The activation count and the native code of a method. An entry is only
+ * valid for the method it was created for, and it is flushed with the method
+ * cache, and when the collector moves the method.
+ */
+typedef struct crankvm_jit_method_s
+{
+    crankvm_oop_t method;
+    uint32_t activationCount;
+    bool isNotCompilable;
+    crankvm_jit_code_t *code;
+} crankvm_jit_method_t;
+
+/**
+ * The baseline JIT translates each bytecode of a hot method with a template.
+ * The stack bytecodes are emitted inline, and the others call their
+ * implementation in the interpreter, so the native code keeps the semantics
+ * of the interpreter without decoding and dispatching the bytecodes. The
+ * native code is kept in an executable code zone, which is bump allocated
+ * and emptied when it is full.
+ */
+typedef struct crankvm_jit_s
+{
+    uint8_t *start;
+    uint8_t *end;
+    uint8_t *top;
+
+    crankvm_jit_method_t methods[CRANK_VM_JIT_METHOD_COUNT];
+
+    uint64_t compiledMethodCount;
+    uint64_t zoneResetCount;
+} crankvm_jit_t;
+
+#ifdef CRANK_VM_USE_JIT
+
+/**
+ * Maps the code zone with the code size of the image header, or with the
+ * default size when the image does not specify it. The JIT stays disabled
+ * when the system refuses executable memory.
+ */
+void crankvm_jit_initialize(crankvm_jit_t *jit, size_t codeSizeInKs);
+void crankvm_jit_destroy(crankvm_jit_t *jit);
+
+/**
+ * Counts an activation of a method. Returns the entry of the method when it
+ * has native code or when it is hot enough to be compiled, and NULL
+ * otherwise.
+ */
+crankvm_jit_method_t *crankvm_jit_noteActivation(crankvm_context_t *context, crankvm_CompiledCode_t *method);
+
+/**
+ * Compiles the bytecodes of a method. The code zone may be emptied, so no
+ * native code can be running. Returns false when the method is interpreted.
+ */
+bool crankvm_jit_compile(crankvm_context_t *context, crankvm_jit_method_t *jitMethod, crankvm_CompiledCode_t *method,
+    crankvm_compiled_code_header_t *header, int bytecodeSetOffset, const crankvm_jit_bytecode_template_t *templates);
+
+void crankvm_jit_flush(crankvm_context_t *context);
+void crankvm_jit_flushMethod(crankvm_context_t *context, crankvm_oop_t method);
+void crankvm_jit_flushNewSpaceReferences(crankvm_context_t *context);
+
+CRANK_VM_INLINE void *
+crankvm_jit_entryAt(crankvm_jit_code_t *code, intptr_t pc)
+{
+    if((uintptr_t)pc >= code->entryCount)
+        return NULL;
+    return code->entries[pc];
+}
+
+#else /* !CRANK_VM_USE_JIT */
+
+CRANK_VM_INLINE void crankvm_jit_initialize(crankvm_jit_t *jit, size_t codeSizeInKs) {}
+CRANK_VM_INLINE void crankvm_jit_destroy(crankvm_jit_t *jit) {}
+CRANK_VM_INLINE void crankvm_jit_flush(crankvm_context_t *context) {}
+CRANK_VM_INLINE void crankvm_jit_flushMethod(crankvm_context_t *context, crankvm_oop_t method) {}
+CRANK_VM_INLINE void crankvm_jit_flushNewSpaceReferences(crankvm_context_t *context) {}
+
+#endif /* CRANK_VM_USE_JIT */
+
+#endif //CRANK_VM_JIT_H
@@ -2,6 +2,10 @@
 
 CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_performWithArgumentsInSuperclass, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_PERFORM_IN_SUPERCLASS)
 
+CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_flushCache, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_FLUSH_CACHE)
+CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_flushCacheByMethod, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_FLUSH_CACHE_BY_METHOD)
+CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_flushCacheBySelector, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_FLUSH_CACHE_BY_SELECTOR)
+
 void
 crankvm_primitive_performWithArgumentsInSuperclass(crankvm_primitive_context_t *primitiveContext)
 {
@@ -32,3 +36,30 @@ crankvm_primitive_performWithArgumentsInSuperclass(crankvm_primitive_context_t *
     // Finish the primitive by activating the new method context.
     crankvm_primitive_finishReplacingMethodContext(primitiveContext, methodContext);
 }
+
+void
+crankvm_primitive_flushCache(crankvm_primitive_context_t *primitiveContext)
+{
+    // A method dictionary or a class hierarchy has changed.
+    crankvm_method_cache_flush(primitiveContext->context);
+    return crankvm_primitive_returnOop(primitiveContext, crankvm_primitive_getReceiver(primitiveContext));
+}
+
+void
+crankvm_primitive_flushCacheByMethod(crankvm_primitive_context_t *primitiveContext)
+{
+    crankvm_oop_t method = crankvm_primitive_getReceiver(primitiveContext);
+    if(!crankvm_oop_isCompiledCode(method))
+        return crankvm_primitive_failWithCode(primitiveContext, CRANK_VM_PRIMITIVE_ERROR_BAD_RECEIVER);
+
+    crankvm_method_cache_flushMethod(primitiveContext->context, method);
+    return crankvm_primitive_returnOop(primitiveContext, method);
+}
+
+void
+crankvm_primitive_flushCacheBySelector(crankvm_primitive_context_t *primitiveContext)
+{
+    crankvm_oop_t selector = crankvm_primitive_getReceiver(primitiveContext);
+    crankvm_method_cache_flushSelector(primitiveContext->context, selector);
+    return crankvm_primitive_returnOop(primitiveContext, selector);
+}
@@ -5,4 +5,8 @@
 
 void crankvm_primitive_performWithArgumentsInSuperclass(crankvm_primitive_context_t *context);
 
+void crankvm_primitive_flushCache(crankvm_primitive_context_t *context);
+void crankvm_primitive_flushCacheByMethod(crankvm_primitive_context_t *context);
+void crankvm_primitive_flushCacheBySelector(crankvm_primitive_context_t *context);
+
 #endif //CRANK_VM_MESSAGE_PRIMITIVES_H
@@ -0,0 +1,142 @@
+#include "method-cache.h"
+#include "context-internal.h"
+#include <string.h>
+
+CRANK_VM_INLINE uintptr_t
+crankvm_method_cache_hash(crankvm_oop_t behavior, crankvm_oop_t selector)
+{
+    return crankvm_oop_addressHash(behavior) ^ crankvm_oop_addressHash(selector);
+}
+
+CRANK_VM_INLINE crankvm_method_cache_entry_t *
+crankvm_method_cache_probe(crankvm_method_cache_t *cache, uintptr_t hash, int probeIndex)
+{
+    return &cache->entries[(hash >> probeIndex) & CRANK_VM_METHOD_CACHE_ENTRY_MASK];
+}
+
+static void
+crankvm_method_cache_add(crankvm_method_cache_t *cache, crankvm_oop_t behavior, crankvm_oop_t selector, crankvm_oop_t method)
+{
+    uintptr_t hash = crankvm_method_cache_hash(behavior, selector);
+
+    // Prefer an empty entry, otherwise replace the first probe.
+    crankvm_method_cache_entry_t *entry = crankvm_method_cache_probe(cache, hash, 0);
+    for(int i = 0; i < CRANK_VM_METHOD_CACHE_PROBE_COUNT; ++i)
+    {
+        crankvm_method_cache_entry_t *candidate = crankvm_method_cache_probe(cache, hash, i);
+        if(!candidate->selector)
+        {
+            entry = candidate;
+            break;
+        }
+    }
+
+    entry->selector = selector;
+    entry->behavior = behavior;
+    entry->method = method;
+}
+
+crankvm_oop_t
+crankvm_method_cache_lookupSelector(crankvm_context_t *context, crankvm_Behavior_t *behavior, crankvm_oop_t selector)
+{
+    crankvm_method_cache_t *cache = &context->methodCache;
+    uintptr_t hash = crankvm_method_cache_hash((crankvm_oop_t)behavior, selector);
+    for(int i = 0; i < CRANK_VM_METHOD_CACHE_PROBE_COUNT; ++i)
+    {
+        crankvm_method_cache_entry_t *entry = crankvm_method_cache_probe(cache, hash, i);
+        if(entry->selector == selector && entry->behavior == (crankvm_oop_t)behavior)
+        {
+            ++cache->hitCount;
+            return entry->method;
+        }
+    }
+
+    // Do the full lookup.
+    ++cache->missCount;
+    crankvm_oop_t method = crankvm_Behavior_lookupSelector(context, behavior, selector);
+
+    // Failed lookups are not cached, they are followed by a doesNotUnderstand: send.
+    if(!crankvm_oop_isNil(context, method))
+        crankvm_method_cache_add(cache, (crankvm_oop_t)behavior, selector, method);
+
+    return method;
+}
+
+void
+crankvm_method_cache_flush(crankvm_context_t *context)
+{
+    crankvm_method_cache_t *cache = &context->methodCache;
+    memset(cache->entries, 0, sizeof(cache->entries));
+    ++cache->flushCount;
+
+    crankvm_selector_index_flush(context);
+    crankvm_inline_cache_flush(context);
+    crankvm_compiled_code_cache_flush(context);
+    crankvm_at_cache_flush(context);
+    crankvm_jit_flush(context);
+}
+
+void
+crankvm_method_cache_flushSelector(crankvm_context_t *context, crankvm_oop_t selector)
+{
+    crankvm_method_cache_t *cache = &context->methodCache;
+    for(size_t i = 0; i < CRANK_VM_METHOD_CACHE_ENTRY_COUNT; ++i)
+    {
+        crankvm_method_cache_entry_t *entry = &cache->entries[i];
+        if(entry->selector == selector)
+            memset(entry, 0, sizeof(crankvm_method_cache_entry_t));
+    }
+    ++cache->flushCount;
+
+    crankvm_selector_index_flush(context);
+    crankvm_inline_cache_flushSelector(context, selector);
+    crankvm_at_cache_flush(context);
+}
+
+void
+crankvm_method_cache_flushMethod(crankvm_context_t *context, crankvm_oop_t method)
+{
+    crankvm_method_cache_t *cache = &context->methodCache;
+    for(size_t i = 0; i < CRANK_VM_METHOD_CACHE_ENTRY_COUNT; ++i)
+    {
+        crankvm_method_cache_entry_t *entry = &cache->entries[i];
+        if(entry->method == method)
+            memset(entry, 0, sizeof(crankvm_method_cache_entry_t));
+    }
+    ++cache->flushCount;
+
+    crankvm_inline_cache_flushMethod(context, method);
+    crankvm_compiled_code_cache_flushMethod(context, method);
+    crankvm_at_cache_flush(context);
+    crankvm_jit_flushMethod(context, method);
+}
+
+void
+crankvm_method_cache_flushNewSpaceReferences(crankvm_context_t *context)
+{
+    crankvm_method_cache_t *cache = &context->methodCache;
+    crankvm_heap_t *heap = &context->heap;
+    for(size_t i = 0; i < CRANK_VM_METHOD_CACHE_ENTRY_COUNT; ++i)
+    {
+        crankvm_method_cache_entry_t *entry = &cache->entries[i];
+        if(crankvm_heap_isYoung(heap, entry->selector) ||
+            crankvm_heap_isYoung(heap, entry->behavior) ||
+            crankvm_heap_isYoung(heap, entry->method))
+            memset(entry, 0, sizeof(crankvm_method_cache_entry_t));
+    }
+
+    crankvm_selector_index_flushNewSpaceReferences(context);
+    crankvm_inline_cache_flushNewSpaceReferences(context);
+    crankvm_compiled_code_cache_flushNewSpaceReferences(context);
+    crankvm_at_cache_flushNewSpaceReferences(context);
+    crankvm_jit_flushNewSpaceReferences(context);
+}
+
+LIB_CRANK_VM_EXPORT void
+crankvm_context_getMethodCacheStatistics(crankvm_context_t *context, uint64_t *hitCount, uint64_t *missCount)
+{
+    if(hitCount)
+        *hitCount = context ? context->methodCache.hitCount : 0;
+    if(missCount)
+        *missCount = context ? context->methodCache.missCount : 0;
+}
@@ -0,0 +1,36 @@
+#ifndef CRANK_VM_METHOD_CACHE_H
+#define CRANK_VM_METHOD_CACHE_H
+
+#include <crank-vm/objectmodel.h>
+#include <crank-vm/special-objects.h>
+
+#define CRANK_VM_METHOD_CACHE_ENTRY_COUNT 2048
+#define CRANK_VM_METHOD_CACHE_ENTRY_MASK (CRANK_VM_METHOD_CACHE_ENTRY_COUNT - 1)
+#define CRANK_VM_METHOD_CACHE_PROBE_COUNT 3
+
+typedef struct crankvm_context_s crankvm_context_t;
+
+typedef struct crankvm_method_cache_entry_s
+{
+    crankvm_oop_t selector;
+    crankvm_oop_t behavior;
+    crankvm_oop_t method;
+} crankvm_method_cache_entry_t;
+
+typedef struct crankvm_method_cache_s
+{
+    crankvm_method_cache_entry_t entries[CRANK_VM_METHOD_CACHE_ENTRY_COUNT];
+
+    uint64_t hitCount;
+    uint64_t missCount;
+    uint64_t flushCount;
+} crankvm_method_cache_t;
+
+crankvm_oop_t crankvm_method_cache_lookupSelector(crankvm_context_t *context, crankvm_Behavior_t *behavior, crankvm_oop_t selector);
+
+void crankvm_method_cache_flush(crankvm_context_t *context);
+void crankvm_method_cache_flushSelector(crankvm_context_t *context, crankvm_oop_t selector);
+void crankvm_method_cache_flushMethod(crankvm_context_t *context, crankvm_oop_t method);
+void crankvm_method_cache_flushNewSpaceReferences(crankvm_context_t *context);
+
+#endif //CRANK_VM_METHOD_CACHE_H
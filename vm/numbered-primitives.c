@@ -93,9 +93,9 @@ const crankvm_primitive_function_t crankvm_numberedPrimitiveTable[552] = {
     NULL,
     crankvm_primitive_semaphoreSignal,
     crankvm_primitive_semaphoreWait,
-    NULL,
-    NULL,
-    NULL,
+    crankvm_primitive_processResume,
+    crankvm_primitive_processSuspend,
+    crankvm_primitive_flushCache,
     NULL,
     NULL,
     NULL,
@@ -122,9 +122,10 @@ const crankvm_primitive_function_t crankvm_numberedPrimitiveTable[552] = {
     crankvm_primitive_systemPrimitive_quit,
     crankvm_primitive_systemPrimitive_exitToDebugger,
     NULL,
-    NULL,
+    crankvm_primitive_flushCacheByMethod,
     crankvm_primitive_callExternalPrimitive,
     NULL,
+    crankvm_primitive_flushCacheBySelector,
     NULL,
     NULL,
     NULL,
@@ -135,9 +136,8 @@ const crankvm_primitive_function_t crankvm_numberedPrimitiveTable[552] = {
     NULL,
     NULL,
     NULL,
-    NULL,
-    NULL,
-    NULL,
+    crankvm_primitive_systemPrimitive_fullGarbageCollect,
+    crankvm_primitive_systemPrimitive_incrementalGarbageCollect,
     NULL,
     NULL,
     NULL,
@@ -173,7 +173,7 @@ const crankvm_primitive_function_t crankvm_numberedPrimitiveTable[552] = {
     NULL,
     NULL,
     NULL,
-    NULL,
+    crankvm_primitive_processorYield,
     NULL,
     crankvm_primitive_identityNotEquals,
     crankvm_primitive_asCharacter,
@@ -236,7 +236,7 @@ const crankvm_primitive_function_t crankvm_numberedPrimitiveTable[552] = {
     NULL,
     NULL,
     NULL,
-    NULL,
+    crankvm_primitive_relinquishProcessor,
     NULL,
     NULL,
     NULL,
@@ -248,7 +248,7 @@ const crankvm_primitive_function_t crankvm_numberedPrimitiveTable[552] = {
     NULL,
     crankvm_primitive_systemPrimitive_utcMicrosecondClock,
     crankvm_primitive_systemPrimitive_localMicrosecondClock,
-    NULL,
+    crankvm_primitive_systemPrimitive_signalAtUTCMicroseconds,
     NULL,
     NULL,
     NULL,
@@ -69,7 +69,11 @@ crankvm_object_getIdentityHash(crankvm_context_t *context, crankvm_oop_t oop)
     uintptr_t rawHash = crankvm_object_header_getIdentityHash((crankvm_object_header_t*) oop);
     if(rawHash == 0)
     {
-        rawHash = crankvm_context_newIdentityHash(context);
+        // Answer the hash as it is stored in the header, so that it does not change on the next call.
+        do
+        {
+            rawHash = crankvm_context_newIdentityHash(context) & CRANK_VM_IDENTITY_HASH_MASK;
+        } while(rawHash == 0);
         crankvm_object_header_setIdentityHash((crankvm_object_header_t*)oop, rawHash);
     }
 
@@ -366,3 +370,42 @@ crankvm_object_tryToDecodeFloat(crankvm_context_t *context, crankvm_oop_t object
     *resultValue = ((crankvm_Float_t*)object)->value;
     return 1;
 }
+
+LIB_CRANK_VM_EXPORT int
+crankvm_object_tryToDecodeUInteger64(crankvm_context_t *context, crankvm_oop_t object, uint64_t *resultValue)
+{
+    if(crankvm_oop_isSmallInteger(object))
+    {
+        intptr_t value = crankvm_oop_decodeSmallInteger(object);
+        if(value < 0)
+            return 0;
+
+        *resultValue = value;
+        return 1;
+    }
+
+    if(!crankvm_oop_isPointer(object))
+        return 0;
+
+    if(crankvm_object_getClass(context, object) != (crankvm_oop_t)context->roots.specialObjectsArray->classLargePositiveInteger)
+        return 0;
+
+    // The bytes are little endian, and the ones above the 64 bits must be zero.
+    crankvm_object_header_t *header = (crankvm_object_header_t*)object;
+    uint8_t *bytes = (uint8_t*)(header + 1);
+    uint64_t value = 0;
+    for(size_t i = crankvm_object_header_getSmalltalkSize(header); i > 0; --i)
+    {
+        if(i > sizeof(uint64_t))
+        {
+            if(bytes[i - 1])
+                return 0;
+            continue;
+        }
+
+        value = (value << 8) | bytes[i - 1];
+    }
+
+    *resultValue = value;
+    return 1;
+}
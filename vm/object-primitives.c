@@ -123,7 +123,11 @@ crankvm_primitive_Object_atPut(crankvm_primitive_context_t *primitiveContext, cr
     // Check the format
     crankvm_oop_t *slots = (crankvm_oop_t *) (object + sizeof(crankvm_object_header_t));
     if(format < CRANK_VM_OBJECT_FORMAT_INDEXABLE_64)
-        return slots[index] = value;
+    {
+        slots[index] = value;
+        crankvm_heap_writeBarrier(&primitiveContext->context->heap, object, value);
+        return value;
+    }
 
     // For compiled code, the index must be after the first literal.
     if(format > CRANK_VM_OBJECT_FORMAT_COMPILED_METHOD)
@@ -179,7 +183,6 @@ crankvm_primitive_at(crankvm_primitive_context_t *primitiveContext)
 {
     crankvm_oop_t receiver = crankvm_primitive_getStackAt(primitiveContext, 1);
     intptr_t index = crankvm_primitive_getSmallIntegerValue(primitiveContext, crankvm_primitive_getStackAt(primitiveContext, 0));
-    printf("Primitive at: [%p]%ld\n", (void*)crankvm_primitive_getStackAt(primitiveContext, 0), index);
     if(crankvm_primitive_hasFailed(primitiveContext))
         return crankvm_primitive_fail(primitiveContext);
 
@@ -314,7 +317,16 @@ crankvm_primitive_size(crankvm_primitive_context_t *primitiveContext)
     if(!crankvm_oop_isPointer(receiver))
         return crankvm_primitive_failWithCode(primitiveContext, CRANK_VM_PRIMITIVE_ERROR_BAD_RECEIVER);
 
-    return crankvm_primitive_returnInteger(primitiveContext, crankvm_object_header_getSmalltalkSize((crankvm_object_header_t*)receiver));
+    // The instance variables are not indexable.
+    size_t size = crankvm_object_header_getSmalltalkSize((crankvm_object_header_t*)receiver);
+    crankvm_object_format_t format = crankvm_oop_getFormat(receiver);
+    if(format == CRANK_VM_OBJECT_FORMAT_VARIABLE_SIZE_IVARS || format == CRANK_VM_OBJECT_FORMAT_WEAK_VARIABLE_SIZE)
+    {
+        crankvm_Behavior_t *behavior = (crankvm_Behavior_t*)crankvm_object_getClass(crankvm_primitive_getContext(primitiveContext), receiver);
+        size -= crankvm_Behavior_getInstanceSize(behavior);
+    }
+
+    return crankvm_primitive_returnInteger(primitiveContext, size);
 }
 
 // StorageManagement Primitives (68-79)
@@ -2,11 +2,48 @@
 #define CRANK_VM_QUICK_METHOD_PRIMITIVES_H
 
 #include <crank-vm/common.h>
+#include <crank-vm/system-primitive-number.h>
+#include <stdbool.h>
+
+/**
+ * The quick methods only answer the receiver, a constant, or an instance
+ * variable of the receiver. They are executed by the interpreter without
+ * activating them.
+ */
+#define CRANK_VM_QUICK_METHOD_RETURN_RECEIVER 256
+#define CRANK_VM_QUICK_METHOD_RETURN_TRUE 257
+#define CRANK_VM_QUICK_METHOD_RETURN_FALSE 258
+#define CRANK_VM_QUICK_METHOD_RETURN_NIL 259
+#define CRANK_VM_QUICK_METHOD_RETURN_MINUS_ONE 260
+#define CRANK_VM_QUICK_METHOD_RETURN_TWO 263
+#define CRANK_VM_QUICK_METHOD_RETURN_INSTANCE_VARIABLE 264
+#define CRANK_VM_QUICK_METHOD_LAST 519
 
 CRANK_VM_INLINE int
 crankvm_primitive_isQuickMethod(int primitiveNumber)
 {
-    return 256 <= primitiveNumber && primitiveNumber <= 519;
+    return CRANK_VM_QUICK_METHOD_RETURN_RECEIVER <= primitiveNumber && primitiveNumber <= CRANK_VM_QUICK_METHOD_LAST;
+}
+
+/**
+ * The trivial primitives only read their receiver and arguments, and they
+ * fail without side effects. They are invoked on the stack of the sender,
+ * and their method is activated only when they fail.
+ */
+CRANK_VM_INLINE bool
+crankvm_primitive_isInlinable(int primitiveNumber)
+{
+    switch(primitiveNumber)
+    {
+    case CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_INTEGER_ADD ... CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_INTEGER_BIT_SHIFT:
+    case CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_AS_FLOAT ... CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_FLOAT_TRUNCATED:
+    case CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_SIZE:
+    case CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_OBJECT_IDENTITY_EQUALS:
+    case CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_OBJECT_CLASS:
+        return true;
+    default:
+        return false;
+    }
 }
 
 #endif //CRANK_VM_QUICK_METHOD_PRIMITIVES_H
@@ -98,4 +98,14 @@ crankvm_read_memory_stream_nextBytesInto(crankvm_read_memory_stream_t *stream, s
     return 1;
 }
 
+CRANK_VM_INLINE int
+crankvm_read_memory_stream_skip(crankvm_read_memory_stream_t *stream, size_t size)
+{
+    if(!crankvm_read_memory_stream_hasNextSize(stream, size))
+        return 0;
+
+    stream->position += size;
+    return 1;
+}
+
 #endif //CRANK_VM_READ_MEMORY_STREAM_H
@@ -0,0 +1,262 @@
+#include "scheduler.h"
+#include "context-internal.h"
+
+crankvm_error_t
+crankvm_scheduler_initialize(crankvm_scheduler_t *scheduler, size_t externalSemaphoreTableSize)
+{
+    if(!externalSemaphoreTableSize)
+        externalSemaphoreTableSize = CRANK_VM_SCHEDULER_DEFAULT_EXTERNAL_SEMAPHORE_TABLE_SIZE;
+    return crankvm_signal_queue_initialize(&scheduler->externalSignals, externalSemaphoreTableSize);
+}
+
+void
+crankvm_scheduler_destroy(crankvm_scheduler_t *scheduler)
+{
+    crankvm_signal_queue_destroy(&scheduler->externalSignals);
+}
+
+crankvm_LinkedLink_t *
+crankvm_scheduler_getRunList(crankvm_context_t *context, crankvm_oop_t priority)
+{
+    crankvm_ProcessorScheduler_t *scheduler = crankvm_context_getProcessorScheduler(context);
+    if(!scheduler || !crankvm_oop_isSmallInteger(priority) || !crankvm_oop_isPointer(scheduler->quiescentProcessLists))
+        return NULL;
+
+    // The run list of a priority is at its one based index.
+    intptr_t index = crankvm_oop_decodeSmallInteger(priority) - 1;
+    crankvm_object_header_t *lists = (crankvm_object_header_t*)scheduler->quiescentProcessLists;
+    if(index < 0 || (size_t)index >= crankvm_object_header_getSlotCount(lists))
+        return NULL;
+
+    crankvm_oop_t list = ((crankvm_oop_t*)&lists[1])[index];
+    if(!crankvm_oop_isPointer(list) || crankvm_oop_isNil(context, list))
+        return NULL;
+    return (crankvm_LinkedLink_t*)list;
+}
+
+void
+crankvm_scheduler_addLastLink(crankvm_context_t *context, crankvm_LinkedLink_t *list, crankvm_Process_t *process)
+{
+    crankvm_heap_t *heap = &context->heap;
+    if(crankvm_oop_isNil(context, list->firstLink))
+    {
+        list->firstLink = (crankvm_oop_t)process;
+        crankvm_heap_writeBarrier(heap, (crankvm_oop_t)list, (crankvm_oop_t)process);
+    }
+    else
+    {
+        crankvm_Link_t *lastLink = (crankvm_Link_t*)list->lastLink;
+        lastLink->next = (crankvm_oop_t)process;
+        crankvm_heap_writeBarrier(heap, (crankvm_oop_t)lastLink, (crankvm_oop_t)process);
+    }
+
+    list->lastLink = (crankvm_oop_t)process;
+    crankvm_heap_writeBarrier(heap, (crankvm_oop_t)list, (crankvm_oop_t)process);
+    process->myList = (crankvm_oop_t)list;
+    crankvm_heap_writeBarrier(heap, (crankvm_oop_t)process, (crankvm_oop_t)list);
+}
+
+crankvm_Process_t *
+crankvm_scheduler_removeFirstLink(crankvm_context_t *context, crankvm_LinkedLink_t *list)
+{
+    crankvm_oop_t nilOop = crankvm_specialObject_nil(context);
+    crankvm_Process_t *process = (crankvm_Process_t*)list->firstLink;
+    if(list->firstLink == list->lastLink)
+    {
+        list->firstLink = nilOop;
+        list->lastLink = nilOop;
+    }
+    else
+    {
+        list->firstLink = process->baseClass.next;
+        crankvm_heap_writeBarrier(&context->heap, (crankvm_oop_t)list, list->firstLink);
+    }
+
+    process->baseClass.next = nilOop;
+    process->myList = nilOop;
+    return process;
+}
+
+bool
+crankvm_scheduler_removeLink(crankvm_context_t *context, crankvm_LinkedLink_t *list, crankvm_Process_t *process)
+{
+    if(list->firstLink == (crankvm_oop_t)process)
+    {
+        crankvm_scheduler_removeFirstLink(context, list);
+        return true;
+    }
+
+    // Find the link that precedes the process.
+    crankvm_oop_t nilOop = crankvm_specialObject_nil(context);
+    crankvm_oop_t link = list->firstLink;
+    while(crankvm_oop_isPointer(link) && link != nilOop && ((crankvm_Link_t*)link)->next != (crankvm_oop_t)process)
+        link = ((crankvm_Link_t*)link)->next;
+    if(!crankvm_oop_isPointer(link) || link == nilOop)
+        return false;
+
+    crankvm_Link_t *previousLink = (crankvm_Link_t*)link;
+    previousLink->next = process->baseClass.next;
+    crankvm_heap_writeBarrier(&context->heap, link, previousLink->next);
+    if(list->lastLink == (crankvm_oop_t)process)
+    {
+        list->lastLink = link;
+        crankvm_heap_writeBarrier(&context->heap, (crankvm_oop_t)list, link);
+    }
+
+    process->baseClass.next = nilOop;
+    process->myList = nilOop;
+    return true;
+}
+
+static crankvm_LinkedLink_t *
+crankvm_scheduler_highestPriorityRunList(crankvm_context_t *context, intptr_t abovePriority)
+{
+    crankvm_ProcessorScheduler_t *scheduler = crankvm_context_getProcessorScheduler(context);
+    if(!scheduler || !crankvm_oop_isPointer(scheduler->quiescentProcessLists))
+        return NULL;
+
+    size_t priorityCount = crankvm_object_header_getSlotCount((crankvm_object_header_t*)scheduler->quiescentProcessLists);
+    if(abovePriority < 0)
+        abovePriority = 0;
+    for(intptr_t priority = priorityCount; priority > abovePriority; --priority)
+    {
+        crankvm_LinkedLink_t *list = crankvm_scheduler_getRunList(context, crankvm_oop_encodeSmallInteger(priority));
+        if(list && crankvm_oop_isPointer(list->firstLink) && !crankvm_oop_isNil(context, list->firstLink))
+            return list;
+    }
+
+    return NULL;
+}
+
+crankvm_Process_t *
+crankvm_scheduler_highestPriorityProcess(crankvm_context_t *context, intptr_t abovePriority)
+{
+    crankvm_LinkedLink_t *list = crankvm_scheduler_highestPriorityRunList(context, abovePriority);
+    return list ? (crankvm_Process_t*)list->firstLink : NULL;
+}
+
+crankvm_Process_t *
+crankvm_scheduler_wakeHighestPriority(crankvm_context_t *context, intptr_t abovePriority)
+{
+    crankvm_LinkedLink_t *list = crankvm_scheduler_highestPriorityRunList(context, abovePriority);
+    return list ? crankvm_scheduler_removeFirstLink(context, list) : NULL;
+}
+
+crankvm_MethodContext_t *
+crankvm_scheduler_transferTo(crankvm_context_t *context, crankvm_Process_t *newProcess, crankvm_MethodContext_t *suspendedContext, uint64_t startTime)
+{
+    crankvm_heap_t *heap = &context->heap;
+    crankvm_ProcessorScheduler_t *processorScheduler = crankvm_context_getProcessorScheduler(context);
+    crankvm_Process_t *oldProcess = (crankvm_Process_t*)processorScheduler->activeProcess;
+    oldProcess->suspendedContext = (crankvm_oop_t)suspendedContext;
+    crankvm_heap_writeBarrier(heap, (crankvm_oop_t)oldProcess, (crankvm_oop_t)suspendedContext);
+
+    // The active process is not suspended in any context.
+    crankvm_MethodContext_t *resumedContext = (crankvm_MethodContext_t*)newProcess->suspendedContext;
+    newProcess->suspendedContext = crankvm_specialObject_nil(context);
+    processorScheduler->activeProcess = (crankvm_oop_t)newProcess;
+    crankvm_heap_writeBarrier(heap, (crankvm_oop_t)processorScheduler, (crankvm_oop_t)newProcess);
+    crankvm_traceWithStringOop(context, PROCESS_SWITCH, newProcess, resumedContext, crankvm_scheduler_getPriority(newProcess), newProcess->name);
+
+    crankvm_scheduler_t *scheduler = &context->scheduler;
+    uint64_t switchTime = crankvm_scheduler_getNanoseconds() - startTime;
+    ++scheduler->processSwitchCount;
+    scheduler->processSwitchNanoseconds += switchTime;
+    if(switchTime > scheduler->maxProcessSwitchNanoseconds)
+        scheduler->maxProcessSwitchNanoseconds = switchTime;
+    return resumedContext;
+}
+
+void
+crankvm_scheduler_signalSemaphore(crankvm_context_t *context, crankvm_Semaphore_t *semaphore)
+{
+    crankvm_oop_t firstLink = semaphore->baseClass.firstLink;
+    crankvm_LinkedLink_t *runList = NULL;
+    if(crankvm_oop_isPointer(firstLink) && !crankvm_oop_isNil(context, firstLink))
+        runList = crankvm_scheduler_getRunList(context, ((crankvm_Process_t*)firstLink)->priority);
+    if(!runList)
+    {
+        semaphore->excessSignals = crankvm_oop_encodeSmallInteger(crankvm_oop_decodeSmallInteger(semaphore->excessSignals) + 1);
+        return;
+    }
+
+    crankvm_Process_t *process = crankvm_scheduler_removeFirstLink(context, &semaphore->baseClass);
+    crankvm_scheduler_addLastLink(context, runList, process);
+}
+
+/**
+ * Gets the semaphore at a one based index of the externalObjectsArray, or
+ * NULL when there is none.
+ */
+static crankvm_Semaphore_t *
+crankvm_scheduler_getExternalSemaphore(crankvm_context_t *context, size_t index)
+{
+    crankvm_special_object_array_t *specialObjects = context->roots.specialObjectsArray;
+    crankvm_oop_t table = specialObjects->externalObjectsArray;
+    if(!crankvm_oop_isPointer(table) || crankvm_oop_isNil(context, table) ||
+        index > crankvm_object_header_getSlotCount((crankvm_object_header_t*)table))
+        return NULL;
+
+    crankvm_oop_t semaphore = ((crankvm_oop_t*)table)[index];
+    if(!crankvm_oop_isPointer(semaphore) ||
+        crankvm_object_getClass(context, semaphore) != (crankvm_oop_t)specialObjects->classSemaphore)
+        return NULL;
+    return (crankvm_Semaphore_t*)semaphore;
+}
+
+void
+crankvm_scheduler_signalExternalSemaphores(crankvm_context_t *context)
+{
+    size_t index;
+    size_t signalCount;
+    while((signalCount = crankvm_signal_queue_next(&context->scheduler.externalSignals, &index)) != 0)
+    {
+        // The signals of an index without a semaphore are lost, as in a signal to a nil semaphore.
+        crankvm_Semaphore_t *semaphore = crankvm_scheduler_getExternalSemaphore(context, index);
+        if(!semaphore)
+            continue;
+
+        while(signalCount-- > 0)
+            crankvm_scheduler_signalSemaphore(context, semaphore);
+    }
+}
+
+void
+crankvm_scheduler_requestInterrupt(crankvm_context_t *context)
+{
+    context->scheduler.interruptRequested = true;
+}
+
+LIB_CRANK_VM_EXPORT crankvm_error_t
+crankvm_context_signalExternalSemaphore(crankvm_context_t *context, size_t index)
+{
+    if(!context)
+        return CRANK_VM_ERROR_NULL_POINTER;
+
+    if(!crankvm_signal_queue_signal(&context->scheduler.externalSignals, index))
+        return CRANK_VM_ERROR_OUT_OF_BOUNDS;
+
+    // The interrupt is requested after the index is queued, so the check that clears it sees the index.
+    crankvm_scheduler_requestInterrupt(context);
+    return CRANK_VM_OK;
+}
+
+LIB_CRANK_VM_EXPORT void
+crankvm_context_dumpSchedulerStatistics(crankvm_context_t *context, FILE *output)
+{
+    if(!context || !output)
+        return;
+
+    crankvm_scheduler_t *scheduler = &context->scheduler;
+    uint64_t switchCount = scheduler->processSwitchCount;
+    fprintf(output, "Process switches: %llu, %llu of them preemptions\n",
+        (unsigned long long)switchCount, (unsigned long long)scheduler->preemptionCount);
+    fprintf(output, "Process switch latency: average %.3f us max %.3f us\n",
+        switchCount ? scheduler->processSwitchNanoseconds / 1000.0 / switchCount : 0.0,
+        scheduler->maxProcessSwitchNanoseconds / 1000.0);
+
+    crankvm_callout_pool_t *pool = &context->calloutPool;
+    fprintf(output, "Callouts: %llu, %llu of them in the interpreter thread\n",
+        (unsigned long long)pool->calloutCount, (unsigned long long)pool->synchronousCalloutCount);
+    fprintf(output, "Timers fired: %llu\n", (unsigned long long)context->timerWheel.firedTimerCount);
+}
@@ -0,0 +1,120 @@
+#ifndef CRANK_VM_SCHEDULER_H
+#define CRANK_VM_SCHEDULER_H
+
+#include <crank-vm/objectmodel.h>
+#include <crank-vm/special-objects.h>
+#include "signal-queue.h"
+#include "timer-wheel.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef struct crankvm_context_s crankvm_context_t;
+
+// The size of the external semaphore table, when the image header does not specify it.
+#define CRANK_VM_SCHEDULER_DEFAULT_EXTERNAL_SEMAPHORE_TABLE_SIZE 256
+
+/**
+ * The state of the process scheduler of the VM. The processes, their run
+ * lists and the semaphores are the objects of the image, so this only keeps
+ * the preemption request, the pending signals of the external semaphores,
+ * the timer of the timer semaphore, and the statistics of the process
+ * switches.
+ *
+ * A process switch that is requested from outside of a scheduling primitive
+ * is performed at the next backward jump or send, where the interpreter can
+ * suspend the active process.
+ *
+ * The external semaphores are the ones in the externalObjectsArray of the
+ * special objects, which the image registers for the I/O and the timers.
+ * The other threads signal their one based indices into a lock-free queue,
+ * which the interpreter drains at the interrupt check.
+ */
+typedef struct crankvm_scheduler_s
+{
+    atomic_bool interruptRequested;
+    crankvm_signal_queue_t externalSignals;
+
+    // The timer that signals the timer semaphore of the special objects.
+    crankvm_timer_t timerSemaphoreTimer;
+
+    uint64_t processSwitchCount;
+    uint64_t preemptionCount;
+    uint64_t processSwitchNanoseconds;
+    uint64_t maxProcessSwitchNanoseconds;
+} crankvm_scheduler_t;
+
+/**
+ * Allocates the queue of the external signals for a table of the given size.
+ * Zero uses the default size.
+ */
+crankvm_error_t crankvm_scheduler_initialize(crankvm_scheduler_t *scheduler, size_t externalSemaphoreTableSize);
+void crankvm_scheduler_destroy(crankvm_scheduler_t *scheduler);
+
+/**
+ * Gets the run list of the processes with a priority, or NULL when the
+ * priority is out of range.
+ */
+crankvm_LinkedLink_t *crankvm_scheduler_getRunList(crankvm_context_t *context, crankvm_oop_t priority);
+
+void crankvm_scheduler_addLastLink(crankvm_context_t *context, crankvm_LinkedLink_t *list, crankvm_Process_t *process);
+crankvm_Process_t *crankvm_scheduler_removeFirstLink(crankvm_context_t *context, crankvm_LinkedLink_t *list);
+
+/**
+ * Removes a process from the list that it is waiting on. Returns false when
+ * the process is not in the list.
+ */
+bool crankvm_scheduler_removeLink(crankvm_context_t *context, crankvm_LinkedLink_t *list, crankvm_Process_t *process);
+
+/**
+ * Gets the runnable process with the highest priority, when its priority is
+ * above the given one. Returns NULL otherwise.
+ */
+crankvm_Process_t *crankvm_scheduler_highestPriorityProcess(crankvm_context_t *context, intptr_t abovePriority);
+
+/**
+ * Removes the runnable process with the highest priority from its run list,
+ * when its priority is above the given one. Returns NULL otherwise.
+ */
+crankvm_Process_t *crankvm_scheduler_wakeHighestPriority(crankvm_context_t *context, intptr_t abovePriority);
+
+/**
+ * Makes the active process suspended in the given context, and makes a
+ * process that is not in any list the active one. Returns the context where
+ * the new active process resumes.
+ */
+crankvm_MethodContext_t *crankvm_scheduler_transferTo(crankvm_context_t *context, crankvm_Process_t *newProcess, crankvm_MethodContext_t *suspendedContext, uint64_t startTime);
+
+/**
+ * Signals a semaphore outside of the primitives. Its first waiting process
+ * becomes runnable, and the process switch is left to the interrupt check.
+ */
+void crankvm_scheduler_signalSemaphore(crankvm_context_t *context, crankvm_Semaphore_t *semaphore);
+
+/**
+ * Signals the external semaphores whose indices were signalled since the last
+ * interrupt check.
+ */
+void crankvm_scheduler_signalExternalSemaphores(crankvm_context_t *context);
+
+/**
+ * Requests a check for a process switch at the next backward jump or send.
+ */
+void crankvm_scheduler_requestInterrupt(crankvm_context_t *context);
+
+CRANK_VM_INLINE uint64_t
+crankvm_scheduler_getNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+CRANK_VM_INLINE intptr_t
+crankvm_scheduler_getPriority(crankvm_Process_t *process)
+{
+    return crankvm_oop_isSmallInteger(process->priority) ? crankvm_oop_decodeSmallInteger(process->priority) : 0;
+}
+
+#endif //CRANK_VM_SCHEDULER_H
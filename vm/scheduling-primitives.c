@@ -2,6 +2,13 @@
 
 CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_semaphoreSignal, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_SEMAPHORE_SIGNAL)
 CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_semaphoreWait, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_SEMAPHORE_WAIT)
+CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_processResume, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_PROCESS_RESUME)
+CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_processSuspend, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_PROCESS_SUSPEND)
+CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_processorYield, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_PROCESSOR_YIELD)
+CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_relinquishProcessor, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_RELINQUISH_PROCESSOR)
+
+// The longest time that the processor is relinquished, so that the image keeps running its idle loop.
+#define CRANK_VM_MAX_RELINQUISH_MICROSECONDS 10000
 
 static crankvm_Semaphore_t*
 crankvm_primitive_fetchReceiverSemaphore(crankvm_primitive_context_t *primitiveContext)
@@ -20,42 +27,232 @@ crankvm_primitive_fetchReceiverSemaphore(crankvm_primitive_context_t *primitiveC
     return (crankvm_Semaphore_t*)semaphoreOop;
 }
 
+static crankvm_Process_t*
+crankvm_primitive_fetchReceiverProcess(crankvm_primitive_context_t *primitiveContext)
+{
+    crankvm_oop_t processOop = crankvm_primitive_getReceiver(primitiveContext);
+    if(crankvm_primitive_hasFailed(primitiveContext))
+        return NULL;
+
+    // The process must have a run list for its priority.
+    if(!crankvm_oop_isPointer(processOop) ||
+        crankvm_object_header_getSlotCount((crankvm_object_header_t *)processOop) < 4 ||
+        !crankvm_scheduler_getRunList(primitiveContext->context, ((crankvm_Process_t*)processOop)->priority))
+    {
+        crankvm_primitive_failWithCode(primitiveContext, CRANK_VM_PRIMITIVE_ERROR_BAD_RECEIVER);
+        return NULL;
+    }
+
+    return (crankvm_Process_t*)processOop;
+}
+
 static int crankvm_Semaphore_isEmpty(crankvm_context_t *context, crankvm_Semaphore_t *self)
 {
     return crankvm_oop_isNil(context, self->baseClass.firstLink);
 }
 
+/**
+ * Suspends the active process in the sender of the primitive, with the
+ * result of the primitive pushed into its stack. Fails the primitive and
+ * returns NULL when the sender cannot receive the result.
+ */
+static crankvm_MethodContext_t *
+crankvm_primitive_suspendActiveProcessInSender(crankvm_primitive_context_t *primitiveContext, crankvm_oop_t result)
+{
+    // The suspended context is stored in the heap.
+    crankvm_interpreter_materializeStackFramesFromPrimitive(primitiveContext);
+
+    crankvm_context_t *context = primitiveContext->context;
+    crankvm_MethodContext_t *sender = crankvm_primitive_getPrimitiveSenderMethodContext(primitiveContext);
+    if(!crankvm_oop_isPointer((crankvm_oop_t)sender) || crankvm_oop_isNil(context, (crankvm_oop_t)sender))
+    {
+        crankvm_primitive_fail(primitiveContext);
+        return NULL;
+    }
+
+    intptr_t stackPointer = crankvm_oop_decodeSmallInteger(sender->stackp);
+    if(stackPointer + CRANK_VM_MethodContext_InstanceFixedSize >= crankvm_object_header_getSlotCount((crankvm_object_header_t *)sender))
+    {
+        crankvm_primitive_fail(primitiveContext);
+        return NULL;
+    }
+
+    sender->stackSlots[stackPointer] = result;
+    crankvm_heap_writeBarrier(&context->heap, (crankvm_oop_t)sender, result);
+    sender->stackp = crankvm_oop_encodeSmallInteger(stackPointer + 1);
+    return sender;
+}
+
+/**
+ * Makes a process runnable, taking it out of the list that it waits on, and
+ * switches to it when its priority is higher than the one of the active
+ * process.
+ */
+static void
+crankvm_primitive_resumeProcess(crankvm_primitive_context_t *primitiveContext, crankvm_Process_t *process, crankvm_LinkedLink_t *waitingList, crankvm_oop_t result, uint64_t startTime)
+{
+    crankvm_context_t *context = primitiveContext->context;
+    crankvm_Process_t *activeProcess = crankvm_context_getActiveProcess(context);
+    if(!activeProcess || crankvm_scheduler_getPriority(process) <= crankvm_scheduler_getPriority(activeProcess))
+    {
+        if(waitingList)
+            crankvm_scheduler_removeFirstLink(context, waitingList);
+        crankvm_scheduler_addLastLink(context, crankvm_scheduler_getRunList(context, process->priority), process);
+        return crankvm_primitive_returnOop(primitiveContext, result);
+    }
+
+    crankvm_MethodContext_t *suspendedContext = crankvm_primitive_suspendActiveProcessInSender(primitiveContext, result);
+    if(!suspendedContext)
+        return;
+
+    // The preempted process waits at the end of its run list.
+    if(waitingList)
+        crankvm_scheduler_removeFirstLink(context, waitingList);
+    crankvm_scheduler_addLastLink(context, crankvm_scheduler_getRunList(context, activeProcess->priority), activeProcess);
+    crankvm_primitive_finishReplacingMethodContext(primitiveContext, crankvm_scheduler_transferTo(context, process, suspendedContext, startTime));
+}
+
+/**
+ * Suspends the active process, and switches to the runnable process with the
+ * highest priority. Fails the primitive when there is no runnable process.
+ */
+static void
+crankvm_primitive_transferToHighestPriority(crankvm_primitive_context_t *primitiveContext, crankvm_LinkedLink_t *waitingList, crankvm_oop_t result, uint64_t startTime)
+{
+    crankvm_context_t *context = primitiveContext->context;
+    crankvm_Process_t *activeProcess = crankvm_context_getActiveProcess(context);
+    if(!activeProcess || !crankvm_scheduler_highestPriorityProcess(context, 0))
+        return crankvm_primitive_fail(primitiveContext);
+
+    crankvm_MethodContext_t *suspendedContext = crankvm_primitive_suspendActiveProcessInSender(primitiveContext, result);
+    if(!suspendedContext)
+        return;
+
+    if(waitingList)
+        crankvm_scheduler_addLastLink(context, waitingList, activeProcess);
+    crankvm_Process_t *newProcess = crankvm_scheduler_wakeHighestPriority(context, 0);
+    crankvm_primitive_finishReplacingMethodContext(primitiveContext, crankvm_scheduler_transferTo(context, newProcess, suspendedContext, startTime));
+}
+
 void
 crankvm_primitive_semaphoreSignal(crankvm_primitive_context_t *primitiveContext)
 {
+    uint64_t startTime = crankvm_scheduler_getNanoseconds();
     crankvm_Semaphore_t* semaphore = crankvm_primitive_fetchReceiverSemaphore(primitiveContext);
     if(!semaphore) return;
 
-    if(crankvm_Semaphore_isEmpty(primitiveContext->context, semaphore))
+    crankvm_context_t *context = primitiveContext->context;
+    if(crankvm_Semaphore_isEmpty(context, semaphore))
     {
         semaphore->excessSignals = crankvm_oop_encodeSmallInteger(crankvm_oop_decodeSmallInteger(semaphore->excessSignals) + 1);
+        return crankvm_primitive_returnOop(primitiveContext, (crankvm_oop_t)semaphore);
     }
-    else
-    {
-        printf("Unimplemented semaphore signal resume once\n");
-        abort();
-    }
+
+    // Resume the first waiting process.
+    crankvm_Process_t *process = (crankvm_Process_t*)semaphore->baseClass.firstLink;
+    if(!crankvm_scheduler_getRunList(context, process->priority))
+        return crankvm_primitive_fail(primitiveContext);
+
+    crankvm_primitive_resumeProcess(primitiveContext, process, &semaphore->baseClass, (crankvm_oop_t)semaphore, startTime);
 }
 
 void
 crankvm_primitive_semaphoreWait(crankvm_primitive_context_t *primitiveContext)
 {
+    uint64_t startTime = crankvm_scheduler_getNanoseconds();
     crankvm_Semaphore_t* semaphore = crankvm_primitive_fetchReceiverSemaphore(primitiveContext);
     if(!semaphore) return;
 
     intptr_t excessSignals = crankvm_oop_decodeSmallInteger(semaphore->excessSignals);
-    if(excessSignals <= 0)
+    if(excessSignals > 0)
     {
-        printf("Unimplemented semaphore wait yield\n");
-        abort();
+        semaphore->excessSignals = crankvm_oop_encodeSmallInteger(excessSignals - 1);
+        return crankvm_primitive_returnOop(primitiveContext, (crankvm_oop_t)semaphore);
     }
-    else
+
+    // Wait in the semaphore.
+    crankvm_primitive_transferToHighestPriority(primitiveContext, &semaphore->baseClass, (crankvm_oop_t)semaphore, startTime);
+}
+
+void
+crankvm_primitive_processResume(crankvm_primitive_context_t *primitiveContext)
+{
+    uint64_t startTime = crankvm_scheduler_getNanoseconds();
+    crankvm_Process_t *process = crankvm_primitive_fetchReceiverProcess(primitiveContext);
+    if(!process) return;
+
+    // Only a suspended process that is not waiting in a list can be resumed.
+    crankvm_context_t *context = primitiveContext->context;
+    if(!crankvm_oop_isPointer(process->suspendedContext) || crankvm_oop_isNil(context, process->suspendedContext) ||
+        !crankvm_oop_isNil(context, process->myList))
+        return crankvm_primitive_failWithCode(primitiveContext, CRANK_VM_PRIMITIVE_ERROR_BAD_RECEIVER);
+
+    crankvm_primitive_resumeProcess(primitiveContext, process, NULL, (crankvm_oop_t)process, startTime);
+}
+
+void
+crankvm_primitive_processSuspend(crankvm_primitive_context_t *primitiveContext)
+{
+    uint64_t startTime = crankvm_scheduler_getNanoseconds();
+    crankvm_Process_t *process = crankvm_primitive_fetchReceiverProcess(primitiveContext);
+    if(!process) return;
+
+    crankvm_context_t *context = primitiveContext->context;
+    crankvm_oop_t nilOop = crankvm_specialObject_nil(context);
+    if(process == crankvm_context_getActiveProcess(context))
+        return crankvm_primitive_transferToHighestPriority(primitiveContext, NULL, nilOop, startTime);
+
+    // A process that is not active is removed from the list that it waits on, which is the result.
+    crankvm_oop_t list = process->myList;
+    if(!crankvm_oop_isPointer(list) || list == nilOop ||
+        !crankvm_scheduler_removeLink(context, (crankvm_LinkedLink_t*)list, process))
+        return crankvm_primitive_failWithCode(primitiveContext, CRANK_VM_PRIMITIVE_ERROR_BAD_RECEIVER);
+
+    return crankvm_primitive_returnOop(primitiveContext, list);
+}
+
+void
+crankvm_primitive_processorYield(crankvm_primitive_context_t *primitiveContext)
+{
+    uint64_t startTime = crankvm_scheduler_getNanoseconds();
+    crankvm_context_t *context = primitiveContext->context;
+    crankvm_oop_t receiver = crankvm_primitive_getReceiver(primitiveContext);
+    crankvm_Process_t *activeProcess = crankvm_context_getActiveProcess(context);
+    if(!activeProcess)
+        return crankvm_primitive_fail(primitiveContext);
+
+    // Give the processor to the next process with the same priority, if there is one.
+    crankvm_LinkedLink_t *runList = crankvm_scheduler_getRunList(context, activeProcess->priority);
+    if(!runList)
+        return crankvm_primitive_fail(primitiveContext);
+    if(crankvm_oop_isNil(context, runList->firstLink))
+        return crankvm_primitive_returnOop(primitiveContext, receiver);
+
+    crankvm_primitive_transferToHighestPriority(primitiveContext, runList, receiver, startTime);
+}
+
+void
+crankvm_primitive_relinquishProcessor(crankvm_primitive_context_t *primitiveContext)
+{
+    intptr_t microseconds = crankvm_primitive_getSmallIntegerValue(primitiveContext, crankvm_primitive_getArgument(primitiveContext, 0));
+    if(crankvm_primitive_hasFailed(primitiveContext))
+        return;
+
+    // The idle process gives the processor back until a request may need a process switch.
+    crankvm_context_t *context = primitiveContext->context;
+    if(microseconds > CRANK_VM_MAX_RELINQUISH_MICROSECONDS)
+        microseconds = CRANK_VM_MAX_RELINQUISH_MICROSECONDS;
+
+    // The sleep ends by the time of the next timer, which would wake a waiting process.
+    uint64_t timerMicroseconds = crankvm_timer_wheel_getMicrosecondsUntilNextTick(context);
+    if(microseconds > 0 && (uint64_t)microseconds > timerMicroseconds)
+        microseconds = timerMicroseconds;
+
+    if(microseconds > 0 && !context->scheduler.interruptRequested)
     {
-        semaphore->excessSignals = crankvm_oop_encodeSmallInteger(excessSignals - 1);
+        struct timespec duration = {.tv_sec = 0, .tv_nsec = microseconds * 1000};
+        nanosleep(&duration, NULL);
     }
+
+    return crankvm_primitive_returnOop(primitiveContext, crankvm_primitive_getReceiver(primitiveContext));
 }
@@ -5,5 +5,9 @@
 
 void crankvm_primitive_semaphoreSignal(crankvm_primitive_context_t *context);
 void crankvm_primitive_semaphoreWait(crankvm_primitive_context_t *context);
+void crankvm_primitive_processResume(crankvm_primitive_context_t *context);
+void crankvm_primitive_processSuspend(crankvm_primitive_context_t *context);
+void crankvm_primitive_processorYield(crankvm_primitive_context_t *context);
+void crankvm_primitive_relinquishProcessor(crankvm_primitive_context_t *context);
 
 #endif //CRANK_VM_SCHEDULING_PRIMITIVES_H
@@ -0,0 +1,126 @@
+#include "selector-index.h"
+#include "context-internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CRANK_VM_USE_SELECTOR_INDEX
+
+void
+crankvm_selector_index_destroy(crankvm_selector_index_t *selectorIndex)
+{
+    for(size_t i = 0; i < CRANK_VM_SELECTOR_INDEX_DICTIONARY_COUNT; ++i)
+        free(selectorIndex->dictionaries[i].entries);
+    memset(selectorIndex, 0, sizeof(crankvm_selector_index_t));
+}
+
+static bool
+crankvm_selector_index_build(crankvm_context_t *context, crankvm_selector_index_dictionary_t *dictionary, crankvm_MethodDictionary_t *methodDict, size_t capacity)
+{
+    crankvm_heap_t *heap = &context->heap;
+    crankvm_oop_t nilOop = crankvm_specialObject_nil(context);
+    size_t selectorCount = 0;
+    for(size_t i = 0; i < capacity; ++i)
+    {
+        if(methodDict->keys[i] != nilOop)
+            ++selectorCount;
+    }
+
+    // Keep the table at most half full, so the misses stop early.
+    size_t entryCount = 16;
+    while(entryCount < selectorCount * 2)
+        entryCount *= 2;
+
+    if(entryCount != dictionary->entryCount)
+    {
+        crankvm_selector_index_entry_t *entries = realloc(dictionary->entries, entryCount * sizeof(crankvm_selector_index_entry_t));
+        if(!entries)
+        {
+            dictionary->methodDictionary = 0;
+            return false;
+        }
+
+        dictionary->entries = entries;
+        dictionary->entryCount = entryCount;
+    }
+
+    memset(dictionary->entries, 0, entryCount * sizeof(crankvm_selector_index_entry_t));
+    dictionary->methodDictionary = (crankvm_oop_t)methodDict;
+    dictionary->array = (crankvm_oop_t)methodDict->array;
+    dictionary->tally = methodDict->tally;
+    dictionary->hasNewSpaceReferences = crankvm_heap_isYoung(heap, dictionary->methodDictionary) || crankvm_heap_isYoung(heap, dictionary->array);
+    for(size_t i = 0; i < capacity; ++i)
+    {
+        crankvm_oop_t selector = methodDict->keys[i];
+        if(selector == nilOop)
+            continue;
+
+        size_t index = crankvm_oop_addressHash(selector) & (entryCount - 1);
+        while(dictionary->entries[index].selector)
+            index = (index + 1) & (entryCount - 1);
+        dictionary->entries[index].selector = selector;
+        dictionary->entries[index].slotIndex = i;
+        dictionary->hasNewSpaceReferences |= crankvm_heap_isYoung(heap, selector);
+    }
+
+    ++context->selectorIndex.buildCount;
+    return true;
+}
+
+bool
+crankvm_selector_index_lookup(crankvm_context_t *context, crankvm_MethodDictionary_t *methodDict, size_t capacity, crankvm_oop_t selector, crankvm_oop_t *result)
+{
+    if(capacity < CRANK_VM_SELECTOR_INDEX_MIN_CAPACITY)
+        return false;
+
+    crankvm_selector_index_dictionary_t *dictionary = &context->selectorIndex.dictionaries[crankvm_oop_addressHash((crankvm_oop_t)methodDict) & CRANK_VM_SELECTOR_INDEX_DICTIONARY_MASK];
+    if(dictionary->methodDictionary != (crankvm_oop_t)methodDict ||
+        dictionary->array != (crankvm_oop_t)methodDict->array ||
+        dictionary->tally != methodDict->tally)
+    {
+        if(!crankvm_selector_index_build(context, dictionary, methodDict, capacity))
+            return false;
+    }
+
+    size_t mask = dictionary->entryCount - 1;
+    for(size_t index = crankvm_oop_addressHash(selector) & mask; dictionary->entries[index].selector; index = (index + 1) & mask)
+    {
+        crankvm_selector_index_entry_t *entry = &dictionary->entries[index];
+        if(entry->selector != selector)
+            continue;
+
+        // The image may have moved the selector without changing the tally.
+        if(entry->slotIndex >= capacity || methodDict->keys[entry->slotIndex] != selector)
+        {
+            dictionary->methodDictionary = 0;
+            return false;
+        }
+
+        *result = methodDict->array->slots[entry->slotIndex];
+        return true;
+    }
+
+    *result = crankvm_specialObject_nil(context);
+    return true;
+}
+
+void
+crankvm_selector_index_flush(crankvm_context_t *context)
+{
+    crankvm_selector_index_t *selectorIndex = &context->selectorIndex;
+    for(size_t i = 0; i < CRANK_VM_SELECTOR_INDEX_DICTIONARY_COUNT; ++i)
+        selectorIndex->dictionaries[i].methodDictionary = 0;
+}
+
+void
+crankvm_selector_index_flushNewSpaceReferences(crankvm_context_t *context)
+{
+    crankvm_selector_index_t *selectorIndex = &context->selectorIndex;
+    for(size_t i = 0; i < CRANK_VM_SELECTOR_INDEX_DICTIONARY_COUNT; ++i)
+    {
+        crankvm_selector_index_dictionary_t *dictionary = &selectorIndex->dictionaries[i];
+        if(dictionary->hasNewSpaceReferences)
+            dictionary->methodDictionary = 0;
+    }
+}
+
+#endif /* CRANK_VM_USE_SELECTOR_INDEX */
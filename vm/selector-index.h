@@ -0,0 +1,74 @@
+#ifndef CRANK_VM_SELECTOR_INDEX_H
+#define CRANK_VM_SELECTOR_INDEX_H
+
+#include <crank-vm/objectmodel.h>
+#include <crank-vm/special-objects.h>
+#include <stdbool.h>
+
+#define CRANK_VM_SELECTOR_INDEX_DICTIONARY_COUNT 256
+#define CRANK_VM_SELECTOR_INDEX_DICTIONARY_MASK (CRANK_VM_SELECTOR_INDEX_DICTIONARY_COUNT - 1)
+
+// The smaller method dictionaries are probed directly.
+#define CRANK_VM_SELECTOR_INDEX_MIN_CAPACITY 64
+
+typedef struct crankvm_context_s crankvm_context_t;
+
+typedef struct crankvm_selector_index_entry_s
+{
+    crankvm_oop_t selector;
+    size_t slotIndex;
+} crankvm_selector_index_entry_t;
+
+/**
+ * The slots of the selectors of a method dictionary, hashed by the address of
+ * the selectors, and filled at most half. An index is only valid for the
+ * array and the tally it was built from, and it is flushed with the method
+ * cache, and when the collector moves the dictionary or its selectors.
+ */
+typedef struct crankvm_selector_index_dictionary_s
+{
+    crankvm_oop_t methodDictionary;
+    crankvm_oop_t array;
+    crankvm_oop_t tally;
+    bool hasNewSpaceReferences;
+
+    size_t entryCount;
+    crankvm_selector_index_entry_t *entries;
+} crankvm_selector_index_dictionary_t;
+
+/**
+ * The selector index answers the lookups in the large method dictionaries,
+ * such as the one of Object, without walking the probe sequences of the
+ * image. The indexes are built lazily at the first lookup in a dictionary,
+ * and a miss ends at the first empty entry of a sparse table.
+ */
+typedef struct crankvm_selector_index_s
+{
+    crankvm_selector_index_dictionary_t dictionaries[CRANK_VM_SELECTOR_INDEX_DICTIONARY_COUNT];
+
+    uint64_t buildCount;
+} crankvm_selector_index_t;
+
+#ifdef CRANK_VM_USE_SELECTOR_INDEX
+
+void crankvm_selector_index_destroy(crankvm_selector_index_t *selectorIndex);
+
+/**
+ * Looks up a selector in the first capacity slots of a method dictionary.
+ * Returns false when the dictionary is not indexed, and it has to be probed.
+ */
+bool crankvm_selector_index_lookup(crankvm_context_t *context, crankvm_MethodDictionary_t *methodDict, size_t capacity, crankvm_oop_t selector, crankvm_oop_t *result);
+
+void crankvm_selector_index_flush(crankvm_context_t *context);
+void crankvm_selector_index_flushNewSpaceReferences(crankvm_context_t *context);
+
+#else /* !CRANK_VM_USE_SELECTOR_INDEX */
+
+CRANK_VM_INLINE void crankvm_selector_index_destroy(crankvm_selector_index_t *selectorIndex) {}
+CRANK_VM_INLINE bool crankvm_selector_index_lookup(crankvm_context_t *context, crankvm_MethodDictionary_t *methodDict, size_t capacity, crankvm_oop_t selector, crankvm_oop_t *result) { return false; }
+CRANK_VM_INLINE void crankvm_selector_index_flush(crankvm_context_t *context) {}
+CRANK_VM_INLINE void crankvm_selector_index_flushNewSpaceReferences(crankvm_context_t *context) {}
+
+#endif /* CRANK_VM_USE_SELECTOR_INDEX */
+
+#endif //CRANK_VM_SELECTOR_INDEX_H
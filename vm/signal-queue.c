@@ -0,0 +1,82 @@
+#include "signal-queue.h"
+#include <stdlib.h>
+
+crankvm_error_t
+crankvm_signal_queue_initialize(crankvm_signal_queue_t *queue, size_t indexCount)
+{
+    crankvm_signal_queue_destroy(queue);
+
+    // The positions of the slots are masked, so their number is a power of two.
+    size_t slotCount = 1;
+    while(slotCount < indexCount)
+        slotCount <<= 1;
+
+    queue->pendingSignalCounts = calloc(indexCount ? indexCount : 1, sizeof(atomic_uint));
+    queue->slots = calloc(slotCount, sizeof(crankvm_signal_queue_slot_t));
+    if(!queue->pendingSignalCounts || !queue->slots)
+    {
+        crankvm_signal_queue_destroy(queue);
+        return CRANK_VM_ERROR_OUT_OF_MEMORY;
+    }
+
+    for(size_t i = 0; i < indexCount; ++i)
+        atomic_init(&queue->pendingSignalCounts[i], 0);
+
+    // A slot is free for the position that is equal to its sequence, and it is full for the next one.
+    for(size_t i = 0; i < slotCount; ++i)
+        atomic_init(&queue->slots[i].sequence, i);
+
+    queue->indexCount = indexCount;
+    queue->mask = slotCount - 1;
+    atomic_init(&queue->enqueuePosition, 0);
+    queue->dequeuePosition = 0;
+    return CRANK_VM_OK;
+}
+
+void
+crankvm_signal_queue_destroy(crankvm_signal_queue_t *queue)
+{
+    free(queue->pendingSignalCounts);
+    free(queue->slots);
+    queue->pendingSignalCounts = NULL;
+    queue->slots = NULL;
+    queue->indexCount = 0;
+}
+
+bool
+crankvm_signal_queue_signal(crankvm_signal_queue_t *queue, size_t index)
+{
+    if(index == 0 || index > queue->indexCount)
+        return false;
+
+    // The index is already queued when it has pending signals.
+    if(atomic_fetch_add_explicit(&queue->pendingSignalCounts[index - 1], 1, memory_order_acq_rel))
+        return true;
+
+    // There are fewer queued indices than slots, so the slot of the position is free.
+    size_t position = atomic_fetch_add_explicit(&queue->enqueuePosition, 1, memory_order_relaxed);
+    crankvm_signal_queue_slot_t *slot = &queue->slots[position & queue->mask];
+    slot->index = index;
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    return true;
+}
+
+size_t
+crankvm_signal_queue_next(crankvm_signal_queue_t *queue, size_t *index)
+{
+    if(!queue->slots)
+        return 0;
+
+    // A producer that is still writing the slot leaves its index for the next drain.
+    size_t position = queue->dequeuePosition;
+    crankvm_signal_queue_slot_t *slot = &queue->slots[position & queue->mask];
+    if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != position + 1)
+        return 0;
+
+    *index = slot->index;
+    atomic_store_explicit(&slot->sequence, position + queue->mask + 1, memory_order_release);
+    queue->dequeuePosition = position + 1;
+
+    // The signals that arrive from now on queue the index again.
+    return atomic_exchange_explicit(&queue->pendingSignalCounts[*index - 1], 0, memory_order_acq_rel);
+}
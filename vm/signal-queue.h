@@ -0,0 +1,55 @@
+#ifndef CRANK_VM_SIGNAL_QUEUE_H
+#define CRANK_VM_SIGNAL_QUEUE_H
+
+#include <crank-vm/error.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct crankvm_signal_queue_slot_s
+{
+    atomic_size_t sequence;
+    size_t index;
+} crankvm_signal_queue_slot_t;
+
+/**
+ * A lock-free queue of the pending signals of the one based indices of a
+ * semaphore table, with many producers and the interpreter as the only
+ * consumer.
+ *
+ * Each index keeps a counter of its pending signals, and it is only queued by
+ * the signal that makes its counter nonzero. An index is then at most once in
+ * the queue, so the queue never becomes full, and the producers never wait,
+ * allocate, or take a lock. This makes signalling safe from any thread and
+ * from the signal handlers.
+ */
+typedef struct crankvm_signal_queue_s
+{
+    size_t indexCount;
+    size_t mask;
+    atomic_uint *pendingSignalCounts;
+    crankvm_signal_queue_slot_t *slots;
+
+    atomic_size_t enqueuePosition;
+    size_t dequeuePosition;
+} crankvm_signal_queue_t;
+
+/**
+ * Allocates the queue for the indices from 1 to indexCount. It must not be
+ * used by the producers meanwhile.
+ */
+crankvm_error_t crankvm_signal_queue_initialize(crankvm_signal_queue_t *queue, size_t indexCount);
+void crankvm_signal_queue_destroy(crankvm_signal_queue_t *queue);
+
+/**
+ * Records a signal of an index. Returns false when the index is out of range.
+ */
+bool crankvm_signal_queue_signal(crankvm_signal_queue_t *queue, size_t index);
+
+/**
+ * Removes the next signalled index from the queue. Returns its number of
+ * pending signals, or zero when no index is ready.
+ */
+size_t crankvm_signal_queue_next(crankvm_signal_queue_t *queue, size_t *index);
+
+#endif //CRANK_VM_SIGNAL_QUEUE_H
@@ -20,19 +20,13 @@ crankvm_CompiledCode_validate(crankvm_context_t *context, crankvm_CompiledCode_t
 LIB_CRANK_VM_EXPORT size_t
 crankvm_CompiledCode_getNumberOfLiterals(crankvm_context_t *context, crankvm_CompiledCode_t *compiledCode)
 {
-    crankvm_compiled_code_header_t header = {};
-    crankvm_object_decodeCompiledCodeHeader(&header, compiledCode->codeHeader);
-
-    return header.numberOfLiterals;
+    return crankvm_object_decodeCompiledCodeNumberOfLiterals(compiledCode->codeHeader);
 }
 
 LIB_CRANK_VM_EXPORT crankvm_oop_t
 crankvm_CompiledCode_getSelector(crankvm_context_t *context, crankvm_CompiledCode_t *compiledCode)
 {
-    crankvm_compiled_code_header_t header = {};
-    crankvm_object_decodeCompiledCodeHeader(&header, compiledCode->codeHeader);
-
-    size_t selectorLiteralIndex = header.numberOfLiterals - 2;
+    size_t selectorLiteralIndex = crankvm_object_decodeCompiledCodeNumberOfLiterals(compiledCode->codeHeader) - 2;
     crankvm_oop_t selectorOrAdditionalMethodState = compiledCode->literals[selectorLiteralIndex];
     if(crankvm_oop_isBytes(selectorOrAdditionalMethodState))
         return selectorOrAdditionalMethodState;
@@ -44,10 +38,7 @@ crankvm_CompiledCode_getSelector(crankvm_context_t *context, crankvm_CompiledCod
 LIB_CRANK_VM_EXPORT crankvm_oop_t
 crankvm_CompiledCode_getClass(crankvm_context_t *context, crankvm_CompiledCode_t *compiledCode)
 {
-    crankvm_compiled_code_header_t header = {};
-    crankvm_object_decodeCompiledCodeHeader(&header, compiledCode->codeHeader);
-
-    size_t classBindingLiteralIndex = header.numberOfLiterals - 1;
+    size_t classBindingLiteralIndex = crankvm_object_decodeCompiledCodeNumberOfLiterals(compiledCode->codeHeader) - 1;
     crankvm_oop_t classBinding = compiledCode->literals[classBindingLiteralIndex];
     return ((crankvm_Association_t*)classBinding)->value;
 }
@@ -62,28 +53,40 @@ crankvm_CompiledCode_getFirstPC(crankvm_context_t *context, crankvm_CompiledCode
 LIB_CRANK_VM_EXPORT crankvm_oop_t
 crankvm_MethodDictionary_atOrNil(crankvm_context_t *context, crankvm_MethodDictionary_t *methodDict, crankvm_oop_t keyObject)
 {
+    crankvm_oop_t nilOop = crankvm_specialObject_nil(context);
     if(crankvm_object_isNil(context, methodDict->array))
-        return crankvm_specialObject_nil(context);
-
+        return nilOop;
+
+    // The keys are the indexable slots of the dictionary, and the values are the slots of its array.
+    size_t capacity = crankvm_object_header_getSlotCount((crankvm_object_header_t*)methodDict->array);
+    size_t keyCount = crankvm_object_header_getSmalltalkSize((crankvm_object_header_t*)methodDict) - CRANK_VM_MethodDictionary_InstanceFixedSize;
+    if(keyCount < capacity)
+        capacity = keyCount;
+    if(!capacity)
+        return nilOop;
+
+    crankvm_oop_t method;
+    if(crankvm_selector_index_lookup(context, methodDict, capacity, keyObject, &method))
+        return method;
+
+    // The image keeps a power of two capacity, and it probes linearly from the
+    // identity hash of the key. The probe sequence of a key ends at a nil key.
     uintptr_t keyHash = crankvm_object_getIdentityHash(context, keyObject);
-
-    size_t finish = crankvm_object_header_getSlotCount((crankvm_object_header_t*)methodDict->array);
-    size_t start = keyHash % finish;
-
-    //printf("Lookup key %p %08x start: %zu finish: %zu at method dict %p\n", (void*)keyObject, (int)keyHash, start, finish, methodDict);
-    for(size_t i = start; i < finish; ++i)
+    bool isPowerOfTwo = (capacity & (capacity - 1)) == 0;
+    size_t index = isPowerOfTwo ? keyHash & (capacity - 1) : keyHash % capacity;
+    for(size_t probeCount = 0; probeCount < capacity; ++probeCount)
     {
-        if(methodDict->keys[i] == keyObject)
-            return methodDict->array->slots[i];
-    }
+        crankvm_oop_t key = methodDict->keys[index];
+        if(key == keyObject)
+            return methodDict->array->slots[index];
+        if(key == nilOop)
+            break;
 
-    for(size_t i = 0; i < start; ++i)
-    {
-        if(methodDict->keys[i] == keyObject)
-            return methodDict->array->slots[i];
+        if(++index == capacity)
+            index = 0;
     }
 
-    return crankvm_specialObject_nil(context);
+    return nilOop;
 }
 
 // Behavior
@@ -238,30 +241,30 @@ crankvm_MethodContext_create(crankvm_context_t *context, int largeFrame)
 {
     crankvm_Behavior_t *classMethodContext = context->roots.specialObjectsArray->classMethodContext;
     size_t frameSize = largeFrame ? CRANK_VM_METHOD_CONTEXT_LARGE_FRAME_SIZE : CRANK_VM_METHOD_CONTEXT_SMALL_FRAME_SIZE;
-    //return (crankvm_MethodContext_t*)crankvm_Behavior_basicNewWithVariable(context, classMethodContext, frameSize)
-    crankvm_MethodContext_t* result = (crankvm_MethodContext_t*)crankvm_Behavior_basicNewWithVariable(context, classMethodContext, frameSize);
-    printf("Created methodContext[size: %d] %p\n", (int)frameSize, result);
-    return result;
+    return (crankvm_MethodContext_t*)crankvm_Behavior_basicNewWithVariable(context, classMethodContext, frameSize);
+}
+
+static crankvm_MethodContext_t*
+crankvm_MethodContext_createActivationFrame(crankvm_context_t *context, int largeFrame)
+{
+    // The activations live in the stack zone until they are reified. The heap is only used when the zone is full.
+    crankvm_MethodContext_t *frame = crankvm_stack_zone_allocateFrame(context, largeFrame);
+    if(frame)
+        return frame;
 
+    return crankvm_stack_zone_allocateContext(context, largeFrame);
 }
 
 LIB_CRANK_VM_EXPORT int
 crankvm_CompiledCode_parsePrimitiveNumber(crankvm_context_t *context, crankvm_CompiledCode_t *compiledCode, int *parsedPrimitiveNumber)
 {
-    crankvm_compiled_code_header_t calledHeader;
-    crankvm_error_t error = crankvm_specialObject_getCompiledCodeHeader(&calledHeader, compiledCode);
+    crankvm_compiled_code_cache_entry_t *codeInfo;
+    crankvm_error_t error = crankvm_compiled_code_cache_lookup(context, compiledCode, &codeInfo);
     if(error) return 0;
-    if(!calledHeader.hasPrimitive) return 0;
-
-    uintptr_t initialPC = (calledHeader.numberOfLiterals + 1) *sizeof(crankvm_oop_t) + 1;
-    size_t compiledMethodSize = crankvm_object_header_getSmalltalkSize(&compiledCode->baseClass.objectHeader);
-    if(initialPC >= compiledMethodSize) return 0;
+    if(!codeInfo->header.hasPrimitive) return 0;
 
     if(parsedPrimitiveNumber)
-    {
-        uint8_t *methodInstructions = (uint8_t*)(((crankvm_oop_t)compiledCode) + sizeof(crankvm_object_header_t));
-        *parsedPrimitiveNumber = methodInstructions[initialPC] | (methodInstructions[initialPC + 1] << 8);
-    }
+        *parsedPrimitiveNumber = codeInfo->primitiveNumber;
 
     return CRANK_VM_OK;
 }
@@ -269,39 +272,24 @@ crankvm_CompiledCode_parsePrimitiveNumber(crankvm_context_t *context, crankvm_Co
 LIB_CRANK_VM_EXPORT crankvm_error_t
 crankvm_CompiledCode_checkActivationWithArgumentCount(crankvm_context_t *context, crankvm_CompiledCode_t *compiledCode, int argumentCount, crankvm_compiled_code_header_t *parsedCompiledCodeHeader, int *parsedPrimitiveNumber, uintptr_t *parsedInitialPC)
 {
-    crankvm_compiled_code_header_t calledHeader;
-    crankvm_error_t error = crankvm_specialObject_getCompiledCodeHeader(&calledHeader, compiledCode);
+    // The decoded header, primitive number and initial pc are cached per method.
+    crankvm_compiled_code_cache_entry_t *codeInfo;
+    crankvm_error_t error = crankvm_compiled_code_cache_lookup(context, compiledCode, &codeInfo);
     if(error)
         return error;
 
     // Check the number of arguments
-    if(calledHeader.numberOfArguments != argumentCount)
+    if(codeInfo->header.numberOfArguments != argumentCount)
         return CRANK_VM_ERROR_CALLED_METHOD_ARGUMENT_MISMATCH;
 
-    // Compute the initial pc
-    uintptr_t initialPC = (calledHeader.numberOfLiterals + 1) *sizeof(crankvm_oop_t) + 1;
-    size_t compiledMethodSize = crankvm_object_header_getSmalltalkSize(&compiledCode->baseClass.objectHeader);
-    if(initialPC >= compiledMethodSize)
-        return CRANK_VM_ERROR_INVALID_PARAMETER;
-
     if(parsedCompiledCodeHeader)
-        *parsedCompiledCodeHeader = calledHeader;
+        *parsedCompiledCodeHeader = codeInfo->header;
 
     if(parsedPrimitiveNumber)
-    {
-        if(calledHeader.hasPrimitive)
-        {
-            uint8_t *methodInstructions = (uint8_t*)(((crankvm_oop_t)compiledCode) + sizeof(crankvm_object_header_t));
-            *parsedPrimitiveNumber = methodInstructions[initialPC] | (methodInstructions[initialPC + 1] << 8);
-        }
-        else
-        {
-            *parsedPrimitiveNumber = -1;
-        }
-    }
+        *parsedPrimitiveNumber = codeInfo->primitiveNumber;
 
     if(parsedInitialPC)
-        *parsedInitialPC = initialPC;
+        *parsedInitialPC = codeInfo->initialPC;
 
     return CRANK_VM_OK;
 }
@@ -311,7 +299,7 @@ LIB_CRANK_VM_EXPORT crankvm_error_t
 crankvm_MethodContext_createCompiledMethodActivationContext(crankvm_context_t *vmContext, crankvm_MethodContext_t **result, crankvm_CompiledCode_t *compiledCode, crankvm_oop_t receiver, int argumentCount, crankvm_oop_t *arguments, crankvm_compiled_code_header_t *calledHeader, uintptr_t initialPC)
 {
     // Create the new context.
-    crankvm_MethodContext_t *newContext = crankvm_MethodContext_create(vmContext, calledHeader->largeFrameRequired);
+    crankvm_MethodContext_t *newContext = crankvm_MethodContext_createActivationFrame(vmContext, calledHeader->largeFrameRequired);
 
     // Setup the activated method context.
     newContext->baseClass.pc = crankvm_oop_encodeSmallInteger(initialPC);
@@ -346,22 +334,20 @@ crankvm_MethodContext_createBlockClosureActivationContext(crankvm_context_t *vmC
     if(expectedArgumentCount != argumentCount || rawStartPC <= 0)
         return CRANK_VM_ERROR_INVALID_PARAMETER;
 
-    // Get the compiled method, and decode its header.
+    // Get the compiled method, and its decoded header.
     crankvm_CompiledCode_t *compiledMethod = (crankvm_CompiledCode_t*)blockClosure->outerContext->method;
-    crankvm_compiled_code_header_t compiledMethodHeader;
-    crankvm_error_t error = crankvm_specialObject_getCompiledCodeHeader(&compiledMethodHeader, compiledMethod);
+    crankvm_compiled_code_cache_entry_t *compiledMethodInfo;
+    crankvm_error_t error = crankvm_compiled_code_cache_lookup(vmContext, compiledMethod, &compiledMethodInfo);
     if(error)
         return error;
 
     // Check whether the initial pc is on bounds.
-    size_t compiledMethodSize = crankvm_object_header_getSmalltalkSize(&compiledMethod->baseClass.objectHeader);
-    uintptr_t methodInitialPC = (compiledMethodHeader.numberOfLiterals + 1) *sizeof(crankvm_oop_t) + 1;
     uintptr_t startPC = (uintptr_t)rawStartPC;
-    if(startPC < methodInitialPC || methodInitialPC >= compiledMethodSize)
+    if(startPC < compiledMethodInfo->initialPC)
         return CRANK_VM_ERROR_OUT_OF_BOUNDS;
 
     // Create the block closure context.
-    crankvm_MethodContext_t *activationContext = crankvm_MethodContext_create(vmContext, compiledMethodHeader.largeFrameRequired);
+    crankvm_MethodContext_t *activationContext = crankvm_MethodContext_createActivationFrame(vmContext, compiledMethodInfo->header.largeFrameRequired);
     if(!activationContext)
         return CRANK_VM_ERROR_OUT_OF_MEMORY;
 
@@ -447,7 +433,7 @@ crankvm_MethodContext_createObjectMessageSendActivationContext(crankvm_context_t
         return CRANK_VM_ERROR_RECEIVER_CLASS_NIL;
 
     // Lookup the selector
-    crankvm_oop_t methodOop = crankvm_Behavior_lookupSelector(context, (crankvm_Behavior_t*)receiverClass, selector);
+    crankvm_oop_t methodOop = crankvm_method_cache_lookupSelector(context, (crankvm_Behavior_t*)receiverClass, selector);
     if(crankvm_oop_isNil(context, methodOop))
     {
         printf("TODO: Send doesNotUnderstand:\n");
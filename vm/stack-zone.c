@@ -0,0 +1,174 @@
+#include "stack-zone.h"
+#include "context-internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+crankvm_error_t
+crankvm_stack_zone_initialize(crankvm_stack_zone_t *zone, size_t pageCount)
+{
+    crankvm_stack_zone_destroy(zone);
+    if(!pageCount)
+        pageCount = CRANK_VM_STACK_ZONE_DEFAULT_PAGE_COUNT;
+
+    size_t size = pageCount * CRANK_VM_STACK_ZONE_PAGE_SIZE;
+    zone->start = malloc(size);
+    if(!zone->start)
+        return CRANK_VM_ERROR_OUT_OF_MEMORY;
+
+    zone->end = zone->start + size;
+    zone->top = zone->start;
+    return CRANK_VM_OK;
+}
+
+void
+crankvm_stack_zone_destroy(crankvm_stack_zone_t *zone)
+{
+    free(zone->start);
+    zone->start = NULL;
+    zone->end = NULL;
+    zone->top = NULL;
+}
+
+crankvm_MethodContext_t *
+crankvm_stack_zone_allocateFrame(crankvm_context_t *context, bool largeFrame)
+{
+    crankvm_stack_zone_t *zone = &context->stackZone;
+    if(!zone->start || !crankvm_stack_zone_hasRoomForFrame(zone))
+    {
+        ++zone->overflowCount;
+        return NULL;
+    }
+
+    // Build the same header as a heap allocated context.
+    crankvm_Behavior_t *classMethodContext = context->roots.specialObjectsArray->classMethodContext;
+    size_t slotCount = CRANK_VM_MethodContext_InstanceFixedSize +
+        (largeFrame ? CRANK_VM_METHOD_CONTEXT_LARGE_FRAME_SIZE : CRANK_VM_METHOD_CONTEXT_SMALL_FRAME_SIZE);
+    crankvm_object_header_t *frame = (crankvm_object_header_t*)zone->top;
+    memset(frame, 0, sizeof(crankvm_object_header_t));
+    crankvm_object_header_setSlotCount(frame, slotCount);
+    crankvm_object_header_setObjectFormat(frame, crankvm_Behavior_getInstanceSpec(classMethodContext));
+    crankvm_object_header_setClassIndex(frame, crankvm_object_getIdentityHash(context, (crankvm_oop_t)classMethodContext));
+
+    // The collector scans all the slots of the frames.
+    crankvm_oop_t *slots = (crankvm_oop_t*)&frame[1];
+    crankvm_oop_t nilOop = context->roots.nilOop;
+    for(size_t i = 0; i < slotCount; ++i)
+        slots[i] = nilOop;
+
+    zone->top = (uint8_t*)crankvm_stack_zone_frameEnd(frame);
+    ++zone->allocatedFrameCount;
+    return (crankvm_MethodContext_t*)frame;
+}
+
+static crankvm_MethodContext_t *
+crankvm_stack_zone_takeRecycledContext(crankvm_context_t *context, size_t poolIndex)
+{
+    crankvm_stack_zone_t *zone = &context->stackZone;
+    crankvm_MethodContext_t *methodContext = zone->contextPool[poolIndex];
+    if(!methodContext)
+        return NULL;
+
+    zone->contextPool[poolIndex] = (crankvm_MethodContext_t*)methodContext->baseClass.sender;
+    ++zone->reusedContextCount;
+
+    // The context is written without write barrier, like a new object.
+    crankvm_heap_t *heap = &context->heap;
+    crankvm_object_header_t *header = (crankvm_object_header_t*)methodContext;
+    if(!crankvm_heap_isYoung(heap, (crankvm_oop_t)methodContext) && !crankvm_object_header_getIsRemembered(header))
+        crankvm_heap_remember(heap, header);
+    return methodContext;
+}
+
+crankvm_MethodContext_t *
+crankvm_stack_zone_allocateContext(crankvm_context_t *context, bool largeFrame)
+{
+    crankvm_MethodContext_t *methodContext = crankvm_stack_zone_takeRecycledContext(context, largeFrame);
+    if(methodContext)
+    {
+        crankvm_oop_t *slots = (crankvm_oop_t*)&((crankvm_object_header_t*)methodContext)[1];
+        crankvm_oop_t nilOop = context->roots.nilOop;
+        for(size_t i = 0; i < crankvm_object_header_getSlotCount((crankvm_object_header_t*)methodContext); ++i)
+            slots[i] = nilOop;
+    }
+    else
+    {
+        methodContext = crankvm_MethodContext_create(context, largeFrame);
+        if(crankvm_object_isNil(context, methodContext))
+            return methodContext;
+    }
+
+    crankvm_object_header_setIsGray((crankvm_object_header_t*)methodContext, 1);
+    return methodContext;
+}
+
+crankvm_MethodContext_t *
+crankvm_stack_zone_materialize(crankvm_context_t *context, crankvm_MethodContext_t *activeContext, bool escaping)
+{
+    crankvm_stack_zone_t *zone = &context->stackZone;
+    crankvm_oop_t frame = (crankvm_oop_t)activeContext;
+    crankvm_MethodContext_t *result = activeContext;
+    crankvm_MethodContext_t *previousCopy = NULL;
+
+    // Copy the frames from the active one, linking each copy with the copy of its sender.
+    // The collector cannot run here, so the frames keep their contents while they are copied.
+    for(; crankvm_stack_zone_isFrame(zone, frame); frame = ((crankvm_MethodContext_t*)frame)->baseClass.sender)
+    {
+        crankvm_object_header_t *frameHeader = (crankvm_object_header_t*)frame;
+        crankvm_MethodContext_t *copy = crankvm_stack_zone_takeRecycledContext(context, crankvm_stack_zone_contextPoolIndex(frameHeader));
+        if(copy)
+            memcpy(&((crankvm_object_header_t*)copy)[1], &frameHeader[1], crankvm_object_header_getSlotCount(frameHeader) * sizeof(crankvm_oop_t));
+        else
+            copy = (crankvm_MethodContext_t*)crankvm_heap_shallowCopy(context, frameHeader);
+        crankvm_object_header_setIsGray((crankvm_object_header_t*)copy, !escaping);
+
+        if(previousCopy)
+        {
+            previousCopy->baseClass.sender = (crankvm_oop_t)copy;
+            crankvm_heap_writeBarrier(&context->heap, (crankvm_oop_t)previousCopy, (crankvm_oop_t)copy);
+        }
+        else
+        {
+            result = copy;
+        }
+
+        previousCopy = copy;
+        ++zone->materializedFrameCount;
+    }
+
+    // The senders of an escaping context are reachable from it.
+    if(escaping)
+    {
+        for(; crankvm_oop_isPointer(frame) && crankvm_stack_zone_isRecyclableContext((crankvm_MethodContext_t*)frame);
+            frame = ((crankvm_MethodContext_t*)frame)->baseClass.sender)
+            crankvm_object_header_setIsGray((crankvm_object_header_t*)frame, 0);
+    }
+
+    if(previousCopy)
+        ++zone->materializationCount;
+    zone->top = zone->start;
+    return result;
+}
+
+void
+crankvm_stack_zone_flushContextPool(crankvm_context_t *context)
+{
+    crankvm_stack_zone_t *zone = &context->stackZone;
+    zone->contextPool[0] = NULL;
+    zone->contextPool[1] = NULL;
+}
+
+LIB_CRANK_VM_EXPORT void
+crankvm_context_dumpStackZoneStatistics(crankvm_context_t *context, FILE *output)
+{
+    if(!context || !output)
+        return;
+
+    crankvm_stack_zone_t *zone = &context->stackZone;
+    fprintf(output, "Stack zone: %zu bytes, %zu bytes in use\n",
+        (size_t)(zone->end - zone->start), (size_t)(zone->top - zone->start));
+    fprintf(output, "Stack zone frames: allocated %llu materialized %llu in %llu materializations, heap frames on overflow %llu\n",
+        (unsigned long long)zone->allocatedFrameCount, (unsigned long long)zone->materializedFrameCount,
+        (unsigned long long)zone->materializationCount, (unsigned long long)zone->overflowCount);
+    fprintf(output, "Recycled contexts: returned %llu reused %llu\n",
+        (unsigned long long)zone->recycledContextCount, (unsigned long long)zone->reusedContextCount);
+}
@@ -0,0 +1,140 @@
+#ifndef CRANK_VM_STACK_ZONE_H
+#define CRANK_VM_STACK_ZONE_H
+
+#include <crank-vm/error.h>
+#include <crank-vm/objectmodel.h>
+#include <crank-vm/special-objects.h>
+#include <stdbool.h>
+
+#define CRANK_VM_STACK_ZONE_PAGE_SIZE 4096
+#define CRANK_VM_STACK_ZONE_DEFAULT_PAGE_COUNT 160
+
+// The size of a frame with a large frame, including its header.
+#define CRANK_VM_STACK_ZONE_MAX_FRAME_SIZE \
+    (sizeof(crankvm_object_header_t) + (CRANK_VM_MethodContext_InstanceFixedSize + CRANK_VM_METHOD_CONTEXT_LARGE_FRAME_SIZE) * sizeof(crankvm_oop_t))
+
+typedef struct crankvm_context_s crankvm_context_t;
+
+/**
+ * The stack zone holds the activations that have not been reified yet. Its
+ * frames are laid out exactly as MethodContext objects, so the interpreter
+ * uses them without distinction, but they are not heap objects. The frames
+ * are bump allocated, and each frame is above its sender.
+ *
+ * No heap object refers to a frame. Before a frame can escape, as thisContext,
+ * as the outer context of a closure, or as the suspended context of a process,
+ * the chain of the active frame is materialized into MethodContext objects.
+ *
+ * The heap contexts that were never reified, because they were materialized
+ * when the zone overflowed or allocated without a zone, are recycled into a
+ * pool when they return. They are flagged with the gray bit of their header,
+ * which the collector does not use.
+ */
+typedef struct crankvm_stack_zone_s
+{
+    uint8_t *start;
+    uint8_t *end;
+    uint8_t *top;
+
+    // The recycled heap contexts with a small and with a large frame, linked through their sender.
+    crankvm_MethodContext_t *contextPool[2];
+
+    uint64_t allocatedFrameCount;
+    uint64_t materializedFrameCount;
+    uint64_t materializationCount;
+    uint64_t overflowCount;
+    uint64_t recycledContextCount;
+    uint64_t reusedContextCount;
+} crankvm_stack_zone_t;
+
+/**
+ * Allocates the zone with the desired number of stack pages of the image
+ * header, or with the default number when the image does not specify it.
+ */
+crankvm_error_t crankvm_stack_zone_initialize(crankvm_stack_zone_t *zone, size_t pageCount);
+void crankvm_stack_zone_destroy(crankvm_stack_zone_t *zone);
+
+/**
+ * Allocates a frame for an activation. Returns NULL when the zone is full.
+ */
+crankvm_MethodContext_t *crankvm_stack_zone_allocateFrame(crankvm_context_t *context, bool largeFrame);
+
+/**
+ * Allocates a heap context for an activation that does not fit in the zone,
+ * reusing a recycled one when possible.
+ */
+crankvm_MethodContext_t *crankvm_stack_zone_allocateContext(crankvm_context_t *context, bool largeFrame);
+
+/**
+ * Copies the chain of the active frame into heap contexts, and empties the
+ * zone. Returns the copy of the active frame, or the active context itself
+ * when it is not a frame. When the contexts escape, none of the contexts of
+ * the chain is recycled anymore.
+ */
+crankvm_MethodContext_t *crankvm_stack_zone_materialize(crankvm_context_t *context, crankvm_MethodContext_t *activeContext, bool escaping);
+
+/**
+ * Drops the recycled contexts. They are garbage for the collector.
+ */
+void crankvm_stack_zone_flushContextPool(crankvm_context_t *context);
+
+CRANK_VM_INLINE bool
+crankvm_stack_zone_isFrame(crankvm_stack_zone_t *zone, crankvm_oop_t oop)
+{
+    return oop - (crankvm_oop_t)zone->start < (size_t)(zone->end - zone->start);
+}
+
+CRANK_VM_INLINE bool
+crankvm_stack_zone_hasRoomForFrame(crankvm_stack_zone_t *zone)
+{
+    return (size_t)(zone->end - zone->top) >= CRANK_VM_STACK_ZONE_MAX_FRAME_SIZE;
+}
+
+CRANK_VM_INLINE crankvm_object_header_t *
+crankvm_stack_zone_frameEnd(crankvm_object_header_t *frame)
+{
+    // The frames never need an overflow header.
+    return (crankvm_object_header_t*)((crankvm_oop_t*)&frame[1] + crankvm_object_header_getSlotCount(frame));
+}
+
+CRANK_VM_INLINE bool
+crankvm_stack_zone_isRecyclableContext(crankvm_MethodContext_t *methodContext)
+{
+    return crankvm_object_header_getIsGray((crankvm_object_header_t*)methodContext);
+}
+
+CRANK_VM_INLINE size_t
+crankvm_stack_zone_contextPoolIndex(crankvm_object_header_t *methodContext)
+{
+    return crankvm_object_header_getSlotCount(methodContext) > CRANK_VM_MethodContext_InstanceFixedSize + CRANK_VM_METHOD_CONTEXT_SMALL_FRAME_SIZE;
+}
+
+/**
+ * Recycles a context that has returned, when nothing else can refer to it.
+ */
+CRANK_VM_INLINE void
+crankvm_stack_zone_recycleContext(crankvm_stack_zone_t *zone, crankvm_MethodContext_t *methodContext)
+{
+    if(!crankvm_stack_zone_isRecyclableContext(methodContext))
+        return;
+
+    crankvm_MethodContext_t **pool = &zone->contextPool[crankvm_stack_zone_contextPoolIndex((crankvm_object_header_t*)methodContext)];
+    methodContext->baseClass.sender = (crankvm_oop_t)*pool;
+    *pool = methodContext;
+    ++zone->recycledContextCount;
+}
+
+/**
+ * Pops the frames above the context that is being returned into. Returning
+ * into a heap context pops all the frames.
+ */
+CRANK_VM_INLINE void
+crankvm_stack_zone_popFramesAbove(crankvm_stack_zone_t *zone, crankvm_MethodContext_t *returnContext)
+{
+    if(crankvm_stack_zone_isFrame(zone, (crankvm_oop_t)returnContext))
+        zone->top = (uint8_t*)crankvm_stack_zone_frameEnd((crankvm_object_header_t*)returnContext);
+    else
+        zone->top = zone->start;
+}
+
+#endif //CRANK_VM_STACK_ZONE_H
@@ -11,10 +11,14 @@ CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_systemPrimitive_snapshot,
 CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_systemPrimitive_quit, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_QUIT)
 CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_systemPrimitive_exitToDebugger, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_EXIT_TO_DEBUGGER)
 
+CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_systemPrimitive_fullGarbageCollect, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_FULL_GARBAGE_COLLECT)
+CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_systemPrimitive_incrementalGarbageCollect, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_INCREMENTAL_GARBAGE_COLLECT)
+
 CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_systemPrimitive_vmParameter, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_VM_PARAMETER);
 
 CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_systemPrimitive_utcMicrosecondClock, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_VM_PARAMETER_UTC_MICROSECOND_CLOCK)
 CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_systemPrimitive_localMicrosecondClock, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_VM_PARAMETER_LOCAL_MICROSECOND_CLOCK)
+CRANK_VM_CONNECT_PRIMITIVE_TO_NUMBER(crankvm_primitive_systemPrimitive_signalAtUTCMicroseconds, CRANK_VM_SYSTEM_PRIMITIVE_NUMBER_SIGNAL_AT_UTC_MICROSECONDS)
 
 void
 crankvm_primitive_primitiveFail(crankvm_primitive_context_t *primitiveContext)
@@ -31,9 +35,43 @@ crankvm_primitive_primitiveFailUnexistent(crankvm_primitive_context_t *primitive
 void
 crankvm_primitive_systemPrimitive_snapshot(crankvm_primitive_context_t *primitiveContext)
 {
-    fprintf(stderr, "Unimplemented crankvm_primitive_systemPrimitive_snapshot\n");
-    abort();
-    //return crankvm_primitive_success(primitiveContext);
+    crankvm_context_t *context = primitiveContext->context;
+    if(!context->imageFileName)
+        return crankvm_primitive_fail(primitiveContext);
+
+    // Only the old space is written, and the suspended context must be a heap object.
+    crankvm_interpreter_materializeStackFramesFromPrimitive(primitiveContext);
+    crankvm_interpreter_fullGarbageCollectFromPrimitive(primitiveContext);
+
+    // The saved image resumes in the sender, with true as the result of the snapshot.
+    crankvm_Process_t *process = crankvm_context_getActiveProcess(context);
+    if(!process)
+        return crankvm_primitive_fail(primitiveContext);
+
+    crankvm_MethodContext_t *sender = (crankvm_MethodContext_t*)primitiveContext->roots.primitiveMethodContext->baseClass.sender;
+    if(!crankvm_oop_isPointer((crankvm_oop_t)sender) || crankvm_oop_isNil(context, (crankvm_oop_t)sender))
+        return crankvm_primitive_fail(primitiveContext);
+
+    intptr_t stackPointer = crankvm_oop_decodeSmallInteger(sender->stackp);
+    if(stackPointer + CRANK_VM_MethodContext_InstanceFixedSize >= crankvm_object_header_getSlotCount((crankvm_object_header_t *)sender))
+        return crankvm_primitive_fail(primitiveContext);
+
+    crankvm_oop_t oldStackTop = sender->stackSlots[stackPointer];
+    crankvm_oop_t oldSuspendedContext = process->suspendedContext;
+    sender->stackSlots[stackPointer] = context->roots.trueOop;
+    sender->stackp = crankvm_oop_encodeSmallInteger(stackPointer + 1);
+    process->suspendedContext = (crankvm_oop_t)sender;
+
+    crankvm_error_t error = crankvm_image_writeFileNamed(context, context->imageFileName);
+
+    // Continue in this session.
+    process->suspendedContext = oldSuspendedContext;
+    sender->stackp = crankvm_oop_encodeSmallInteger(stackPointer);
+    sender->stackSlots[stackPointer] = oldStackTop;
+    if(error)
+        return crankvm_primitive_fail(primitiveContext);
+
+    return crankvm_primitive_returnBoolean(primitiveContext, false);
 }
 
 void
@@ -93,7 +131,9 @@ VM parameters are numbered as follows:
     43	nil (desired number of stack pages in Stack VM)
     44	nil (size of eden, in bytes in Stack VM)
     45	nil (desired size of eden in Stack VM)
-    46-55 nil; reserved for VM parameters that persist in the image (such as eden above)
+    46-48 nil; reserved for VM parameters that persist in the image (such as eden above)
+    49	the size of the external semaphore table (read-write; the new size is used by the next run of the saved image)
+    50-55 nil; reserved for VM parameters that persist in the image
     56	number of process switches since startup (read-only)
     57	number of ioProcessEvents calls since startup (read-only)
     58	number of ForceInterruptCheck calls since startup (read-only)
@@ -103,10 +143,19 @@ VM parameters are numbered as follows:
 static crankvm_oop_t
 crankvm_primitive_systemPrimitive_getVMParameter(crankvm_primitive_context_t *primitiveContext, intptr_t parameterIndex)
 {
+    crankvm_heap_t *heap = &primitiveContext->context->heap;
+    crankvm_heap_new_space_t *newSpace = &heap->newSpace;
     switch(parameterIndex)
     {
+    case 7: return crankvm_object_forUInteger64(primitiveContext->context, heap->fullGCCount);
+    case 8: return crankvm_object_forUInteger64(primitiveContext->context, heap->fullGCMicroseconds / 1000);
+    case 9: return crankvm_object_forUInteger64(primitiveContext->context, newSpace->scavengeCount);
+    case 10: return crankvm_object_forUInteger64(primitiveContext->context, newSpace->scavengeMicroseconds / 1000);
+    case 11: return crankvm_object_forUInteger64(primitiveContext->context, newSpace->tenuredObjectCount);
     case 40: return crankvm_oop_encodeSmallInteger(CRANK_VM_WORD_SIZE);
-    case 44: return crankvm_oop_encodeSmallInteger(0); // Size of eden, in bytes.
+    case 44: return crankvm_oop_encodeSmallInteger(newSpace->edenLimit - newSpace->edenStart); // Size of eden, in bytes.
+    case 49: return crankvm_oop_encodeSmallInteger(primitiveContext->context->scheduler.externalSignals.indexCount);
+    case 56: return crankvm_object_forUInteger64(primitiveContext->context, primitiveContext->context->scheduler.processSwitchCount);
     default:
         printf("Unsupported vm parameter %d requested\n", (int)parameterIndex);
         return crankvm_specialObject_nil(primitiveContext->context);
@@ -116,14 +165,46 @@ crankvm_primitive_systemPrimitive_getVMParameter(crankvm_primitive_context_t *pr
 static void
 crankvm_primitive_systemPrimitive_setVMParameter(crankvm_primitive_context_t *primitiveContext, intptr_t parameterIndex, crankvm_oop_t newValue)
 {
+    crankvm_context_t *context = primitiveContext->context;
     switch(parameterIndex)
     {
+    case 49:
+        {
+            // The producers use the queue of the external signals without a lock, so it keeps its size until the next run.
+            intptr_t tableSize = crankvm_primitive_getSmallIntegerValue(primitiveContext, newValue);
+            if(crankvm_primitive_hasFailed(primitiveContext) || tableSize <= 0 || tableSize > UINT16_MAX)
+                return crankvm_primitive_fail(primitiveContext);
+
+            context->imageHeader.maxExtSemTabSizeSet = tableSize;
+            return crankvm_primitive_returnOop(primitiveContext, crankvm_oop_encodeSmallInteger(context->scheduler.externalSignals.indexCount));
+        }
     default:
         printf("Unsupported setting vm parameter %d.\n", (int)parameterIndex);
         return crankvm_primitive_returnOop(primitiveContext, newValue);
     }
 }
 
+/**
+ * The collections are performed immediately, with the frames of the stack
+ * zone materialized as in the snapshot primitive. The result is the amount of
+ * memory that is available after the collection.
+ */
+void
+crankvm_primitive_systemPrimitive_fullGarbageCollect(crankvm_primitive_context_t *primitiveContext)
+{
+    crankvm_interpreter_materializeStackFramesFromPrimitive(primitiveContext);
+    crankvm_interpreter_fullGarbageCollectFromPrimitive(primitiveContext);
+    return crankvm_primitive_returnUInteger64(primitiveContext, crankvm_heap_getFreeBytes(&primitiveContext->context->heap));
+}
+
+void
+crankvm_primitive_systemPrimitive_incrementalGarbageCollect(crankvm_primitive_context_t *primitiveContext)
+{
+    crankvm_interpreter_materializeStackFramesFromPrimitive(primitiveContext);
+    crankvm_interpreter_scavengeFromPrimitive(primitiveContext);
+    return crankvm_primitive_returnUInteger64(primitiveContext, crankvm_heap_getFreeBytes(&primitiveContext->context->heap));
+}
+
 void
 crankvm_primitive_systemPrimitive_vmParameter(crankvm_primitive_context_t *primitiveContext)
 {
@@ -185,3 +266,54 @@ crankvm_primitive_systemPrimitive_localMicrosecondClock(crankvm_primitive_contex
 {
     return crankvm_primitive_returnUInteger64(primitiveContext, getCurrentMicrosecondsInLocalTime());
 }
+
+static void
+crankvm_primitive_systemPrimitive_signalTimerSemaphore(crankvm_context_t *context, crankvm_timer_t *timer)
+{
+    (void)timer;
+    crankvm_special_object_array_t *specialObjects = context->roots.specialObjectsArray;
+    crankvm_oop_t semaphore = specialObjects->theTimerSemaphore;
+    if(crankvm_oop_isPointer(semaphore) && !crankvm_oop_isNil(context, semaphore))
+        crankvm_scheduler_signalSemaphore(context, (crankvm_Semaphore_t*)semaphore);
+}
+
+/**
+ * Makes the semaphore the timer semaphore, which is signalled at the given
+ * UTC microseconds since 1901. A nil semaphore cancels the timer. The Delays
+ * of the image share this timer, and it is kept in the timer wheel.
+ */
+void
+crankvm_primitive_systemPrimitive_signalAtUTCMicroseconds(crankvm_primitive_context_t *primitiveContext)
+{
+    crankvm_context_t *context = primitiveContext->context;
+    crankvm_oop_t semaphore = crankvm_primitive_getArgument(primitiveContext, 0);
+    crankvm_oop_t microsecondsOop = crankvm_primitive_getArgument(primitiveContext, 1);
+    if(crankvm_primitive_hasFailed(primitiveContext))
+        return;
+
+    uint64_t microseconds;
+    if(!crankvm_object_tryToDecodeUInteger64(context, microsecondsOop, &microseconds))
+        return crankvm_primitive_failWithCode(primitiveContext, CRANK_VM_PRIMITIVE_ERROR_BAD_ARGUMENT);
+
+    crankvm_special_object_array_t *specialObjects = context->roots.specialObjectsArray;
+    crankvm_timer_t *timer = &context->scheduler.timerSemaphoreTimer;
+    if(crankvm_oop_isNil(context, semaphore))
+    {
+        specialObjects->theTimerSemaphore = semaphore;
+        crankvm_timer_wheel_cancel(context, timer);
+        return crankvm_primitive_returnOop(primitiveContext, crankvm_primitive_getReceiver(primitiveContext));
+    }
+
+    if(!crankvm_oop_isPointer(semaphore) ||
+        crankvm_object_getClass(context, semaphore) != (crankvm_oop_t)specialObjects->classSemaphore)
+        return crankvm_primitive_failWithCode(primitiveContext, CRANK_VM_PRIMITIVE_ERROR_BAD_ARGUMENT);
+
+    specialObjects->theTimerSemaphore = semaphore;
+    crankvm_heap_writeBarrier(&context->heap, (crankvm_oop_t)specialObjects, semaphore);
+
+    // The timer wheel uses the realtime clock since 1970.
+    timer->fire = crankvm_primitive_systemPrimitive_signalTimerSemaphore;
+    uint64_t deadline = microseconds > MicrosecondsFrom1901To1970 ? microseconds - MicrosecondsFrom1901To1970 : 0;
+    crankvm_timer_wheel_schedule(context, timer, deadline);
+    return crankvm_primitive_returnOop(primitiveContext, crankvm_primitive_getReceiver(primitiveContext));
+}
@@ -10,9 +10,13 @@ void crankvm_primitive_systemPrimitive_snapshot(crankvm_primitive_context_t *pri
 void crankvm_primitive_systemPrimitive_quit(crankvm_primitive_context_t *primitiveContext);
 void crankvm_primitive_systemPrimitive_exitToDebugger(crankvm_primitive_context_t *primitiveContext);
 
+void crankvm_primitive_systemPrimitive_fullGarbageCollect(crankvm_primitive_context_t *primitiveContext);
+void crankvm_primitive_systemPrimitive_incrementalGarbageCollect(crankvm_primitive_context_t *primitiveContext);
+
 void crankvm_primitive_systemPrimitive_vmParameter(crankvm_primitive_context_t *primitiveContext);
 
 void crankvm_primitive_systemPrimitive_utcMicrosecondClock(crankvm_primitive_context_t *primitiveContext);
 void crankvm_primitive_systemPrimitive_localMicrosecondClock(crankvm_primitive_context_t *primitiveContext);
+void crankvm_primitive_systemPrimitive_signalAtUTCMicroseconds(crankvm_primitive_context_t *primitiveContext);
 
 #endif //CRANK_VM_SYSTEM_PRIMITIVES_H
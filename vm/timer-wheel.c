@@ -0,0 +1,253 @@
+#include "timer-wheel.h"
+#include "context-internal.h"
+
+// The farthest deadline from the current tick that fits in the last level.
+#define CRANK_VM_TIMER_WHEEL_MAX_DELTA ((1ULL << (CRANK_VM_TIMER_WHEEL_SLOT_BITS * CRANK_VM_TIMER_WHEEL_LEVEL_COUNT)) - 1)
+
+static void *
+crankvm_timer_wheel_thread(void *argument)
+{
+    crankvm_context_t *context = argument;
+    crankvm_timer_wheel_t *wheel = &context->timerWheel;
+
+    pthread_mutex_lock(&wheel->mutex);
+    while(!wheel->isShuttingDown)
+    {
+        if(!wheel->wakeupTick)
+        {
+            pthread_cond_wait(&wheel->wakeupChanged, &wheel->mutex);
+            continue;
+        }
+
+        uint64_t wakeupMicroseconds = wheel->wakeupTick * CRANK_VM_TIMER_WHEEL_TICK_MICROSECONDS;
+        if(crankvm_timer_wheel_getMicroseconds() >= wakeupMicroseconds)
+        {
+            // The interpreter sets the next wakeup when it advances the wheel.
+            wheel->wakeupTick = 0;
+            crankvm_scheduler_requestInterrupt(context);
+            continue;
+        }
+
+        struct timespec deadline = {
+            .tv_sec = wakeupMicroseconds / 1000000,
+            .tv_nsec = (wakeupMicroseconds % 1000000) * 1000,
+        };
+        pthread_cond_timedwait(&wheel->wakeupChanged, &wheel->mutex, &deadline);
+    }
+
+    pthread_mutex_unlock(&wheel->mutex);
+    return NULL;
+}
+
+void
+crankvm_timer_wheel_destroy(crankvm_context_t *context)
+{
+    crankvm_timer_wheel_t *wheel = &context->timerWheel;
+    if(!wheel->isInitialized)
+        return;
+
+    pthread_mutex_lock(&wheel->mutex);
+    wheel->isShuttingDown = true;
+    pthread_cond_signal(&wheel->wakeupChanged);
+    pthread_mutex_unlock(&wheel->mutex);
+    if(wheel->isThreadStarted)
+        pthread_join(wheel->thread, NULL);
+
+    pthread_cond_destroy(&wheel->wakeupChanged);
+    pthread_mutex_destroy(&wheel->mutex);
+    memset(wheel, 0, sizeof(crankvm_timer_wheel_t));
+}
+
+static void
+crankvm_timer_wheel_link(crankvm_timer_wheel_t *wheel, crankvm_timer_t *timer)
+{
+    uint64_t tick = timer->deadlineTick;
+    if(tick < wheel->currentTick)
+        tick = wheel->currentTick;
+
+    uint64_t delta = tick - wheel->currentTick;
+    if(delta > CRANK_VM_TIMER_WHEEL_MAX_DELTA)
+    {
+        // The timer waits in the last level, and it is placed again when its slot is reached.
+        delta = CRANK_VM_TIMER_WHEEL_MAX_DELTA;
+        tick = wheel->currentTick + delta;
+    }
+
+    // The level is the one whose slots span the distance to the deadline.
+    size_t level = 0;
+    while(level < CRANK_VM_TIMER_WHEEL_LEVEL_COUNT - 1 && (delta >> (CRANK_VM_TIMER_WHEEL_SLOT_BITS * (level + 1))))
+        ++level;
+
+    crankvm_timer_t **slot = &wheel->slots[level][(tick >> (CRANK_VM_TIMER_WHEEL_SLOT_BITS * level)) & CRANK_VM_TIMER_WHEEL_SLOT_MASK];
+    timer->next = *slot;
+    if(timer->next)
+        timer->next->link = &timer->next;
+    *slot = timer;
+    timer->link = slot;
+}
+
+static void
+crankvm_timer_wheel_unlink(crankvm_timer_t *timer)
+{
+    *timer->link = timer->next;
+    if(timer->next)
+        timer->next->link = timer->link;
+    timer->next = NULL;
+    timer->link = NULL;
+}
+
+/**
+ * Gets the first tick when the wheel has work, which is the deadline of a
+ * timer in the first level, or the tick when a slot of an upper level is
+ * moved down. Returns zero when there are no timers.
+ */
+static uint64_t
+crankvm_timer_wheel_getNextTick(crankvm_timer_wheel_t *wheel)
+{
+    if(!wheel->timerCount)
+        return 0;
+
+    uint64_t nextTick = UINT64_MAX;
+    for(size_t level = 0; level < CRANK_VM_TIMER_WHEEL_LEVEL_COUNT; ++level)
+    {
+        // Past the start of its span, the slot of the current tick in an upper level is only reached after a whole turn.
+        uint64_t levelTick = wheel->currentTick >> (CRANK_VM_TIMER_WHEEL_SLOT_BITS * level);
+        size_t firstOffset = (wheel->currentTick & ((1ULL << (CRANK_VM_TIMER_WHEEL_SLOT_BITS * level)) - 1)) ? 1 : 0;
+        for(size_t offset = firstOffset; offset < firstOffset + CRANK_VM_TIMER_WHEEL_SLOT_COUNT; ++offset)
+        {
+            if(!wheel->slots[level][(levelTick + offset) & CRANK_VM_TIMER_WHEEL_SLOT_MASK])
+                continue;
+
+            uint64_t tick = (levelTick + offset) << (CRANK_VM_TIMER_WHEEL_SLOT_BITS * level);
+            if(tick < nextTick)
+                nextTick = tick;
+            break;
+        }
+    }
+
+    return nextTick;
+}
+
+static void
+crankvm_timer_wheel_updateWakeup(crankvm_context_t *context)
+{
+    crankvm_timer_wheel_t *wheel = &context->timerWheel;
+    uint64_t nextTick = crankvm_timer_wheel_getNextTick(wheel);
+    wheel->nextTick = nextTick;
+    if(!wheel->isThreadStarted)
+        return;
+
+    pthread_mutex_lock(&wheel->mutex);
+    if(wheel->wakeupTick != nextTick)
+    {
+        wheel->wakeupTick = nextTick;
+        pthread_cond_signal(&wheel->wakeupChanged);
+    }
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+void
+crankvm_timer_wheel_schedule(crankvm_context_t *context, crankvm_timer_t *timer, uint64_t deadlineMicroseconds)
+{
+    crankvm_timer_wheel_t *wheel = &context->timerWheel;
+    if(!wheel->isInitialized)
+    {
+        wheel->isInitialized = true;
+        pthread_mutex_init(&wheel->mutex, NULL);
+        pthread_cond_init(&wheel->wakeupChanged, NULL);
+        wheel->isThreadStarted = !pthread_create(&wheel->thread, NULL, crankvm_timer_wheel_thread, context);
+    }
+
+    if(crankvm_timer_isScheduled(timer))
+    {
+        crankvm_timer_wheel_unlink(timer);
+        --wheel->timerCount;
+    }
+
+    // An empty wheel is not advanced, so it starts again from the current tick.
+    if(!wheel->timerCount)
+        wheel->currentTick = crankvm_timer_wheel_getMicroseconds() / CRANK_VM_TIMER_WHEEL_TICK_MICROSECONDS;
+
+    // A deadline is rounded up to the next tick, so the timer never fires early.
+    timer->deadlineTick = (deadlineMicroseconds + CRANK_VM_TIMER_WHEEL_TICK_MICROSECONDS - 1) / CRANK_VM_TIMER_WHEEL_TICK_MICROSECONDS;
+    crankvm_timer_wheel_link(wheel, timer);
+    ++wheel->timerCount;
+    crankvm_timer_wheel_updateWakeup(context);
+}
+
+void
+crankvm_timer_wheel_cancel(crankvm_context_t *context, crankvm_timer_t *timer)
+{
+    crankvm_timer_wheel_t *wheel = &context->timerWheel;
+    if(!crankvm_timer_isScheduled(timer))
+        return;
+
+    crankvm_timer_wheel_unlink(timer);
+    --wheel->timerCount;
+    crankvm_timer_wheel_updateWakeup(context);
+}
+
+void
+crankvm_timer_wheel_advance(crankvm_context_t *context)
+{
+    crankvm_timer_wheel_t *wheel = &context->timerWheel;
+    if(!wheel->timerCount)
+        return;
+
+    uint64_t nowTick = crankvm_timer_wheel_getMicroseconds() / CRANK_VM_TIMER_WHEEL_TICK_MICROSECONDS;
+    while(wheel->timerCount)
+    {
+        // The ticks without work are skipped.
+        uint64_t tick = crankvm_timer_wheel_getNextTick(wheel);
+        if(tick > nowTick)
+        {
+            wheel->currentTick = nowTick + 1;
+            break;
+        }
+
+        wheel->currentTick = tick;
+
+        // When the slots of a level wrap around, the next slot of the level above is spread into them.
+        for(size_t level = 1; level < CRANK_VM_TIMER_WHEEL_LEVEL_COUNT; ++level)
+        {
+            if(tick & ((1ULL << (CRANK_VM_TIMER_WHEEL_SLOT_BITS * level)) - 1))
+                break;
+
+            crankvm_timer_t **slot = &wheel->slots[level][(tick >> (CRANK_VM_TIMER_WHEEL_SLOT_BITS * level)) & CRANK_VM_TIMER_WHEEL_SLOT_MASK];
+            crankvm_timer_t *timer = *slot;
+            *slot = NULL;
+            while(timer)
+            {
+                crankvm_timer_t *next = timer->next;
+                crankvm_timer_wheel_link(wheel, timer);
+                timer = next;
+            }
+        }
+
+        // The timers that are scheduled again by a firing timer go after this tick.
+        wheel->currentTick = tick + 1;
+        crankvm_timer_t **slot = &wheel->slots[0][tick & CRANK_VM_TIMER_WHEEL_SLOT_MASK];
+        crankvm_timer_t *timer;
+        while((timer = *slot) != NULL)
+        {
+            crankvm_timer_wheel_unlink(timer);
+            --wheel->timerCount;
+            ++wheel->firedTimerCount;
+            timer->fire(context, timer);
+        }
+    }
+
+    crankvm_timer_wheel_updateWakeup(context);
+}
+
+uint64_t
+crankvm_timer_wheel_getMicrosecondsUntilNextTick(crankvm_context_t *context)
+{
+    crankvm_timer_wheel_t *wheel = &context->timerWheel;
+    if(!wheel->timerCount)
+        return UINT64_MAX;
+
+    uint64_t nextMicroseconds = wheel->nextTick * CRANK_VM_TIMER_WHEEL_TICK_MICROSECONDS;
+    uint64_t now = crankvm_timer_wheel_getMicroseconds();
+    return nextMicroseconds > now ? nextMicroseconds - now : 0;
+}
@@ -0,0 +1,108 @@
+#ifndef CRANK_VM_TIMER_WHEEL_H
+#define CRANK_VM_TIMER_WHEEL_H
+
+#include <crank-vm/common.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define CRANK_VM_TIMER_WHEEL_TICK_MICROSECONDS 1000
+#define CRANK_VM_TIMER_WHEEL_LEVEL_COUNT 4
+#define CRANK_VM_TIMER_WHEEL_SLOT_BITS 6
+#define CRANK_VM_TIMER_WHEEL_SLOT_COUNT (1 << CRANK_VM_TIMER_WHEEL_SLOT_BITS)
+#define CRANK_VM_TIMER_WHEEL_SLOT_MASK (CRANK_VM_TIMER_WHEEL_SLOT_COUNT - 1)
+
+typedef struct crankvm_context_s crankvm_context_t;
+typedef struct crankvm_timer_s crankvm_timer_t;
+
+typedef void (*crankvm_timer_fire_function_t)(crankvm_context_t *context, crankvm_timer_t *timer);
+
+/**
+ * A timer of the wheel. It is owned by its user, and it is linked into a slot
+ * of the wheel while it is scheduled.
+ */
+struct crankvm_timer_s
+{
+    crankvm_timer_fire_function_t fire;
+
+    // The deadline, in ticks of the realtime clock.
+    uint64_t deadlineTick;
+
+    crankvm_timer_t *next;
+    crankvm_timer_t **link;
+};
+
+/**
+ * A hierarchical timer wheel, whose ticks are milliseconds of the realtime
+ * clock. Each level has 64 slots, and a slot of a level spans all the slots
+ * of the level below it, so a timer is scheduled and cancelled in constant
+ * time, and it is moved down at most once per level before it fires. The
+ * deadlines that are beyond the last level wait in it, and they are
+ * scheduled again when their slot is reached.
+ *
+ * The wheel is only used by the interpreter thread, which advances it at the
+ * interrupt checks. A helper thread sleeps until the tick of the earliest
+ * timer, and then requests an interrupt, so nothing polls the clock while
+ * the timers are pending.
+ */
+typedef struct crankvm_timer_wheel_s
+{
+    uint64_t currentTick;
+    size_t timerCount;
+    crankvm_timer_t *slots[CRANK_VM_TIMER_WHEEL_LEVEL_COUNT][CRANK_VM_TIMER_WHEEL_SLOT_COUNT];
+
+    pthread_mutex_t mutex;
+    pthread_cond_t wakeupChanged;
+    pthread_t thread;
+    bool isInitialized;
+    bool isThreadStarted;
+    bool isShuttingDown;
+
+    // The first tick when the wheel has work, or zero.
+    uint64_t nextTick;
+
+    // The tick when the helper thread requests an interrupt, or zero.
+    uint64_t wakeupTick;
+
+    uint64_t firedTimerCount;
+} crankvm_timer_wheel_t;
+
+void crankvm_timer_wheel_destroy(crankvm_context_t *context);
+
+/**
+ * Schedules a timer to fire at the given realtime clock microseconds since
+ * 1970. A timer that is already scheduled is moved to the new deadline, and
+ * a deadline in the past fires at the next interrupt check.
+ */
+void crankvm_timer_wheel_schedule(crankvm_context_t *context, crankvm_timer_t *timer, uint64_t deadlineMicroseconds);
+
+void crankvm_timer_wheel_cancel(crankvm_context_t *context, crankvm_timer_t *timer);
+
+/**
+ * Fires the timers whose deadline has passed. It is called at the interrupt
+ * checks of the interpreter.
+ */
+void crankvm_timer_wheel_advance(crankvm_context_t *context);
+
+/**
+ * Gets the time until the wheel has work, or UINT64_MAX when there are no timers.
+ */
+uint64_t crankvm_timer_wheel_getMicrosecondsUntilNextTick(crankvm_context_t *context);
+
+CRANK_VM_INLINE bool
+crankvm_timer_isScheduled(crankvm_timer_t *timer)
+{
+    return timer->link != NULL;
+}
+
+CRANK_VM_INLINE uint64_t
+crankvm_timer_wheel_getMicroseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+#endif //CRANK_VM_TIMER_WHEEL_H
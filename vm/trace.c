@@ -0,0 +1,159 @@
+#include "trace.h"
+#include "context-internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static crankvm_error_t
+crankvm_trace_writeToFileNamed(crankvm_context_t *context, const char *fileName)
+{
+    crankvm_trace_buffer_t *buffer = &context->trace;
+    FILE *output = fopen(fileName, "wb");
+    if(!output)
+        return CRANK_VM_ERROR_FAILED_TO_OPEN_FILE;
+
+    // Compute the chronological range of the ring buffer.
+    size_t recordCount = buffer->totalRecordCount < buffer->recordCount ? buffer->totalRecordCount : buffer->recordCount;
+    size_t firstRecord = buffer->totalRecordCount < buffer->recordCount ? 0 : buffer->totalRecordCount & (buffer->recordCount - 1);
+
+    crankvm_trace_file_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CRANK_VM_TRACE_FILE_MAGIC, sizeof(header.magic));
+    header.recordSize = sizeof(crankvm_trace_record_t);
+    header.recordCount = recordCount;
+    header.totalRecordCount = buffer->totalRecordCount;
+
+    bool succeeded = fwrite(&header, sizeof(header), 1, output) == 1;
+    if(recordCount)
+    {
+        size_t tailCount = recordCount - firstRecord;
+        succeeded = succeeded && fwrite(buffer->records + firstRecord, sizeof(crankvm_trace_record_t), tailCount, output) == tailCount;
+        succeeded = succeeded && fwrite(buffer->records, sizeof(crankvm_trace_record_t), firstRecord, output) == firstRecord;
+    }
+
+    fclose(output);
+    return succeeded ? CRANK_VM_OK : CRANK_VM_ERROR_FAILED_TO_WRITE_FILE;
+}
+
+void
+crankvm_trace_destroy(crankvm_context_t *context)
+{
+    crankvm_trace_buffer_t *buffer = &context->trace;
+    if(buffer->fileName && buffer->records)
+        crankvm_trace_writeToFileNamed(context, buffer->fileName);
+
+    free(buffer->records);
+    free(buffer->fileName);
+    memset(buffer, 0, sizeof(crankvm_trace_buffer_t));
+}
+
+#ifdef CRANK_VM_ENABLE_TRACE
+
+static crankvm_trace_record_t *
+crankvm_trace_newRecord(crankvm_context_t *context, crankvm_trace_event_kind_t kind, uint64_t argument0, uint64_t argument1, uint64_t argument2)
+{
+    crankvm_trace_buffer_t *buffer = &context->trace;
+    if(!buffer->records)
+        return NULL;
+
+    uint64_t sequence = buffer->totalRecordCount++;
+    crankvm_trace_record_t *record = &buffer->records[sequence & (buffer->recordCount - 1)];
+    record->sequence = sequence;
+    record->kind = kind;
+    record->nameLength = 0;
+    record->reserved = 0;
+    record->arguments[0] = argument0;
+    record->arguments[1] = argument1;
+    record->arguments[2] = argument2;
+    return record;
+}
+
+static void
+crankvm_trace_appendName(crankvm_trace_record_t *record, const char *name, size_t nameLength)
+{
+    size_t available = CRANK_VM_TRACE_RECORD_NAME_SIZE - record->nameLength;
+    if(nameLength > available)
+        nameLength = available;
+
+    memcpy(record->name + record->nameLength, name, nameLength);
+    record->nameLength += nameLength;
+}
+
+static void
+crankvm_trace_appendStringOop(crankvm_trace_record_t *record, crankvm_oop_t string)
+{
+    if(!crankvm_oop_isPointer(string) ||
+        crankvm_oop_getFormat(string) < CRANK_VM_OBJECT_FORMAT_INDEXABLE_8 ||
+        crankvm_oop_getFormat(string) >= CRANK_VM_OBJECT_FORMAT_COMPILED_METHOD)
+        return;
+
+    crankvm_trace_appendName(record, (const char *)(string + sizeof(crankvm_object_header_t)),
+        crankvm_object_header_getSmalltalkSize((crankvm_object_header_t*)string));
+}
+
+void
+crankvm_trace_record(crankvm_context_t *context, crankvm_trace_event_kind_t kind, uint64_t argument0, uint64_t argument1, uint64_t argument2)
+{
+    crankvm_trace_newRecord(context, kind, argument0, argument1, argument2);
+}
+
+void
+crankvm_trace_recordWithStringOop(crankvm_context_t *context, crankvm_trace_event_kind_t kind, uint64_t argument0, uint64_t argument1, uint64_t argument2, crankvm_oop_t string)
+{
+    crankvm_trace_record_t *record = crankvm_trace_newRecord(context, kind, argument0, argument1, argument2);
+    if(record)
+        crankvm_trace_appendStringOop(record, string);
+}
+
+void
+crankvm_trace_recordWithMethod(crankvm_context_t *context, crankvm_trace_event_kind_t kind, uint64_t argument0, uint64_t argument1, uint64_t argument2, crankvm_CompiledCode_t *method)
+{
+    crankvm_trace_record_t *record = crankvm_trace_newRecord(context, kind, argument0, argument1, argument2);
+    if(!record)
+        return;
+
+    // Class >> #selector
+    crankvm_oop_t methodClass = crankvm_CompiledCode_getClass(context, method);
+    crankvm_trace_appendStringOop(record, crankvm_class_getNameOop(context, methodClass));
+    if(crankvm_object_isMetaclassInstance(context, methodClass))
+        crankvm_trace_appendName(record, " class", 6);
+    crankvm_trace_appendName(record, " >> #", 5);
+    crankvm_trace_appendStringOop(record, crankvm_CompiledCode_getSelector(context, method));
+}
+
+#endif
+
+LIB_CRANK_VM_EXPORT crankvm_error_t
+crankvm_context_setTraceFileName(crankvm_context_t *context, const char *fileName)
+{
+#ifdef CRANK_VM_ENABLE_TRACE
+    if(!context || !fileName)
+        return CRANK_VM_ERROR_NULL_POINTER;
+
+    crankvm_trace_buffer_t *buffer = &context->trace;
+    if(!buffer->records)
+    {
+        buffer->records = calloc(CRANK_VM_TRACE_DEFAULT_RECORD_COUNT, sizeof(crankvm_trace_record_t));
+        if(!buffer->records)
+            return CRANK_VM_ERROR_OUT_OF_MEMORY;
+        buffer->recordCount = CRANK_VM_TRACE_DEFAULT_RECORD_COUNT;
+    }
+
+    free(buffer->fileName);
+    buffer->fileName = strdup(fileName);
+    return buffer->fileName ? CRANK_VM_OK : CRANK_VM_ERROR_OUT_OF_MEMORY;
+#else
+    return CRANK_VM_ERROR_UNSUPPORTED_OPERATION;
+#endif
+}
+
+LIB_CRANK_VM_EXPORT crankvm_error_t
+crankvm_context_writeTrace(crankvm_context_t *context)
+{
+    if(!context)
+        return CRANK_VM_ERROR_NULL_POINTER;
+    if(!context->trace.records || !context->trace.fileName)
+        return CRANK_VM_ERROR_UNSUPPORTED_OPERATION;
+
+    return crankvm_trace_writeToFileNamed(context, context->trace.fileName);
+}
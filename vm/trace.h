@@ -0,0 +1,45 @@
+#ifndef CRANK_VM_TRACE_H
+#define CRANK_VM_TRACE_H
+
+#include <crank-vm/trace-format.h>
+#include <crank-vm/objectmodel.h>
+#include <crank-vm/special-objects.h>
+
+// The number of records must be a power of two.
+#define CRANK_VM_TRACE_DEFAULT_RECORD_COUNT (1<<16)
+
+typedef struct crankvm_context_s crankvm_context_t;
+
+typedef struct crankvm_trace_buffer_s
+{
+    crankvm_trace_record_t *records;
+    size_t recordCount;
+    uint64_t totalRecordCount;
+    char *fileName;
+} crankvm_trace_buffer_t;
+
+void crankvm_trace_destroy(crankvm_context_t *context);
+
+#ifdef CRANK_VM_ENABLE_TRACE
+
+void crankvm_trace_record(crankvm_context_t *context, crankvm_trace_event_kind_t kind, uint64_t argument0, uint64_t argument1, uint64_t argument2);
+void crankvm_trace_recordWithStringOop(crankvm_context_t *context, crankvm_trace_event_kind_t kind, uint64_t argument0, uint64_t argument1, uint64_t argument2, crankvm_oop_t string);
+void crankvm_trace_recordWithMethod(crankvm_context_t *context, crankvm_trace_event_kind_t kind, uint64_t argument0, uint64_t argument1, uint64_t argument2, crankvm_CompiledCode_t *method);
+
+#define crankvm_trace(context, kind, argument0, argument1, argument2) \
+    crankvm_trace_record(context, CRANK_VM_TRACE_EVENT_ ## kind, (uint64_t)(argument0), (uint64_t)(argument1), (uint64_t)(argument2))
+#define crankvm_traceWithStringOop(context, kind, argument0, argument1, argument2, string) \
+    crankvm_trace_recordWithStringOop(context, CRANK_VM_TRACE_EVENT_ ## kind, (uint64_t)(argument0), (uint64_t)(argument1), (uint64_t)(argument2), (crankvm_oop_t)(string))
+#define crankvm_traceWithMethod(context, kind, argument0, argument1, argument2, method) \
+    crankvm_trace_recordWithMethod(context, CRANK_VM_TRACE_EVENT_ ## kind, (uint64_t)(argument0), (uint64_t)(argument1), (uint64_t)(argument2), (crankvm_CompiledCode_t*)(method))
+
+#else
+
+// Tracing is compiled out, the arguments are not evaluated.
+#define crankvm_trace(context, kind, argument0, argument1, argument2) do {} while(0)
+#define crankvm_traceWithStringOop(context, kind, argument0, argument1, argument2, string) do {} while(0)
+#define crankvm_traceWithMethod(context, kind, argument0, argument1, argument2, method) do {} while(0)
+
+#endif
+
+#endif //CRANK_VM_TRACE_H
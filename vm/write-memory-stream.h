@@ -0,0 +1,64 @@
+#ifndef CRANK_VM_WRITE_MEMORY_STREAM_H
+#define CRANK_VM_WRITE_MEMORY_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef struct crankvm_write_memory_stream_s
+{
+    uint8_t *data;
+    size_t position;
+    size_t size;
+} crankvm_write_memory_stream_t;
+
+CRANK_VM_INLINE crankvm_write_memory_stream_t
+crankvm_write_memory_stream_create(void *data, size_t position, size_t size)
+{
+    crankvm_write_memory_stream_t result;
+    result.data = (uint8_t*)data;
+    result.position = position;
+    result.size = size;
+    return result;
+}
+
+CRANK_VM_INLINE int
+crankvm_write_memory_stream_hasNextSize(crankvm_write_memory_stream_t *stream, size_t size)
+{
+    return stream->size - stream->position >= size;
+}
+
+CRANK_VM_INLINE int
+crankvm_write_memory_stream_nextPutU16(crankvm_write_memory_stream_t *stream, uint16_t value)
+{
+    if(!crankvm_write_memory_stream_hasNextSize(stream, 2))
+        return 0;
+
+    memcpy(stream->data + stream->position, &value, 2);
+    stream->position += 2;
+    return 1;
+}
+
+CRANK_VM_INLINE int
+crankvm_write_memory_stream_nextPutU32(crankvm_write_memory_stream_t *stream, uint32_t value)
+{
+    if(!crankvm_write_memory_stream_hasNextSize(stream, 4))
+        return 0;
+
+    memcpy(stream->data + stream->position, &value, 4);
+    stream->position += 4;
+    return 1;
+}
+
+CRANK_VM_INLINE int
+crankvm_write_memory_stream_nextPutWord(crankvm_write_memory_stream_t *stream, uintptr_t value)
+{
+    if(!crankvm_write_memory_stream_hasNextSize(stream, sizeof(uintptr_t)))
+        return 0;
+
+    memcpy(stream->data + stream->position, &value, sizeof(uintptr_t));
+    stream->position += sizeof(uintptr_t);
+    return 1;
+}
+
+#endif //CRANK_VM_WRITE_MEMORY_STREAM_H